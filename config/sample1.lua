@@ -3,3 +3,8 @@ MPI_OVERLAP = true
 MULTISTREAM_BOUNDARY = true
 -- TRACE_KERNEL = false
 -- CUDA_KERNEL_ERROR_CHECK = false
+-- RED_BLACK_COLOR_SPLIT = false
+-- NON_TEMPORAL_STORE = false
+-- SOA_LAYOUT = false
+-- SOA_LANE_WIDTH = 0
+-- MPI_THREADS = false
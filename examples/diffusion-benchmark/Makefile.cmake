@@ -186,9 +186,75 @@ $(PHYSIS_BUILD_DIR)/diffusion3d_physis.mpi-cuda.exe: $(PHYSIS_BUILD_DIR)/diffusi
 	main_physis.o baseline.o diffusion3d.o @CMAKE_INSTALL_PREFIX@/lib/libphysis_rt_mpi_cuda.a
 	$(MPICXX) -o $@ $^ $(LDFLAGS) $(CUDA_LDFLAGS)
 
+# Stencil benchmark suite
+# Each stencil is linked with the driver into one executable per backend.
+# Use run_stencil_suite.sh to run all of them.
+SUITE_STENCILS = 7pt 19pt 27pt 9pt2d redblack struct
+SUITE_MPI_THREADS_BUILD_DIR = $(PHYSIS_BUILD_DIR_TOP)/mpi_threads
+PHYSISC_MPI_THREADS = @CMAKE_INSTALL_PREFIX@/bin/physisc-mpi --config $(realpath mpi_threads.conf)
+# Keep the translated sources and objects
+.SECONDARY:
+
+.PHONY: suite
+suite: suite-ref suite-mpi suite-mpi-threads
+
+.PHONY: suite-ref
+suite-ref: $(PHYSIS_BUILD_DIR) \
+	$(SUITE_STENCILS:%=$(PHYSIS_BUILD_DIR)/stencil_suite_%.ref.exe)
+
+.PHONY: suite-mpi
+suite-mpi: $(PHYSIS_BUILD_DIR) \
+	$(SUITE_STENCILS:%=$(PHYSIS_BUILD_DIR)/stencil_suite_%.mpi.exe)
+
+.PHONY: suite-mpi-threads
+suite-mpi-threads: $(SUITE_MPI_THREADS_BUILD_DIR) \
+	$(SUITE_STENCILS:%=$(SUITE_MPI_THREADS_BUILD_DIR)/stencil_suite_%.mpi.exe)
+
+$(SUITE_MPI_THREADS_BUILD_DIR):
+	mkdir -p $(SUITE_MPI_THREADS_BUILD_DIR)
+
+stencil_suite_ref.o: stencil_suite.cc stencil_suite.h
+	$(CXX) -o $@ -c $< $(CXXFLAGS) -I@CMAKE_INSTALL_PREFIX@/include \
+	-DSUITE_BACKEND=\"ref\"
+stencil_suite_mpi.o: stencil_suite.cc stencil_suite.h
+	$(CXX) -o $@ -c $< $(CXXFLAGS) -I@CMAKE_INSTALL_PREFIX@/include \
+	-DSUITE_BACKEND=\"mpi\"
+stencil_suite_mpi_threads.o: stencil_suite.cc stencil_suite.h
+	$(CXX) -o $@ -c $< $(CXXFLAGS) $(OPENMP_CFLAGS) \
+	-I@CMAKE_INSTALL_PREFIX@/include -DSUITE_BACKEND=\"mpi-threads\"
+
+# reference
+$(PHYSIS_BUILD_DIR)/stencil_suite_%.ref.c: stencil_suite_%.c stencil_suite.h $(PHYSISC_CONFIG)
+	cd $(PHYSIS_BUILD_DIR) && $(PHYSISC_REF) ../../$<
+$(PHYSIS_BUILD_DIR)/stencil_suite_%.ref.o: CFLAGS += -I@CMAKE_INSTALL_PREFIX@/include -I$(CURDIR)
+$(PHYSIS_BUILD_DIR)/stencil_suite_%.ref.exe: $(PHYSIS_BUILD_DIR)/stencil_suite_%.ref.o \
+	stencil_suite_ref.o @CMAKE_INSTALL_PREFIX@/lib/libphysis_rt_ref.a
+	$(CXX) -o $@ $^ $(LDFLAGS)
+
+# mpi
+$(PHYSIS_BUILD_DIR)/stencil_suite_%.mpi.c: stencil_suite_%.c stencil_suite.h $(PHYSISC_CONFIG)
+	cd $(PHYSIS_BUILD_DIR) && $(PHYSISC_MPI) ../../$<
+$(PHYSIS_BUILD_DIR)/stencil_suite_%.mpi.o: CFLAGS += -I@CMAKE_INSTALL_PREFIX@/include -I$(CURDIR) -I$(MPI_INCLUDE)
+$(PHYSIS_BUILD_DIR)/stencil_suite_%.mpi.exe: $(PHYSIS_BUILD_DIR)/stencil_suite_%.mpi.o \
+	stencil_suite_mpi.o @CMAKE_INSTALL_PREFIX@/lib/libphysis_rt_mpi.a
+	$(MPICXX) -o $@ $^ $(LDFLAGS)
+
+# mpi+threads
+$(SUITE_MPI_THREADS_BUILD_DIR)/stencil_suite_%.mpi.c: stencil_suite_%.c stencil_suite.h mpi_threads.conf
+	cd $(SUITE_MPI_THREADS_BUILD_DIR) && $(PHYSISC_MPI_THREADS) ../../$<
+$(SUITE_MPI_THREADS_BUILD_DIR)/stencil_suite_%.mpi.o: CFLAGS += -I@CMAKE_INSTALL_PREFIX@/include -I$(CURDIR) \
+	-I$(MPI_INCLUDE) $(OPENMP_CFLAGS)
+$(SUITE_MPI_THREADS_BUILD_DIR)/stencil_suite_%.mpi.exe: $(SUITE_MPI_THREADS_BUILD_DIR)/stencil_suite_%.mpi.o \
+	stencil_suite_mpi_threads.o @CMAKE_INSTALL_PREFIX@/lib/libphysis_rt_mpi_threads.a
+	$(MPICXX) -o $@ $^ $(LDFLAGS) $(OPENMP_LDFLAGS)
+
+.PHONY: suite-run
+suite-run:
+	./run_stencil_suite.sh
+
 clean:
 	-$(RM) *.o $(EXE)
-	-$(RM) diffusion3d_result.*.out
+	-$(RM) diffusion3d_result.*.out stencil_suite.csv
 	-$(RM) *.cudafe* *.gpu *.stub.c *.pptx *.cubin *.i *.ii *.fatbin *.fatbin.c
 	-$(RM) *.exe
 	-$(RM) *_physis.ref.* *_physis.cuda.* *_physis.mpi.* \
@@ -0,0 +1,85 @@
+#!/usr/bin/env bash
+#
+# Run the stencil benchmark suite on each CPU backend built with
+# `make suite' and collect the results in a CSV file.
+#
+# Usage:
+#
+# run_stencil_suite.sh [-n <ranks>] [-t <threads>] [-s <size>]
+#                      [-c <count>] [-o <output>]
+# - ranks: number of local MPI processes (default: 2)
+# - threads: OpenMP threads per process of the MPI+threads backend
+#   (default: 2)
+# - size: size of each dimension of the 3D stencils; the 2D stencil
+#   uses size*8 (default: 128)
+# - count: number of iterations (default: 100)
+# - output: CSV file (default: stencil_suite.csv)
+#
+# Backends whose executables are not built are skipped.
+
+set -u
+set -e
+
+RANKS=2
+THREADS=2
+SIZE=128
+COUNT=100
+OUTPUT=stencil_suite.csv
+MPIRUN=${MPIRUN:-mpirun}
+PHYSIS_BUILD_DIR=${PHYSIS_BUILD_DIR:-physis_build/opt.conf}
+MPI_THREADS_BUILD_DIR=${MPI_THREADS_BUILD_DIR:-physis_build/mpi_threads}
+STENCILS="7pt 19pt 27pt 9pt2d redblack struct"
+
+while getopts ":n:t:s:c:o:" opt; do
+	case $opt in
+		n) RANKS=$OPTARG ;;
+		t) THREADS=$OPTARG ;;
+		s) SIZE=$OPTARG ;;
+		c) COUNT=$OPTARG ;;
+		o) OUTPUT=$OPTARG ;;
+		*) echo "Invalid option: -$OPTARG" >&2; exit 1 ;;
+	esac
+done
+
+# Decomposes the last dimension
+function proc_dim() {
+	if [ $1 = 9pt2d ]; then
+		echo 1x$RANKS
+	else
+		echo 1x1x$RANKS
+	fi
+}
+
+function stencil_size() {
+	if [ $1 = 9pt2d ]; then
+		echo $((SIZE * 8))
+	else
+		echo $SIZE
+	fi
+}
+
+HEADER=--header
+rm -f $OUTPUT
+for stencil in $STENCILS; do
+	exe=$PHYSIS_BUILD_DIR/stencil_suite_$stencil.ref.exe
+	if [ -x $exe ]; then
+		OMP_NUM_THREADS=1 $exe $HEADER --count $COUNT \
+			--size $(stencil_size $stencil) >> $OUTPUT
+		HEADER=
+	fi
+	exe=$PHYSIS_BUILD_DIR/stencil_suite_$stencil.mpi.exe
+	if [ -x $exe ]; then
+		OMP_NUM_THREADS=1 $MPIRUN -np $RANKS $exe $HEADER \
+			--count $COUNT --size $(stencil_size $stencil) \
+			--ranks $RANKS --physis-proc $(proc_dim $stencil) >> $OUTPUT
+		HEADER=
+	fi
+	exe=$MPI_THREADS_BUILD_DIR/stencil_suite_$stencil.mpi.exe
+	if [ -x $exe ]; then
+		OMP_NUM_THREADS=$THREADS $MPIRUN -np $RANKS -x OMP_NUM_THREADS \
+			$exe $HEADER --count $COUNT --size $(stencil_size $stencil) \
+			--ranks $RANKS --physis-proc $(proc_dim $stencil) >> $OUTPUT
+		HEADER=
+	fi
+done
+echo "Results written to $OUTPUT"
@@ -0,0 +1,175 @@
+// Driver of the stencil benchmark suite.
+//
+// Runs one of the stencil_suite_*.c stencils and prints a CSV line
+// with the measured rates. The achieved bandwidth is compared with the
+// attainable bandwidth of all the processes reported by the runtime,
+// and the time spent in halo exchanges, the maximum over the
+// processes, is reported as a fraction of the kernel time.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <iostream>
+
+#include "stopwatch.h"
+#include "stencil_suite.h"
+#include "physis/physis_common.h"
+
+#ifndef SUITE_BACKEND
+#define SUITE_BACKEND "unknown"
+#endif
+
+namespace {
+
+struct StencilInfo {
+  const char *name;
+  int num_dims;
+  // Float values per point
+  int num_values;
+  // Floating-point operations per updated point
+  double flops;
+  // Bytes read and written per updated point, assuming perfect reuse
+  double bytes;
+};
+
+const StencilInfo stencils[] = {
+  {"7pt", 3, 1, 13, 2 * sizeof(float)},
+  {"19pt", 3, 1, 21, 2 * sizeof(float)},
+  {"27pt", 3, 1, 30, 2 * sizeof(float)},
+  {"9pt2d", 2, 1, 11, 2 * sizeof(float)},
+  // Updated in place
+  {"redblack", 3, 1, 13, 2 * sizeof(float)},
+  // 7-point stencil on each of three float members
+  {"struct", 3, 3, 39, 2 * 3 * sizeof(float)},
+};
+
+const StencilInfo *FindStencil(const char *name) {
+  for (size_t i = 0; i < sizeof(stencils) / sizeof(StencilInfo); ++i) {
+    if (strcmp(stencils[i].name, name) == 0) return &stencils[i];
+  }
+  return NULL;
+}
+
+// Returns a buffer of the values of all the points of a size^d grid
+// with the initial values common to all the stencils.
+float *NewGridBuffer(const StencilInfo *info, int size, size_t &len) {
+  len = info->num_values;
+  for (int i = 0; i < info->num_dims; ++i) {
+    len *= size;
+  }
+  float *buf = (float*)malloc(sizeof(float) * len);
+  if (!buf) {
+    std::cerr << "Failed to allocate the grid buffer\n";
+    exit(EXIT_FAILURE);
+  }
+  for (size_t i = 0; i < len; ++i) {
+    buf[i] = (float)(i % 17) * 0.1f;
+  }
+  return buf;
+}
+
+// Copies out the result and returns its sum.
+double Checksum(float *buf, size_t len) {
+  suite_copyout(buf);
+  double sum = 0.0;
+  for (size_t i = 0; i < len; ++i) {
+    sum += buf[i];
+  }
+  return sum;
+}
+
+void PrintUsage(std::ostream &os, char *prog_name) {
+  os << "Usage: " << prog_name << " [options] [physis options]\n\n";
+  os << "Options\n"
+     << "\t--count N        " << "Number of iterations\n"
+     << "\t--size N         " << "Size of each dimension\n"
+     << "\t--ranks N        " << "Number of MPI processes, only reported\n"
+     << "\t--header         " << "Print the CSV header\n"
+     << "\t--help           " << "Display this help message\n";
+}
+
+// Unlike getopt_long, leaves the order of the arguments intact so
+// that the Physis options can be parsed by PSInit.
+void ProcessProgramOptions(int argc, char *argv[],
+                           int &count, int &size, int &ranks,
+                           bool &header) {
+  for (int i = 1; i < argc; ++i) {
+    std::string opt(argv[i]);
+    bool has_arg = i + 1 < argc;
+    if (opt == "--count" && has_arg) {
+      count = atoi(argv[++i]);
+    } else if (opt == "--size" && has_arg) {
+      size = atoi(argv[++i]);
+    } else if (opt == "--ranks" && has_arg) {
+      ranks = atoi(argv[++i]);
+    } else if (opt == "--header") {
+      header = true;
+    } else if (opt == "--help") {
+      PrintUsage(std::cerr, argv[0]);
+      exit(EXIT_SUCCESS);
+    }
+  }
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+  int count = 100;
+  int size = 128;
+  int ranks = 1;
+  bool header = false;
+
+  ProcessProgramOptions(argc, argv, count, size, ranks, header);
+  const StencilInfo *info = FindStencil(suite_stencil_name());
+  if (info == NULL) {
+    std::cerr << "Unknown stencil: " << suite_stencil_name() << "\n";
+    exit(EXIT_FAILURE);
+  }
+  // Two-map runs alternate the grids
+  count += count % 2;
+  const char *threads = getenv("OMP_NUM_THREADS");
+
+  size_t len;
+  float *buf = NewGridBuffer(info, size, len);
+  suite_initialize(&argc, &argv, size, buf);
+  // Warm up, which also completes the deferred copyins
+  suite_run(2);
+  Checksum(buf, len);
+
+  double halo_start = PSGetHaloExchangeTime();
+  Stopwatch st;
+  StopwatchStart(&st);
+  suite_run(count);
+  // Forces the completion of the runs
+  double checksum = Checksum(buf, len);
+  double time = StopwatchStop(&st);
+  double halo_time = PSGetHaloExchangeTime() - halo_start;
+  // Excludes the copyout
+  StopwatchStart(&st);
+  Checksum(buf, len);
+  time -= StopwatchStop(&st);
+  double stream_gbs = PSGetAttainableBandwidth();
+  suite_finalize();
+  free(buf);
+
+  double points = 1.0;
+  for (int i = 0; i < info->num_dims; ++i) {
+    points *= size - 2;
+  }
+  points *= count;
+  double gflops = time > 0 ? points * info->flops / time * 1.0e-09 : 0;
+  double gbs = time > 0 ? points * info->bytes / time * 1.0e-09 : 0;
+
+  if (header) {
+    printf("backend,stencil,dims,size,ranks,threads,count,time,"
+           "gflops,gbs,stream_gbs,stream_ratio,halo_time,halo_fraction,"
+           "checksum\n");
+  }
+  printf("%s,%s,%d,%d,%d,%s,%d,%.6f,%.3f,%.3f,%.3f,%.3f,%.6f,%.3f,%.6e\n",
+         SUITE_BACKEND, info->name, info->num_dims, size, ranks,
+         threads ? threads : "1", count, time, gflops, gbs, stream_gbs,
+         stream_gbs > 0 ? gbs / stream_gbs : 0.0,
+         halo_time, time > 0 ? halo_time / time : 0.0, checksum);
+  return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef BENCHMARKS_DIFFUSION3D_STENCIL_SUITE_H_
+#define BENCHMARKS_DIFFUSION3D_STENCIL_SUITE_H_
+
+/*
+ * Interface implemented by each stencil of the benchmark suite
+ * (stencil_suite_*.c). The driver (stencil_suite.cc) is linked with
+ * one of them after it is translated by physisc.
+ *
+ * Each stencil updates the interior of an n^d grid, leaving a
+ * one-point boundary unchanged. The driver owns the host buffers, so
+ * the stencils only contain the Physis code.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+  /* Name of the stencil, e.g., "7pt" */
+  extern const char *suite_stencil_name();
+  /* Initializes Physis and the grids with an n^d problem whose
+     points are copied in from init */
+  extern void suite_initialize(int *argc, char ***argv, int n,
+                               const void *init);
+  /* Runs count iterations of the stencil */
+  extern void suite_run(int count);
+  /* Copies out the result to buf */
+  extern void suite_copyout(void *buf);
+  extern void suite_finalize();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BENCHMARKS_DIFFUSION3D_STENCIL_SUITE_H_ */
@@ -0,0 +1,54 @@
+#include "physis/physis.h"
+#include "stencil_suite.h"
+
+static int n;
+static PSGrid3DFloat g1, g2;
+
+const char *suite_stencil_name() {
+  return "19pt";
+}
+
+void suite_initialize(int *argc, char ***argv, int size,
+                      const void *init) {
+  n = size;
+  PSInit(argc, argv, 3, n, n, n);
+  g1 = PSGrid3DFloatNew(n, n, n);
+  g2 = PSGrid3DFloatNew(n, n, n);
+  PSGridCopyin(g1, init);
+  PSGridCopyin(g2, init);
+}
+
+static void kernel_19pt(const int x, const int y, const int z,
+                        PSGrid3DFloat in, PSGrid3DFloat out,
+                        float cc, float c1, float c2) {
+  float v = cc * PSGridGet(in, x, y, z)
+      + c1 * (PSGridGet(in, x, y, z-1) + PSGridGet(in, x, y-1, z)
+              + PSGridGet(in, x-1, y, z) + PSGridGet(in, x+1, y, z)
+              + PSGridGet(in, x, y+1, z) + PSGridGet(in, x, y, z+1))
+      + c2 * (PSGridGet(in, x, y-1, z-1) + PSGridGet(in, x-1, y, z-1)
+              + PSGridGet(in, x+1, y, z-1) + PSGridGet(in, x, y+1, z-1)
+              + PSGridGet(in, x-1, y-1, z) + PSGridGet(in, x+1, y-1, z)
+              + PSGridGet(in, x-1, y+1, z) + PSGridGet(in, x+1, y+1, z)
+              + PSGridGet(in, x, y-1, z+1) + PSGridGet(in, x-1, y, z+1)
+              + PSGridGet(in, x+1, y, z+1) + PSGridGet(in, x, y+1, z+1));
+  PSGridEmit(out, v);
+}
+
+void suite_run(int count) {
+  PSDomain3D d = PSDomain3DNew(1, n-1, 1, n-1, 1, n-1);
+  PSStencilRun(PSStencilMap(kernel_19pt, d, g1, g2,
+                            0.4f, 0.06f, 0.02f),
+               PSStencilMap(kernel_19pt, d, g2, g1,
+                            0.4f, 0.06f, 0.02f),
+               count/2);
+}
+
+void suite_copyout(void *buf) {
+  PSGridCopyout(g1, buf);
+}
+
+void suite_finalize() {
+  PSGridFree(g1);
+  PSGridFree(g2);
+  PSFinalize();
+}
@@ -0,0 +1,47 @@
+#include "physis/physis.h"
+#include "stencil_suite.h"
+
+static int n;
+static PSGrid2DFloat g1, g2;
+
+const char *suite_stencil_name() {
+  return "9pt2d";
+}
+
+void suite_initialize(int *argc, char ***argv, int size,
+                      const void *init) {
+  n = size;
+  PSInit(argc, argv, 2, n, n);
+  g1 = PSGrid2DFloatNew(n, n);
+  g2 = PSGrid2DFloatNew(n, n);
+  PSGridCopyin(g1, init);
+  PSGridCopyin(g2, init);
+}
+
+static void kernel_9pt2d(const int x, const int y,
+                         PSGrid2DFloat in, PSGrid2DFloat out,
+                         float cc, float c1, float c2) {
+  float v = cc * PSGridGet(in, x, y)
+      + c1 * (PSGridGet(in, x-1, y) + PSGridGet(in, x+1, y)
+              + PSGridGet(in, x, y-1) + PSGridGet(in, x, y+1))
+      + c2 * (PSGridGet(in, x-1, y-1) + PSGridGet(in, x+1, y-1)
+              + PSGridGet(in, x-1, y+1) + PSGridGet(in, x+1, y+1));
+  PSGridEmit(out, v);
+}
+
+void suite_run(int count) {
+  PSDomain2D d = PSDomain2DNew(1, n-1, 1, n-1);
+  PSStencilRun(PSStencilMap(kernel_9pt2d, d, g1, g2, 0.4f, 0.1f, 0.05f),
+               PSStencilMap(kernel_9pt2d, d, g2, g1, 0.4f, 0.1f, 0.05f),
+               count/2);
+}
+
+void suite_copyout(void *buf) {
+  PSGridCopyout(g1, buf);
+}
+
+void suite_finalize() {
+  PSGridFree(g1);
+  PSGridFree(g2);
+  PSFinalize();
+}
@@ -0,0 +1,42 @@
+#include "physis/physis.h"
+#include "stencil_suite.h"
+
+static int n;
+static PSGrid3DFloat g;
+
+const char *suite_stencil_name() {
+  return "redblack";
+}
+
+void suite_initialize(int *argc, char ***argv, int size,
+                      const void *init) {
+  n = size;
+  PSInit(argc, argv, 3, n, n, n);
+  g = PSGrid3DFloatNew(n, n, n);
+  PSGridCopyin(g, init);
+}
+
+/* Gauss-Seidel sweep updating the grid in place */
+static void kernel_redblack(const int x, const int y, const int z,
+                            PSGrid3DFloat g, float cc, float cn) {
+  float v = cc * PSGridGet(g, x, y, z)
+      + cn * PSGridGet(g, x-1, y, z) + cn * PSGridGet(g, x+1, y, z)
+      + cn * PSGridGet(g, x, y-1, z) + cn * PSGridGet(g, x, y+1, z)
+      + cn * PSGridGet(g, x, y, z-1) + cn * PSGridGet(g, x, y, z+1);
+  PSGridEmit(g, v);
+}
+
+void suite_run(int count) {
+  PSDomain3D d = PSDomain3DNew(1, n-1, 1, n-1, 1, n-1);
+  PSStencilRun(PSStencilMapRedBlack(kernel_redblack, d, g, 0.4f, 0.1f),
+               count);
+}
+
+void suite_copyout(void *buf) {
+  PSGridCopyout(g, buf);
+}
+
+void suite_finalize() {
+  PSGridFree(g);
+  PSFinalize();
+}
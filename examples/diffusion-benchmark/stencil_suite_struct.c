@@ -0,0 +1,64 @@
+#include "physis/physis.h"
+#include "stencil_suite.h"
+
+struct Point {
+  float x;
+  float y;
+  float z;
+};
+
+DeclareGrid3D(Point, struct Point);
+
+static int n;
+static PSGrid3DPoint g1, g2;
+
+const char *suite_stencil_name() {
+  return "struct";
+}
+
+void suite_initialize(int *argc, char ***argv, int size,
+                      const void *init) {
+  n = size;
+  PSInit(argc, argv, 3, n, n, n);
+  g1 = PSGrid3DPointNew(n, n, n);
+  g2 = PSGrid3DPointNew(n, n, n);
+  PSGridCopyin(g1, init);
+  PSGridCopyin(g2, init);
+}
+
+/* 7-point stencil on each member */
+static void kernel_struct(const int x, const int y, const int z,
+                          PSGrid3DPoint in, PSGrid3DPoint out,
+                          float cc, float cn) {
+  struct Point v;
+  v.x = cc * PSGridGet(in, x, y, z).x
+      + cn * PSGridGet(in, x-1, y, z).x + cn * PSGridGet(in, x+1, y, z).x
+      + cn * PSGridGet(in, x, y-1, z).x + cn * PSGridGet(in, x, y+1, z).x
+      + cn * PSGridGet(in, x, y, z-1).x + cn * PSGridGet(in, x, y, z+1).x;
+  v.y = cc * PSGridGet(in, x, y, z).y
+      + cn * PSGridGet(in, x-1, y, z).y + cn * PSGridGet(in, x+1, y, z).y
+      + cn * PSGridGet(in, x, y-1, z).y + cn * PSGridGet(in, x, y+1, z).y
+      + cn * PSGridGet(in, x, y, z-1).y + cn * PSGridGet(in, x, y, z+1).y;
+  v.z = cc * PSGridGet(in, x, y, z).z
+      + cn * PSGridGet(in, x-1, y, z).z + cn * PSGridGet(in, x+1, y, z).z
+      + cn * PSGridGet(in, x, y-1, z).z + cn * PSGridGet(in, x, y+1, z).z
+      + cn * PSGridGet(in, x, y, z-1).z + cn * PSGridGet(in, x, y, z+1).z;
+  PSGridEmit(out, v);
+}
+
+void suite_run(int count) {
+  PSDomain3D d = PSDomain3DNew(1, n-1, 1, n-1, 1, n-1);
+  PSStencilRun(PSStencilMap(kernel_struct, d, g1, g2, 0.4f, 0.1f),
+               PSStencilMap(kernel_struct, d, g2, g1, 0.4f, 0.1f),
+               count/2);
+}
+
+void suite_copyout(void *buf) {
+  PSGridCopyout(g1, buf);
+}
+
+void suite_finalize() {
+  PSGridFree(g1);
+  PSGridFree(g2);
+  PSFinalize();
+}
@@ -16,6 +16,11 @@
 // is included to make code generation easier
 #include "physis/runtime.h"
 
+#if defined(__SSE2__) && !defined(PHYSIS_USER) && !defined(__CUDACC__)
+#include <emmintrin.h>
+#define PS_NON_TEMPORAL_STORE
+#endif
+
 /*
  * Declarations that are common both in user input code and generated
  * code. 
@@ -77,6 +82,14 @@ extern "C" {
   extern void PSFinalize();
 
   extern void PSPrintInternalInfo(FILE *out);
+  //! Returns the maximum seconds a process spent exchanging halos.
+  extern double PSGetHaloExchangeTime();
+  //! Returns the attainable memory bandwidth of all processes in GB/s.
+  /*!
+    The bandwidth is given with --physis-peak-bandwidth <GB/s> or
+    measured with a STREAM triad run by all processes.
+   */
+  extern double PSGetAttainableBandwidth();
 
   extern void PSGridCopyin(void *g, const void *src_array);
   extern void PSGridCopyout(void *g, void *dst_array);
@@ -88,6 +101,8 @@ extern "C" {
     PSIndex max[PS_MAX_DIM];
     PSIndex local_min[PS_MAX_DIM];
     PSIndex local_max[PS_MAX_DIM];
+    //! Handle of the active bricks; zero if the domain is not masked.
+    int mask;
   } __PSDomain;
   typedef __PSDomain PSDomain1D;
   typedef __PSDomain PSDomain2D;
@@ -99,6 +114,22 @@ extern "C" {
   extern PSDomain3D PSDomain3DNew(PSIndex minx, PSIndex maxx,
                                   PSIndex miny, PSIndex maxy,
                                   PSIndex minz, PSIndex maxz);
+  //! Restricts a domain to the points near nonzero mask points.
+  /*!
+    The domain is divided into bricks, and stencils mapped over the
+    returned domain are applied only to the bricks with any nonzero
+    point of the mask grid. The mask is read when this is called.
+
+    \param dom Domain to restrict.
+    \param mask Grid of the same size as the domain's grids.
+   */
+  extern PSDomain1D PSDomain1DMasked(PSDomain1D dom, void *mask);
+  extern PSDomain2D PSDomain2DMasked(PSDomain2D dom, void *mask);
+  extern PSDomain3D PSDomain3DMasked(PSDomain3D dom, void *mask);
+  //! Returns the number of local active bricks of a masked domain.
+  extern int __PSDomainGetNumBricks(const __PSDomain *d);
+  //! Sets the local part of a masked domain to an active brick.
+  extern void __PSDomainSetBrick(__PSDomain *d, int brick);
 
   static inline __PSDomain __PSDomainGetBoundary(
       __PSDomain *d, int dim, int right, int width, 
@@ -128,6 +159,37 @@ extern "C" {
     return bd;
   }
 
+  // Returns the number of points in the local part of a domain.
+  static inline double __PSDomainGetNumPoints(const __PSDomain *d,
+                                              int num_dims) {
+    double n = 1.0;
+    int i;
+    for (i = 0; i < num_dims; ++i) {
+      if (d->local_max[i] <= d->local_min[i]) return 0.0;
+      n *= d->local_max[i] - d->local_min[i];
+    }
+    return n;
+  }
+
+  //! Returns non-zero if the local part of a domain includes a face.
+  /*!
+    Only the processes owning a face of the domain run the boundary
+    loops of the face. For a domain covering the whole grid, this is
+    the same as testing the process index against the number of
+    processes in the dimension, and it also holds for domains
+    smaller than the grid and for bricks of masked domains.
+
+    \param dim Dimension, starting from zero.
+    \param fw Non-zero for the upper face.
+   */
+  static inline int __PSDomainOwnsFace(const __PSDomain *d, int dim,
+                                       int fw) {
+    // No compute part for this process
+    if (d->local_max[dim] <= d->local_min[dim]) return 0;
+    return fw ? d->local_max[dim] == d->max[dim] :
+        d->local_min[dim] == d->min[dim];
+  }
+
   typedef struct {
     int num;
     PSIndex offsets[(PS_MAX_DIM * 2 + 1) * PS_MAX_DIM * 2];
@@ -139,15 +201,162 @@ extern "C" {
     __PSOffsets max_offsets[PS_MAX_DIM];
   } __PSGridRange;
 
+  //! Local layout of a distributed grid.
+  /*!
+    Exposes the process-local part of a grid to generated code so
+    that element offsets can be computed inline. The fields mirror
+    the corresponding members of the runtime grid object and are
+    updated by the runtime.
+   */
+  typedef struct __PSMPIGridInfo {
+    //! Base address of the local buffer including halo
+    void *p0;
+    //! Buffer read by kernels updating the grid out of place
+    /*!
+      Points to a snapshot of p0 during such a sweep, and is the same
+      as p0 otherwise.
+     */
+    void *p1;
+    int num_dims;
+    //! Global size of the grid
+    PSIndex dim[PS_MAX_DIM];
+    //! Offset of the local buffer including halo
+    PSIndex local_real_offset[PS_MAX_DIM];
+    //! Length of the local buffer including halo
+    PSIndex local_real_size[PS_MAX_DIM];
+    //! Length of the local sub grid w/o halo
+    PSIndex local_size[PS_MAX_DIM];
+    //! Number of bricks of the local buffer including halo
+    /*!
+      Zero if the local buffer is stored in the row-major order.
+     */
+    PSIndex local_num_bricks[PS_MAX_DIM];
+    //! Size of each point in bytes
+    int elm_size;
+    //! Number of points interleaved per member in the SoA layout.
+    /*!
+      Zero if points are stored as an array of structs.
+     */
+    PSIndex soa_lanes;
+    //! Runtime grid object
+    void *grid;
+  } __PSMPIGridInfo;
+
   static inline void PSAbort(int code) {
     exit(code);
   }
 
+  //! Stores a float without allocating the destination in cache.
+  /*!
+    Falls back to a normal store when non-temporal stores are not
+    available.
+   */
+  static inline void __PSStreamFloat(float *p, float v) {
+#ifdef PS_NON_TEMPORAL_STORE
+    union { float f; int i; } u;
+    u.f = v;
+    _mm_stream_si32((int *)p, u.i);
+#else
+    *p = v;
+#endif
+  }
+
+  //! Stores a double without allocating the destination in cache.
+  static inline void __PSStreamDouble(double *p, double v) {
+#if defined(PS_NON_TEMPORAL_STORE) && defined(__x86_64__)
+    union { double f; long long i; } u;
+    u.f = v;
+    _mm_stream_si64((long long *)p, u.i);
+#else
+    *p = v;
+#endif
+  }
+
+  //! Orders non-temporal stores before subsequent memory accesses.
+  static inline void __PSStreamFence(void) {
+#ifdef PS_NON_TEMPORAL_STORE
+    _mm_sfence();
+#endif
+  }
+
   enum PS_GRID_ATTRIBUTE {
     // just a dummy constant to avoid compile errors on empty enum
     // declarations
-    PS_GRID_ATTRIBUTE_DUMMY = 1 << 0 
+    PS_GRID_ATTRIBUTE_DUMMY = 1 << 0,
+    //! The grid is accessed with PSGridGetPeriodic.
+    PS_GRID_ATTRIBUTE_PERIODIC = 1 << 1,
+    //! The grid is a coarsening of the grid space.
+    /*!
+      Each dimension has ceil(n/r) points for a grid-space size n and
+      an integer ratio r. Point i of the grid is placed on the process
+      that owns point i*r of the grids of the grid-space size, so the
+      decomposition nests inside the one of the grid space. Stencils
+      cannot yet access grids at scaled indices such as 2*x, so data
+      is moved between levels through the host.
+     */
+    PS_GRID_ATTRIBUTE_COARSE = 1 << 2,
+    //! The local buffer is stored in bricks.
+    /*!
+      See __PSBrickOffset3D. Not set by the translator, as with
+      __PSGridNewBrick.
+     */
+    PS_GRID_ATTRIBUTE_BRICK = 1 << 3
+  };
+
+  //! Storage layouts of grids of the reference runtime.
+  enum __PSGridLayout {
+    PS_GRID_LAYOUT_ROW_MAJOR = 0,
+    //! Red and black points are stored separately.
+    PS_GRID_LAYOUT_COLOR_SPLIT = 1,
+    //! Points are stored in bricks.
+    PS_GRID_LAYOUT_BRICK = 2
   };
+
+  // Brick layout. The buffer is divided into bricks of
+  // PS_BRICK_WIDTH points in each dimension, padded at the upper
+  // ends, and the points of a brick are stored contiguously, so
+  // neighbors in every dimension are at most a few bricks apart. Both
+  // the bricks and the points within a brick are in the row-major
+  // order. Indices are relative to the start of the buffer.
+#define PS_BRICK_WIDTH_LOG2 (3)
+#define PS_BRICK_WIDTH (1 << PS_BRICK_WIDTH_LOG2)
+#define PS_BRICK_MASK (PS_BRICK_WIDTH - 1)
+
+  //! Returns the number of bricks to hold n points.
+  static inline PSIndex __PSBrickCount(PSIndex n) {
+    return (n + PS_BRICK_MASK) >> PS_BRICK_WIDTH_LOG2;
+  }
+  static inline PSIndex __PSBrickOffset2D(PSIndex i1, PSIndex i2,
+                                          PSIndex nb1) {
+    return (((i2 >> PS_BRICK_WIDTH_LOG2) * nb1 +
+             (i1 >> PS_BRICK_WIDTH_LOG2)) << (PS_BRICK_WIDTH_LOG2 * 2))
+        + (((i2 & PS_BRICK_MASK) << PS_BRICK_WIDTH_LOG2) |
+           (i1 & PS_BRICK_MASK));
+  }
+  //! Returns the offset of a point in the brick layout.
+  /*!
+    \param nb1 Number of bricks in the first dimension.
+    \param nb2 Number of bricks in the second dimension.
+   */
+  static inline PSIndex __PSBrickOffset3D(PSIndex i1, PSIndex i2,
+                                          PSIndex i3, PSIndex nb1,
+                                          PSIndex nb2) {
+    return ((((i3 >> PS_BRICK_WIDTH_LOG2) * nb2 +
+              (i2 >> PS_BRICK_WIDTH_LOG2)) * nb1 +
+             (i1 >> PS_BRICK_WIDTH_LOG2)) << (PS_BRICK_WIDTH_LOG2 * 3))
+        + (((i3 & PS_BRICK_MASK) << (PS_BRICK_WIDTH_LOG2 * 2)) |
+           ((i2 & PS_BRICK_MASK) << PS_BRICK_WIDTH_LOG2) |
+           (i1 & PS_BRICK_MASK));
+  }
+
+  //! Wraps around an index off the end of a dimension by at most n.
+  /*!
+    Stencil offsets are constant and smaller than the grid, so a
+    compare and add suffices instead of an integer division.
+   */
+  static inline PSIndex __PSWrapIndex(PSIndex i, PSIndex n) {
+    return i < 0 ? i + n : (i >= n ? i - n : i);
+  }
   
 #define INVALID_GRID (NULL)
 
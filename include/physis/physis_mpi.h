@@ -23,23 +23,25 @@
 extern "C" {
 #endif
 
-  // __PSGridMPI: dummy type for grid objects. We use the different
+  // __PSGridMPI: type for grid objects. We use the different
   // name than the reference implementation so that CPU and GPU
-  // versions could coexist in the future implementation.
+  // versions could coexist in the future implementation. Generated
+  // code only sees the local layout of the grid, which is
+  // sufficient to compute element offsets inline.
+  typedef struct __PSMPIGridInfo __PSGridMPI;
 
-#ifdef PHYSIS_USER
-  typedef struct {
-    int dummy;
-  } __PSGridMPI;
-#else
-  typedef void __PSGridMPI;
+#ifndef PHYSIS_USER
   typedef __PSGridMPI *PSGrid1DFloat;
   typedef __PSGridMPI *PSGrid2DFloat;
   typedef __PSGridMPI *PSGrid3DFloat;
   typedef __PSGridMPI *PSGrid1DDouble;
   typedef __PSGridMPI *PSGrid2DDouble;
   typedef __PSGridMPI *PSGrid3DDouble;
+#ifdef PHYSIS_RUNTIME
   extern PSIndex PSGridDim(void *p, int d);
+#else
+#define PSGridDim(p, d) (((__PSGridMPI *)(p))->dim[(d)])
+#endif
 #endif
 
   extern void __PSDomainSetLocalSize(__PSDomain *dom);
@@ -50,36 +52,200 @@ extern "C" {
                                      const PSVectorInt global_offset,
                                      const PSVectorInt stencil_offset_min,
                                      const PSVectorInt stencil_offset_max);
+  //! Creates a grid of a user-defined type in the SoA layout.
+  /*!
+    \param lanes Number of points interleaved per member. The whole
+    local buffer forms a single block if zero.
+    \param member_layout Pairs of the offset and size of each member.
+   */
+  extern __PSGridMPI* __PSGridNewSoAMPI(PSType type, int elm_size,
+                                        int dim,
+                                        const PSVectorInt size,
+                                        int attr,
+                                        const PSVectorInt global_offset,
+                                        const PSVectorInt stencil_offset_min,
+                                        const PSVectorInt stencil_offset_max,
+                                        int lanes, int num_members,
+                                        const size_t *member_layout);
   extern void __PSGridSwap(__PSGridMPI *g);
+  //! Copies a grid to p1 so that a kernel can read the old values.
+  extern void __PSGridSnapshot(__PSGridMPI *g);
+  extern void __PSGridReleaseSnapshot(__PSGridMPI *g);
   extern void __PSGridMirror(__PSGridMPI *g);
   extern int __PSGridGetID(__PSGridMPI *g);
   extern __PSGridMPI *__PSGetGridByID(int id);
   extern void __PSGridSet(__PSGridMPI *g, void *buf, ...);
+  //! Executes the deferred tasks accessing a grid.
+  /*!
+    Called before the host reads elements of a grid.
+   */
+  extern void __PSGridFlush(__PSGridMPI *g);
   extern float __PSGridGetFloat(__PSGridMPI *g, ...);
   extern double __PSGridGetDouble(__PSGridMPI *g, ...);
 
   extern void __PSStencilRun(int id, int iter, int num_stencils, ...);
+  //! Access modes of the grids passed to __PSStencilRunWithAccess.
+  enum __PSGridAccessMode {
+    PS_GRID_READ = 1,
+    PS_GRID_WRITE = 2,
+    //! The halo is loaded before any stencil of the run writes a grid.
+    PS_GRID_HALO = 4
+  };
+  //! Runs stencils with the grids they access.
+  /*!
+    Same as __PSStencilRun except that the grids accessed by the
+    stencils and their access modes are given, so that the run can
+    be deferred until its results are needed.
+
+    \param num_grids Number of grids accessed.
+    \param grids Grids accessed.
+    \param modes Bitwise OR of __PSGridAccessMode for each grid.
+    The halos of grids with PS_GRID_HALO are exchanged by separate
+    tasks that may run ahead of the run.
+   */
+  extern void __PSStencilRunWithAccess(int id, int iter, int num_grids,
+                                       __PSGridMPI **grids,
+                                       const int *modes,
+                                       int num_stencils, ...);
 
   extern int __PSBcast(void *buf, size_t size);
   
-  extern PSIndex __PSGridGetOffset1D(__PSGridMPI *g, PSIndex i1);
-  extern PSIndex __PSGridGetOffset2D(__PSGridMPI *g, PSIndex i1,
-                                     PSIndex i2);
-  extern PSIndex __PSGridGetOffset3D(__PSGridMPI *g, PSIndex i1,
-                                     PSIndex i2, PSIndex i3);
-  extern PSIndex __PSGridGetOffsetPeriodic1D(__PSGridMPI *g, PSIndex i1);
-  extern PSIndex __PSGridGetOffsetPeriodic2D(__PSGridMPI *g, PSIndex i1,
-                                             PSIndex i2);
-  extern PSIndex __PSGridGetOffsetPeriodic3D(__PSGridMPI *g, PSIndex i1,
-                                             PSIndex i2, PSIndex i3);
-
-  extern void *__PSGridGetBaseAddr(__PSGridMPI *g);
+  static inline PSIndex __PSGridGetOffset1D(__PSGridMPI *g, PSIndex i1) {
+    return i1 - g->local_real_offset[0];
+  }
+  static inline PSIndex __PSGridGetOffset2D(__PSGridMPI *g, PSIndex i1,
+                                            PSIndex i2) {
+    return __PSGridGetOffset1D(g, i1) +
+        (i2 - g->local_real_offset[1]) * g->local_real_size[0];
+  }
+  static inline PSIndex __PSGridGetOffset3D(__PSGridMPI *g, PSIndex i1,
+                                            PSIndex i2, PSIndex i3) {
+    return __PSGridGetOffset2D(g, i1, i2) +
+        (i3 - g->local_real_offset[2]) * g->local_real_size[0]
+        * g->local_real_size[1];
+  }
+
+  //! Returns the length of the local buffer including halo.
+  /*!
+    This is the stride used to linearize indices of the grid.
+   */
+  static inline PSIndex __PSGridRealDim(__PSGridMPI *g, int d) {
+    return g->local_real_size[d];
+  }
+
+  //! Returns the position of a periodic index within the local buffer.
+  /*!
+    Grids accessed periodically have halo on every dimension, which
+    holds the wrapped-around points even when the dimension is not
+    decomposed, so no wrap-around is needed here.
+   */
+  static inline PSIndex __PSGridMPIPeriodicIndex(__PSGridMPI *g,
+                                                 PSIndex i, int d) {
+    return i - g->local_real_offset[d];
+  }
+  static inline PSIndex __PSGridGetOffsetPeriodic1D(__PSGridMPI *g,
+                                                    PSIndex i1) {
+    return __PSGridMPIPeriodicIndex(g, i1, 0);
+  }
+  static inline PSIndex __PSGridGetOffsetPeriodic2D(__PSGridMPI *g,
+                                                    PSIndex i1,
+                                                    PSIndex i2) {
+    return __PSGridGetOffsetPeriodic1D(g, i1) +
+        __PSGridMPIPeriodicIndex(g, i2, 1) * g->local_real_size[0];
+  }
+  static inline PSIndex __PSGridGetOffsetPeriodic3D(__PSGridMPI *g,
+                                                    PSIndex i1,
+                                                    PSIndex i2,
+                                                    PSIndex i3) {
+    return __PSGridGetOffsetPeriodic2D(g, i1, i2) +
+        __PSGridMPIPeriodicIndex(g, i3, 2) * g->local_real_size[0]
+        * g->local_real_size[1];
+  }
+
+  // Brick layout of grids created with PS_GRID_ATTRIBUTE_BRICK. See
+  // __PSBrickOffset3D. The halo is part of the bricks, so accesses
+  // to neighbors need no special case. Periodic accesses read the
+  // wrapped-around points in the halo as in the row-major layout.
+  static inline PSIndex __PSGridGetOffsetBrick1D(__PSGridMPI *g,
+                                                 PSIndex i1) {
+    return __PSGridGetOffset1D(g, i1);
+  }
+  static inline PSIndex __PSGridGetOffsetBrick2D(__PSGridMPI *g,
+                                                 PSIndex i1, PSIndex i2) {
+    return __PSBrickOffset2D(i1 - g->local_real_offset[0],
+                             i2 - g->local_real_offset[1],
+                             g->local_num_bricks[0]);
+  }
+  static inline PSIndex __PSGridGetOffsetBrick3D(__PSGridMPI *g,
+                                                 PSIndex i1, PSIndex i2,
+                                                 PSIndex i3) {
+    return __PSBrickOffset3D(i1 - g->local_real_offset[0],
+                             i2 - g->local_real_offset[1],
+                             i3 - g->local_real_offset[2],
+                             g->local_num_bricks[0],
+                             g->local_num_bricks[1]);
+  }
+  static inline PSIndex __PSGridGetOffsetBrickPeriodic1D(__PSGridMPI *g,
+                                                         PSIndex i1) {
+    return __PSGridGetOffsetBrick1D(g, i1);
+  }
+  static inline PSIndex __PSGridGetOffsetBrickPeriodic2D(__PSGridMPI *g,
+                                                         PSIndex i1,
+                                                         PSIndex i2) {
+    return __PSGridGetOffsetBrick2D(g, i1, i2);
+  }
+  static inline PSIndex __PSGridGetOffsetBrickPeriodic3D(__PSGridMPI *g,
+                                                         PSIndex i1,
+                                                         PSIndex i2,
+                                                         PSIndex i3) {
+    return __PSGridGetOffsetBrick3D(g, i1, i2, i3);
+  }
+
+  static inline void *__PSGridGetBaseAddr(__PSGridMPI *g) {
+    return g->p0;
+  }
+  //! Returns the snapshot if taken, and the local buffer otherwise.
+  static inline void *__PSGridGetReadAddr(__PSGridMPI *g) {
+    return g->p1;
+  }
+
+  // SoA layout of the local buffer for user-defined point types. The
+  // point index is the offset of the point within the local buffer
+  // including halo. See __PSGridSoAOffset of the reference runtime.
+  static inline size_t __PSGridSoAOffset(const __PSGridMPI *g, PSIndex i,
+                                         size_t member_offset,
+                                         size_t member_size) {
+    return member_offset * g->soa_lanes + i * member_size;
+  }
+  static inline size_t __PSGridAoSoAOffset(const __PSGridMPI *g, PSIndex i,
+                                           size_t member_offset,
+                                           size_t member_size,
+                                           PSIndex lanes) {
+    return (i / lanes) * lanes * g->elm_size + member_offset * lanes
+        + (i % lanes) * member_size;
+  }
   
   extern void __PSLoadNeighbor(__PSGridMPI *g,
                                const PSVectorInt offset_min,
                                const PSVectorInt offset_max,
                                int diagonal, int reuse,
                                int overlap, int periodic);
+  //! Loads the halo of members of user-defined points.
+  /*!
+    \param num_members Number of members to load.
+    \param member_layout Pairs of the offset and size of each member.
+    \param offset_min Minimum offsets of each member, PS_MAX_DIM
+    elements per member.
+    \param offset_max Maximum offsets of each member, PS_MAX_DIM
+    elements per member.
+   */
+  extern void __PSLoadNeighborMembers(__PSGridMPI *g,
+                                      int num_members,
+                                      const size_t *member_layout,
+                                      const int *offset_min,
+                                      const int *offset_max,
+                                      int diagonal, int reuse,
+                                      int overlap, int periodic);
   extern void __PSLoadSubgrid(__PSGridMPI *g, const __PSGridRange *gr,
                               int reuse);
   extern void __PSLoadSubgrid2D(__PSGridMPI *g, 
@@ -68,6 +68,7 @@ typedef struct {
   index_t max[PS_MAX_DIM];
   index_t local_min[PS_MAX_DIM];
   index_t local_max[PS_MAX_DIM];
+  int mask;
 } __PSDomain;
 
 #endif /* PHYSIS_PHYSIS_OPENCL_KERNEL_H_ */
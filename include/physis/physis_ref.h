@@ -26,6 +26,23 @@ extern "C" {
     int64_t num_elms;
     PSVectorInt dim;
     void *p0, *p1;
+    //! Non-zero if red and black points are stored separately.
+    int color_split;
+    //! Number of bricks in each dimension in the brick layout.
+    /*!
+      Zero if points are not stored in bricks.
+     */
+    PSIndex num_bricks[PS_MAX_DIM];
+    //! Number of points interleaved per member in the SoA layout.
+    /*!
+      Zero if points are stored as an array of structs.
+     */
+    PSIndex soa_lanes;
+    int num_members;
+    //! Offset and size of each point member in the SoA layout.
+    size_t *member_layout;
+    //! Non-zero if p0 is taken from the runtime buffer pool.
+    int scratch;
   } __PSGrid;
 
 #ifndef PHYSIS_USER
@@ -48,8 +65,46 @@ extern "C" {
 #endif
   
   extern __PSGrid* __PSGridNew(int elm_size, int num_dims, PSVectorInt dim);
+  extern __PSGrid* __PSGridNewColorSplit(int elm_size, int num_dims,
+                                         PSVectorInt dim);
+  //! Creates a grid in the brick layout.
+  /*!
+    Not generated by the translator, since run kernels do not sweep
+    brick by brick yet; addressing every point through the brick
+    offset is slower than the row-major layout.
+   */
+  extern __PSGrid* __PSGridNewBrick(int elm_size, int num_dims,
+                                    PSVectorInt dim);
+  //! Creates a temporary grid in the runtime buffer pool.
+  /*!
+    Used for grids that the translator finds to live only within a
+    single stencil run. The buffer is zero-filled like the one of
+    __PSGridNew and goes back to the pool on PSGridFree, so that the
+    next temporary of a similar size reuses it.
+   */
+  extern __PSGrid* __PSGridNewScratch(int elm_size, int num_dims,
+                                      PSVectorInt dim);
+  //! Creates a grid of a user-defined type in the SoA layout.
+  /*!
+    \param layout Layout of the points, which is one of
+    __PSGridLayout.
+    \param lanes Number of points interleaved per member. The whole
+    grid forms a single block if zero.
+    \param member_layout Pairs of the offset and size of each member.
+   */
+  extern __PSGrid* __PSGridNewSoA(int elm_size, int num_dims,
+                                  PSVectorInt dim, int layout,
+                                  int lanes, int num_members,
+                                  const size_t *member_layout);
   extern void __PSGridSwap(__PSGrid *g);
   extern void __PSGridMirror(__PSGrid *g);
+  //! Copies a grid to p1 so that a kernel can read the old values.
+  /*!
+    The copy is taken from the runtime buffer pool and is valid until
+    __PSGridReleaseSnapshot, which makes p1 the same as p0 again.
+   */
+  extern void __PSGridSnapshot(__PSGrid *g);
+  extern void __PSGridReleaseSnapshot(__PSGrid *g);
   extern int __PSGridGetID(__PSGrid *g);
   extern void __PSGridSet(__PSGrid *g, void *buf, ...);
   extern void __PSGridGet(__PSGrid *g, void *buf, ...);
@@ -67,17 +122,119 @@ extern "C" {
   }
 
   static inline PSIndex __PSGridGetOffsetPeriodic1D(__PSGrid *g, PSIndex i1) {
-    return (i1 + PSGridDim(g, 0)) % PSGridDim(g, 0);
+    return __PSWrapIndex(i1, PSGridDim(g, 0));
   }
   static inline PSIndex __PSGridGetOffsetPeriodic2D(__PSGrid *g, PSIndex i1,
                                                  PSIndex i2) {
     return __PSGridGetOffsetPeriodic1D(g, i1) +
-        (i2 + PSGridDim(g, 1)) % PSGridDim(g, 1) * PSGridDim(g, 0);
+        __PSWrapIndex(i2, PSGridDim(g, 1)) * PSGridDim(g, 0);
   }
   static inline PSIndex __PSGridGetOffsetPeriodic3D(__PSGrid *g, PSIndex i1,
                                                  PSIndex i2, PSIndex i3) {
     return __PSGridGetOffsetPeriodic2D(g, i1, i2) +
-        (i3 + PSGridDim(g, 2)) % PSGridDim(g, 2) * PSGridDim(g, 0) * PSGridDim(g, 1);
+        __PSWrapIndex(i3, PSGridDim(g, 2)) * PSGridDim(g, 0) * PSGridDim(g, 1);
+  }
+
+  // Color-split layout for red-black stencils. Points whose index
+  // sum is even (red) and odd (black) are kept in two separate
+  // arrays, each of which packs every other point of the first
+  // dimension, so that a half sweep accesses its color with unit
+  // stride.
+  static inline PSIndex __PSGridColorSplitDim(__PSGrid *g) {
+    return (PSGridDim(g, 0) + 1) >> 1;
+  }
+  static inline PSIndex __PSGridGetOffsetColorSplit1D(__PSGrid *g,
+                                                      PSIndex i1) {
+    return (i1 & 1) * __PSGridColorSplitDim(g) + (i1 >> 1);
+  }
+  static inline PSIndex __PSGridGetOffsetColorSplit2D(__PSGrid *g,
+                                                      PSIndex i1,
+                                                      PSIndex i2) {
+    PSIndex h = __PSGridColorSplitDim(g);
+    return ((i1 + i2) & 1) * h * PSGridDim(g, 1) + (i1 >> 1) + i2 * h;
+  }
+  static inline PSIndex __PSGridGetOffsetColorSplit3D(__PSGrid *g,
+                                                      PSIndex i1,
+                                                      PSIndex i2,
+                                                      PSIndex i3) {
+    PSIndex h = __PSGridColorSplitDim(g);
+    return ((i1 + i2 + i3) & 1) * h * PSGridDim(g, 1) * PSGridDim(g, 2)
+        + (i1 >> 1) + (i2 + i3 * PSGridDim(g, 1)) * h;
+  }
+  static inline PSIndex __PSGridGetOffsetColorSplitPeriodic1D(__PSGrid *g,
+                                                              PSIndex i1) {
+    return __PSGridGetOffsetColorSplit1D(
+        g, __PSWrapIndex(i1, PSGridDim(g, 0)));
+  }
+  static inline PSIndex __PSGridGetOffsetColorSplitPeriodic2D(__PSGrid *g,
+                                                              PSIndex i1,
+                                                              PSIndex i2) {
+    return __PSGridGetOffsetColorSplit2D(
+        g, __PSWrapIndex(i1, PSGridDim(g, 0)),
+        __PSWrapIndex(i2, PSGridDim(g, 1)));
+  }
+  static inline PSIndex __PSGridGetOffsetColorSplitPeriodic3D(__PSGrid *g,
+                                                              PSIndex i1,
+                                                              PSIndex i2,
+                                                              PSIndex i3) {
+    return __PSGridGetOffsetColorSplit3D(
+        g, __PSWrapIndex(i1, PSGridDim(g, 0)),
+        __PSWrapIndex(i2, PSGridDim(g, 1)),
+        __PSWrapIndex(i3, PSGridDim(g, 2)));
+  }
+
+  // Brick layout. See __PSBrickOffset3D. Points of one-dimensional
+  // grids are stored in the row-major order, which is the same as
+  // the brick layout.
+  static inline PSIndex __PSGridGetOffsetBrick1D(__PSGrid *g, PSIndex i1) {
+    return i1;
+  }
+  static inline PSIndex __PSGridGetOffsetBrick2D(__PSGrid *g, PSIndex i1,
+                                                 PSIndex i2) {
+    return __PSBrickOffset2D(i1, i2, g->num_bricks[0]);
+  }
+  static inline PSIndex __PSGridGetOffsetBrick3D(__PSGrid *g, PSIndex i1,
+                                                 PSIndex i2, PSIndex i3) {
+    return __PSBrickOffset3D(i1, i2, i3, g->num_bricks[0],
+                             g->num_bricks[1]);
+  }
+  static inline PSIndex __PSGridGetOffsetBrickPeriodic1D(__PSGrid *g,
+                                                         PSIndex i1) {
+    return __PSWrapIndex(i1, PSGridDim(g, 0));
+  }
+  static inline PSIndex __PSGridGetOffsetBrickPeriodic2D(__PSGrid *g,
+                                                         PSIndex i1,
+                                                         PSIndex i2) {
+    return __PSGridGetOffsetBrick2D(
+        g, __PSWrapIndex(i1, PSGridDim(g, 0)),
+        __PSWrapIndex(i2, PSGridDim(g, 1)));
+  }
+  static inline PSIndex __PSGridGetOffsetBrickPeriodic3D(__PSGrid *g,
+                                                         PSIndex i1,
+                                                         PSIndex i2,
+                                                         PSIndex i3) {
+    return __PSGridGetOffsetBrick3D(
+        g, __PSWrapIndex(i1, PSGridDim(g, 0)),
+        __PSWrapIndex(i2, PSGridDim(g, 1)),
+        __PSWrapIndex(i3, PSGridDim(g, 2)));
+  }
+
+  // SoA layout for user-defined point types. Each member of
+  // soa_lanes consecutive points is stored contiguously, so a kernel
+  // reading some of the members only touches their arrays. The byte
+  // offset is computed from the member offset and size in the
+  // point type.
+  static inline size_t __PSGridSoAOffset(const __PSGrid *g, PSIndex i,
+                                         size_t member_offset,
+                                         size_t member_size) {
+    return member_offset * g->soa_lanes + i * member_size;
+  }
+  static inline size_t __PSGridAoSoAOffset(const __PSGrid *g, PSIndex i,
+                                           size_t member_offset,
+                                           size_t member_size,
+                                           PSIndex lanes) {
+    return (i / lanes) * lanes * g->elm_size + member_offset * lanes
+        + (i % lanes) * member_size;
   }
 
   typedef void (*ReducerFunc)();
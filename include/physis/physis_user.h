@@ -87,6 +87,20 @@ extern "C" {
 #define PSGridSet(g, ...) g->set(__VA_ARGS__)  
 #define PSGridEmit(g, v) g->emit(v)
 #define PSGridEmitUtype(g, v) (*(typeof(v)*)(__PSGridEmitUtype(#g, v)))  
+  /*
+    Boundary conditions of a grid emitted by a stencil kernel. They
+    must be unconditional statements of the kernel, and their values
+    may only refer to the kernel parameters and global variables.
+    
+    PSGridEmitDirichlet sets the faces of the domain to v.
+    PSGridEmitNeumann sets the faces of dimension grad, starting from
+    zero, to the adjacent inner points plus v, and replaces the
+    Dirichlet condition of the grid on those faces.
+
+    The kernel is not applied to the points on the faces with
+    conditions, so other grids emitted by the kernel keep their
+    values there.
+  */
 #define PSGridEmitDirichlet(g, v) g->emitDirichlet(v)  
 #define PSGridEmitNeumann(g, v, grad) g->emitNeumann(v, grad)
   //#define grid_map(d, k, g, ...) g.map(&d, #(void*)k,###__VA_ARGS__)
@@ -33,6 +33,15 @@ static inline void __PSTraceStencilPre(const char *msg) {
   return;
 }
 
+  /** record the cost and elapsed time of a stencil run
+   * @param[in] name ... names of the kernels run
+   * @param[in] bytes ... compulsory bytes loaded and stored
+   * @param[in] flops ... floating-point operations
+   * @param[in] time ... elapsed time in milliseconds
+   */
+  extern void __PSProfileStencilRun(const char *name, double bytes,
+                                    double flops, float time);
+
 #ifdef AUTO_TUNING  
   /**  initialize random
    * @param[in] n ... number of randomized value
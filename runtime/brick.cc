@@ -0,0 +1,118 @@
+// Copyright 2011-2012, RIKEN AICS.
+// All rights reserved.
+//
+// This file is distributed under the BSD license. See LICENSE.txt for
+// details.
+
+#include "runtime/brick.h"
+
+#include <algorithm>
+
+namespace physis {
+namespace runtime {
+
+namespace {
+// Lists by handle - 1
+std::vector<BrickList*> brick_lists;
+}
+
+// Returns true if any point in [min, max) is active.
+static bool IsBrickActive(const IndexArray &min, const IndexArray &max,
+                          const BrickList::MaskFunc &mask) {
+  IndexArray idx;
+  for (idx[2] = min[2]; idx[2] < max[2]; ++idx[2]) {
+    for (idx[1] = min[1]; idx[1] < max[1]; ++idx[1]) {
+      for (idx[0] = min[0]; idx[0] < max[0]; ++idx[0]) {
+        if (mask(idx)) return true;
+      }
+    }
+  }
+  return false;
+}
+
+// Returns the start of the brick following the one containing i.
+static PSIndex NextBrickStart(PSIndex i, PSIndex origin) {
+  PSIndex d = i - origin;
+  // Rounds toward negative infinity
+  PSIndex b = d >= 0 ? d / kBrickWidth : -((-d - 1) / kBrickWidth) - 1;
+  return origin + (b + 1) * kBrickWidth;
+}
+
+BrickList::BrickList(int num_dims, const IndexArray &min,
+                     const IndexArray &max, const IndexArray &origin,
+                     const MaskFunc &mask):
+    num_dims_(num_dims), num_points_(0) {
+  active_min_.Set(PSINDEX_MAX);
+  active_max_.Set(PSINDEX_MIN);
+  // Unused dimensions have a single brick of one point
+  IndexArray rmin = min, rmax = max, rorigin = origin;
+  for (int i = num_dims; i < PS_MAX_DIM; ++i) {
+    rmin[i] = 0;
+    rmax[i] = 1;
+    rorigin[i] = 0;
+  }
+  for (int i = 0; i < num_dims; ++i) {
+    if (rmin[i] >= rmax[i]) {
+      SetGlobalActiveRegion(active_min_, active_max_);
+      return;
+    }
+  }
+  IndexArray bmin, bmax;
+  for (bmin[2] = rmin[2]; bmin[2] < rmax[2]; bmin[2] = bmax[2]) {
+    bmax[2] = std::min(NextBrickStart(bmin[2], rorigin[2]), rmax[2]);
+    for (bmin[1] = rmin[1]; bmin[1] < rmax[1]; bmin[1] = bmax[1]) {
+      bmax[1] = std::min(NextBrickStart(bmin[1], rorigin[1]), rmax[1]);
+      for (bmin[0] = rmin[0]; bmin[0] < rmax[0]; bmin[0] = bmax[0]) {
+        bmax[0] = std::min(NextBrickStart(bmin[0], rorigin[0]), rmax[0]);
+        if (!IsBrickActive(bmin, bmax, mask)) continue;
+        brick_min_.push_back(bmin);
+        brick_max_.push_back(bmax);
+        num_points_ += (bmax - bmin).accumulate(num_dims_);
+        active_min_.SetNoMoreThan(bmin);
+        active_max_.SetNoLessThan(bmax);
+      }
+    }
+  }
+  SetGlobalActiveRegion(active_min_, active_max_);
+  LOG_DEBUG() << "Active bricks: " << *this << "\n";
+}
+
+std::ostream &BrickList::Print(std::ostream &os) const {
+  os << "BrickList {#bricks: " << num_bricks()
+     << ", #points: " << num_points_;
+  if (num_bricks()) {
+    os << ", active: " << active_min_ << " - " << active_max_;
+  }
+  os << "}";
+  return os;
+}
+
+int RegisterBrickList(BrickList *bl) {
+  brick_lists.push_back(bl);
+  return (int)brick_lists.size();
+}
+
+BrickList *FindBrickList(int handle) {
+  PSAssert(handle > 0 && handle <= (int)brick_lists.size());
+  return brick_lists[handle - 1];
+}
+
+} // namespace runtime
+} // namespace physis
+
+using physis::runtime::BrickList;
+using physis::runtime::FindBrickList;
+
+extern "C" {
+  int __PSDomainGetNumBricks(const __PSDomain *d) {
+    return FindBrickList(d->mask)->num_bricks();
+  }
+
+  void __PSDomainSetBrick(__PSDomain *d, int brick) {
+    const BrickList *bl = FindBrickList(d->mask);
+    for (int i = 0; i < bl->num_dims(); ++i) {
+      d->local_min[i] = bl->brick_min(brick)[i];
+      d->local_max[i] = bl->brick_max(brick)[i];
+    }
+  }
+}
@@ -0,0 +1,104 @@
+// Copyright 2011-2012, RIKEN AICS.
+// All rights reserved.
+//
+// This file is distributed under the BSD license. See LICENSE.txt for
+// details.
+
+#ifndef PHYSIS_RUNTIME_BRICK_H_
+#define PHYSIS_RUNTIME_BRICK_H_
+
+#include <vector>
+#include <ostream>
+#include <boost/function.hpp>
+
+#include "runtime/runtime_common.h"
+
+namespace physis {
+namespace runtime {
+
+//! Width of a brick in each dimension
+/*!
+  Same as the bricks of the brick storage layout.
+ */
+const PSIndex kBrickWidth = PS_BRICK_WIDTH;
+
+//! Active bricks of a masked domain in a process.
+/*!
+  The local region of a domain is divided into bricks of
+  kBrickWidth points in each dimension, whose boundaries are
+  kBrickWidth apart from an origin, clipped at the ends of the region,
+  and a brick is active if the mask is nonzero at any of its
+  points. Stencils are applied to the whole active bricks, so inactive
+  points in an active brick are computed too. With the origin of the
+  bricks of the brick storage layout, each brick is stored
+  contiguously.
+
+  For example, a 20x20 region starting at the origin is divided into
+  3x3 bricks of 8x8, 8x4, 4x8 and 4x4 points, and a region [2, 22)
+  with origin 0 is divided into bricks of widths 6, 8 and 6.
+ */
+class BrickList {
+ public:
+  typedef boost::function<bool (const IndexArray&)> MaskFunc;
+  /*!
+    \param num_dims Number of dimensions.
+    \param min Lower corner of the region, inclusive.
+    \param max Upper corner of the region, exclusive.
+    \param origin Index where a brick would start in each dimension.
+    \param mask Returns true if a point is active.
+   */
+  BrickList(int num_dims, const IndexArray &min, const IndexArray &max,
+            const IndexArray &origin, const MaskFunc &mask);
+  int num_dims() const { return num_dims_; }
+  int num_bricks() const { return (int)brick_min_.size(); }
+  const IndexArray &brick_min(int i) const { return brick_min_[i]; }
+  const IndexArray &brick_max(int i) const { return brick_max_[i]; }
+  //! Number of points in the active bricks
+  size_t num_points() const { return num_points_; }
+  //! Lower corner of the bounding box of the active bricks
+  const IndexArray &active_min() const { return active_min_; }
+  //! Upper corner of the bounding box of the active bricks
+  const IndexArray &active_max() const { return active_max_; }
+  //! Bounding box of the active bricks of all processes.
+  /*!
+    Same as the local one unless set by a distributed runtime. The
+    box is empty, i.e., min > max, if no brick is active.
+   */
+  const IndexArray &global_active_min() const { return global_active_min_; }
+  const IndexArray &global_active_max() const { return global_active_max_; }
+  void SetGlobalActiveRegion(const IndexArray &min, const IndexArray &max) {
+    global_active_min_ = min;
+    global_active_max_ = max;
+  }
+  std::ostream &Print(std::ostream &os) const;
+ protected:
+  int num_dims_;
+  std::vector<IndexArray> brick_min_;
+  std::vector<IndexArray> brick_max_;
+  size_t num_points_;
+  IndexArray active_min_;
+  IndexArray active_max_;
+  IndexArray global_active_min_;
+  IndexArray global_active_max_;
+};
+
+//! Registers a brick list and returns its handle.
+/*!
+  Handles are assigned from one in the order of registration, so
+  processes registering their lists in the same order get the same
+  handles. The list is owned by the registry.
+ */
+int RegisterBrickList(BrickList *bl);
+
+//! Returns the brick list of a handle.
+BrickList *FindBrickList(int handle);
+
+} // namespace runtime
+} // namespace physis
+
+inline std::ostream &operator<<(std::ostream &os,
+                                const physis::runtime::BrickList &bl) {
+  return bl.Print(os);
+}
+
+#endif /* PHYSIS_RUNTIME_BRICK_H_ */
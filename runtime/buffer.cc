@@ -6,6 +6,18 @@
 
 #include "runtime/buffer.h"
 
+#include <sys/mman.h>
+#include <unistd.h>
+#include <map>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#define HUGE_PAGE_SIZE (2UL << 20)
+// Memory policy modes of mbind
+#define PS_MPOL_BIND (2)
+#define PS_MPOL_INTERLEAVE (3)
+
 namespace physis {
 namespace runtime {
 
@@ -64,6 +76,151 @@ void *BufferHost::GetChunk(size_t size) {
   return p;
 }
 
+//
+// BufferHostNUMA
+//
+
+static BufferNUMAConfig numa_config;
+
+void SetBufferNUMAConfig(const BufferNUMAConfig &config) {
+  numa_config = config;
+}
+
+const BufferNUMAConfig &GetBufferNUMAConfig() {
+  return numa_config;
+}
+
+// Mapped length of each chunk, which is needed by munmap
+static std::map<void*, size_t> mapped_chunks;
+
+static void UnmapChunk(void *p) {
+  if (p == NULL) return;
+  std::map<void*, size_t>::iterator it = mapped_chunks.find(p);
+  PSAssert(it != mapped_chunks.end());
+  munmap(p, it->second);
+  mapped_chunks.erase(it);
+}
+
+// Returns the number of online NUMA nodes, or 1 if unknown.
+static int GetNumNUMANodes() {
+  int n = 1;
+  FILE *fp = fopen("/sys/devices/system/node/online", "r");
+  if (fp == NULL) return n;
+  // The format is a list of ranges such as "0-1" or "0,2-3"
+  int first, last;
+  char sep;
+  while (fscanf(fp, "%d", &first) == 1) {
+    last = first;
+    if (fscanf(fp, "%c", &sep) == 1 && sep == '-') {
+      if (fscanf(fp, "%d", &last) != 1) break;
+      if (fscanf(fp, "%c", &sep) != 1) sep = '\n';
+    }
+    n = std::max(n, last + 1);
+    if (sep != ',') break;
+  }
+  fclose(fp);
+  return n;
+}
+
+static void BindPages(void *p, size_t len, int mode,
+                      const std::vector<unsigned long> &mask) {
+  if (len == 0) return;
+#if defined(__linux__) && defined(SYS_mbind)
+  unsigned long max_node = mask.size() * sizeof(unsigned long) * 8 + 1;
+  if (syscall(SYS_mbind, p, len, mode, &mask[0], max_node, 0) != 0) {
+    LOG_WARNING() << "mbind failed: " << strerror(errno) << "\n";
+  }
+#else
+  LOG_WARNING() << "NUMA binding not supported\n";
+#endif
+}
+
+static std::vector<unsigned long> BuildNodeMask(int first, int last) {
+  int bits = sizeof(unsigned long) * 8;
+  std::vector<unsigned long> mask(last / bits + 1, 0);
+  for (int i = first; i <= last; ++i) {
+    mask[i / bits] |= 1UL << (i % bits);
+  }
+  return mask;
+}
+
+BufferHostNUMA::BufferHostNUMA(const BufferNUMAConfig &config,
+                               size_t slab_size):
+    Buffer(UnmapChunk), config_(config), slab_size_(slab_size) {
+}
+
+BufferHostNUMA::~BufferHostNUMA() {}
+
+void *BufferHostNUMA::GetChunk(size_t size) {
+  if (size == 0) return NULL;
+  size_t page_size = sysconf(_SC_PAGESIZE);
+  size_t map_len = 0;
+  void *p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  if (config_.huge_pages && size >= HUGE_PAGE_SIZE) {
+    map_len = (size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    p = mmap(NULL, map_len, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+      page_size = HUGE_PAGE_SIZE;
+    } else {
+      LOG_DEBUG() << "No huge pages reserved; using transparent huge pages\n";
+    }
+  }
+#endif
+  if (p == MAP_FAILED) {
+    map_len = (size + page_size - 1) / page_size * page_size;
+    p = mmap(NULL, map_len, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    PSAssert(p != MAP_FAILED);
+#ifdef MADV_HUGEPAGE
+    if (config_.huge_pages) madvise(p, map_len, MADV_HUGEPAGE);
+#endif
+  }
+  mapped_chunks[p] = map_len;
+
+  // Pages are not touched yet, so they can still be placed.
+  char *buf = (char*)p;
+  size_t slab_size = slab_size_ ? slab_size_ : size;
+  long num_slabs = (size + slab_size - 1) / slab_size;
+  switch (config_.policy) {
+    case NUMA_FIRST_TOUCH:
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+      for (long i = 0; i < num_slabs; ++i) {
+        memset(buf + i * slab_size, 0,
+               std::min(slab_size, size - i * slab_size));
+      }
+      break;
+    case NUMA_BIND: {
+      // Contiguous blocks of slabs are bound to each node, which
+      // matches static scheduling when threads are bound to cores
+      // in node order.
+      int num_nodes = GetNumNUMANodes();
+      for (int n = 0; n < num_nodes; ++n) {
+        size_t begin = (num_slabs * n / num_nodes) * slab_size;
+        size_t end = (n == num_nodes - 1) ? size :
+            (num_slabs * (n + 1) / num_nodes) * slab_size;
+        begin = begin / page_size * page_size;
+        end = std::min(end / page_size * page_size, map_len);
+        if (n == num_nodes - 1) end = map_len;
+        if (end <= begin) continue;
+        BindPages(buf + begin, end - begin, PS_MPOL_BIND,
+                  BuildNodeMask(n, n));
+      }
+      break;
+    }
+    case NUMA_INTERLEAVE:
+      BindPages(buf, map_len, PS_MPOL_INTERLEAVE,
+                BuildNodeMask(0, GetNumNUMANodes() - 1));
+      break;
+    default:
+      break;
+  }
+  return p;
+}
+
 
 } // namespace runtime
 } // namespace physis
@@ -76,6 +76,55 @@ class BufferHost: public Buffer {
   virtual void *GetChunk(size_t size);
 };
 
+//! Placement of host buffer pages on NUMA nodes.
+enum BUFFER_NUMA_POLICY {
+  //! Pages are placed by whichever thread touches them first.
+  NUMA_DEFAULT,
+  //! Slabs are first touched with the static schedule of sweeps.
+  NUMA_FIRST_TOUCH,
+  //! Slabs are explicitly bound to nodes with the static schedule.
+  NUMA_BIND,
+  //! Pages are interleaved over all nodes.
+  NUMA_INTERLEAVE
+};
+
+struct BufferNUMAConfig {
+  BUFFER_NUMA_POLICY policy;
+  //! Use huge pages for buffers larger than a huge page.
+  bool huge_pages;
+#ifdef _OPENMP
+  BufferNUMAConfig(): policy(NUMA_FIRST_TOUCH), huge_pages(false) {}
+#else
+  BufferNUMAConfig(): policy(NUMA_DEFAULT), huge_pages(false) {}
+#endif
+};
+
+//! Set the NUMA placement used for host grid buffers.
+void SetBufferNUMAConfig(const BufferNUMAConfig &config);
+const BufferNUMAConfig &GetBufferNUMAConfig();
+
+//! Host buffer placed on NUMA nodes slab by slab.
+/*!
+  A buffer is viewed as a sequence of slabs, i.e., planes of the
+  slowest dimension of a grid. Slabs are assigned to threads or
+  nodes in contiguous blocks in the same way as OpenMP static
+  scheduling of the outermost loop of sweeps.
+ */
+class BufferHostNUMA: public Buffer {
+ public:
+  /*!
+    \param config Placement policy.
+    \param slab_size Size of each slab in bytes.
+   */
+  BufferHostNUMA(const BufferNUMAConfig &config, size_t slab_size);
+  virtual ~BufferHostNUMA();
+  
+ protected:
+  virtual void *GetChunk(size_t size);
+  BufferNUMAConfig config_;
+  size_t slab_size_;
+};
+
 } // namespace runtime
 } // namespace physis
 
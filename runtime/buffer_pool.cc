@@ -0,0 +1,147 @@
+// Copyright 2011-2012, RIKEN AICS.
+// All rights reserved.
+//
+// This file is distributed under the BSD license. See LICENSE.txt for
+// details.
+
+#include "runtime/buffer_pool.h"
+
+namespace physis {
+namespace runtime {
+
+namespace {
+// Chunks smaller than this share a single class
+const size_t kMinSizeClass = 64;
+// Default limit of the cached bytes
+const size_t kDefaultMaxCachedBytes = ((size_t)256) << 20;
+
+class ScopedLock {
+ public:
+  explicit ScopedLock(pthread_mutex_t *m): m_(m) {
+    pthread_mutex_lock(m_);
+  }
+  ~ScopedLock() {
+    pthread_mutex_unlock(m_);
+  }
+ private:
+  pthread_mutex_t *m_;
+};
+}
+
+std::ostream &BufferPoolStats::Print(std::ostream &os) const {
+  return os << "{allocs: " << num_allocs
+            << ", hits: " << num_hits
+            << ", frees: " << num_frees
+            << ", in use: " << bytes_in_use
+            << ", peak: " << peak_bytes_in_use
+            << ", cached: " << bytes_cached << "}";
+}
+
+BufferPool::BufferPool(): max_cached_bytes_(kDefaultMaxCachedBytes) {
+  pthread_mutex_init(&mutex_, NULL);
+}
+
+BufferPool::~BufferPool() {
+  Trim();
+  FOREACH (it, in_use_.begin(), in_use_.end()) {
+    free(it->first);
+  }
+  pthread_mutex_destroy(&mutex_);
+}
+
+BufferPool *BufferPool::GetInstance() {
+  // Never deleted since buffers may be returned during exit
+  static BufferPool *pool = new BufferPool();
+  return pool;
+}
+
+size_t BufferPool::GetSizeClass(size_t size) {
+  if (size <= kMinSizeClass) return kMinSizeClass;
+  // Four classes per power of two: 2^k * {1, 1.25, 1.5, 1.75}
+  int k = 0;
+  for (size_t t = size - 1; t > 1; t >>= 1) ++k;
+  size_t step = ((size_t)1) << (k - 2);
+  return (size + step - 1) / step * step;
+}
+
+void *BufferPool::Allocate(size_t size, MEMORY_CATEGORY cat) {
+  if (size == 0) return NULL;
+  size_t cls = GetSizeClass(size);
+  ScopedLock lock(&mutex_);
+  ++stats_.num_allocs;
+  void *p = NULL;
+  std::vector<void*> &fl = free_lists_[cls];
+  if (fl.size()) {
+    p = fl.back();
+    fl.pop_back();
+    stats_.bytes_cached -= cls;
+    MemoryAccount::GetInstance()->Subtract(MEM_POOL, cls);
+    ++stats_.num_hits;
+  } else {
+    p = malloc(cls);
+    if (p == NULL) {
+      LOG_ERROR() << "Failed to allocate " << cls << " bytes\n";
+      PSAbort(1);
+    }
+  }
+  Chunk c = {cls, cat};
+  in_use_.insert(std::make_pair(p, c));
+  MemoryAccount::GetInstance()->Add(cat, cls);
+  stats_.bytes_in_use += cls;
+  stats_.peak_bytes_in_use = std::max(stats_.peak_bytes_in_use,
+                                      stats_.bytes_in_use);
+  return p;
+}
+
+void BufferPool::Free(void *p) {
+  if (p == NULL) return;
+  ScopedLock lock(&mutex_);
+  std::map<void*, Chunk>::iterator it = in_use_.find(p);
+  PSAssert(it != in_use_.end());
+  size_t cls = it->second.size;
+  MemoryAccount::GetInstance()->Subtract(it->second.cat, cls);
+  in_use_.erase(it);
+  ++stats_.num_frees;
+  stats_.bytes_in_use -= cls;
+  if (stats_.bytes_cached + cls > max_cached_bytes_) {
+    free(p);
+    return;
+  }
+  free_lists_[cls].push_back(p);
+  stats_.bytes_cached += cls;
+  MemoryAccount::GetInstance()->Add(MEM_POOL, cls);
+}
+
+void BufferPool::TrimTo(size_t limit) {
+  // Release the largest chunks first
+  std::map<size_t, std::vector<void*> >::reverse_iterator it =
+      free_lists_.rbegin();
+  for (; it != free_lists_.rend() && stats_.bytes_cached > limit; ++it) {
+    std::vector<void*> &fl = it->second;
+    while (fl.size() && stats_.bytes_cached > limit) {
+      free(fl.back());
+      fl.pop_back();
+      stats_.bytes_cached -= it->first;
+      MemoryAccount::GetInstance()->Subtract(MEM_POOL, it->first);
+    }
+  }
+}
+
+void BufferPool::Trim() {
+  ScopedLock lock(&mutex_);
+  TrimTo(0);
+}
+
+void BufferPool::set_max_cached_bytes(size_t s) {
+  ScopedLock lock(&mutex_);
+  max_cached_bytes_ = s;
+  TrimTo(s);
+}
+
+BufferPoolStats BufferPool::GetStats() const {
+  ScopedLock lock(&mutex_);
+  return stats_;
+}
+
+} // namespace runtime
+} // namespace physis
@@ -0,0 +1,105 @@
+// Copyright 2011-2012, RIKEN AICS.
+// All rights reserved.
+//
+// This file is distributed under the BSD license. See LICENSE.txt for
+// details.
+
+#ifndef PHYSIS_RUNTIME_BUFFER_POOL_H_
+#define PHYSIS_RUNTIME_BUFFER_POOL_H_
+
+#include <pthread.h>
+#include <map>
+#include <vector>
+#include <ostream>
+
+#include "runtime/runtime_common.h"
+#include "runtime/memory_usage.h"
+
+namespace physis {
+namespace runtime {
+
+//! Counters of a buffer pool.
+struct BufferPoolStats {
+  //! Number of Allocate calls
+  size_t num_allocs;
+  //! Number of allocations served from a free list
+  size_t num_hits;
+  //! Number of Free calls
+  size_t num_frees;
+  //! Bytes handed out and not yet returned
+  size_t bytes_in_use;
+  //! Maximum of bytes_in_use
+  size_t peak_bytes_in_use;
+  //! Bytes kept in the free lists
+  size_t bytes_cached;
+  BufferPoolStats(): num_allocs(0), num_hits(0), num_frees(0),
+                     bytes_in_use(0), peak_bytes_in_use(0),
+                     bytes_cached(0) {}
+  std::ostream &Print(std::ostream &os) const;
+};
+
+//! Size-class pool for transient host buffers.
+/*!
+  Requests are rounded up to a size class, and freed chunks are kept
+  in a free list per class so that the next request of a similar
+  size does not go to malloc. Classes are four per power of two, so
+  at most 25% of a chunk is wasted. The pool is shared by all the
+  threads of a process and guarded by a mutex; the statistics are
+  per process, i.e., per rank.
+ */
+class BufferPool {
+ public:
+  BufferPool();
+  ~BufferPool();
+  //! Returns the process-wide pool.
+  static BufferPool *GetInstance();
+  /*! Allocates a chunk of at least the given size.
+    \param size Size in bytes.
+    \param cat Category the chunk is accounted to while in use.
+    \return Pointer to the chunk; NULL if size is zero.
+   */
+  void *Allocate(size_t size, MEMORY_CATEGORY cat=MEM_STAGING);
+  //! Returns a chunk allocated by Allocate; NULL is ignored.
+  void Free(void *p);
+  //! Releases all cached chunks to the system.
+  void Trim();
+  //! Sets the upper limit of the bytes kept in the free lists.
+  void set_max_cached_bytes(size_t s);
+  size_t max_cached_bytes() const { return max_cached_bytes_; }
+  BufferPoolStats GetStats() const;
+  //! Rounds up a request size to its size class.
+  static size_t GetSizeClass(size_t size);
+ protected:
+  //! Frees the cached chunks until the cache fits in limit.
+  void TrimTo(size_t limit);
+  mutable pthread_mutex_t mutex_;
+  //! Free chunks by class size
+  std::map<size_t, std::vector<void*> > free_lists_;
+  struct Chunk {
+    size_t size;
+    MEMORY_CATEGORY cat;
+  };
+  //! Chunks in use
+  std::map<void*, Chunk> in_use_;
+  size_t max_cached_bytes_;
+  BufferPoolStats stats_;
+};
+
+//! Shorthands for the process-wide pool.
+inline void *PoolAllocate(size_t size, MEMORY_CATEGORY cat=MEM_STAGING) {
+  return BufferPool::GetInstance()->Allocate(size, cat);
+}
+
+inline void PoolFree(void *p) {
+  BufferPool::GetInstance()->Free(p);
+}
+
+} // namespace runtime
+} // namespace physis
+
+inline std::ostream &operator<<(std::ostream &os,
+                                const physis::runtime::BufferPoolStats &s) {
+  return s.Print(os);
+}
+
+#endif /* PHYSIS_RUNTIME_BUFFER_POOL_H_ */
@@ -89,7 +89,7 @@ void Grid::Get(const IndexArray &indices, void *buf) {
   Copyout(buf, GetAddress(indices), elm_size());
 }
 
-bool Grid::AttributeSet(enum PS_GRID_ATTRIBUTE a) {
+bool Grid::AttributeSet(enum PS_GRID_ATTRIBUTE a) const {
   return ((attr_ & a) != 0);
 }
 
@@ -54,7 +54,7 @@ class Grid {
   virtual void *GetAddress(const IndexArray &indices);    
   virtual void Set(const IndexArray &indices, const void *buf);
   virtual void Get(const IndexArray &indices, void *buf); 
-  bool AttributeSet(enum PS_GRID_ATTRIBUTE);
+  bool AttributeSet(enum PS_GRID_ATTRIBUTE) const;
 
   //! Reduce the grid with operator op.
   /*
@@ -10,13 +10,14 @@
 #include <algorithm>
 
 #include "runtime/grid_util.h"
+#include "runtime/buffer_pool.h"
 
 using namespace std;
 
 namespace physis {
 namespace runtime {
 
-size_t GridMPI::CalcHaloSize(int dim, unsigned width) {
+size_t GridMPI::CalcHaloSize(int dim, unsigned width) const {
   IndexArray halo_size = local_real_size_;
   halo_size[dim] = width;
   return halo_size.accumulate(num_dims_);
@@ -32,22 +33,57 @@ GridMPI::GridMPI(PSType type, int elm_size, int num_dims,
     Grid(type, elm_size, num_dims, size, false, attr),
     global_offset_(global_offset),  
     local_offset_(local_offset), local_size_(local_size),
-    halo_self_fw_(NULL), halo_self_bw_(NULL),
-    halo_peer_fw_(NULL), halo_peer_bw_(NULL) {
+    soa_lanes_(0), halo_self_fw_(NULL), halo_self_bw_(NULL),
+    halo_peer_fw_(NULL), halo_peer_bw_(NULL), snapshot_(NULL),
+    data_bytes_accounted_(0) {
+  for (int i = 0; i < PS_MAX_DIM; ++i) {
+    halo_fw_capacity_[i] = halo_bw_capacity_[i] = 0;
+  }
+  // One-dimensional grids are the same in both layouts
+  bool bricked = (attr & PS_GRID_ATTRIBUTE_BRICK) && num_dims_ > 1;
+  // The backward halo of bricked grids is padded to whole bricks, so
+  // bricks start at the local offset plus multiples of the brick
+  // width in all grids, as do the bricks of masked domains.
+  Width2 padded_halo = halo;
+  if (bricked) {
+    for (int i = 0; i < num_dims_; ++i) {
+      padded_halo.bw[i] = __PSBrickCount(halo.bw[i]) * PS_BRICK_WIDTH;
+    }
+  }
   local_real_size_ = local_size_;
   local_real_offset_ = local_offset_;
   for (int i = 0; i < num_dims_; ++i) {
-    local_real_size_[i] += halo.fw[i] + halo.bw[i];
-    local_real_offset_[i] -= halo.bw[i];
+    local_real_size_[i] += padded_halo.fw[i] + padded_halo.bw[i];
+    local_real_offset_[i] -= padded_halo.bw[i];
+  }
+  if (bricked) {
+    for (int i = 0; i < num_dims_; ++i) {
+      local_num_bricks_[i] = __PSBrickCount(local_real_size_[i]);
+    }
   }
   
   empty_ = local_size_.accumulate(num_dims_) == 0;
+  UpdateInfo();
   if (empty_) return;
 
-  halo_ = halo;
+  halo_ = padded_halo;
 
 }
 
+void GridMPI::UpdateInfo() {
+  info_.p0 = _data();
+  info_.p1 = snapshot_ ? snapshot_ : info_.p0;
+  info_.num_dims = num_dims_;
+  size_.Set(info_.dim);
+  local_real_offset_.Set(info_.local_real_offset);
+  local_real_size_.Set(info_.local_real_size);
+  local_size_.Set(info_.local_size);
+  local_num_bricks_.Set(info_.local_num_bricks);
+  info_.elm_size = elm_size_;
+  info_.soa_lanes = soa_lanes_;
+  info_.grid = this;
+}
+
 GridMPI *GridMPI::Create(
     PSType type, int elm_size,
     int num_dims, const IndexArray &size,
@@ -68,66 +104,128 @@ GridMPI *GridMPI::Create(
   return g;
 }
 
+void GridMPI::SetMemberLayout(int lanes, int num_members,
+                              const size_t *member_layout) {
+  // Bricks of points are not interleaved
+  PSAssert(!bricked());
+  PSAssert(num_members > 0);
+  DeleteBuffers();
+  member_layout_.assign(member_layout, member_layout + num_members * 2);
+  soa_lanes_ = lanes;
+  if (lanes == 0) {
+    // The whole local buffer is a single block
+    soa_lanes_ = std::max(local_real_size_.accumulate(num_dims_),
+                          (PSIndex)1);
+  }
+  InitBuffers();
+  UpdateInfo();
+}
+
 void GridMPI::InitBuffers() {
   if (empty_) return;  
-  data_buffer_[0] = new BufferHost();
+  // Pages are placed slab by slab of the slowest dimension, which is
+  // the dimension split among threads in thread-parallel sweeps. A
+  // slab of bricked grids is a layer of bricks.
+  const BufferNUMAConfig &numa_config = GetBufferNUMAConfig();
+  if (numa_config.policy == NUMA_DEFAULT && !numa_config.huge_pages) {
+    data_buffer_[0] = new BufferHost();
+  } else {
+    size_t slab_size = bricked() ?
+        GetLocalBufferRealSize() / local_num_bricks_[num_dims_ - 1] :
+        local_real_size_.accumulate(num_dims_ - 1) * elm_size_;
+    data_buffer_[0] = new BufferHostNUMA(numa_config, slab_size);
+  }
   data_buffer_[0]->Allocate(GetLocalBufferRealSize());
+  data_bytes_accounted_ = data_buffer_[0]->size();
+  MemoryAccount::GetInstance()->Add(MEM_DATA, data_bytes_accounted_);
   data_buffer_[1] = NULL;
   data_[0] = (char*)data_buffer_[0]->Get();
   LOG_DEBUG() << "buffer addr: " << (void*)(data_[0]) << "\n";
   data_[1] = NULL;
+  UpdateInfo();
   InitHaloBuffers();
 }
 
 void GridMPI::InitHaloBuffers() {
   // Note that the halo for the last dimension is continuously located
-  // in memory, so no separate buffer is necessary.
-  
-  halo_self_fw_ = new char*[num_dims_-1];
-  halo_self_bw_ = new char*[num_dims_-1];
-  halo_peer_fw_ = new char*[num_dims_-1];
-  halo_peer_bw_ = new char*[num_dims_-1];
+  // in memory unless the grid is bricked, so no separate buffer is
+  // necessary. Its entries point into the grid buffer.
+  //
+  // The send and receive buffers are allocated at the first exchange
+  // that needs them since halo_ is the union of the widths of all
+  // stencils using this grid.
+  halo_self_fw_ = new char*[num_dims_];
+  halo_self_bw_ = new char*[num_dims_];
+  halo_peer_fw_ = new char*[num_dims_];
+  halo_peer_bw_ = new char*[num_dims_];
   
-  for (int i = 0; i < num_dims_ - 1; ++i) {
+  for (int i = 0; i < num_dims_; ++i) {
     halo_self_fw_[i] = halo_self_bw_[i] = NULL;
     halo_peer_fw_[i] = halo_peer_bw_[i] = NULL;
-    if (halo_.fw[i]) {
-      halo_self_fw_[i] =
-          (char*)malloc(CalcHaloSize(i, halo_.fw[i]) * elm_size_);
-      assert(halo_self_fw_[i]);
-      halo_peer_fw_[i] =
-          (char*)malloc(CalcHaloSize(i, halo_.fw[i]) * elm_size_);
-      assert(halo_peer_fw_[i]);      
-    } 
-    if (halo_.bw[i]) {
-      halo_self_bw_[i] =
-          (char*)malloc(CalcHaloSize(i, halo_.bw[i]) * elm_size_);
-      assert(halo_self_bw_[i]);
-      halo_peer_bw_[i] =
-          (char*)malloc(CalcHaloSize(i, halo_.bw[i]) * elm_size_);
-      assert(halo_peer_bw_[i]);      
-    } 
+    halo_fw_capacity_[i] = halo_bw_capacity_[i] = 0;
   }
 }
 
+void GridMPI::ResizeHaloBuffers(int dim, bool fw, unsigned width) {
+  if (IsHaloInPlace(dim) || width == 0) return;
+  size_t size = CalcHaloSize(dim, width) * elm_size_;
+  size_t &capacity = fw ? halo_fw_capacity_[dim] : halo_bw_capacity_[dim];
+  // Shrink only when less than half is used so that alternating
+  // widths do not reallocate every time
+  if (size <= capacity && size > capacity / 2) return;
+  char *&self = fw ? halo_self_fw_[dim] : halo_self_bw_[dim];
+  char *&peer = fw ? halo_peer_fw_[dim] : halo_peer_bw_[dim];
+  LOG_DEBUG() << "Resizing halo buffers of dimension " << dim
+              << (fw ? " fw" : " bw") << " from " << capacity
+              << " to " << size << " bytes\n";
+  PoolFree(self);
+  PoolFree(peer);
+  self = (char*)PoolAllocate(size, MEM_HALO);
+  peer = (char*)PoolAllocate(size, MEM_HALO);
+  capacity = size;
+}
+
 GridMPI::~GridMPI() {
   DeleteBuffers();
 }
 
 void GridMPI::DeleteBuffers() {
   if (empty_) return;
+  ReleaseSnapshot();
+  MemoryAccount::GetInstance()->Subtract(MEM_DATA, data_bytes_accounted_);
+  data_bytes_accounted_ = 0;
   DeleteHaloBuffers();
   Grid::DeleteBuffers();
 }
 
+void GridMPI::Snapshot() {
+  PSAssert(snapshot_ == NULL);
+  if (empty_) return;
+  size_t s = GetLocalBufferRealSize();
+  snapshot_ = PoolAllocate(s, MEM_STAGING);
+  memcpy(snapshot_, _data(), s);
+  UpdateInfo();
+}
+
+void GridMPI::ReleaseSnapshot() {
+  if (snapshot_ == NULL) return;
+  PoolFree(snapshot_);
+  snapshot_ = NULL;
+  UpdateInfo();
+}
+
 void GridMPI::DeleteHaloBuffers() {
   if (empty_) return;
   
-  for (int i = 0; i < num_dims_ - 1; ++i) {
-    if (halo_self_fw_) PS_XFREE(halo_self_fw_[i]);
-    if (halo_self_bw_) PS_XFREE(halo_self_bw_[i]);
-    if (halo_peer_fw_) PS_XFREE(halo_peer_fw_[i]);
-    if (halo_peer_bw_) PS_XFREE(halo_peer_bw_[i]);
+  // Halo buffers go back to the pool so that grids created later can
+  // reuse them
+  for (int i = 0; i < num_dims_; ++i) {
+    if (IsHaloInPlace(i)) continue;
+    if (halo_self_fw_) PoolFree(halo_self_fw_[i]);
+    if (halo_self_bw_) PoolFree(halo_self_bw_[i]);
+    if (halo_peer_fw_) PoolFree(halo_peer_fw_[i]);
+    if (halo_peer_bw_) PoolFree(halo_peer_bw_[i]);
+    halo_fw_capacity_[i] = halo_bw_capacity_[i] = 0;
   }
   PS_XDELETEA(halo_self_fw_);
   PS_XDELETEA(halo_self_bw_);
@@ -136,7 +234,7 @@ void GridMPI::DeleteHaloBuffers() {
 }
     
 char *GridMPI::GetHaloPeerBuf(int dim, bool fw, unsigned width) {
-  if (dim == num_dims_ - 1) {
+  if (IsHaloInPlace(dim)) {
     IndexArray offset(0);
     if (fw) {
       offset[dim] = local_real_size_[dim] - halo_.fw[dim];
@@ -154,7 +252,7 @@ char *GridMPI::GetHaloPeerBuf(int dim, bool fw, unsigned width) {
 void GridMPI::CopyinHalo(int dim, unsigned width, bool fw, bool diagonal) {
   // The slowest changing dimension does not need actual copying
   // because it's directly copied into the grid buffer.
-  if (dim == num_dims_ - 1) {
+  if (IsHaloInPlace(dim)) {
     return;
   }
   
@@ -170,8 +268,7 @@ void GridMPI::CopyinHalo(int dim, unsigned width, bool fw, bool diagonal) {
   IndexArray halo_size = local_real_size_;
   halo_size[dim] = width;
   
-  CopyinSubgrid(elm_size_, num_dims_, data_[0], local_real_size_,
-                halo_buf, halo_offset, halo_size);
+  CopyinLocalSubgrid(halo_buf, halo_offset, halo_size);
 }
 
 // fw: prepare buffer for sending halo for forward access if true
@@ -197,7 +294,7 @@ void GridMPI::CopyoutHalo(int dim, unsigned width, bool fw, bool diagonal) {
 
   // The slowest changing dimension does not need actual copying
   // because its halo region is physically continuous.
-  if (dim == (num_dims_ - 1)) {
+  if (IsHaloInPlace(dim)) {
     char *p = data_[0]
         + GridCalcOffset3D(halo_offset, local_real_size_) * elm_size_;
     LOG_DEBUG() << "halo_offset: " << halo_offset << "\n";
@@ -207,12 +304,125 @@ void GridMPI::CopyoutHalo(int dim, unsigned width, bool fw, bool diagonal) {
   } else {
     IndexArray halo_size = local_real_size_;
     halo_size[dim] = width;
-    CopyoutSubgrid(elm_size_, num_dims_, data_[0], local_real_size_,
-                   *halo_buf, halo_offset, halo_size);
+    CopyoutLocalSubgrid(*halo_buf, halo_offset, halo_size);
+    return;
+  }
+}
+
+void GridMPI::CopyoutHaloMember(int dim, unsigned width, bool fw,
+                                size_t member_offset, size_t member_size,
+                                void *buf) {
+  IndexArray halo_offset(0);
+  if (fw) {
+    halo_offset[dim] = halo_.bw[dim];
+  } else {
+    halo_offset[dim] = local_real_size_[dim] - halo_.fw[dim] - width;
+  }
+  IndexArray halo_size = local_real_size_;
+  halo_size[dim] = width;
+  if (bricked()) {
+    CopyoutSubgridMemberBrick(elm_size_, num_dims_, data_[0],
+                              local_num_bricks_, buf, halo_offset,
+                              halo_size, member_offset, member_size);
+    return;
+  }
+  if (soa()) {
+    CopyoutSubgridMemberSoA(elm_size_, num_dims_, data_[0],
+                            local_real_size_, soa_lanes_, buf,
+                            halo_offset, halo_size,
+                            member_offset, member_size);
+    return;
+  }
+  CopyoutSubgridMember(elm_size_, num_dims_, data_[0], local_real_size_,
+                       buf, halo_offset, halo_size,
+                       member_offset, member_size);
+}
+
+void GridMPI::CopyinHaloMember(int dim, unsigned width, bool fw,
+                               size_t member_offset, size_t member_size,
+                               const void *buf) {
+  IndexArray halo_offset(0);
+  if (fw) {
+    halo_offset[dim] = local_real_size_[dim] - halo_.fw[dim];
+  } else {
+    halo_offset[dim] = halo_.bw[dim] - width;
+  }
+  IndexArray halo_size = local_real_size_;
+  halo_size[dim] = width;
+  if (bricked()) {
+    CopyinSubgridMemberBrick(elm_size_, num_dims_, data_[0],
+                             local_num_bricks_, buf, halo_offset,
+                             halo_size, member_offset, member_size);
+    return;
+  }
+  if (soa()) {
+    CopyinSubgridMemberSoA(elm_size_, num_dims_, data_[0],
+                           local_real_size_, soa_lanes_, buf,
+                           halo_offset, halo_size,
+                           member_offset, member_size);
     return;
   }
+  CopyinSubgridMember(elm_size_, num_dims_, data_[0], local_real_size_,
+                      buf, halo_offset, halo_size,
+                      member_offset, member_size);
 }
 
+void GridMPI::CopyHaloPeriodic(int dim, unsigned width, bool fw) {
+  PSAssert((PSIndex)width <= local_size_[dim]);
+  IndexArray src_offset(0), dst_offset(0);
+  if (fw) {
+    src_offset[dim] = halo_.bw[dim];
+    dst_offset[dim] = local_real_size_[dim] - halo_.fw[dim];
+  } else {
+    src_offset[dim] = local_real_size_[dim] - halo_.fw[dim] - width;
+    dst_offset[dim] = halo_.bw[dim] - width;
+  }
+  IndexArray halo_size = local_real_size_;
+  halo_size[dim] = width;
+  size_t size = halo_size.accumulate(num_dims_) * elm_size_;
+  // The slowest changing dimension is continuous in the grid buffer
+  if (IsHaloInPlace(dim)) {
+    memcpy(data_[0] + GridCalcOffset3D(dst_offset, local_real_size_)
+           * elm_size_,
+           data_[0] + GridCalcOffset3D(src_offset, local_real_size_)
+           * elm_size_, size);
+    return;
+  }
+  void *buf = PoolAllocate(size, MEM_HALO);
+  CopyoutLocalSubgrid(buf, src_offset, halo_size);
+  CopyinLocalSubgrid(buf, dst_offset, halo_size);
+  PoolFree(buf);
+}
+
+void GridMPI::CopyoutLocalSubgrid(void *dst, const IndexArray &offset,
+                                  const IndexArray &size) const {
+  if (bricked()) {
+    CopyoutSubgridBrick(elm_size_, num_dims_, data_[0], local_num_bricks_,
+                        dst, offset, size);
+  } else if (soa()) {
+    CopyoutSubgridSoA(elm_size_, num_dims_, data_[0], local_real_size_,
+                      soa_lanes_, member_layout_.size() / 2,
+                      &member_layout_[0], dst, offset, size);
+  } else {
+    CopyoutSubgrid(elm_size_, num_dims_, data_[0], local_real_size_,
+                   dst, offset, size);
+  }
+}
+
+void GridMPI::CopyinLocalSubgrid(const void *src, const IndexArray &offset,
+                                 const IndexArray &size) {
+  if (bricked()) {
+    CopyinSubgridBrick(elm_size_, num_dims_, data_[0], local_num_bricks_,
+                       src, offset, size);
+  } else if (soa()) {
+    CopyinSubgridSoA(elm_size_, num_dims_, data_[0], local_real_size_,
+                     soa_lanes_, member_layout_.size() / 2,
+                     &member_layout_[0], src, offset, size);
+  } else {
+    CopyinSubgrid(elm_size_, num_dims_, data_[0], local_real_size_,
+                  src, offset, size);
+  }
+}
 
 std::ostream &GridMPI::Print(std::ostream &os) const {
   os << "GridMPI {"
@@ -221,11 +431,30 @@ std::ostream &GridMPI::Print(std::ostream &os) const {
      << ", global offset: " << global_offset_
      << ", local offset: " << local_offset_
      << ", local size: " << local_size_
-     << ", local real size: " << local_real_size_      
-     << "}";
+     << ", local real size: " << local_real_size_;
+  if (bricked()) os << ", bricks: " << local_num_bricks_;
+  if (soa()) os << ", SoA lanes: " << soa_lanes_;
+  os << "}";
   return os;
 }
 
+size_t GridMPI::GetMemoryUsage(MEMORY_CATEGORY cat) const {
+  if (empty_) return 0;
+  size_t bytes = 0;
+  if (cat == MEM_DATA) {
+    if (data_buffer_[0]) bytes += data_buffer_[0]->size();
+    if (data_buffer_[1] && data_buffer_[1] != data_buffer_[0]) {
+      bytes += data_buffer_[1]->size();
+    }
+  } else if (cat == MEM_HALO) {
+    // Self and peer buffers have the same capacity
+    for (int i = 0; i < num_dims_; ++i) {
+      bytes += (halo_fw_capacity_[i] + halo_bw_capacity_[i]) * 2;
+    }
+  }
+  return bytes;
+}
+
 template <class T>
 int ReduceGridMPI3D(GridMPI *g, PSReduceOp op, T *out) {
   size_t nelms = g->local_size().accumulate(g->num_dims());
@@ -236,9 +465,10 @@ int ReduceGridMPI3D(GridMPI *g, PSReduceOp op, T *out) {
   for (int k = 0; k < g->local_size()[2]; ++k) {
     for (int j = 0; j < g->local_size()[1]; ++j) {
       for (int i = 0; i < g->local_size()[0]; ++i) {
-        intptr_t offset =
-            GridCalcOffset3D(i + g->halo().bw[0], j + g->halo().bw[1],
-                             k + g->halo().bw[2], g->local_real_size());
+        IndexArray t(i + g->halo().bw[0], j + g->halo().bw[1],
+                     k + g->halo().bw[2]);
+        intptr_t offset = g->bricked() ? g->CalcBrickOffset(t) :
+            GridCalcOffset3D(t, g->local_real_size());
         v = func(v, d[offset]);
       }
     }
@@ -266,23 +496,37 @@ int GridMPI::Reduce(PSReduceOp op, void *out) {
 
 void GridMPI::Copyout(void *dst) const {
   const void *src = buffer()->Get();
-  if (HasHalo()) {
+  if (!IsPacked()) {
     IndexArray offset(halo_.bw);
-    CopyoutSubgrid(elm_size(), num_dims(),
-                   src, local_real_size(),
-                   dst, offset, local_size());
+    CopyoutLocalSubgrid(dst, offset, local_size());
   } else {
     memcpy(dst, src, GetLocalBufferSize());
   }
   return;
 }
 
+// Points in the SoA layout are gathered from the member arrays.
+void GridMPI::Set(const IndexArray &indices, const void *buf) {
+  if (!soa()) {
+    Grid::Set(indices, buf);
+    return;
+  }
+  CopyinLocalSubgrid(buf, indices - local_real_offset_, IndexArray(1, 1, 1));
+}
+
+void GridMPI::Get(const IndexArray &indices, void *buf) {
+  if (!soa()) {
+    Grid::Get(indices, buf);
+    return;
+  }
+  CopyoutLocalSubgrid(buf, indices - local_real_offset_,
+                      IndexArray(1, 1, 1));
+}
+
 void GridMPI::Copyin(const void *src) {
   void *dst = buffer()->Get();
-  if (HasHalo()) {
-    CopyinSubgrid(elm_size(), num_dims(),
-                  dst, local_real_size(),
-                  src, halo_.bw, local_size());
+  if (!IsPacked()) {
+    CopyinLocalSubgrid(src, halo_.bw, local_size());
   } else {
     memcpy(dst, src, GetLocalBufferSize());
   }
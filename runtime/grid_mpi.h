@@ -9,17 +9,18 @@
 
 #include <iostream>
 #include <sstream>
+#include <vector>
 
 #include "runtime/runtime_common.h"
 #include "runtime/grid.h"
 #include "runtime/grid_util.h"
+#include "runtime/memory_usage.h"
 
 namespace physis {
 namespace runtime {
 
 class GridSpaceMPI;
 
-// TODO: Replace MPI with class IPC.
 class GridMPI: public Grid {
   friend class GridSpaceMPI;
   template <class T> friend std::ostream& print_grid(
@@ -53,12 +54,30 @@ class GridMPI: public Grid {
   /*!
     halo_.bw[i] and halo_.fw[i] are the (unsigned) width of the
     backward and forward halo in the i'th dimension, respectively.
+    This is the padding within the grid buffer; the send and receive
+    buffers are sized by the exchanges actually done. The backward
+    width of bricked grids is rounded up to whole bricks.
    */
   Width2 halo_; 
   //! Offset of the actual buffer within the whole grid.
   IndexArray local_real_offset_;    
   //! Length of the actual buffer with halo
   IndexArray local_real_size_;
+  //! Number of bricks of the actual buffer in the brick layout.
+  /*!
+    Zero if the buffer is in the row-major order.
+   */
+  IndexArray local_num_bricks_;
+  //! Number of points interleaved per member in the SoA layout.
+  PSIndex soa_lanes_;
+  //! Offset and size of each point member in the SoA layout.
+  /*!
+    Empty if points are stored as an array of structs.
+   */
+  std::vector<size_t> member_layout_;
+
+  //! Local layout exposed to generated code.
+  __PSMPIGridInfo info_;
 
   //! Buffer for sending halo for forward accesses
   char **halo_self_fw_;
@@ -68,13 +87,60 @@ class GridMPI: public Grid {
   char **halo_peer_fw_;
   //! Buffer for receiving halo for backward accesses  
   char **halo_peer_bw_;
+  //! Copy of the local buffer taken by Snapshot
+  void *snapshot_;
+  //! Bytes of the data buffer added to the memory account
+  size_t data_bytes_accounted_;
+  //! Capacity in bytes of each of halo_self_fw_ and halo_peer_fw_
+  size_t halo_fw_capacity_[PS_MAX_DIM];
+  //! Capacity in bytes of each of halo_self_bw_ and halo_peer_bw_
+  size_t halo_bw_capacity_[PS_MAX_DIM];
+
+  size_t CalcHaloSize(int dim, unsigned width) const;    
+
+  //! Returns true if the halo of a dimension is exchanged in place.
+  /*!
+    The halo for the last dimension is continuously located in the
+    row-major buffer, so it is sent and received without copying.
+   */
+  bool IsHaloInPlace(int dim) const {
+    return dim == num_dims_ - 1 && !bricked() && !soa();
+  }
+
+  //! Copy a sub grid of the local buffer into a continuous buffer.
+  /*!
+    \param dst Destination buffer.
+    \param offset Offset of the sub grid within the local buffer
+    including halo.
+    \param size Size of the sub grid.
+   */
+  void CopyoutLocalSubgrid(void *dst, const IndexArray &offset,
+                           const IndexArray &size) const;
+  //! Copy a continuous buffer into a sub grid of the local buffer.
+  void CopyinLocalSubgrid(const void *src, const IndexArray &offset,
+                          const IndexArray &size);
 
-  size_t CalcHaloSize(int dim, unsigned width);    
+  //! Updates the layout exposed to generated code.
+  void UpdateInfo();
   
   //! Allocates buffers, including halo buffers.
   virtual void InitBuffers();
-  //! Allocates buffers for halo communications.
+  //! Initializes buffers for halo communications.
+  /*!
+    No buffer is allocated until ResizeHaloBuffers is called.
+   */
   virtual void InitHaloBuffers();
+  //! Sizes the halo send and receive buffers for an exchange.
+  /*!
+    The buffers grow to the given width, and shrink when it is less
+    than half of their capacity. Nothing is done for the last
+    dimension, whose halo is exchanged in place.
+    
+    \param dim Dimension to exchange.
+    \param fw True if the halo is for forward accesses.
+    \param width Halo width.
+   */
+  void ResizeHaloBuffers(int dim, bool fw, unsigned width);
   //! Deletes buffers, including halo buffers.
   virtual void DeleteBuffers();
   //! Deletes halo buffers.
@@ -107,6 +173,43 @@ class GridMPI: public Grid {
    */
   virtual void CopyinHalo(int dim, unsigned width, bool fw, bool diagonal);
 
+  //! Copy a member of halo points into a send buffer.
+  /*!
+    \param dim Dimension to copy.
+    \param width Halo length.
+    \param fw True if the halo is for forward accesses.
+    \param member_offset Offset of the member in each point.
+    \param member_size Size of the member.
+    \param buf Buffer packed with the member.
+   */
+  virtual void CopyoutHaloMember(int dim, unsigned width, bool fw,
+                                 size_t member_offset, size_t member_size,
+                                 void *buf);
+
+  //! Copy a member of remote halo points from the recv buffer.
+  /*!
+    \param dim Dimension to copy.
+    \param width Halo length.
+    \param fw True if the received halo is for forward accesses.
+    \param member_offset Offset of the member in each point.
+    \param member_size Size of the member.
+    \param buf Buffer packed with the member.
+   */
+  virtual void CopyinHaloMember(int dim, unsigned width, bool fw,
+                                size_t member_offset, size_t member_size,
+                                const void *buf);
+
+  //! Copy halo from the opposite end of the local grid buffer.
+  /*!
+    Used for periodic accesses on a dimension that is not
+    decomposed, where the process is the peer of itself.
+    
+    \param dim Dimension to copy.
+    \param width Halo length.
+    \param fw True if the halo is for forward accesses.
+   */
+  virtual void CopyHaloPeriodic(int dim, unsigned width, bool fw);
+
  public:
   static GridMPI *Create(
       PSType type, int elm_size,
@@ -126,9 +229,50 @@ class GridMPI: public Grid {
   const IndexArray& local_real_size() const { return local_real_size_; }
   const Width2 &halo() const { return halo_; }
   bool HasHalo() const { return ! (halo_.fw == 0 && halo_.bw == 0); }  
+  //! Returns true if the local buffer is stored in bricks.
+  bool bricked() const { return local_num_bricks_[0] != 0; }
+  //! Returns true if the local buffer is stored in the SoA layout.
+  bool soa() const { return !member_layout_.empty(); }
+  //! Stores the points in the SoA layout.
+  /*!
+    Must be called before the grid is accessed as the local buffer is
+    reallocated.
+    
+    \param lanes Number of points interleaved per member. The whole
+    local buffer forms a single block if zero.
+    \param num_members Number of members of each point.
+    \param member_layout Pairs of the offset and size of each member.
+   */
+  void SetMemberLayout(int lanes, int num_members,
+                       const size_t *member_layout);
+  //! Returns true if the local buffer is the sub grid in the row-major order.
+  /*!
+    Otherwise, the sub grid is copied in and out with Copyin and
+    Copyout.
+   */
+  bool IsPacked() const { return !HasHalo() && !bricked() && !soa(); }
+  const IndexArray& local_real_offset() const { return local_real_offset_; }
+  //! Returns the handle passed to generated code.
+  __PSMPIGridInfo *info() { return &info_; }
+  //! Returns the grid object of a handle returned by info().
+  static GridMPI *FromInfo(void *p) {
+    return static_cast<GridMPI*>(static_cast<__PSMPIGridInfo*>(p)->grid);
+  }
   
   virtual int Reduce(PSReduceOp op, void *out);
 
+  //! Returns the bytes allocated for this grid in a category.
+  size_t GetMemoryUsage(MEMORY_CATEGORY cat) const;
+
+  //! Copies the local buffer including halo to info()->p1.
+  /*!
+    The copy is taken from the buffer pool as scratch for a sweep
+    that updates the grid out of place.
+   */
+  void Snapshot();
+  //! Releases the copy taken by Snapshot.
+  void ReleaseSnapshot();
+
   //! Copy out the grid data (w/o halo).
   /*!
     \param dst Destination buffer.
@@ -140,20 +284,37 @@ class GridMPI: public Grid {
    */
   virtual void Copyin(const void *src);
 
+  virtual void Set(const IndexArray &indices, const void *buf);
+  virtual void Get(const IndexArray &indices, void *buf);
+
   //! Get the address of an grid element.
   /*!
-    Keep definition here to make it inlined.
+    Keep definition here to make it inlined. Points in the SoA layout
+    have no single address.
     
     \param indices Position of the element.
     \return Address of the element.
    */
   void *GetAddress(const IndexArray &indices) {
+    PSAssert(!soa());
     IndexArray t = indices;
     t -= local_real_offset_;
+    if (bricked()) {
+      return (void*)(_data() + CalcBrickOffset(t) * elm_size());
+    }
     return (void*)(_data() +
                    GridCalcOffset3D(t, local_real_size_)
                    * elm_size());
   }
+
+  //! Get the offset of a position relative to the buffer in bricks.
+  PSIndex CalcBrickOffset(const IndexArray &t) const {
+    if (num_dims_ == 2) {
+      return __PSBrickOffset2D(t[0], t[1], local_num_bricks_[0]);
+    }
+    return __PSBrickOffset3D(t[0], t[1], t[2], local_num_bricks_[0],
+                             local_num_bricks_[1]);
+  }
   
   //! Get the offset of an grid element.
   /*!
@@ -162,6 +323,11 @@ class GridMPI: public Grid {
    */
   template <int dim>
   PSIndex CalcOffset(const IndexArray &indices) {
+    if (dim > 1 && bricked()) {
+      IndexArray t = indices;
+      t -= local_real_offset_;
+      return CalcBrickOffset(t);
+    }
     PSIndex off = indices[0] - local_real_offset_[0];
     if (dim > 1)
       off += (indices[1] - local_real_offset_[1]) * local_real_size_[0];
@@ -182,23 +348,9 @@ class GridMPI: public Grid {
    */
   template <int dim>
   PSIndex CalcOffsetPeriodic(const IndexArray &indices) {
-    PSIndex off =
-        local_size_[0] == size_[0] ? 
-        (indices[0] + size_[0]) % size_[0] :
-        indices[0] - local_real_offset_[0];
-    if (dim > 1)
-      off +=
-          (local_size_[1] == size_[1] ? 
-           (indices[1] + size_[1]) % size_[1] :
-           indices[1] - local_real_offset_[1])
-          * local_real_size_[0];
-    if (dim > 2)
-      off +=
-          (local_size_[2] == size_[2] ? 
-           (indices[2] + size_[2]) % size_[2] :
-           indices[2] - local_real_offset_[2])
-          * local_real_size_[0] * local_real_size_[1];
-    return off;
+    // The halo holds the wrapped-around points on every dimension
+    // of grids created with PS_GRID_ATTRIBUTE_PERIODIC.
+    return CalcOffset<dim>(indices);
   }
   
   //! Returns the size of the logical buffer area in bytes.
@@ -213,12 +365,20 @@ class GridMPI: public Grid {
 
   //! Returns the size of the actual buffer area in bytes.
   /*!
-    Does count the halo region.
+    Does count the halo region and the padding of partial bricks
+    and of the last block in the SoA layout.
     
     \return Size in bytes.
   */
   size_t GetLocalBufferRealSize() const {
-    return local_real_size_.accumulate(num_dims_) * elm_size_;
+    if (bricked()) {
+      return (local_num_bricks_ * PS_BRICK_WIDTH).accumulate(num_dims_)
+          * elm_size_;
+    }
+    size_t n = local_real_size_.accumulate(num_dims_);
+    // Pads the last block of lanes
+    if (soa()) n = (n + soa_lanes_ - 1) / soa_lanes_ * soa_lanes_;
+    return n * elm_size_;
   };
 };
 
@@ -425,7 +425,7 @@ GridMPICUDA3D *GridSpaceMPICUDA::CreateGrid(
 
   IndexArray local_offset, local_size;  
   PartitionGrid(num_dims, grid_size, grid_global_offset,
-                local_offset, local_size);
+                local_offset, local_size, attr);
 
   LOG_DEBUG() << "local_size: " << local_size << "\n";
   GridMPICUDA3D *g = GridMPICUDA3D::Create(type, elm_size, num_dims, grid_size,
@@ -717,7 +717,7 @@ void GridSpaceMPICUDA::HandleFetchRequest(GridRequest &req, GridMPI *g) {
   buf->EnsureCapacity(bytes);
   static_cast<BufferCUDADev3D*>(gm->buffer())->Copyout(
       *buf, finfo.peer_offset - g->local_offset(), finfo.peer_size);
-  SendGridRequest(my_rank_, req.my_rank, comm_, FETCH_REPLY);
+  SendGridRequest(my_rank_, req.my_rank, ipc_, FETCH_REPLY);
   MPI_Request mr;
   buf->MPIIsend(req.my_rank, comm_, &mr, IndexArray(), IndexArray(bytes));
   //CHECK_MPI(PS_MPI_Isend(buf, bytes, MPI_BYTE, req.my_rank, 0, comm_, &mr));
@@ -819,7 +819,7 @@ void GridSpaceMPIOpenCL::HandleFetchRequest(GridRequest &req, GridMPI *g) {
   buf->EnsureCapacity(bytes);
   static_cast<BufferOpenCLDev3D*>(gm->buffer())->Copyout(
       *buf, finfo.peer_offset - g->local_offset(), finfo.peer_size);
-  SendGridRequest(my_rank_, req.my_rank, comm_, FETCH_REPLY);
+  SendGridRequest(my_rank_, req.my_rank, ipc_, FETCH_REPLY);
   MPI_Request mr;
   buf->MPIIsend(req.my_rank, comm_, &mr, IntArray(), IntArray(bytes));
   //CHECK_MPI(PS_MPI_Isend(buf, bytes, MPI_BYTE, req.my_rank, 0, comm_, &mr));
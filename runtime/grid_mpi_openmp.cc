@@ -567,7 +567,7 @@ bool GridSpaceMPIOpenMP::SendFetchRequest(FetchInfo &finfo) const {
   int peer_rank = GetProcessRank(finfo.peer_index);
   size_t size = finfo.peer_size.accumulate(num_dims_);
   if (size == 0) return false; 
-  SendGridRequest(my_rank_, peer_rank, comm_, FETCH_REQUEST);
+  SendGridRequest(my_rank_, peer_rank, ipc_, FETCH_REQUEST);
   MPI_Request mpi_req;  
   CHECK_MPI(PS_MPI_Isend(&finfo, sizeof(FetchInfo), MPI_BYTE,
                          peer_rank, 0, comm_, &mpi_req));
@@ -601,7 +601,7 @@ void GridSpaceMPIOpenMP::HandleFetchRequest(GridRequest &req, GridMPI *g) {
       finfo.peer_size
                          );
 #endif
-  SendGridRequest(my_rank_, req.my_rank, comm_, FETCH_REPLY);
+  SendGridRequest(my_rank_, req.my_rank, ipc_, FETCH_REPLY);
   MPI_Request mr;
   CHECK_MPI(PS_MPI_Isend(buf, bytes, MPI_BYTE, req.my_rank, 0, comm_, &mr));
   return;
@@ -6,9 +6,14 @@
 
 #include "runtime/grid_space_mpi.h"
 
+#include <boost/bind.hpp>
+
 #include "runtime/mpi_util.h"
 #include "runtime/mpi_wrapper.h"
 #include "runtime/grid_mpi.h"
+#include "runtime/ipc_mpi.h"
+#include "runtime/buffer_pool.h"
+#include "runtime/timing.h"
 
 using namespace std;
 
@@ -27,6 +32,8 @@ std::ostream &GridSpaceMPI::Print(std::ostream &os) const {
      << ", size: " << my_size_
      << ", offset: " << my_offset_
      << ", #grids: " << grids_.size()
+     << ", #coarse levels: " << levels_.size()
+     << ", halo exchange time: " << halo_exchange_time_
      << "}";
   return os;
 }
@@ -36,12 +43,14 @@ std::ostream &GridSpaceMPI::Print(std::ostream &os) const {
 // num_procs: 6 = 1*1*6
 // size = global_size: {64, 64, 64}
 // num_partitions = proc_size: {1, 1, 6}
+// align: 1
 static void partition(int num_dims, int num_procs,
                       const IndexArray &size, 
                       const IntArray &num_partitions,
                       PSIndex **partitions, PSIndex **offsets,
                       std::vector<IntArray> &proc_indices,
-                      IndexArray &min_partition)  {
+                      IndexArray &min_partition,
+                      PSIndex align)  {
   for (int i = 0; i < num_procs; ++i) {
     IntArray pidx;
     for (int j = 0, t = i; j < num_dims; ++j) {
@@ -56,13 +65,22 @@ static void partition(int num_dims, int num_procs,
   for (int i = 0; i < num_dims; i++) {
     partitions[i] = new PSIndex[num_partitions[i]];
     offsets[i] = new PSIndex[num_partitions[i]];    
+    // Units of align points are distributed instead of points
+    PSIndex unit = align;
+    PSIndex num_units = (size[i] + unit - 1) / unit;
+    if (num_units < num_partitions[i]) {
+      unit = 1;
+      num_units = size[i];
+    }
     int offset = 0;
     for (int j = 0; j < num_partitions[i]; ++j) {
-      int rem = size[i] % num_partitions[i]; // <0, 0, 4>
-      partitions[i][j] = size[i] / num_partitions[i]; // {{64}, {64}, {10,10,10,10,10,10}}
+      int rem = num_units % num_partitions[i]; // <0, 0, 4>
+      partitions[i][j] = num_units / num_partitions[i]; // {{64}, {64}, {10,10,10,10,10,10}}
       if (num_partitions[i] - j <= rem) {
         ++partitions[i][j]; // {{64}, {64}, {10,10,11,11,11,11}}
       }
+      partitions[i][j] = std::min(partitions[i][j] * unit,
+                                  size[i] - offset);
       min_partition[i] = std::min(min_partition[i], partitions[i][j]); // {64,64,10}
       offsets[i][j] = offset;
       offset += partitions[i][j]; // {{0}, {0}, {0,10,20,31,42,53}}
@@ -79,10 +97,15 @@ static void partition(int num_dims, int num_procs,
 // proc_size: {1, 1, 6}
 GridSpaceMPI::GridSpaceMPI(int num_dims, const IndexArray &global_size,
                            int proc_num_dims, const IntArray &proc_size,
-                           int my_rank):
+                           int my_rank, InterProcComm *ipc,
+                           PSIndex partition_align):
     num_dims_(num_dims), global_size_(global_size),
     proc_num_dims_(proc_num_dims), proc_size_(proc_size),
-    my_rank_(my_rank), buf(NULL), cur_buf_size(0) {
+    my_rank_(my_rank), ipc_(ipc), halo_exchange_time_(0.0),
+    periodic_grids_(false), active_region_set_(false) {
+  if (ipc_ == NULL) {
+    ipc_ = InterProcCommMPI::GetInstance();
+  }
   assert(num_dims_ == proc_num_dims_);
   
   num_procs_ = proc_size_.accumulate(proc_num_dims_); // For example 6
@@ -91,7 +114,8 @@ GridSpaceMPI::GridSpaceMPI(int num_dims, const IndexArray &global_size,
   offsets_ = new PSIndex*[num_dims_];
   
   partition(num_dims_, num_procs_, global_size_, proc_size_,
-            partitions_, offsets_, proc_indices_, min_partition_);
+            partitions_, offsets_, proc_indices_, min_partition_,
+            partition_align);
 
   my_idx_ = proc_indices_[my_rank_]; // Usually {0,0, my_rank_}
   
@@ -117,19 +141,225 @@ GridSpaceMPI::GridSpaceMPI(int num_dims, const IndexArray &global_size,
 }
 
 GridSpaceMPI::~GridSpaceMPI() {
-  FREE(buf);
+  FOREACH (it, levels_.begin(), levels_.end()) {
+    GridSpaceLevel *lv = *it;
+    for (int i = 0; i < num_dims_; ++i) {
+      delete[] lv->partitions[i];
+      delete[] lv->offsets[i];
+    }
+    delete lv;
+  }
+}
+
+// For example
+// global_size: {64, 64, 64}
+// offsets: {{0}, {0}, {0,10,20,31,42,53}}
+// size: {32, 32, 32}
+// ratio: {2, 2, 2}
+// offsets of the level: {{0}, {0}, {0,5,10,16,21,27}}
+const GridSpaceLevel *GridSpaceMPI::GetLevel(const IndexArray &size) {
+  IntArray ratio;
+  ratio.Set(1);
+  for (int i = 0; i < num_dims_; ++i) {
+    if (size[i] > 0) {
+      ratio[i] = (global_size_[i] + size[i] - 1) / size[i];
+    }
+    if (size[i] <= 0 ||
+        (global_size_[i] + ratio[i] - 1) / ratio[i] != size[i]) {
+      LOG_ERROR() << "Grid size " << size
+                  << " is not a coarsening of the grid space ("
+                  << global_size_ << ")\n";
+      PSAbort(1);
+    }
+  }
+  FOREACH (it, levels_.begin(), levels_.end()) {
+    if ((*it)->ratio == ratio) return *it;
+  }
+  GridSpaceLevel *lv = new GridSpaceLevel;
+  lv->ratio = ratio;
+  lv->global_size = size;
+  for (int i = 0; i < num_dims_; ++i) {
+    lv->partitions[i] = new PSIndex[proc_size_[i]];
+    lv->offsets[i] = new PSIndex[proc_size_[i]];
+    // Coarse point j is owned by the owner of fine point j*ratio
+    for (int j = 0; j < proc_size_[i]; ++j) {
+      PSIndex fine_end = offsets_[i][j] + partitions_[i][j];
+      lv->offsets[i][j] = (offsets_[i][j] + ratio[i] - 1) / ratio[i];
+      lv->partitions[i][j] =
+          (fine_end + ratio[i] - 1) / ratio[i] - lv->offsets[i][j];
+      // Halo exchanges assume every process has its part
+      if (lv->partitions[i][j] == 0) {
+        LOG_ERROR() << "Coarse grid size " << size
+                    << " leaves process " << j << " of dimension " << i
+                    << " empty; use fewer processes\n";
+        PSAbort(1);
+      }
+    }
+    lv->my_offset[i] = lv->offsets[i][my_idx_[i]];
+    lv->my_size[i] = lv->partitions[i][my_idx_[i]];
+  }
+  LOG_DEBUG() << "Coarse level with ratio " << ratio
+              << "; offset: " << lv->my_offset
+              << ", size: " << lv->my_size << "\n";
+  levels_.push_back(lv);
+  return lv;
+}
+
+const GridSpaceLevel *GridSpaceMPI::FindLevel(const GridMPI *g) const {
+  if (!g->AttributeSet(PS_GRID_ATTRIBUTE_COARSE)) return NULL;
+  FOREACH (it, levels_.begin(), levels_.end()) {
+    if ((*it)->global_size == g->size()) return *it;
+  }
+  // Created along with the grid
+  PSAssert(0);
+  return NULL;
+}
+
+// For example
+// offsets: {{0}, {0}, {0,10,20,31,42,53}}
+// region: {0, 0, 0} - {64, 64, 8}
+// stencil_width: {1, 1, 1}
+// active processes: {0, 0, 0} - {1, 1, 1}
+bool GridSpaceMPI::SetActiveRegion(const IndexArray &region_min,
+                                   const IndexArray &region_max) {
+  active_region_set_ = false;
+  // Periodic halos wrap around the region, and coarse grids are
+  // partitioned differently
+  if (periodic_grids_ || levels_.size()) return true;
+  for (int i = 0; i < num_dims_; ++i) {
+    PSIndex min = region_min[i] - (PSIndex)stencil_width_.bw[i];
+    PSIndex max = region_max[i] + (PSIndex)stencil_width_.fw[i];
+    active_min_[i] = proc_size_[i];
+    active_max_[i] = 0;
+    if (region_min[i] >= region_max[i]) continue;
+    for (int j = 0; j < proc_size_[i]; ++j) {
+      if (offsets_[i][j] < max && min < offsets_[i][j] + partitions_[i][j]) {
+        active_min_[i] = std::min(active_min_[i], j);
+        active_max_[i] = j + 1;
+      }
+    }
+  }
+  active_region_set_ = true;
+  bool active = true;
+  for (int i = 0; i < num_dims_; ++i) {
+    active &= active_min_[i] <= my_idx_[i] && my_idx_[i] < active_max_[i];
+  }
+  LOG_DEBUG() << "Active processes: " << active_min_ << " - "
+              << active_max_ << (active ? "" : "; idle") << "\n";
+  return active;
+}
+
+// Tests if the point of a mask grid has any nonzero byte.
+static bool IsMaskPointActive(GridMPI *mask, const IndexArray &idx) {
+  const char *p = (const char*)mask->GetAddress(idx);
+  for (int i = 0; i < mask->elm_size(); ++i) {
+    if (p[i]) return true;
+  }
+  return false;
+}
+
+int GridSpaceMPI::MaskDomain(const __PSDomain &dom, GridMPI *mask) {
+  IndexArray local_min = my_offset_;
+  local_min.SetNoLessThan(IndexArray(dom.min));
+  IndexArray local_max = my_offset_ + my_size_;
+  local_max.SetNoMoreThan(IndexArray(dom.max));
+  if (mask->empty()) local_max = local_min;
+  // Bricks of the brick layout start at the local offset
+  BrickList *bl = new BrickList(num_dims_, local_min, local_max,
+                                my_offset_,
+                                boost::bind(IsMaskPointActive, mask, _1));
+  // Handles agree since all processes register in the same order
+  int handle = RegisterBrickList(bl);
+
+  // Bounding box of the active bricks of all processes. The bounds
+  // of processes without active bricks are PSINDEX_MAX and
+  // PSINDEX_MIN, so they are not negated to reduce both at once.
+  long min[PS_MAX_DIM], max[PS_MAX_DIM];
+  long global_box[PS_MAX_DIM * 2];
+  for (int i = 0; i < PS_MAX_DIM; ++i) {
+    min[i] = bl->active_min()[i];
+    max[i] = bl->active_max()[i];
+  }
+  ipc_->Reduce(min, global_box, PS_MAX_DIM, PS_LONG, PS_MIN, 0);
+  ipc_->Reduce(max, global_box + PS_MAX_DIM, PS_MAX_DIM, PS_LONG,
+               PS_MAX, 0);
+  ipc_->Bcast(global_box, sizeof(global_box), 0);
+  IndexArray global_min, global_max;
+  for (int i = 0; i < PS_MAX_DIM; ++i) {
+    global_min[i] = (PSIndex)global_box[i];
+    global_max[i] = (PSIndex)global_box[PS_MAX_DIM + i];
+  }
+  bl->SetGlobalActiveRegion(global_min, global_max);
+
+  // For example, with stencil widths of one, a process owning
+  // [8, 16) in a dimension needs the backward halo if it has an
+  // active brick starting at 8, and the forward halo if it has one
+  // ending at 16.
+  MaskedHalo &mh = masked_halos_[handle];
+  mh.width = stencil_width_;
+  std::vector<int> needs(num_procs_ * PS_MAX_DIM * 2, 0);
+  for (int b = 0; b < bl->num_bricks(); ++b) {
+    for (int i = 0; i < num_dims_; ++i) {
+      int *n = &needs[(my_rank_ * PS_MAX_DIM + i) * 2];
+      if (bl->brick_min(b)[i] < my_offset_[i] + (PSIndex)mh.width.bw[i]) {
+        n[0] = 1;
+      }
+      if (bl->brick_max(b)[i] >
+          my_offset_[i] + my_size_[i] - (PSIndex)mh.width.fw[i]) {
+        n[1] = 1;
+      }
+    }
+  }
+  mh.needs.resize(needs.size());
+  ipc_->Reduce(&needs[0], &mh.needs[0], needs.size(), PS_INT, PS_MAX, 0);
+  ipc_->Bcast(&mh.needs[0], mh.needs.size() * sizeof(int), 0);
+  LOG_DEBUG() << "Masked domain " << handle << ": " << *bl << "\n";
+  return handle;
+}
+
+void GridSpaceMPI::SetActiveMasks(const std::vector<int> &masks) {
+  halo_needs_.clear();
+  if (!active_region_set_ || masks.empty()) return;
+  std::vector<int> needs(num_procs_ * PS_MAX_DIM * 2, 0);
+  FOREACH (it, masks.begin(), masks.end()) {
+    std::map<int, MaskedHalo>::const_iterator mit = masked_halos_.find(*it);
+    // Unmasked stencils read all the halos
+    if (mit == masked_halos_.end()) return;
+    const MaskedHalo &mh = mit->second;
+    // Grids with wider halos are created after the mask
+    if (!(mh.width.bw == stencil_width_.bw &&
+          mh.width.fw == stencil_width_.fw)) return;
+    for (size_t i = 0; i < needs.size(); ++i) {
+      needs[i] |= mh.needs[i];
+    }
+  }
+  halo_needs_.swap(needs);
+}
+
+bool GridSpaceMPI::NeedsHalo(int rank, int dim, bool fw,
+                             bool diagonal) const {
+  if (halo_needs_.empty() || diagonal) return true;
+  return halo_needs_[(rank * PS_MAX_DIM + dim) * 2 + (fw ? 1 : 0)];
 }
 
 void GridSpaceMPI::PartitionGrid(int num_dims, const IndexArray &size,
                                  const IndexArray &global_offset,
                                  IndexArray &local_offset,
-                                 IndexArray &local_size) {
+                                 IndexArray &local_size,
+                                 int attr) {
+  IndexArray my_offset = my_offset_;
+  IndexArray my_size = my_size_;
+  if (attr & PS_GRID_ATTRIBUTE_COARSE) {
+    const GridSpaceLevel *lv = GetLevel(size);
+    my_offset = lv->my_offset;
+    my_size = lv->my_size;
+  }
   for (int i = 0; i < num_dims; ++i) {
     local_offset[i] =
-        std::max(my_offset_[i] - global_offset[i], (PSIndex)0);
-    PSIndex first = std::max(my_offset_[i], global_offset[i]);
+        std::max(my_offset[i] - global_offset[i], (PSIndex)0);
+    PSIndex first = std::max(my_offset[i], global_offset[i]);
     PSIndex last = std::min(global_offset[i] + size[i],
-                        my_offset_[i] + my_size_[i]);
+                        my_offset[i] + my_size[i]);
     local_size[i] = std::max(last - first, (PSIndex)0);
   }
   return;
@@ -153,7 +383,7 @@ GridMPI *GridSpaceMPI::CreateGrid(PSType type, int elm_size, int num_dims,
 
   IndexArray local_offset, local_size;  
   PartitionGrid(num_dims, grid_size, grid_global_offset,
-                local_offset, local_size);
+                local_offset, local_size, attr);
 
   LOG_DEBUG() << "local_size: " << local_size << "\n";
   LOG_DEBUG() << "stencil_offset_min: "
@@ -164,8 +394,21 @@ GridMPI *GridSpaceMPI::CreateGrid(PSType type, int elm_size, int num_dims,
   IndexArray halo_fw = stencil_offset_max;
   IndexArray halo_bw = stencil_offset_min;  
   halo_bw = halo_bw * -1;
+  // Same on all processes unlike the halo below
+  for (int i = 0; i < num_dims_; ++i) {
+    if (halo_bw[i] > (PSIndex)stencil_width_.bw[i]) {
+      stencil_width_.bw[i] = halo_bw[i];
+    }
+    if (halo_fw[i] > (PSIndex)stencil_width_.fw[i]) {
+      stencil_width_.fw[i] = halo_fw[i];
+    }
+  }
+  // Periodic grids keep the halo on undecomposed dimensions too so
+  // that wrapped-around points are accessed without index arithmetic
+  bool periodic = (attr & PS_GRID_ATTRIBUTE_PERIODIC) != 0;
+  periodic_grids_ |= periodic;
   for (int i = 0; i < num_dims_; ++i) {
-    if (local_size[i] == 0 || proc_size()[i] == 1) {
+    if (local_size[i] == 0 || (proc_size()[i] == 1 && !periodic)) {
       halo_bw[i] = 0;
       halo_fw[i] = 0;
     }
@@ -185,17 +428,41 @@ GridMPI *GridSpaceMPI::CreateGrid(PSType type, int elm_size, int num_dims,
   return g;
 }
 
+// Note: If no decomposition is done for this dimension, periodic
+// access has no peer; its halo is filled locally by
+// ExchangeBoundaries.
+bool GridSpaceMPI::HasHaloPeer(const GridMPI *grid, int dim, bool fw,
+                               bool periodic) const {
+  if (active_region_set_) {
+    int peer = my_idx_[dim] + (fw ? 1 : -1);
+    if (peer < active_min_[dim] || peer >= active_max_[dim]) return false;
+  }
+  if (periodic && proc_size_[dim] > 1) return true;
+  if (fw) {
+    return grid->local_offset()[dim] + grid->local_size()[dim]
+        < grid->size_[dim];
+  } else {
+    return grid->local_offset()[dim] > 0;
+  }
+}
+
 // Note: width is unsigned. 
 void GridSpaceMPI::ExchangeBoundariesAsync(
     GridMPI *grid, int dim, unsigned halo_fw_width, unsigned halo_bw_width,
     bool diagonal, bool periodic,
-    std::vector<MPI_Request> &requests) const {
+    std::vector<void*> &requests) const {
   
   if (grid->empty()) return;
 
+  // Buffers are needed only if there is a peer to exchange with
+  if (HasHaloPeer(grid, dim, true, periodic) ||
+      HasHaloPeer(grid, dim, false, periodic)) {
+    grid->ResizeHaloBuffers(dim, true, halo_fw_width);
+    grid->ResizeHaloBuffers(dim, false, halo_bw_width);
+  }
+
   int fw_peer = fw_neighbors_[dim];
   int bw_peer = bw_neighbors_[dim];
-  int tag = 0;
   size_t fw_size = grid->CalcHaloSize(dim, halo_fw_width)
       * grid->elm_size_;
   size_t bw_size = grid->CalcHaloSize(dim, halo_bw_width)
@@ -208,40 +475,31 @@ void GridSpaceMPI::ExchangeBoundariesAsync(
     forward access, and then the halo for the backward access.
    */
 
-  // Note: If no decomposition is done for this dimension, periodic
-  // access is implemented without halo buffer, but with wrap-around
-  // offsets. 
-  if (halo_fw_width > 0 &&
-      (grid->local_offset()[dim] + grid->local_size()[dim]
-       < grid->size_[dim] ||
-       (periodic && proc_size_[dim] > 1))) {
+  if (halo_fw_width > 0 && HasHaloPeer(grid, dim, true, periodic) &&
+      NeedsHalo(my_rank_, dim, true, diagonal)) {
     LOG_DEBUG() << "[" << my_rank_ << "] "
                 << "Receiving halo of " << fw_size
                 << " bytes for fw access from " << fw_peer << "\n";
-    MPI_Request req;
-    CHECK_MPI(MPI_Irecv(
-        grid->GetHaloPeerBuf(dim, true, halo_fw_width),
-        fw_size, MPI_BYTE, fw_peer, tag, comm_, &req));
+    void *req = ipc_->CreateRequest();
+    ipc_->Irecv(grid->GetHaloPeerBuf(dim, true, halo_fw_width),
+                fw_size, fw_peer, req);
     requests.push_back(req);
   }
 
-  if (halo_bw_width > 0 &&
-      (grid->local_offset()[dim] > 0 ||
-       (periodic && proc_size_[dim] > 1))) {
+  if (halo_bw_width > 0 && HasHaloPeer(grid, dim, false, periodic) &&
+      NeedsHalo(my_rank_, dim, false, diagonal)) {
     LOG_DEBUG() << "[" << my_rank_ << "] "
                 << "Receiving halo of " << bw_size
                 << " bytes for bw access from " << bw_peer << "\n";
-    MPI_Request req;
-    CHECK_MPI(MPI_Irecv(
-        grid->GetHaloPeerBuf(dim, false, halo_bw_width),
-        bw_size, MPI_BYTE, bw_peer, tag, comm_, &req));
+    void *req = ipc_->CreateRequest();
+    ipc_->Irecv(grid->GetHaloPeerBuf(dim, false, halo_bw_width),
+                bw_size, bw_peer, req);
     requests.push_back(req);
   }
 
   // Sends out the halo for forward access
-  if (halo_fw_width > 0 &&
-      (grid->local_offset()[dim] > 0 ||
-       (periodic && proc_size_[dim] > 1))) {
+  if (halo_fw_width > 0 && HasHaloPeer(grid, dim, false, periodic) &&
+      NeedsHalo(bw_peer, dim, true, diagonal)) {
     LOG_DEBUG() << "[" << my_rank_ << "] "
                 << "Sending halo of " << fw_size << " bytes"
                 << " for fw access to " << bw_peer << "\n";
@@ -249,26 +507,24 @@ void GridSpaceMPI::ExchangeBoundariesAsync(
     grid->CopyoutHalo(dim, halo_fw_width, true, diagonal);
     LOG_DEBUG() << "grid2: " << (void*)(grid->_data()) << "\n";
     LOG_DEBUG() << "dim: " << dim << "\n";        
-    MPI_Request req;
     LOG_DEBUG() << "send buf: " <<
         (void*)(grid->halo_self_fw_[dim])
                 << "\n";        
-    CHECK_MPI(PS_MPI_Isend(grid->halo_self_fw_[dim], fw_size, MPI_BYTE,
-                           bw_peer, tag, comm_, &req));
+    void *req = ipc_->CreateRequest();
+    ipc_->Isend(grid->halo_self_fw_[dim], fw_size, bw_peer, req);
+    requests.push_back(req);
   }
 
    // Sends out the halo for backward access
-  if (halo_bw_width > 0 &&
-      (grid->local_offset()[dim] + grid->local_size()[dim]
-       < grid->size_[dim] ||
-       (periodic && proc_size_[dim] > 1))) {
+  if (halo_bw_width > 0 && HasHaloPeer(grid, dim, true, periodic) &&
+      NeedsHalo(fw_peer, dim, false, diagonal)) {
     LOG_DEBUG() << "[" << my_rank_ << "] "
                 << "Sending halo of " << bw_size << " bytes"
                 << " for bw access to " << fw_peer << "\n";
     grid->CopyoutHalo(dim, halo_bw_width, false, diagonal);
-    MPI_Request req;
-    CHECK_MPI(PS_MPI_Isend(grid->halo_self_bw_[dim], bw_size, MPI_BYTE,
-                           fw_peer, tag, comm_, &req));
+    void *req = ipc_->CreateRequest();
+    ipc_->Isend(grid->halo_self_bw_[dim], bw_size, fw_peer, req);
+    requests.push_back(req);
   }
 
   return;
@@ -280,19 +536,156 @@ void GridSpaceMPI::ExchangeBoundaries(GridMPI *grid,
                                       unsigned halo_bw_width,
                                       bool diagonal,
                                       bool periodic) const {
-  std::vector<MPI_Request> requests;
+  if (periodic && proc_size_[dim] == 1) {
+    WrapAroundBoundaries(grid, dim, halo_fw_width, halo_bw_width);
+    return;
+  }
+  std::vector<void*> requests;
   ExchangeBoundariesAsync(grid, dim, halo_fw_width,
                           halo_bw_width, diagonal,
                           periodic, requests);
   FOREACH (it, requests.begin(), requests.end()) {
-    MPI_Request *req = &(*it);
-    CHECK_MPI(MPI_Wait(req, MPI_STATUS_IGNORE));
+    ipc_->Wait(*it);
+    ipc_->DeleteRequest(*it);
+  }
+  if (grid->empty()) return;
+  if (halo_bw_width > 0 && HasHaloPeer(grid, dim, false, periodic) &&
+      NeedsHalo(my_rank_, dim, false, diagonal)) {
     grid->CopyinHalo(dim, halo_bw_width, false, diagonal);
+  }
+  if (halo_fw_width > 0 && HasHaloPeer(grid, dim, true, periodic) &&
+      NeedsHalo(my_rank_, dim, true, diagonal)) {
     grid->CopyinHalo(dim, halo_fw_width, true, diagonal);
   }
   return;
 }
 
+void GridSpaceMPI::WrapAroundBoundaries(GridMPI *grid, int dim,
+                                        unsigned halo_fw_width,
+                                        unsigned halo_bw_width) const {
+  if (grid->empty()) return;
+  if (grid->halo().fw[dim] < halo_fw_width ||
+      grid->halo().bw[dim] < halo_bw_width) {
+    LOG_ERROR() << "Periodic access to grid " << grid->id()
+                << " without halo on dimension " << dim
+                << "; the grid must be created with "
+                << "PS_GRID_ATTRIBUTE_PERIODIC\n";
+    PSAbort(1);
+  }
+  if (halo_fw_width > 0) grid->CopyHaloPeriodic(dim, halo_fw_width, true);
+  if (halo_bw_width > 0) grid->CopyHaloPeriodic(dim, halo_bw_width, false);
+}
+
+void GridSpaceMPI::ExchangeBoundariesMembers(
+    GridMPI *grid, int dim, const std::vector<MemberHalo> &members,
+    bool diagonal, bool periodic) const {
+  if (grid->empty()) return;
+  unsigned halo_fw_width = 0, halo_bw_width = 0;
+  size_t fw_size = 0, bw_size = 0;
+  FOREACH (it, members.begin(), members.end()) {
+    halo_fw_width = std::max(halo_fw_width, it->width.fw[dim]);
+    halo_bw_width = std::max(halo_bw_width, it->width.bw[dim]);
+    fw_size += grid->CalcHaloSize(dim, it->width.fw[dim]) * it->size;
+    bw_size += grid->CalcHaloSize(dim, it->width.bw[dim]) * it->size;
+  }
+  // Whole points are copied since no packing is needed locally
+  if (periodic && proc_size_[dim] == 1) {
+    WrapAroundBoundaries(grid, dim, halo_fw_width, halo_bw_width);
+    return;
+  }
+
+  int fw_peer = fw_neighbors_[dim];
+  int bw_peer = bw_neighbors_[dim];
+  bool has_fw_peer = HasHaloPeer(grid, dim, true, periodic);
+  bool has_bw_peer = HasHaloPeer(grid, dim, false, periodic);
+  bool recv_fw = halo_fw_width > 0 && has_fw_peer &&
+      NeedsHalo(my_rank_, dim, true, diagonal);
+  bool recv_bw = halo_bw_width > 0 && has_bw_peer &&
+      NeedsHalo(my_rank_, dim, false, diagonal);
+  bool send_fw = halo_fw_width > 0 && has_bw_peer &&
+      NeedsHalo(bw_peer, dim, true, diagonal);
+  bool send_bw = halo_bw_width > 0 && has_fw_peer &&
+      NeedsHalo(fw_peer, dim, false, diagonal);
+
+  // Members are packed even for the last dimension since they are
+  // not continuous in the grid buffer. All the members to a
+  // neighbor go in a single message, one after another.
+  char *fw_recv_buf = (char*)(recv_fw ? PoolAllocate(fw_size) : NULL);
+  char *bw_recv_buf = (char*)(recv_bw ? PoolAllocate(bw_size) : NULL);
+  char *fw_send_buf = (char*)(send_fw ? PoolAllocate(fw_size) : NULL);
+  char *bw_send_buf = (char*)(send_bw ? PoolAllocate(bw_size) : NULL);
+  std::vector<void*> requests;
+
+  if (recv_fw) {
+    void *req = ipc_->CreateRequest();
+    ipc_->Irecv(fw_recv_buf, fw_size, fw_peer, req);
+    requests.push_back(req);
+  }
+  if (recv_bw) {
+    void *req = ipc_->CreateRequest();
+    ipc_->Irecv(bw_recv_buf, bw_size, bw_peer, req);
+    requests.push_back(req);
+  }
+  if (send_fw) {
+    LOG_DEBUG() << "[" << my_rank_ << "] "
+                << "Sending halo of " << members.size() << " members in "
+                << fw_size << " bytes for fw access to " << bw_peer << "\n";
+    char *p = fw_send_buf;
+    FOREACH (it, members.begin(), members.end()) {
+      unsigned width = it->width.fw[dim];
+      if (width == 0) continue;
+      grid->CopyoutHaloMember(dim, width, true, it->offset, it->size, p);
+      p += grid->CalcHaloSize(dim, width) * it->size;
+    }
+    void *req = ipc_->CreateRequest();
+    ipc_->Isend(fw_send_buf, fw_size, bw_peer, req);
+    requests.push_back(req);
+  }
+  if (send_bw) {
+    LOG_DEBUG() << "[" << my_rank_ << "] "
+                << "Sending halo of " << members.size() << " members in "
+                << bw_size << " bytes for bw access to " << fw_peer << "\n";
+    char *p = bw_send_buf;
+    FOREACH (it, members.begin(), members.end()) {
+      unsigned width = it->width.bw[dim];
+      if (width == 0) continue;
+      grid->CopyoutHaloMember(dim, width, false, it->offset, it->size, p);
+      p += grid->CalcHaloSize(dim, width) * it->size;
+    }
+    void *req = ipc_->CreateRequest();
+    ipc_->Isend(bw_send_buf, bw_size, fw_peer, req);
+    requests.push_back(req);
+  }
+
+  FOREACH (it, requests.begin(), requests.end()) {
+    ipc_->Wait(*it);
+    ipc_->DeleteRequest(*it);
+  }
+  if (recv_bw) {
+    char *p = bw_recv_buf;
+    FOREACH (it, members.begin(), members.end()) {
+      unsigned width = it->width.bw[dim];
+      if (width == 0) continue;
+      grid->CopyinHaloMember(dim, width, false, it->offset, it->size, p);
+      p += grid->CalcHaloSize(dim, width) * it->size;
+    }
+  }
+  if (recv_fw) {
+    char *p = fw_recv_buf;
+    FOREACH (it, members.begin(), members.end()) {
+      unsigned width = it->width.fw[dim];
+      if (width == 0) continue;
+      grid->CopyinHaloMember(dim, width, true, it->offset, it->size, p);
+      p += grid->CalcHaloSize(dim, width) * it->size;
+    }
+  }
+  PoolFree(fw_recv_buf);
+  PoolFree(bw_recv_buf);
+  PoolFree(fw_send_buf);
+  PoolFree(bw_send_buf);
+  return;
+}
+
 #if 0
 void GridSpaceMPI::ExchangeBoundariesAsync(
     int grid_id,  const UnsignedArray &halo_fw_width,
@@ -317,12 +710,10 @@ void GridSpaceMPI::ExchangeBoundariesAsync(
 }
 #endif
 
-// TODO: reuse is used?
 void GridSpaceMPI::ExchangeBoundaries(int grid_id,
                                       const Width2 &halo_width,
                                       bool diagonal,
-                                      bool periodic, 
-                                      bool reuse) const {
+                                      bool periodic) const {
   LOG_DEBUG() << "GridSpaceMPI::ExchangeBoundaries\n";
 
   GridMPI *g = static_cast<GridMPI*>(FindGrid(grid_id));
@@ -335,32 +726,21 @@ void GridSpaceMPI::ExchangeBoundaries(int grid_id,
 }
 
 void SendGridRequest(int my_rank, int peer_rank,
-                     MPI_Comm comm,
+                     InterProcComm *ipc,
                      GRID_REQUEST_KIND kind) {
   LOG_DEBUG() << "Sending request " << kind << " to " << peer_rank << "\n";
   GridRequest req(my_rank, kind);
-  MPI_Request mpi_req;
-  CHECK_MPI(PS_MPI_Isend(&req, sizeof(GridRequest), MPI_BYTE,
-                      peer_rank, 0, comm, &mpi_req));
+  ipc->Send(&req, sizeof(GridRequest), peer_rank,
+            InterProcComm::TAG_REQUEST);
 }
 
-GridRequest RecvGridRequest(MPI_Comm comm) {
+GridRequest RecvGridRequest(InterProcComm *ipc) {
   GridRequest req;
-  CHECK_MPI(MPI_Recv(&req, sizeof(GridRequest), MPI_BYTE, MPI_ANY_SOURCE, 0,
-                     comm, MPI_STATUS_IGNORE));
+  ipc->Recv(&req, sizeof(GridRequest), InterProcComm::ANY_SOURCE,
+            InterProcComm::TAG_REQUEST);
   return req;
 }
 
-static void *ensure_buffer_capacity(void *buf, size_t cur_size,
-                                    size_t required_size) {
-  if (cur_size < required_size) {
-    FREE(buf);
-    cur_size = required_size;
-    buf = malloc(cur_size);
-  }
-  return buf;
-}
-
 void GridSpaceMPI::CollectPerProcSubgridInfo(
     const GridMPI *g,  const IndexArray &grid_offset,
     const IndexArray &grid_size,
@@ -371,10 +751,17 @@ void GridSpaceMPI::CollectPerProcSubgridInfo(
   std::vector<FetchInfo> *fetch_info_next = new std::vector<FetchInfo>;
   FetchInfo dummy;
   fetch_info->push_back(dummy);
+  PSIndex *const *offsets = offsets_;
+  PSIndex *const *partitions = partitions_;
+  const GridSpaceLevel *lv = FindLevel(g);
+  if (lv) {
+    offsets = lv->offsets;
+    partitions = lv->partitions;
+  }
   for (int d = 0; d < num_dims_; ++d) {
     PSIndex x = grid_offset[d] + g->global_offset_[d];
     for (int pidx = 0; pidx < proc_size_[d] && x < grid_lim[d]; ++pidx) {
-      if (x < offsets_[d][pidx] + partitions_[d][pidx]) {
+      if (x < offsets[d][pidx] + partitions[d][pidx]) {
         LOG_VERBOSE_MPI() << "inclusion: " << pidx
                           << ", dim: " << d << "\n";
         FOREACH (it, fetch_info->begin(), fetch_info->end()) {
@@ -385,11 +772,11 @@ void GridSpaceMPI::CollectPerProcSubgridInfo(
           info.peer_offset[d] = x - g->global_offset_[d];
           // peer size
           info.peer_size[d] =
-              std::min(offsets_[d][pidx] + partitions_[d][pidx] - x,
+              std::min(offsets[d][pidx] + partitions[d][pidx] - x,
                        grid_lim[d] - x);
           fetch_info_next->push_back(info);
         }
-        x = offsets_[d][pidx] + partitions_[d][pidx];
+        x = offsets[d][pidx] + partitions[d][pidx];
       }
     }
     std::swap(fetch_info, fetch_info_next);
@@ -413,10 +800,8 @@ bool GridSpaceMPI::SendFetchRequest(FetchInfo &finfo) const {
   int peer_rank = GetProcessRank(finfo.peer_index);
   size_t size = finfo.peer_size.accumulate(num_dims_);
   if (size == 0) return false; 
-  SendGridRequest(my_rank_, peer_rank, comm_, FETCH_REQUEST);
-  MPI_Request mpi_req;  
-  CHECK_MPI(PS_MPI_Isend(&finfo, sizeof(FetchInfo), MPI_BYTE,
-                      peer_rank, 0, comm_, &mpi_req));
+  SendGridRequest(my_rank_, peer_rank, ipc_, FETCH_REQUEST);
+  ipc_->Send(&finfo, sizeof(FetchInfo), peer_rank);
   return true;
 }
 
@@ -424,16 +809,14 @@ void GridSpaceMPI::HandleFetchRequest(GridRequest &req, GridMPI *g) {
   LOG_DEBUG() << "HandleFetchRequest\n";
   FetchInfo finfo;
   int nd = num_dims_;
-  CHECK_MPI(MPI_Recv(&finfo, sizeof(FetchInfo), MPI_BYTE,
-                     req.my_rank, 0, comm_, MPI_STATUS_IGNORE));
+  ipc_->Recv(&finfo, sizeof(FetchInfo), req.my_rank);
   size_t bytes = finfo.peer_size.accumulate(nd) * g->elm_size();
-  buf = ensure_buffer_capacity(buf, cur_buf_size, bytes);
-  CopyoutSubgrid(g->elm_size(), nd, g->_data(), g->local_size(),
-                 buf, finfo.peer_offset - g->local_offset(),
-                 finfo.peer_size);
-  SendGridRequest(my_rank_, req.my_rank, comm_, FETCH_REPLY);
-  MPI_Request mr;
-  CHECK_MPI(PS_MPI_Isend(buf, bytes, MPI_BYTE, req.my_rank, 0, comm_, &mr));
+  void *buf = PoolAllocate(bytes);
+  g->CopyoutLocalSubgrid(buf, finfo.peer_offset - g->local_real_offset(),
+                         finfo.peer_size);
+  SendGridRequest(my_rank_, req.my_rank, ipc_, FETCH_REPLY);
+  ipc_->Send(buf, bytes, req.my_rank);
+  PoolFree(buf);
   return;
 }
 
@@ -445,14 +828,13 @@ void GridSpaceMPI::HandleFetchReply(GridRequest &req, GridMPI *g,
   PSAssert(GetProcessRank(finfo.peer_index) == req.my_rank);
   size_t bytes = finfo.peer_size.accumulate(num_dims_) * g->elm_size();
   LOG_DEBUG() << "Fetch reply data size: " << bytes << "\n";
-  buf = ensure_buffer_capacity(buf, cur_buf_size, bytes);
-  CHECK_MPI(MPI_Recv(buf, bytes, MPI_BYTE, req.my_rank, 0,
-                     comm_, MPI_STATUS_IGNORE));
+  void *buf = PoolAllocate(bytes);
+  ipc_->Recv(buf, bytes, req.my_rank);
   LOG_DEBUG() << "Fetch reply received\n";
-  CopyinSubgrid(sg->elm_size(), num_dims_, sg->_data(),
-                sg->local_size(), buf,
-                finfo.peer_offset - sg->local_offset(), finfo.peer_size);
-  return;;
+  sg->CopyinLocalSubgrid(buf, finfo.peer_offset - sg->local_real_offset(),
+                         finfo.peer_size);
+  PoolFree(buf);
+  return;
 }
 
 int GridSpaceMPI::GetProcessRank(const IntArray &proc_index) const {
@@ -471,15 +853,84 @@ GridMPI *GridSpaceMPI::LoadNeighbor(GridMPI *g,
                                     bool diagonal,
                                     bool reuse,
                                     bool periodic) {
+  // The halo is not modified since the last exchange
+  if (reuse) return NULL;
   Width2 hw;
   for (int i = 0; i < PS_MAX_DIM; ++i) {
     hw.bw[i] = (offset_min[i] <= 0) ? (unsigned)(abs(offset_min[i])) : 0;
     hw.fw[i] = (offset_max[i] >= 0) ? (unsigned)(offset_max[i]) : 0;
   }
-  GridSpaceMPI::ExchangeBoundaries(g->id(), hw, diagonal, periodic, reuse);
+  if (UsePrefetchedHalo(g, hw, periodic)) return NULL;
+  performance::Stopwatch st;
+  st.Start();
+  GridSpaceMPI::ExchangeBoundaries(g->id(), hw, diagonal, periodic);
+  // Stopwatch returns milliseconds
+  halo_exchange_time_ += st.Stop() * 1.0e-03;
   return NULL;
 }
 
+GridMPI *GridSpaceMPI::LoadNeighborMembers(
+    GridMPI *g, const std::vector<MemberHalo> &members,
+    bool diagonal, bool reuse, bool periodic) {
+  // The halo is not modified since the last exchange
+  if (reuse) return NULL;
+  Width2 hw;
+  hw.bw.Set(0);
+  hw.fw.Set(0);
+  FOREACH (it, members.begin(), members.end()) {
+    hw.bw.SetNoLessThan(it->width.bw);
+    hw.fw.SetNoLessThan(it->width.fw);
+  }
+  if (UsePrefetchedHalo(g, hw, periodic)) return NULL;
+  performance::Stopwatch st;
+  st.Start();
+  for (int i = g->num_dims_ - 1; i >= 0; --i) {
+    LOG_VERBOSE() << "Exchanging dimension " << i << " member data\n";
+    ExchangeBoundariesMembers(g, i, members, diagonal, periodic);
+  }
+  // Stopwatch returns milliseconds
+  halo_exchange_time_ += st.Stop() * 1.0e-03;
+  return NULL;
+}
+
+void GridSpaceMPI::PrefetchHalo(GridMPI *g) {
+  // The whole halo with the diagonal points covers the accesses of
+  // any stencil, and the run is not known yet
+  performance::Stopwatch st;
+  st.Start();
+  ExchangeBoundaries(g->id(), g->halo(), true, false);
+  // Stopwatch returns milliseconds
+  halo_exchange_time_ += st.Stop() * 1.0e-03;
+  prefetched_halos_[g->id()] = g->halo();
+}
+
+bool GridSpaceMPI::UsePrefetchedHalo(GridMPI *g, const Width2 &width,
+                                     bool periodic) {
+  std::map<int, Width2>::iterator it = prefetched_halos_.find(g->id());
+  if (it == prefetched_halos_.end()) return false;
+  // Only the first load after the prefetch is valid
+  Width2 hw = it->second;
+  prefetched_halos_.erase(it);
+  if (periodic) return false;
+  for (int i = 0; i < g->num_dims_; ++i) {
+    // Dimensions without halo have no peer to exchange with
+    if ((width.bw[i] > hw.bw[i] && g->halo().bw[i] > 0) ||
+        (width.fw[i] > hw.fw[i] && g->halo().fw[i] > 0)) {
+      return false;
+    }
+  }
+  LOG_DEBUG() << "Using the prefetched halo of grid " << g->id() << "\n";
+  return true;
+}
+
+bool GridSpaceMPI::IsActiveRegionFull() const {
+  if (!active_region_set_) return true;
+  for (int i = 0; i < num_dims_; ++i) {
+    if (active_min_[i] > 0 || active_max_[i] < proc_size_[i]) return false;
+  }
+  return true;
+}
+
 int GridSpaceMPI::FindOwnerProcess(GridMPI *g, const IndexArray &index) {
   std::vector<FetchInfo> fetch_requests;
   IndexArray one;
@@ -492,7 +943,7 @@ int GridSpaceMPI::FindOwnerProcess(GridMPI *g, const IndexArray &index) {
 
 int GridSpaceMPI::ReduceGrid(void *out, PSReduceOp op,
                              GridMPI *g) {
-  void *p = malloc(g->elm_size());
+  void *p = PoolAllocate(g->elm_size());
   if (g->Reduce(op, p) == 0) {
     switch (g->type()) {
       case PS_FLOAT:
@@ -505,13 +956,40 @@ int GridSpaceMPI::ReduceGrid(void *out, PSReduceOp op,
         PSAbort(1);
     }
   }
-  MPI_Datatype type = GetMPIDataType(g->type());
-  MPI_Op mpi_op = GetMPIOp(op);
-  PS_MPI_Reduce(p, out, 1, type, mpi_op, 0, comm_);
-  free(p);
+  ipc_->Reduce(p, out, 1, g->type(), op, 0);
+  PoolFree(p);
   return g->num_elms();
 }
 
+void GridSpaceMPI::ReduceMemoryUsage(MemoryUsage &min, MemoryUsage &max,
+                                     MemoryUsage &sum) const {
+  MemoryUsage mu = MemoryAccount::GetInstance()->Get();
+  // MemoryUsage consists only of long counters
+  int count = sizeof(MemoryUsage) / sizeof(long);
+  ipc_->Reduce(&mu, &min, count, PS_LONG, PS_MIN, 0);
+  ipc_->Reduce(&mu, &max, count, PS_LONG, PS_MAX, 0);
+  ipc_->Reduce(&mu, &sum, count, PS_LONG, PS_SUM, 0);
+}
+
+double GridSpaceMPI::ReduceHaloExchangeTime() const {
+  double t = halo_exchange_time_;
+  double max = 0.0;
+  ipc_->Reduce(&t, &max, 1, PS_DOUBLE, PS_MAX, 0);
+  return max;
+}
+
+std::ostream &GridSpaceMPI::PrintGridMemoryUsage(std::ostream &os) const {
+  FOREACH (it, grids_.begin(), grids_.end()) {
+    const GridMPI *g = static_cast<const GridMPI*>(it->second);
+    os << "Grid " << it->first << ": "
+       << GetMemoryCategoryName(MEM_DATA) << ": "
+       << g->GetMemoryUsage(MEM_DATA) << ", "
+       << GetMemoryCategoryName(MEM_HALO) << ": "
+       << g->GetMemoryUsage(MEM_HALO) << "\n";
+  }
+  return os;
+}
+
 } // namespace runtime
 } // namespace physis
 
@@ -12,6 +12,9 @@
 
 #include "runtime/runtime_common.h"
 #include "runtime/grid.h"
+#include "runtime/ipc.h"
+#include "runtime/memory_usage.h"
+#include "runtime/brick.h"
 
 namespace physis {
 namespace runtime {
@@ -31,17 +34,58 @@ struct GridRequest {
   GridRequest(int rank, GRID_REQUEST_KIND k): my_rank(rank), kind(k) {}
 };
 
-void SendGridRequest(int my_rank, int peer_rank, MPI_Comm comm,
+//! Sends a request with the request tag.
+void SendGridRequest(int my_rank, int peer_rank, InterProcComm *ipc,
                      GRID_REQUEST_KIND kind);
-GridRequest RecvGridRequest(MPI_Comm comm);
+//! Receives a request from any process.
+/*!
+  Only requests match since they have their own tag.
+ */
+GridRequest RecvGridRequest(InterProcComm *ipc);
 
 class GridMPI;
 
+//! Halo of a member of user-defined points.
+struct MemberHalo {
+  //! Offset of the member in each point
+  size_t offset;
+  //! Size of the member
+  size_t size;
+  //! Halo width of the member
+  Width2 width;
+};
+
+//! Decomposition of coarse grids of a grid space.
+/*!
+  Created for grids with PS_GRID_ATTRIBUTE_COARSE. The process grid is
+  the same as the grid space, and each process owns the coarse points
+  whose fine counterparts it owns.
+ */
+struct GridSpaceLevel {
+  //! Coarsening ratio of each dimension
+  IntArray ratio;
+  IndexArray global_size;
+  PSIndex *partitions[PS_MAX_DIM];
+  PSIndex *offsets[PS_MAX_DIM];
+  IndexArray my_offset;
+  IndexArray my_size;
+};
+
 class GridSpaceMPI: public GridSpace {
  public:
+  //! Create a grid space.
+  /*!
+    \param ipc Communicator used for all inter-process
+    communication. Defaults to the MPI communicator if NULL.
+    \param partition_align Partition boundaries are multiples of
+    this unless it leaves some process empty. For coarse grids with
+    ratios dividing it, each process then owns all the fine points
+    of its coarse points.
+   */
   GridSpaceMPI(int num_dims, const IndexArray &global_size,
                int proc_num_dims, const IntArray &proc_size,
-               int my_rank);
+               int my_rank, InterProcComm *ipc=NULL,
+               PSIndex partition_align=1);
   
   virtual ~GridSpaceMPI();
 
@@ -64,13 +108,13 @@ class GridSpaceMPI: public GridSpace {
     \param halo_bw_width Backward width
     \param diagonal True if diagonal points are accessed.
     \param periodic True if periodic access is used.
-    \param requests MPI request vector to poll completion
+    \param requests IPC request vector to poll completion
    */
   virtual void ExchangeBoundariesAsync(
       GridMPI *grid, int dim,
       unsigned halo_fw_width, unsigned halo_bw_width,
       bool diagonal, bool periodic,
-      std::vector<MPI_Request> &requests) const;
+      std::vector<void*> &requests) const;
   
 
   //! Exchange halo on one dimension of a grid.
@@ -88,27 +132,92 @@ class GridSpaceMPI: public GridSpace {
                                   bool diagonal,
                                   bool periodic) const;
 
+  //! Fills the halo of a dimension with the local grid points.
+  /*!
+    Periodic access on a dimension that is not decomposed wraps
+    around within the process.
+    
+    \param grid Grid to exchange
+    \param dim Halo dimension
+    \param halo_fw_width Forward width
+    \param halo_bw_width Backward width
+   */
+  virtual void WrapAroundBoundaries(GridMPI *grid, int dim,
+                                    unsigned halo_fw_width,
+                                    unsigned halo_bw_width) const;
+
   //! Exchange all boundaries of a grid.
   /*!
     \param grid_id Index of the grid to exchange.
     \param halo_width Halo width.
     \param diagonal True if diagonal points are accessed.
     \param periodic True if periodic access is used.
-    \param reuse True if reuse is enabled.
    */
   virtual void ExchangeBoundaries(int grid_id,
                                   const Width2 &halo_width,
                                   bool diagonal,
-                                  bool periodic,
-                                  bool reuse=false) const;
+                                  bool periodic) const;
 
+  //! Exchange the halo of a grid for stencil accesses.
+  /*!
+    \param g Grid to exchange.
+    \param offset_min Minimum offsets of the accesses.
+    \param offset_max Maximum offsets of the accesses.
+    \param diagonal True if diagonal points are accessed.
+    \param reuse True if the halo loaded previously is still valid,
+    in which case nothing is exchanged.
+    \param periodic True if periodic access is used.
+    \return Always NULL.
+   */
   virtual GridMPI *LoadNeighbor(GridMPI *g,
                                 const IndexArray &offset_min,
                                 const IndexArray &offset_max,
                                 bool diagonal,
                                 bool reuse,
                                 bool periodic);
-  
+
+  //! Exchange halo of members of user-defined points on one dimension.
+  /*!
+    Only the given members are packed, each with its own width, into
+    a single message per neighbor, so members that are not accessed
+    with neighbor offsets do not need any communication.
+    
+    \param grid Grid to exchange
+    \param dim Halo dimension
+    \param members Members to exchange.
+    \param diagonal True if diagonal points are accessed.
+    \param periodic True if periodic access is used.
+   */
+  virtual void ExchangeBoundariesMembers(
+      GridMPI *grid, int dim, const std::vector<MemberHalo> &members,
+      bool diagonal, bool periodic) const;
+
+  //! Exchange the halo of members of user-defined points.
+  /*!
+    Same as LoadNeighbor except that only the given members are
+    exchanged.
+    
+    \param members Members to exchange with their widths.
+   */
+  virtual GridMPI *LoadNeighborMembers(GridMPI *g,
+                                       const std::vector<MemberHalo> &members,
+                                       bool diagonal,
+                                       bool reuse,
+                                       bool periodic);
+
+  //! Exchanges the whole halo of a grid ahead of a stencil run.
+  /*!
+    This is a collective operation. The next LoadNeighbor or
+    LoadNeighborMembers of the grid is skipped if its widths are
+    within the halo and it is not periodic.
+
+    \param g Grid to exchange.
+   */
+  virtual void PrefetchHalo(GridMPI *g);
+  //! Drops the halos exchanged by PrefetchHalo but not loaded yet.
+  void DropPrefetchedHalos() { prefetched_halos_.clear(); }
+  //! Returns true unless the active region excludes a process.
+  bool IsActiveRegionFull() const;
 
   virtual int FindOwnerProcess(GridMPI *g, const IndexArray &index);
   
@@ -122,10 +231,61 @@ class GridSpaceMPI: public GridSpace {
   PSIndex **partitions() const { return partitions_; }
   PSIndex **offsets() const { return offsets_; }
   int my_rank() const { return my_rank_; }
+  InterProcComm *ipc() const { return ipc_; }
   const IndexArray &my_size() { return my_size_; }
   const IndexArray &my_offset() { return my_offset_; }  
   const std::vector<IntArray> &proc_indices() const { return proc_indices_; }
   int GetProcessRank(const IntArray &proc_index) const;
+  //! Returns the decomposition of a coarse grid size.
+  /*!
+    The decomposition is derived from the one of the grid space when
+    a size is first used. Aborts if the size is not a coarsening of
+    the grid space or a process would own no point of it.
+
+    \param size Global size of coarse grids.
+   */
+  const GridSpaceLevel *GetLevel(const IndexArray &size);
+  //! Restricts halo exchanges to the processes near a region.
+  /*!
+    A process is active if its partition intersects the region
+    widened by the stencil widths of the grids. Halos are exchanged
+    only between active processes, so the others can skip a stencil
+    run over the region. All processes stay active if a grid is
+    periodic or coarse.
+
+    \param region_min Minimum index of the region.
+    \param region_max Maximum index of the region, exclusive.
+    \return True if this process is active.
+   */
+  bool SetActiveRegion(const IndexArray &region_min,
+                       const IndexArray &region_max);
+  //! Makes all processes active again.
+  void ClearActiveRegion() {
+    active_region_set_ = false;
+    halo_needs_.clear();
+  }
+  //! Builds the active bricks of a masked domain.
+  /*!
+    This is a collective operation. Each process divides the part of
+    the domain in its partition into bricks, and the bounding box of
+    the active bricks of all processes is set to the list. Each
+    process also records which of its faces have active bricks
+    within the stencil widths, so that halos are not exchanged for
+    faces without them.
+
+    \param dom The domain.
+    \param mask Grid whose nonzero points are active.
+    \return Handle of the brick list.
+   */
+  int MaskDomain(const __PSDomain &dom, GridMPI *mask);
+  //! Restricts halo exchanges to the faces of active bricks.
+  /*!
+    Has effect only between SetActiveRegion and ClearActiveRegion,
+    and only if all the stencils of the run are masked.
+
+    \param masks Handles of the brick lists of the stencils.
+   */
+  void SetActiveMasks(const std::vector<int> &masks);
   //! Reduce a grid with binary operator op.
   /*
    * \param out The destination scalar buffer.
@@ -134,6 +294,29 @@ class GridSpaceMPI: public GridSpace {
    * \return The number of reduced elements.
    */
   virtual int ReduceGrid(void *out, PSReduceOp op, GridMPI *g);
+  //! Reduce the memory usage of all processes.
+  /*!
+    This is a collective operation, and the results are valid only
+    at the root process.
+    
+    \param min Per-counter minimum across processes.
+    \param max Per-counter maximum across processes.
+    \param sum Per-counter sum across processes.
+   */
+  virtual void ReduceMemoryUsage(MemoryUsage &min, MemoryUsage &max,
+                                 MemoryUsage &sum) const;
+  //! Prints the memory usage of each grid in this process.
+  std::ostream &PrintGridMemoryUsage(std::ostream &os) const;
+  //! Seconds spent in LoadNeighbor and LoadNeighborMembers.
+  double halo_exchange_time() const { return halo_exchange_time_; }
+  //! Reduce the halo exchange time of all processes.
+  /*!
+    This is a collective operation, and the result is valid only
+    at the root process.
+
+    \return The maximum halo exchange time across processes.
+   */
+  virtual double ReduceHaloExchangeTime() const;
 
   //virtual void Save() const;
   //virtual void Restore();
@@ -155,24 +338,66 @@ class GridSpaceMPI: public GridSpace {
   IntArray bw_neighbors_;
   //! Indices for all processes; proc_indices_[my_rank] == my_idx_
   std::vector<IntArray> proc_indices_;
+  InterProcComm *ipc_;
+  //! Used only by the subclasses that send their buffers directly
+  //! with MPI.
   MPI_Comm comm_;
+  //! Accumulated time of halo exchanges by this process
+  double halo_exchange_time_;
+  //! Decompositions of coarse grids
+  std::vector<GridSpaceLevel*> levels_;
+  //! Maximum stencil widths of the grids created so far
+  Width2 stencil_width_;
+  //! Widths of the halos exchanged by PrefetchHalo by grid ID
+  std::map<int, Width2> prefetched_halos_;
+  //! Consumes the prefetched halo of a grid.
+  /*!
+    \return True if the prefetched halo covers the given widths.
+   */
+  bool UsePrefetchedHalo(GridMPI *g, const Width2 &width, bool periodic);
+  //! True if a periodic grid has been created
+  bool periodic_grids_;
+  //! True if only the processes in [active_min_, active_max_) exchange
+  bool active_region_set_;
+  IntArray active_min_;
+  IntArray active_max_;
+  //! Faces of the processes with active bricks near them.
+  struct MaskedHalo {
+    //! Stencil widths when the faces are computed
+    Width2 width;
+    //! Indexed by (rank * PS_MAX_DIM + dim) * 2 + fw
+    std::vector<int> needs;
+  };
+  //! Faces of each masked domain by handle
+  std::map<int, MaskedHalo> masked_halos_;
+  //! Faces of the current run; empty if all are needed
+  std::vector<int> halo_needs_;
+  //! Returns true if a process reads the halo of one of its faces.
+  /*!
+    Diagonal halos are forwarded through the neighbors, so they are
+    always needed.
+   */
+  bool NeedsHalo(int rank, int dim, bool fw, bool diagonal) const;
+  //! Returns the decomposition of a grid; NULL if not coarse.
+  const GridSpaceLevel *FindLevel(const GridMPI *g) const;
   virtual void CollectPerProcSubgridInfo(
       const GridMPI *g,
       const IndexArray &grid_offset,
       const IndexArray &grid_size,
       std::vector<FetchInfo> &finfo_holder) const;
+  //! Returns true if a peer exists in the given direction.
+  bool HasHaloPeer(const GridMPI *grid, int dim, bool fw,
+                   bool periodic) const;
   virtual bool SendFetchRequest(FetchInfo &finfo) const;
   virtual void HandleFetchRequest(GridRequest &req, GridMPI *g);
   virtual void HandleFetchReply(GridRequest &req, GridMPI *g,
                                 std::map<int, FetchInfo> &fetch_map,  GridMPI *sg);
-  
-  void *buf;
-  size_t cur_buf_size;
 
   //! Calculate paritioning of a grid into sub grids.
   virtual void PartitionGrid(int num_dims, const IndexArray &size,
                              const IndexArray &global_offset,
-                             IndexArray &local_offset, IndexArray &local_size);
+                             IndexArray &local_offset, IndexArray &local_size,
+                             int attr=0);
   
 };
 
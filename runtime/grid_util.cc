@@ -12,6 +12,9 @@ using namespace physis::runtime;
 using physis::IntArray;
 using physis::IndexArray;
 
+// Minimum number of bytes to copy sub grids with multiple threads
+#define PS_PARALLEL_COPY_THRESHOLD (1 << 16)
+
 namespace physis {
 namespace runtime {
 
@@ -97,8 +100,6 @@ static void CopySubgrid(void *buf, const void *src,
   }
   
   
-  // just for sanity checking
-  intptr_t subgrid_original = (intptr_t) (is_copyin ? src : buf);
   std::list<IndexArray> *offsets = new std::list<IndexArray>;
   std::list<IndexArray> *offsets_new = new std::list<IndexArray>;
   
@@ -126,9 +127,21 @@ static void CopySubgrid(void *buf, const void *src,
   }
 
   // Copy the collected 1-D continuous regions. The region is allowed
-  // to periodically access off grid boundaries
-  FOREACH (oit, offsets->begin(), offsets->end()) {
-    IndexArray &offset = *oit;
+  // to periodically access off grid boundaries. Each region is
+  // subgrid_size[0] elements long in the linear buffer, so regions
+  // can be copied independently by threads.
+  std::vector<IndexArray> regions(offsets->begin(), offsets->end());
+  delete offsets;
+  delete offsets_new;
+  size_t region_size = subgrid_size[0] * elm_size;
+  long num_regions = regions.size();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static) \
+  if (num_regions * region_size > PS_PARALLEL_COPY_THRESHOLD)
+#endif
+  for (long r = 0; r < num_regions; ++r) {
+    IndexArray offset = regions[r];
+    intptr_t linear = (intptr_t)(is_copyin ? src : buf) + r * region_size;
     PSIndex next_offset;
     PSIndex initial_size;
     IndexArray ss = subgrid_size;
@@ -153,36 +166,24 @@ static void CopySubgrid(void *buf, const void *src,
       const void *src_ptr;
       void *dst_ptr;
       if (is_copyin) {
-        src_ptr = src;
+        src_ptr = (const void *)linear;
         dst_ptr = (void *)((intptr_t)buf + grid_1d_offset);
       } else {
         src_ptr = (const void *)((intptr_t)src + grid_1d_offset);
-        dst_ptr = buf;
+        dst_ptr = (void *)linear;
       }
       size_t line_size = ss[0] * elm_size;
       memcpy(dst_ptr, src_ptr, line_size);
-      if (is_copyin) {
-        src = (const void*)((intptr_t)src + line_size);
-      } else {
-        buf = (void*)((intptr_t)buf + line_size);
-      }
+      linear += line_size;
       
       offset[0] = next_offset;
       ss[0] = initial_size - ss[0];
     }
   }
 
-  delete offsets;
-  delete offsets_new;
-
   // sanity checking
-  void *p = (void *)(subgrid_original +
-                     subgrid_size.accumulate(num_dims) * elm_size);
-  if (is_copyin) {
-    assert(src == p);
-  } else {
-    assert(buf == p);
-  }
+  assert((size_t)num_regions * region_size ==
+         subgrid_size.accumulate(num_dims) * elm_size);
 
   return;
 }
@@ -208,5 +209,301 @@ void CopyinSubgrid(size_t elm_size, int num_dims,
   return;
 }
 
+// Copy a member of each element of a sub grid from or out to a
+// linear buffer. The sub grid must be within the grid.
+static void CopySubgridMember(void *grid, void *subgrid,
+                              size_t elm_size, int num_dims,
+                              const IndexArray &grid_size,
+                              const IndexArray &subgrid_offset,
+                              const IndexArray &subgrid_size,
+                              size_t member_offset, size_t member_size,
+                              bool is_copyin) {
+  IndexArray ss(1, 1, 1);
+  for (int i = 0; i < num_dims; ++i) {
+    ss[i] = subgrid_size[i];
+  }
+  char *buf = (char *)subgrid;
+  for (PSIndex k = 0; k < ss[2]; ++k) {
+    for (PSIndex j = 0; j < ss[1]; ++j) {
+      IndexArray offset = subgrid_offset;
+      offset[1] += j;
+      offset[2] += k;
+      char *p = (char *)grid +
+          get1DOffset(offset, grid_size, num_dims) * elm_size + member_offset;
+      for (PSIndex i = 0; i < ss[0]; ++i) {
+        if (is_copyin) {
+          memcpy(p, buf, member_size);
+        } else {
+          memcpy(buf, p, member_size);
+        }
+        p += elm_size;
+        buf += member_size;
+      }
+    }
+  }
+  return;
+}
+
+void CopyoutSubgridMember(size_t elm_size, int num_dims,
+                          const void *grid, const IndexArray &grid_size,
+                          void *subgrid,
+                          const IndexArray &subgrid_offset,
+                          const IndexArray &subgrid_size,
+                          size_t member_offset, size_t member_size) {
+  CopySubgridMember(const_cast<void *>(grid), subgrid, elm_size,
+                    num_dims, grid_size, subgrid_offset, subgrid_size,
+                    member_offset, member_size, false);
+  return;
+}
+
+void CopyinSubgridMember(size_t elm_size, int num_dims,
+                         void *grid, const IndexArray &grid_size,
+                         const void *subgrid,
+                         const IndexArray &subgrid_offset,
+                         const IndexArray &subgrid_size,
+                         size_t member_offset, size_t member_size) {
+  CopySubgridMember(grid, const_cast<void *>(subgrid), elm_size,
+                    num_dims, grid_size, subgrid_offset, subgrid_size,
+                    member_offset, member_size, true);
+  return;
+}
+
+// Copy a sub grid of a grid in the brick layout from or out to a
+// linear buffer. A row of the sub grid within a brick is continuous
+// in both the grid and the buffer, so bricks are copied row by row,
+// and independently by threads. Only a member of each element is
+// copied if member_size is less than elm_size.
+static void CopySubgridBrick(void *grid, void *subgrid,
+                             size_t elm_size, int num_dims,
+                             const IndexArray &num_bricks,
+                             const IndexArray &subgrid_offset,
+                             const IndexArray &subgrid_size,
+                             size_t member_offset, size_t member_size,
+                             bool is_copyin) {
+  IndexArray off, ss(1, 1, 1), nb(1, 1, 1);
+  IndexArray bmin, bmax(1, 1, 1);
+  for (int i = 0; i < num_dims; ++i) {
+    off[i] = subgrid_offset[i];
+    ss[i] = subgrid_size[i];
+    nb[i] = num_bricks[i];
+    if (ss[i] == 0) return;
+    bmin[i] = off[i] >> PS_BRICK_WIDTH_LOG2;
+    bmax[i] = ((off[i] + ss[i] - 1) >> PS_BRICK_WIDTH_LOG2) + 1;
+  }
+  std::vector<IndexArray> bricks;
+  IndexArray b;
+  for (b[2] = bmin[2]; b[2] < bmax[2]; ++b[2]) {
+    for (b[1] = bmin[1]; b[1] < bmax[1]; ++b[1]) {
+      for (b[0] = bmin[0]; b[0] < bmax[0]; ++b[0]) {
+        bricks.push_back(b);
+      }
+    }
+  }
+  size_t brick_elms = (size_t)1 << (PS_BRICK_WIDTH_LOG2 * num_dims);
+  long num_bricks_copied = bricks.size();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)                       \
+  if (ss.accumulate(num_dims) * member_size > PS_PARALLEL_COPY_THRESHOLD)
+#endif
+  for (long r = 0; r < num_bricks_copied; ++r) {
+    const IndexArray &br = bricks[r];
+    // Intersection of the brick and the sub grid
+    IndexArray lo, hi(1, 1, 1);
+    for (int i = 0; i < num_dims; ++i) {
+      lo[i] = std::max(off[i], br[i] << PS_BRICK_WIDTH_LOG2);
+      hi[i] = std::min(off[i] + ss[i], (br[i] + 1) << PS_BRICK_WIDTH_LOG2);
+    }
+    char *brick = (char *)grid +
+        ((br[2] * nb[1] + br[1]) * nb[0] + br[0]) * brick_elms * elm_size;
+    size_t row_len = hi[0] - lo[0];
+    for (PSIndex k = lo[2]; k < hi[2]; ++k) {
+      for (PSIndex j = lo[1]; j < hi[1]; ++j) {
+        char *p = brick + ((((k & PS_BRICK_MASK) << (PS_BRICK_WIDTH_LOG2 * 2))
+                            | ((j & PS_BRICK_MASK) << PS_BRICK_WIDTH_LOG2)
+                            | (lo[0] & PS_BRICK_MASK)) * elm_size);
+        char *q = (char *)subgrid +
+            GridCalcOffset3D(lo[0] - off[0], j - off[1], k - off[2], ss)
+            * member_size;
+        if (member_size == elm_size) {
+          if (is_copyin) memcpy(p, q, row_len * elm_size);
+          else memcpy(q, p, row_len * elm_size);
+          continue;
+        }
+        p += member_offset;
+        for (size_t i = 0; i < row_len; ++i) {
+          if (is_copyin) memcpy(p, q, member_size);
+          else memcpy(q, p, member_size);
+          p += elm_size;
+          q += member_size;
+        }
+      }
+    }
+  }
+  return;
+}
+
+void CopyoutSubgridBrick(size_t elm_size, int num_dims,
+                         const void *grid, const IndexArray &num_bricks,
+                         void *subgrid,
+                         const IndexArray &subgrid_offset,
+                         const IndexArray &subgrid_size) {
+  CopySubgridBrick(const_cast<void *>(grid), subgrid, elm_size,
+                   num_dims, num_bricks, subgrid_offset, subgrid_size,
+                   0, elm_size, false);
+  return;
+}
+
+void CopyinSubgridBrick(size_t elm_size, int num_dims,
+                        void *grid, const IndexArray &num_bricks,
+                        const void *subgrid,
+                        const IndexArray &subgrid_offset,
+                        const IndexArray &subgrid_size) {
+  CopySubgridBrick(grid, const_cast<void *>(subgrid), elm_size,
+                   num_dims, num_bricks, subgrid_offset, subgrid_size,
+                   0, elm_size, true);
+  return;
+}
+
+void CopyoutSubgridMemberBrick(size_t elm_size, int num_dims,
+                               const void *grid,
+                               const IndexArray &num_bricks,
+                               void *subgrid,
+                               const IndexArray &subgrid_offset,
+                               const IndexArray &subgrid_size,
+                               size_t member_offset, size_t member_size) {
+  CopySubgridBrick(const_cast<void *>(grid), subgrid, elm_size,
+                   num_dims, num_bricks, subgrid_offset, subgrid_size,
+                   member_offset, member_size, false);
+  return;
+}
+
+void CopyinSubgridMemberBrick(size_t elm_size, int num_dims,
+                              void *grid, const IndexArray &num_bricks,
+                              const void *subgrid,
+                              const IndexArray &subgrid_offset,
+                              const IndexArray &subgrid_size,
+                              size_t member_offset, size_t member_size) {
+  CopySubgridBrick(grid, const_cast<void *>(subgrid), elm_size,
+                   num_dims, num_bricks, subgrid_offset, subgrid_size,
+                   member_offset, member_size, true);
+  return;
+}
+
+// Copy a member of each element of a sub grid of a grid in the SoA
+// layout from or out to a linear buffer, where the member of
+// consecutive elements is subgrid_stride bytes apart. Each member of
+// lanes consecutive elements is continuous in the grid, so a row is
+// copied in runs that do not cross the blocks of lanes elements.
+static void CopySubgridMemberSoA(void *grid, void *subgrid,
+                                 size_t elm_size, int num_dims,
+                                 const IndexArray &grid_size,
+                                 PSIndex lanes,
+                                 const IndexArray &subgrid_offset,
+                                 const IndexArray &subgrid_size,
+                                 size_t member_offset, size_t member_size,
+                                 size_t subgrid_stride,
+                                 bool is_copyin) {
+  IndexArray ss(1, 1, 1);
+  for (int i = 0; i < num_dims; ++i) {
+    ss[i] = subgrid_size[i];
+  }
+  char *buf = (char *)subgrid;
+  for (PSIndex k = 0; k < ss[2]; ++k) {
+    for (PSIndex j = 0; j < ss[1]; ++j) {
+      IndexArray offset = subgrid_offset;
+      offset[1] += j;
+      offset[2] += k;
+      PSIndex e = get1DOffset(offset, grid_size, num_dims);
+      PSIndex i = 0;
+      while (i < ss[0]) {
+        PSIndex lane = (e + i) % lanes;
+        PSIndex run = std::min(ss[0] - i, lanes - lane);
+        char *p = (char *)grid + ((e + i) - lane) * elm_size
+            + member_offset * lanes + lane * member_size;
+        if (subgrid_stride == member_size) {
+          if (is_copyin) memcpy(p, buf, run * member_size);
+          else memcpy(buf, p, run * member_size);
+          buf += run * member_size;
+        } else {
+          for (PSIndex l = 0; l < run; ++l) {
+            if (is_copyin) memcpy(p, buf, member_size);
+            else memcpy(buf, p, member_size);
+            p += member_size;
+            buf += subgrid_stride;
+          }
+        }
+        i += run;
+      }
+    }
+  }
+  return;
+}
+
+void CopyoutSubgridSoA(size_t elm_size, int num_dims,
+                       const void *grid, const IndexArray &grid_size,
+                       PSIndex lanes, int num_members,
+                       const size_t *member_layout,
+                       void *subgrid,
+                       const IndexArray &subgrid_offset,
+                       const IndexArray &subgrid_size) {
+  for (int m = 0; m < num_members; ++m) {
+    size_t member_offset = member_layout[m * 2];
+    size_t member_size = member_layout[m * 2 + 1];
+    CopySubgridMemberSoA(const_cast<void *>(grid),
+                         (char *)subgrid + member_offset, elm_size,
+                         num_dims, grid_size, lanes, subgrid_offset,
+                         subgrid_size, member_offset, member_size,
+                         elm_size, false);
+  }
+  return;
+}
+
+void CopyinSubgridSoA(size_t elm_size, int num_dims,
+                      void *grid, const IndexArray &grid_size,
+                      PSIndex lanes, int num_members,
+                      const size_t *member_layout,
+                      const void *subgrid,
+                      const IndexArray &subgrid_offset,
+                      const IndexArray &subgrid_size) {
+  for (int m = 0; m < num_members; ++m) {
+    size_t member_offset = member_layout[m * 2];
+    size_t member_size = member_layout[m * 2 + 1];
+    CopySubgridMemberSoA(grid, (char *)subgrid + member_offset, elm_size,
+                         num_dims, grid_size, lanes, subgrid_offset,
+                         subgrid_size, member_offset, member_size,
+                         elm_size, true);
+  }
+  return;
+}
+
+void CopyoutSubgridMemberSoA(size_t elm_size, int num_dims,
+                             const void *grid,
+                             const IndexArray &grid_size,
+                             PSIndex lanes,
+                             void *subgrid,
+                             const IndexArray &subgrid_offset,
+                             const IndexArray &subgrid_size,
+                             size_t member_offset, size_t member_size) {
+  CopySubgridMemberSoA(const_cast<void *>(grid), subgrid, elm_size,
+                       num_dims, grid_size, lanes, subgrid_offset,
+                       subgrid_size, member_offset, member_size,
+                       member_size, false);
+  return;
+}
+
+void CopyinSubgridMemberSoA(size_t elm_size, int num_dims,
+                            void *grid, const IndexArray &grid_size,
+                            PSIndex lanes,
+                            const void *subgrid,
+                            const IndexArray &subgrid_offset,
+                            const IndexArray &subgrid_size,
+                            size_t member_offset, size_t member_size) {
+  CopySubgridMemberSoA(grid, const_cast<void *>(subgrid), elm_size,
+                       num_dims, grid_size, lanes, subgrid_offset,
+                       subgrid_size, member_offset, member_size,
+                       member_size, true);
+  return;
+}
+
 } // namespace runtime
 } // namespace physis
@@ -48,6 +48,149 @@ void CopyinSubgrid(size_t elm_size, int num_dims,
                    const IndexArray &subgrid_offset,
                    const IndexArray &subgrid_size);
 
+//! Copy a member of each element of a sub grid into a continuous buffer.
+/*
+  Only the member is copied, so the buffer is packed with member_size
+  bytes per element.
+  
+  \param elm_size The size of each element.
+  \param num_dims The number of dimensions of the grid.
+  \param grid The source grid.
+  \param grid_size The size of each dimension of the grid.
+  \param subgrid The destination buffer.
+  \param subgrid_offset The offset of the sub grid to copy.
+  \param subgrid_size The offset of the sub grid to copy.
+  \param member_offset The offset of the member in each element.
+  \param member_size The size of the member.
+ */
+void CopyoutSubgridMember(size_t elm_size, int num_dims,
+                          const void *grid,
+                          const IndexArray &grid_size,
+                          void *subgrid,
+                          const IndexArray &subgrid_offset,
+                          const IndexArray &subgrid_size,
+                          size_t member_offset, size_t member_size);
+
+//! Copy a continuous buffer into a member of a multi-dimensional sub grid.
+/*
+  \param elm_size The size of each element.
+  \param num_dims The number of dimensions of the grid.
+  \param grid The destination grid.
+  \param grid_size The size of each dimension of the grid.
+  \param subgrid The source buffer.
+  \param subgrid_offset The offset of the sub grid to copy.
+  \param subgrid_size The offset of the sub grid to copy.
+  \param member_offset The offset of the member in each element.
+  \param member_size The size of the member.
+ */
+void CopyinSubgridMember(size_t elm_size, int num_dims,
+                         void *grid, const IndexArray &grid_size,
+                         const void *subgrid,
+                         const IndexArray &subgrid_offset,
+                         const IndexArray &subgrid_size,
+                         size_t member_offset, size_t member_size);
+
+//! Copy a sub grid of a grid in the brick layout into a continuous buffer.
+/*
+  The buffer is packed in the row-major order. Rows of the sub grid
+  are copied brick by brick. The sub grid must be within the grid.
+  
+  \param elm_size The size of each element.
+  \param num_dims The number of dimensions of the grid.
+  \param grid The source grid.
+  \param num_bricks The number of bricks of each dimension of the grid.
+  \param subgrid The destination buffer.
+  \param subgrid_offset The offset of the sub grid to copy.
+  \param subgrid_size The offset of the sub grid to copy.
+ */
+void CopyoutSubgridBrick(size_t elm_size, int num_dims,
+                         const void *grid,
+                         const IndexArray &num_bricks,
+                         void *subgrid,
+                         const IndexArray &subgrid_offset,
+                         const IndexArray &subgrid_size);
+
+//! Copy a continuous buffer into a sub grid of a grid in the brick layout.
+void CopyinSubgridBrick(size_t elm_size, int num_dims,
+                        void *grid, const IndexArray &num_bricks,
+                        const void *subgrid,
+                        const IndexArray &subgrid_offset,
+                        const IndexArray &subgrid_size);
+
+//! Copy a member of each element of a sub grid in the brick layout.
+/*
+  Same as CopyoutSubgridMember except for the layout of the grid.
+ */
+void CopyoutSubgridMemberBrick(size_t elm_size, int num_dims,
+                               const void *grid,
+                               const IndexArray &num_bricks,
+                               void *subgrid,
+                               const IndexArray &subgrid_offset,
+                               const IndexArray &subgrid_size,
+                               size_t member_offset, size_t member_size);
+
+//! Copy a continuous buffer into a member of a sub grid in the brick layout.
+void CopyinSubgridMemberBrick(size_t elm_size, int num_dims,
+                              void *grid, const IndexArray &num_bricks,
+                              const void *subgrid,
+                              const IndexArray &subgrid_offset,
+                              const IndexArray &subgrid_size,
+                              size_t member_offset, size_t member_size);
+
+//! Copy a sub grid of a grid in the SoA layout into a continuous buffer.
+/*
+  The buffer is packed with whole elements in the row-major order, so
+  the members are gathered from their arrays.
+  
+  \param elm_size The size of each element.
+  \param num_dims The number of dimensions of the grid.
+  \param grid The source grid.
+  \param grid_size The size of each dimension of the grid.
+  \param lanes The number of elements interleaved per member.
+  \param num_members The number of members of each element.
+  \param member_layout Pairs of the offset and size of each member.
+  \param subgrid The destination buffer.
+  \param subgrid_offset The offset of the sub grid to copy.
+  \param subgrid_size The offset of the sub grid to copy.
+ */
+void CopyoutSubgridSoA(size_t elm_size, int num_dims,
+                       const void *grid, const IndexArray &grid_size,
+                       PSIndex lanes, int num_members,
+                       const size_t *member_layout,
+                       void *subgrid,
+                       const IndexArray &subgrid_offset,
+                       const IndexArray &subgrid_size);
+
+//! Copy a continuous buffer into a sub grid of a grid in the SoA layout.
+void CopyinSubgridSoA(size_t elm_size, int num_dims,
+                      void *grid, const IndexArray &grid_size,
+                      PSIndex lanes, int num_members,
+                      const size_t *member_layout,
+                      const void *subgrid,
+                      const IndexArray &subgrid_offset,
+                      const IndexArray &subgrid_size);
+
+//! Copy a member of each element of a sub grid in the SoA layout.
+/*
+  Same as CopyoutSubgridMember except for the layout of the grid.
+ */
+void CopyoutSubgridMemberSoA(size_t elm_size, int num_dims,
+                             const void *grid,
+                             const IndexArray &grid_size,
+                             PSIndex lanes,
+                             void *subgrid,
+                             const IndexArray &subgrid_offset,
+                             const IndexArray &subgrid_size,
+                             size_t member_offset, size_t member_size);
+
+//! Copy a continuous buffer into a member of a sub grid in the SoA layout.
+void CopyinSubgridMemberSoA(size_t elm_size, int num_dims,
+                            void *grid, const IndexArray &grid_size,
+                            PSIndex lanes,
+                            const void *subgrid,
+                            const IndexArray &subgrid_offset,
+                            const IndexArray &subgrid_size,
+                            size_t member_offset, size_t member_size);
 
 // TODO: Create two distinctive types: offset_type and index_type
 //#define _OFFSET_TYPE intprt_t
@@ -19,20 +19,39 @@ class InterProcComm {
   virtual ~InterProcComm() {}
  public:
   typedef enum {IPC_SUCCESS = 0, IPC_FAILURE = 1} IPC_ERROR_T;
+  //! Source rank to receive from any process.
+  /*!
+    A receive from any source matches only messages with the same
+    tag, so messages of a tag received from any source must not be
+    received from a specific process as well.
+   */
+  static const int ANY_SOURCE = -1;
+  //! Message tags.
+  typedef enum {
+    //! Default tag of point-to-point messages.
+    TAG_DATA = 0,
+    //! Requests received from any source.
+    TAG_REQUEST = 1,
+    NUM_TAGS = 2
+  } IPC_TAG_T;
   virtual void *CreateRequest() const = 0;
+  virtual void DeleteRequest(void *req) const = 0;
   virtual IPC_ERROR_T Init(int *argc, char ***argv) = 0;
   virtual IPC_ERROR_T Finalize() = 0;
   virtual int GetRank() const = 0;
   virtual int GetNumProcs() const = 0;
   virtual IPC_ERROR_T Send(void *buf, size_t len,
-                           int dest) = 0;
+                           int dest, int tag=TAG_DATA) = 0;
   virtual IPC_ERROR_T Isend(void *buf, size_t len,
-                            int dest, void *req) = 0;
-  virtual IPC_ERROR_T Recv(void *buf, size_t len, int src) = 0;
+                            int dest, void *req, int tag=TAG_DATA) = 0;
+  virtual IPC_ERROR_T Recv(void *buf, size_t len, int src,
+                           int tag=TAG_DATA) = 0;
   virtual IPC_ERROR_T Irecv(void *buf, size_t len,
-                    int src, void *req) = 0;
+                    int src, void *req, int tag=TAG_DATA) = 0;
+  //! Block until the request completes.
   virtual IPC_ERROR_T Wait(void *req) = 0;
   virtual IPC_ERROR_T WaitAll() = 0;
+  //! Returns IPC_SUCCESS if the request is completed.
   virtual IPC_ERROR_T Test(void *req) = 0;
   virtual IPC_ERROR_T Bcast(void *buf, size_t len, int root) = 0;
   virtual IPC_ERROR_T Reduce(void *src, void *dst,
@@ -36,13 +36,13 @@ InterProcComm::IPC_ERROR_T InterProcCommMPI::Finalize() {
 
 int InterProcCommMPI::GetRank() const {
   int rank;
-  assert(PS_MPI_Comm_rank(comm_, &rank) == MPI_SUCCESS);
+  CHECK_MPI(PS_MPI_Comm_rank(comm_, &rank));
   return rank;
 }
 
 int InterProcCommMPI::GetNumProcs() const {
   int np;
-  assert(PS_MPI_Comm_size(comm_, &np) == MPI_SUCCESS);
+  CHECK_MPI(PS_MPI_Comm_size(comm_, &np));
   return np;
 }
 
@@ -52,64 +52,65 @@ void *InterProcCommMPI::CreateRequest() const {
   return (void*)r;
 }
 
+void InterProcCommMPI::DeleteRequest(void *req) const {
+  delete static_cast<MPI_Request*>(req);
+}
+
+static int GetMPISource(int src) {
+  return src == InterProcComm::ANY_SOURCE ? MPI_ANY_SOURCE : src;
+}
+
 InterProcComm::IPC_ERROR_T InterProcCommMPI::Send(
-    void *buf, size_t len, int dest) {
-  int tag = 0;
-  assert(PS_MPI_Send(buf, len, MPI_BYTE,
-                     dest, tag, comm_) == MPI_SUCCESS);
+    void *buf, size_t len, int dest, int tag) {
+  CHECK_MPI(PS_MPI_Send(buf, len, MPI_BYTE, dest, tag, comm_));
   return IPC_SUCCESS;
 }
 
 InterProcComm::IPC_ERROR_T InterProcCommMPI::Isend(
-    void *buf, size_t len, int dest, void *req) {
+    void *buf, size_t len, int dest, void *req, int tag) {
   MPI_Request *mpi_req = static_cast<MPI_Request*>(req);
-  int tag = 0;
-  assert(PS_MPI_Isend(buf, len, MPI_BYTE,
-                      dest, tag, comm_, mpi_req)
-         == MPI_SUCCESS);
+  CHECK_MPI(PS_MPI_Isend(buf, len, MPI_BYTE, dest, tag, comm_, mpi_req));
   return IPC_SUCCESS;
 }
 
 InterProcComm::IPC_ERROR_T InterProcCommMPI::Recv(
-    void *buf, size_t len, int src) {
-  int tag = 0;
-  assert(PS_MPI_Recv(buf, len, MPI_BYTE, src, tag, comm_,
-                     MPI_STATUS_IGNORE) == MPI_SUCCESS);
+    void *buf, size_t len, int src, int tag) {
+  CHECK_MPI(PS_MPI_Recv(buf, len, MPI_BYTE, GetMPISource(src), tag, comm_,
+                        MPI_STATUS_IGNORE));
   return IPC_SUCCESS;
 }
 
 InterProcComm::IPC_ERROR_T InterProcCommMPI::Irecv(
-    void *buf, size_t len, int src, void *req) {
-  int tag = 0;
+    void *buf, size_t len, int src, void *req, int tag) {
   MPI_Request *mpi_req = static_cast<MPI_Request*>(req);  
-  assert(PS_MPI_Irecv(buf, len, MPI_BYTE, src, tag, comm_,
-                      mpi_req)
-         == MPI_SUCCESS);
+  CHECK_MPI(PS_MPI_Irecv(buf, len, MPI_BYTE, GetMPISource(src), tag, comm_,
+                         mpi_req));
   return IPC_SUCCESS;
 }
 
 InterProcComm::IPC_ERROR_T InterProcCommMPI::Wait(void *req) {
-  assert(PS_MPI_Wait() == MPI_SUCCESS);
+  CHECK_MPI(PS_MPI_Wait(static_cast<MPI_Request*>(req)));
   return IPC_SUCCESS;
 }
 
+// Requests are owned by callers, so there is nothing to track
+// here. Use Wait for each request instead.
 InterProcComm::IPC_ERROR_T InterProcCommMPI::WaitAll() {
-  assert(PS_MPI_Wait() == MPI_SUCCESS);
   return IPC_SUCCESS;
 }
 
 InterProcComm::IPC_ERROR_T InterProcCommMPI::Test(void *req) {
-  assert(PS_MPI_Test(static_cast<MPI_Request*>(req))
-         == MPI_SUCCESS);
-  return IPC_SUCCESS;
+  int flag = 0;
+  CHECK_MPI(PS_MPI_Test(static_cast<MPI_Request*>(req), &flag));
+  return flag ? IPC_SUCCESS : IPC_FAILURE;
 }
 
 InterProcComm::IPC_ERROR_T InterProcCommMPI::Bcast(void *buf, size_t len, int root) {
   // MPI Bcast uses int type for length parameter
   while (len > 0 ) {
     int bcast_len = (int)std::min((size_t)INT_MAX, len);
-    assert(PS_MPI_Bcast(buf, bcast_len, MPI_BYTE, root, comm_)
-           == MPI_SUCCESS);
+    CHECK_MPI(PS_MPI_Bcast(buf, bcast_len, MPI_BYTE, root, comm_));
+    buf = (char*)buf + bcast_len;
     len -= bcast_len;    
   }
   return IPC_SUCCESS;
@@ -118,14 +119,13 @@ InterProcComm::IPC_ERROR_T InterProcCommMPI::Bcast(void *buf, size_t len, int ro
 InterProcComm::IPC_ERROR_T InterProcCommMPI::Reduce(void *src, void *dst,
                              int count, PSType type,
                              PSReduceOp op, int root) {
-  assert(MPI_SUCCESS ==
-         PS_MPI_Reduce(src, dst, count, GetMPIDataType(type),
-                       GetMPIOp(op), root, comm_));
+  CHECK_MPI(PS_MPI_Reduce(src, dst, count, GetMPIDataType(type),
+                          GetMPIOp(op), root, comm_));
   return IPC_SUCCESS;
 }
 
 InterProcComm::IPC_ERROR_T InterProcCommMPI::Barrier() {
-  assert(MPI_SUCCESS == PS_MPI_Barrier(comm_));
+  CHECK_MPI(PS_MPI_Barrier(comm_));
   return IPC_SUCCESS;
 }
 } // namespace runtime
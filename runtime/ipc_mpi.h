@@ -22,16 +22,19 @@ class InterProcCommMPI: public InterProcComm {
  public:
   static InterProcCommMPI* GetInstance();
   virtual void *CreateRequest() const;
+  virtual void DeleteRequest(void *req) const;
   virtual IPC_ERROR_T Init(int *argc, char ***argv);
   virtual IPC_ERROR_T Finalize();
   virtual int GetRank() const;
   virtual int GetNumProcs() const;
-  virtual IPC_ERROR_T Send(void *buf, size_t len, int dest);
+  virtual IPC_ERROR_T Send(void *buf, size_t len, int dest,
+                           int tag=TAG_DATA);
   virtual IPC_ERROR_T Isend(void *buf, size_t len,
-                            int dest, void *req);
-  virtual IPC_ERROR_T Recv(void *buf, size_t len, int src);
+                            int dest, void *req, int tag=TAG_DATA);
+  virtual IPC_ERROR_T Recv(void *buf, size_t len, int src,
+                           int tag=TAG_DATA);
   virtual IPC_ERROR_T Irecv(void *buf, size_t len,
-                    int src, void *req);
+                    int src, void *req, int tag=TAG_DATA);
   virtual IPC_ERROR_T Wait(void *req);
   virtual IPC_ERROR_T WaitAll();
   virtual IPC_ERROR_T Test(void *req);
@@ -0,0 +1,529 @@
+// Copyright 2011-2012, RIKEN AICS.
+// All rights reserved.
+//
+// This file is distributed under the BSD license. See LICENSE.txt for
+// details.
+
+#include "runtime/ipc_shm.h"
+
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "runtime/runtime.h"
+#include "runtime/reduce.h"
+
+#define CACHE_LINE_SIZE (64)
+#define DEFAULT_RING_SIZE (1 << 20)
+
+namespace physis {
+namespace runtime {
+
+// The producer only writes tail and the consumer only writes
+// head. Both are monotonically increasing byte counts, so the
+// number of bytes in the ring is always tail - head.
+struct InterProcCommSHM::Ring {
+  size_t head;
+  char pad0[CACHE_LINE_SIZE - sizeof(size_t)];
+  size_t tail;
+  char pad1[CACHE_LINE_SIZE - sizeof(size_t)];
+  char data[CACHE_LINE_SIZE];
+};
+
+static size_t RingAvailable(InterProcCommSHM::Ring *r) {
+  return __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE)
+      - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+}
+
+// Returns the number of bytes pushed
+static size_t RingPush(InterProcCommSHM::Ring *r, size_t capacity,
+                       const char *buf, size_t len) {
+  size_t tail = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+  size_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+  len = std::min(len, capacity - (tail - head));
+  if (len == 0) return 0;
+  size_t pos = tail % capacity;
+  size_t first = std::min(len, capacity - pos);
+  memcpy(r->data + pos, buf, first);
+  memcpy(r->data, buf + first, len - first);
+  __atomic_store_n(&r->tail, tail + len, __ATOMIC_RELEASE);
+  return len;
+}
+
+// Returns the number of bytes popped
+static size_t RingPop(InterProcCommSHM::Ring *r, size_t capacity,
+                      char *buf, size_t len) {
+  size_t head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+  size_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+  len = std::min(len, tail - head);
+  if (len == 0) return 0;
+  size_t pos = head % capacity;
+  size_t first = std::min(len, capacity - pos);
+  memcpy(buf, r->data + pos, first);
+  memcpy(buf + first, r->data, len - first);
+  __atomic_store_n(&r->head, head + len, __ATOMIC_RELEASE);
+  return len;
+}
+
+InterProcCommSHM *InterProcCommSHM::singleton_ = NULL;
+
+InterProcCommSHM *InterProcCommSHM::GetInstance() {
+  if (singleton_ == NULL) {
+    singleton_ = new InterProcCommSHM();
+  }
+  return singleton_;
+}
+
+bool InterProcCommSHM::IsRequested(int argc, char **argv) {
+  for (int i = 0; i < argc; ++i) {
+    if (strcmp(argv[i], "-physis-shm") == 0 ||
+        strcmp(argv[i], "--physis-shm") == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+InterProcCommSHM::InterProcCommSHM():
+    rank_(0), num_procs_(1), ring_size_(DEFAULT_RING_SIZE),
+    segment_(NULL), segment_size_(0) {
+}
+
+InterProcCommSHM::~InterProcCommSHM() {
+}
+
+InterProcComm::IPC_ERROR_T InterProcCommSHM::Init(int *argc,
+                                                  char ***argv) {
+  vector<string> opts;
+  if (ParseOption(argc, argv, "physis-shm", 1, opts)) {
+    num_procs_ = physis::toInteger(opts[1]);
+  }
+  opts.clear();
+  if (ParseOption(argc, argv, "physis-shm-ring-size", 1, opts)) {
+    ring_size_ = physis::toInteger(opts[1]);
+  }
+  PSAssert(num_procs_ > 0);
+  PSAssert(ring_size_ > 0);
+
+  size_t ring_stride = offsetof(Ring, data) + ring_size_;
+  ring_stride = (ring_stride + CACHE_LINE_SIZE - 1)
+      / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+  segment_size_ = ring_stride * NUM_CHANNELS * num_procs_ * num_procs_;
+
+  // The segment is unlinked right after mapping; the mapping is
+  // inherited by the forked processes and released when all of
+  // them exit.
+  std::stringstream ss;
+  ss << "/physis-shm-" << getpid();
+  int fd = shm_open(ss.str().c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  if (fd < 0) {
+    LOG_ERROR() << "shm_open failed: " << strerror(errno) << "\n";
+    return IPC_FAILURE;
+  }
+  if (ftruncate(fd, segment_size_) != 0) {
+    LOG_ERROR() << "ftruncate failed: " << strerror(errno) << "\n";
+    close(fd);
+    shm_unlink(ss.str().c_str());
+    return IPC_FAILURE;
+  }
+  void *p = mmap(NULL, segment_size_, PROT_READ | PROT_WRITE,
+                 MAP_SHARED, fd, 0);
+  close(fd);
+  shm_unlink(ss.str().c_str());
+  if (p == MAP_FAILED) {
+    LOG_ERROR() << "mmap failed: " << strerror(errno) << "\n";
+    return IPC_FAILURE;
+  }
+  segment_ = (char*)p;
+
+  sends_.resize(NUM_CHANNELS * num_procs_);
+  recvs_.resize(NUM_CHANNELS * num_procs_);
+
+  parent_ = getpid();
+  for (int i = 1; i < num_procs_; ++i) {
+    pid_t pid = fork();
+    if (pid < 0) {
+      LOG_ERROR() << "fork failed: " << strerror(errno) << "\n";
+      PSAbort(1);
+    }
+    if (pid == 0) {
+      rank_ = i;
+      children_.clear();
+      break;
+    }
+    children_.push_back(pid);
+  }
+  LOG_DEBUG() << "Shared memory IPC initialized (rank: " << rank_
+              << ", #procs: " << num_procs_
+              << ", ring size: " << ring_size_ << ")\n";
+  return IPC_SUCCESS;
+}
+
+InterProcComm::IPC_ERROR_T InterProcCommSHM::Finalize() {
+  // Flush messages that did not fit into the rings
+  bool pending = true;
+  while (pending) {
+    pending = false;
+    FOREACH (it, sends_.begin(), sends_.end()) {
+      if (!it->empty()) pending = true;
+    }
+    if (pending && !Progress()) Idle();
+  }
+  IPC_ERROR_T r = IPC_SUCCESS;
+  FOREACH (it, children_.begin(), children_.end()) {
+    int status;
+    waitpid(*it, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+      LOG_ERROR() << "Process " << *it << " exited abnormally\n";
+      r = IPC_FAILURE;
+    }
+  }
+  children_.clear();
+  munmap(segment_, segment_size_);
+  segment_ = NULL;
+  return r;
+}
+
+int InterProcCommSHM::GetRank() const {
+  return rank_;
+}
+
+int InterProcCommSHM::GetNumProcs() const {
+  return num_procs_;
+}
+
+void *InterProcCommSHM::CreateRequest() const {
+  return new Request();
+}
+
+void InterProcCommSHM::DeleteRequest(void *req) const {
+  delete static_cast<Request*>(req);
+}
+
+InterProcCommSHM::Ring *InterProcCommSHM::GetRing(int channel, int src,
+                                                  int dst) const {
+  size_t ring_stride = offsetof(Ring, data) + ring_size_;
+  ring_stride = (ring_stride + CACHE_LINE_SIZE - 1)
+      / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+  size_t idx = ((size_t)channel * num_procs_ + src) * num_procs_ + dst;
+  return (Ring*)(segment_ + ring_stride * idx);
+}
+
+// Each message is a size_t length header followed by the
+// payload. Messages are pushed directly when nothing is queued for
+// the destination and the ring has enough space; otherwise they are
+// copied and queued.
+void InterProcCommSHM::PostSend(int channel, const void *buf, size_t len,
+                                int dest) {
+  PSAssert(dest >= 0 && dest < num_procs_);
+  std::deque<PendingSend> &q = sends_[channel * num_procs_ + dest];
+  Ring *r = GetRing(channel, rank_, dest);
+  if (q.empty() &&
+      ring_size_ - RingAvailable(r) >= sizeof(size_t) + len) {
+    RingPush(r, ring_size_, (const char*)&len, sizeof(size_t));
+    RingPush(r, ring_size_, (const char*)buf, len);
+    return;
+  }
+  q.push_back(PendingSend());
+  PendingSend &ps = q.back();
+  ps.data.resize(sizeof(size_t) + len);
+  memcpy(&ps.data[0], &len, sizeof(size_t));
+  if (len > 0) memcpy(&ps.data[sizeof(size_t)], buf, len);
+  ps.done = 0;
+  ProgressSend(channel, dest);
+}
+
+void InterProcCommSHM::PostRecv(int channel, void *buf, size_t len,
+                                int src, Request *req) {
+  PSAssert(src >= 0 && src < num_procs_);
+  PendingRecv pr;
+  pr.buf = (char*)buf;
+  pr.len = len;
+  pr.done = 0;
+  pr.header_read = false;
+  pr.req = req;
+  recvs_[channel * num_procs_ + src].push_back(pr);
+  ProgressRecv(channel, src);
+}
+
+bool InterProcCommSHM::ProgressSend(int channel, int dest) {
+  std::deque<PendingSend> &q = sends_[channel * num_procs_ + dest];
+  Ring *r = GetRing(channel, rank_, dest);
+  bool moved = false;
+  while (!q.empty()) {
+    PendingSend &ps = q.front();
+    size_t n = RingPush(r, ring_size_, &ps.data[ps.done],
+                        ps.data.size() - ps.done);
+    if (n > 0) moved = true;
+    ps.done += n;
+    if (ps.done < ps.data.size()) break;
+    q.pop_front();
+  }
+  return moved;
+}
+
+bool InterProcCommSHM::ProgressRecv(int channel, int src) {
+  std::deque<PendingRecv> &q = recvs_[channel * num_procs_ + src];
+  Ring *r = GetRing(channel, src, rank_);
+  bool moved = false;
+  while (!q.empty()) {
+    PendingRecv &pr = q.front();
+    if (!pr.header_read) {
+      if (RingAvailable(r) < sizeof(size_t)) break;
+      size_t len;
+      RingPop(r, ring_size_, (char*)&len, sizeof(size_t));
+      if (len != pr.len) {
+        LOG_ERROR() << "Message size mismatch; expected " << pr.len
+                    << " bytes, but received " << len << " bytes from "
+                    << src << "\n";
+        PSAbort(1);
+      }
+      pr.header_read = true;
+      moved = true;
+    }
+    size_t n = RingPop(r, ring_size_, pr.buf + pr.done,
+                       pr.len - pr.done);
+    if (n > 0) moved = true;
+    pr.done += n;
+    if (pr.done < pr.len) break;
+    if (pr.req) pr.req->done = true;
+    q.pop_front();
+  }
+  return moved;
+}
+
+bool InterProcCommSHM::Progress() {
+  bool moved = false;
+  for (int c = 0; c < NUM_CHANNELS; ++c) {
+    for (int i = 0; i < num_procs_; ++i) {
+      if (!sends_[c * num_procs_ + i].empty()) {
+        moved |= ProgressSend(c, i);
+      }
+      if (!recvs_[c * num_procs_ + i].empty()) {
+        moved |= ProgressRecv(c, i);
+      }
+    }
+  }
+  return moved;
+}
+
+// A process waiting for a message from a crashed process would spin
+// forever, so the processes are checked whenever nothing moves. The
+// first process reaps the others, and the others watch the first.
+void InterProcCommSHM::Idle() {
+  if (rank_ != 0) {
+    if (getppid() != parent_) {
+      LOG_ERROR() << "Process " << parent_ << " of rank 0 exited\n";
+      PSAbort(1);
+    }
+  } else {
+    std::vector<int>::iterator it = children_.begin();
+    while (it != children_.end()) {
+      int status;
+      if (waitpid(*it, &status, WNOHANG) != *it) {
+        ++it;
+        continue;
+      }
+      // A process may finish while its messages are still in the rings
+      if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+        LOG_ERROR() << "Process " << *it << " exited abnormally\n";
+        PSAbort(1);
+      }
+      it = children_.erase(it);
+    }
+  }
+  sched_yield();
+}
+
+void InterProcCommSHM::WaitRequest(Request *req) {
+  while (!req->done) {
+    if (!Progress()) Idle();
+  }
+}
+
+void InterProcCommSHM::SendOn(int channel, const void *buf, size_t len,
+                              int dest) {
+  PostSend(channel, buf, len, dest);
+}
+
+void InterProcCommSHM::RecvOn(int channel, void *buf, size_t len,
+                              int src) {
+  Request req;
+  PostRecv(channel, buf, len, src, &req);
+  WaitRequest(&req);
+}
+
+int InterProcCommSHM::GetChannel(int tag) const {
+  PSAssert(tag >= 0 && tag < NUM_TAGS);
+  return tag;
+}
+
+InterProcComm::IPC_ERROR_T InterProcCommSHM::Send(
+    void *buf, size_t len, int dest, int tag) {
+  SendOn(GetChannel(tag), buf, len, dest);
+  return IPC_SUCCESS;
+}
+
+// Sends are buffered, so the request completes immediately.
+InterProcComm::IPC_ERROR_T InterProcCommSHM::Isend(
+    void *buf, size_t len, int dest, void *req, int tag) {
+  SendOn(GetChannel(tag), buf, len, dest);
+  static_cast<Request*>(req)->done = true;
+  return IPC_SUCCESS;
+}
+
+InterProcComm::IPC_ERROR_T InterProcCommSHM::Recv(
+    void *buf, size_t len, int src, int tag) {
+  int channel = GetChannel(tag);
+  if (src != ANY_SOURCE) {
+    RecvOn(channel, buf, len, src);
+    return IPC_SUCCESS;
+  }
+  // Take the first process that has a message of the tag not
+  // claimed by receives already posted.
+  while (true) {
+    bool moved = Progress();
+    for (int i = 0; i < num_procs_; ++i) {
+      if (recvs_[channel * num_procs_ + i].empty() &&
+          RingAvailable(GetRing(channel, i, rank_)) >= sizeof(size_t)) {
+        RecvOn(channel, buf, len, i);
+        return IPC_SUCCESS;
+      }
+    }
+    if (!moved) Idle();
+  }
+  return IPC_SUCCESS;
+}
+
+InterProcComm::IPC_ERROR_T InterProcCommSHM::Irecv(
+    void *buf, size_t len, int src, void *req, int tag) {
+  if (src == ANY_SOURCE) {
+    LOG_ERROR() << "Non-blocking receive from any source not supported\n";
+    PSAbort(1);
+  }
+  PostRecv(GetChannel(tag), buf, len, src, static_cast<Request*>(req));
+  return IPC_SUCCESS;
+}
+
+InterProcComm::IPC_ERROR_T InterProcCommSHM::Wait(void *req) {
+  WaitRequest(static_cast<Request*>(req));
+  return IPC_SUCCESS;
+}
+
+InterProcComm::IPC_ERROR_T InterProcCommSHM::WaitAll() {
+  bool pending = true;
+  while (pending) {
+    pending = false;
+    FOREACH (it, sends_.begin(), sends_.end()) {
+      if (!it->empty()) pending = true;
+    }
+    FOREACH (it, recvs_.begin(), recvs_.end()) {
+      if (!it->empty()) pending = true;
+    }
+    if (pending && !Progress()) Idle();
+  }
+  return IPC_SUCCESS;
+}
+
+InterProcComm::IPC_ERROR_T InterProcCommSHM::Test(void *req) {
+  Progress();
+  return static_cast<Request*>(req)->done ? IPC_SUCCESS : IPC_FAILURE;
+}
+
+InterProcComm::IPC_ERROR_T InterProcCommSHM::Bcast(void *buf, size_t len,
+                                                   int root) {
+  if (rank_ == root) {
+    for (int i = 0; i < num_procs_; ++i) {
+      if (i == root) continue;
+      SendOn(COLLECTIVE, buf, len, i);
+    }
+  } else {
+    RecvOn(COLLECTIVE, buf, len, root);
+  }
+  return IPC_SUCCESS;
+}
+
+template <class T>
+static void ReduceBuffer(void *dst, const void *src, int count,
+                         PSReduceOp op) {
+  boost::function<T (T, T)> func = GetReducer<T>(op);
+  T *d = (T*)dst;
+  const T *s = (const T*)src;
+  for (int i = 0; i < count; ++i) {
+    d[i] = func(d[i], s[i]);
+  }
+}
+
+InterProcComm::IPC_ERROR_T InterProcCommSHM::Reduce(void *src, void *dst,
+                                                    int count, PSType type,
+                                                    PSReduceOp op,
+                                                    int root) {
+  size_t elm_size;
+  switch (type) {
+    case PS_INT:
+      elm_size = sizeof(int);
+      break;
+    case PS_LONG:
+      elm_size = sizeof(long);
+      break;
+    case PS_FLOAT:
+      elm_size = sizeof(float);
+      break;
+    case PS_DOUBLE:
+      elm_size = sizeof(double);
+      break;
+    default:
+      LOG_ERROR() << "Unsupported type: " << type << "\n";
+      PSAbort(1);
+      return IPC_FAILURE;
+  }
+  size_t len = elm_size * count;
+  if (rank_ != root) {
+    SendOn(COLLECTIVE, src, len, root);
+    return IPC_SUCCESS;
+  }
+  memcpy(dst, src, len);
+  std::vector<char> buf(len);
+  for (int i = 0; i < num_procs_; ++i) {
+    if (i == root) continue;
+    RecvOn(COLLECTIVE, &buf[0], len, i);
+    switch (type) {
+      case PS_INT:
+        ReduceBuffer<int>(dst, &buf[0], count, op);
+        break;
+      case PS_LONG:
+        ReduceBuffer<long>(dst, &buf[0], count, op);
+        break;
+      case PS_FLOAT:
+        ReduceBuffer<float>(dst, &buf[0], count, op);
+        break;
+      case PS_DOUBLE:
+        ReduceBuffer<double>(dst, &buf[0], count, op);
+        break;
+    }
+  }
+  return IPC_SUCCESS;
+}
+
+InterProcComm::IPC_ERROR_T InterProcCommSHM::Barrier() {
+  char token = 0;
+  if (rank_ == 0) {
+    for (int i = 1; i < num_procs_; ++i) {
+      RecvOn(COLLECTIVE, &token, sizeof(char), i);
+    }
+    for (int i = 1; i < num_procs_; ++i) {
+      SendOn(COLLECTIVE, &token, sizeof(char), i);
+    }
+  } else {
+    SendOn(COLLECTIVE, &token, sizeof(char), 0);
+    RecvOn(COLLECTIVE, &token, sizeof(char), 0);
+  }
+  return IPC_SUCCESS;
+}
+
+} // namespace runtime
+} // namespace physis
@@ -0,0 +1,112 @@
+// Copyright 2011-2012, RIKEN AICS.
+// All rights reserved.
+//
+// This file is distributed under the BSD license. See LICENSE.txt for
+// details.
+
+#ifndef PHYSIS_RUNTIME_IPC_SHM_H_
+#define PHYSIS_RUNTIME_IPC_SHM_H_
+
+#include <deque>
+
+#include "runtime/ipc.h"
+
+namespace physis {
+namespace runtime {
+
+//! Node-local communicator over POSIX shared memory.
+/*!
+  Init forks the processes given by the --physis-shm option, and
+  every pair of processes is connected with single-producer
+  single-consumer ring buffers in a shared memory segment. Sends are
+  buffered, so they complete immediately; pending messages are
+  pushed to and pulled from the rings whenever a request is waited
+  or tested. Each message tag and the collectives use their own
+  rings so that they never match messages of others.
+ */
+class InterProcCommSHM: public InterProcComm {
+ protected:
+  InterProcCommSHM();
+  virtual ~InterProcCommSHM();
+ public:
+  static InterProcCommSHM* GetInstance();
+  //! Returns true if the shared memory communicator is requested.
+  static bool IsRequested(int argc, char **argv);
+  virtual void *CreateRequest() const;
+  virtual void DeleteRequest(void *req) const;
+  virtual IPC_ERROR_T Init(int *argc, char ***argv);
+  virtual IPC_ERROR_T Finalize();
+  virtual int GetRank() const;
+  virtual int GetNumProcs() const;
+  virtual IPC_ERROR_T Send(void *buf, size_t len, int dest,
+                           int tag=TAG_DATA);
+  virtual IPC_ERROR_T Isend(void *buf, size_t len,
+                            int dest, void *req, int tag=TAG_DATA);
+  virtual IPC_ERROR_T Recv(void *buf, size_t len, int src,
+                           int tag=TAG_DATA);
+  virtual IPC_ERROR_T Irecv(void *buf, size_t len,
+                    int src, void *req, int tag=TAG_DATA);
+  virtual IPC_ERROR_T Wait(void *req);
+  virtual IPC_ERROR_T WaitAll();
+  virtual IPC_ERROR_T Test(void *req);
+  virtual IPC_ERROR_T Bcast(void *buf, size_t len, int root);
+  virtual IPC_ERROR_T Reduce(void *src, void *dst,
+                     int count, PSType type,
+                     PSReduceOp op, int root);
+  virtual IPC_ERROR_T Barrier();
+
+  //! Ring buffer shared by a sender and a receiver.
+  struct Ring;
+  struct Request {
+    bool done;
+    Request(): done(false) {}
+  };
+
+ protected:
+  //! Channels 0 to NUM_TAGS - 1 carry the messages of each tag.
+  enum CHANNEL {COLLECTIVE = NUM_TAGS, NUM_CHANNELS = NUM_TAGS + 1};
+  int GetChannel(int tag) const;
+  struct PendingSend {
+    std::vector<char> data;
+    size_t done;
+  };
+  struct PendingRecv {
+    char *buf;
+    size_t len;
+    size_t done;
+    bool header_read;
+    Request *req;
+  };
+  Ring *GetRing(int channel, int src, int dst) const;
+  //! Pushes and pulls pending messages. Returns true if any byte moved.
+  bool Progress();
+  //! Yields the CPU; aborts if another process has died.
+  void Idle();
+  bool ProgressSend(int channel, int dest);
+  bool ProgressRecv(int channel, int src);
+  void PostSend(int channel, const void *buf, size_t len, int dest);
+  void PostRecv(int channel, void *buf, size_t len, int src,
+                Request *req);
+  void WaitRequest(Request *req);
+  void SendOn(int channel, const void *buf, size_t len, int dest);
+  void RecvOn(int channel, void *buf, size_t len, int src);
+
+  int rank_;
+  int num_procs_;
+  size_t ring_size_;
+  char *segment_;
+  size_t segment_size_;
+  //! Pending sends indexed by channel * num_procs_ + dest
+  std::vector<std::deque<PendingSend> > sends_;
+  //! Pending receives indexed by channel * num_procs_ + src
+  std::vector<std::deque<PendingRecv> > recvs_;
+  std::vector<int> children_;
+  //! Process ID of rank 0
+  int parent_;
+  static InterProcCommSHM *singleton_;
+};
+
+} // namespace runtime
+} // namespace physis
+
+#endif /* PHYSIS_RUNTIME_IPC_SHM_H_ */
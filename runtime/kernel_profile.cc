@@ -0,0 +1,157 @@
+// Copyright 2011-2012, RIKEN AICS.
+// All rights reserved.
+//
+// This file is distributed under the BSD license. See LICENSE.txt for
+// details.
+
+#include "runtime/kernel_profile.h"
+
+#include <stdio.h>
+#include <vector>
+
+#include "runtime/timing.h"
+
+namespace physis {
+namespace runtime {
+
+namespace {
+// Each array is larger than the last-level caches
+const size_t kTriadLength = ((size_t)1) << 22;
+const int kTriadTrials = 3;
+// Keeps the triad from being eliminated
+volatile double triad_sink;
+}
+
+KernelProfile *KernelProfile::GetInstance() {
+  static KernelProfile *profile = new KernelProfile();
+  return profile;
+}
+
+void KernelProfile::Add(const std::string &name, double bytes,
+                        double flops, double time) {
+  StencilRunProfile &p = runs_[name];
+  ++p.num_calls;
+  p.bytes += bytes;
+  p.flops += flops;
+  p.time += time;
+}
+
+double KernelProfile::GetPeakBandwidth() {
+  if (peak_bandwidth_ <= 0.0) {
+    peak_bandwidth_ = MeasureTriadBandwidth();
+  }
+  return peak_bandwidth_;
+}
+
+double KernelProfile::GetPeakBandwidth(InterProcComm *ipc, int root) {
+  // All processes keep the result so that they agree on whether to
+  // measure it in later calls
+  if (peak_bandwidth_ <= 0.0) {
+    ipc->Barrier();
+    double triad = MeasureTriadBandwidth();
+    double sum = 0.0;
+    ipc->Reduce(&triad, &sum, 1, PS_DOUBLE, PS_SUM, root);
+    ipc->Bcast(&sum, sizeof(double), root);
+    peak_bandwidth_ = sum;
+  }
+  return peak_bandwidth_;
+}
+
+void KernelProfile::Reduce(InterProcComm *ipc, int root) {
+  // All processes run the same kernels, so the maps have the same keys
+  int n = runs_.size();
+  std::vector<double> src(n * 3), dst(n * 3);
+  int i = 0;
+  FOREACH (it, runs_.begin(), runs_.end()) {
+    src[i] = it->second.bytes;
+    src[n + i] = it->second.flops;
+    src[n * 2 + i] = it->second.time;
+    ++i;
+  }
+  if (n > 0) {
+    ipc->Reduce(&src[0], &dst[0], n * 2, PS_DOUBLE, PS_SUM, root);
+    ipc->Reduce(&src[n * 2], &dst[n * 2], n, PS_DOUBLE, PS_MAX, root);
+  }
+  GetPeakBandwidth(ipc, root);
+  if (ipc->GetRank() != root) return;
+  i = 0;
+  FOREACH (it, runs_.begin(), runs_.end()) {
+    it->second.bytes = dst[i];
+    it->second.flops = dst[n + i];
+    it->second.time = dst[n * 2 + i];
+    ++i;
+  }
+}
+
+std::ostream &KernelProfile::Print(std::ostream &os) {
+  double peak = GetPeakBandwidth();
+  char buf[256];
+  snprintf(buf, sizeof(buf),
+           "Stencil run profile (attainable bandwidth: %.2f GB/s)\n", peak);
+  os << buf;
+  FOREACH (it, runs_.begin(), runs_.end()) {
+    const StencilRunProfile &p = it->second;
+    double gbs = p.time > 0 ? p.bytes / p.time * 1.0e-09 : 0.0;
+    double gflops = p.time > 0 ? p.flops / p.time * 1.0e-09 : 0.0;
+    double intensity = p.bytes > 0 ? p.flops / p.bytes : 0.0;
+    snprintf(buf, sizeof(buf),
+             "  %s: %lu calls, %.6f s, %.2f GB/s (%.1f%% of attainable), "
+             "%.2f GFLOP/s (%.2f flops/byte, attainable %.2f GFLOP/s)\n",
+             it->first.c_str(), (unsigned long)p.num_calls, p.time, gbs,
+             peak > 0 ? gbs / peak * 100.0 : 0.0, gflops, intensity,
+             intensity * peak);
+    os << buf;
+  }
+  return os;
+}
+
+double MeasureTriadBandwidth() {
+  double *a = new double[kTriadLength];
+  double *b = new double[kTriadLength];
+  double *c = new double[kTriadLength];
+  long n = (long)kTriadLength;
+  long i;
+  // Threads touch the same pages as in the triad
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+  for (i = 0; i < n; ++i) {
+    a[i] = 0.0;
+    b[i] = 1.0;
+    c[i] = 2.0;
+  }
+  double best = 0.0;
+  for (int t = 0; t < kTriadTrials; ++t) {
+    performance::Stopwatch st;
+    st.Start();
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+    for (i = 0; i < n; ++i) {
+      a[i] = b[i] + 3.0 * c[i];
+    }
+    // Stopwatch returns milliseconds
+    double time = st.Stop() * 1.0e-03;
+    if (time > 0) {
+      best = std::max(best, 3.0 * sizeof(double) * kTriadLength / time
+                      * 1.0e-09);
+    }
+  }
+  triad_sink = a[kTriadLength - 1];
+  delete[] a;
+  delete[] b;
+  delete[] c;
+  return best;
+}
+
+} // namespace runtime
+} // namespace physis
+
+using physis::runtime::KernelProfile;
+
+extern "C" {
+  void __PSProfileStencilRun(const char *name, double bytes,
+                             double flops, float time) {
+    KernelProfile::GetInstance()->Add(name, bytes, flops, time * 1.0e-03);
+  }
+}
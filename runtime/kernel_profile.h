@@ -0,0 +1,86 @@
+// Copyright 2011-2012, RIKEN AICS.
+// All rights reserved.
+//
+// This file is distributed under the BSD license. See LICENSE.txt for
+// details.
+
+#ifndef PHYSIS_RUNTIME_KERNEL_PROFILE_H_
+#define PHYSIS_RUNTIME_KERNEL_PROFILE_H_
+
+#include <map>
+#include <string>
+#include <ostream>
+
+#include "runtime/runtime_common.h"
+#include "runtime/ipc.h"
+
+namespace physis {
+namespace runtime {
+
+//! Accumulated measurements of a stencil run.
+struct StencilRunProfile {
+  size_t num_calls;
+  double time;
+  //! Compulsory bytes given by the translator
+  double bytes;
+  double flops;
+  StencilRunProfile(): num_calls(0), time(0.0), bytes(0.0), flops(0.0) {}
+};
+
+//! Profile of the stencil runs of a process.
+/*!
+  The generated code reports each stencil run with its elapsed time
+  and the bytes and flops estimated by the translator when
+  TRACE_KERNEL is enabled. The report compares the achieved
+  bandwidth with the attainable one, which is either given with
+  --physis-peak-bandwidth <GB/s> or measured with a STREAM triad
+  when the report is printed. The triad uses as many threads as the
+  stencil runs.
+ */
+class KernelProfile {
+ public:
+  KernelProfile(): peak_bandwidth_(0.0) {}
+  //! Returns the process-wide profile.
+  static KernelProfile *GetInstance();
+  void Add(const std::string &name, double bytes, double flops,
+           double time);
+  bool empty() const { return runs_.empty(); }
+  //! Sets the attainable bandwidth in GB/s.
+  void set_peak_bandwidth(double gbs) { peak_bandwidth_ = gbs; }
+  //! Returns the attainable bandwidth in GB/s, measuring it if not set.
+  double GetPeakBandwidth();
+  //! Returns the attainable bandwidth of all processes in GB/s.
+  /*!
+    This is a collective operation. Unless given, the bandwidth is
+    the sum of the triads run by all processes at the same time, so
+    that they share the memory system as in the stencil runs. A
+    given bandwidth is taken as the one of all processes.
+
+    \param ipc Communicator of all processes.
+    \param root Rank of the process reducing the triads.
+   */
+  double GetPeakBandwidth(InterProcComm *ipc, int root);
+  //! Aggregates the profiles of all processes at the root process.
+  /*!
+    This is a collective operation. The bytes and flops of a kernel
+    are summed and its time is the maximum across processes. The
+    attainable bandwidth is the one of all processes as well.
+
+    \param ipc Communicator of all processes.
+    \param root Rank of the process to hold the result.
+   */
+  void Reduce(InterProcComm *ipc, int root);
+  std::ostream &Print(std::ostream &os);
+ protected:
+  //! Profiles by kernel names
+  std::map<std::string, StencilRunProfile> runs_;
+  double peak_bandwidth_;
+};
+
+//! Returns the bandwidth of a STREAM triad in GB/s.
+double MeasureTriadBandwidth();
+
+} // namespace runtime
+} // namespace physis
+
+#endif /* PHYSIS_RUNTIME_KERNEL_PROFILE_H_ */
@@ -8,8 +8,11 @@
 
 
 #include <stdarg.h>
+#include <algorithm>
 #include <map>
 #include <string>
+#include <vector>
+#include <boost/bind.hpp>
 
 #include "mpi.h"
 
@@ -18,12 +21,16 @@
 #include "runtime/mpi_util.h"
 #include "runtime/mpi_runtime_common.h"
 #include "runtime/runtime_mpi.h"
+#include "runtime/buffer_pool.h"
+#include "runtime/kernel_profile.h"
+#include "runtime/task_graph.h"
 
 #include "physis/physis_mpi.h"
 #include "physis/physis_util.h"
 
 using std::map;
 using std::string;
+using std::vector;
 
 using namespace physis::runtime;
 using physis::IndexArray;
@@ -39,10 +46,100 @@ GridSpaceMPI *gs;
 } // namespace runtime
 } // namespace physis
 
+namespace {
+
+// Deferred calls of the master; NULL unless deferred execution is
+// enabled
+TaskGraph *graph = NULL;
+
+void ReleaseStencils(int num_stencils, void **stencils,
+                     unsigned *stencil_sizes) {
+  for (int i = 0; i < num_stencils; ++i) {
+    PoolFree(stencils[i]);
+  }
+  delete[] stencils;
+  delete[] stencil_sizes;
+}
+
+void StencilRun(int id, int iter, int num_grids, __PSGridMPI **grids,
+                const int *modes, int num_stencils, va_list vl) {
+  void **stencils = new void*[num_stencils];
+  unsigned *stencil_sizes = new unsigned[num_stencils];
+  for (int i = 0; i < num_stencils; ++i) {
+    unsigned stencil_size = (unsigned)va_arg(vl, size_t);
+    void *sobj = va_arg(vl, void*);
+    stencils[i] = sobj;
+    stencil_sizes[i] = stencil_size;
+  }
+  if (graph == NULL || grids == NULL) {
+    // Accesses are unknown without the grid list
+    if (graph) graph->Flush();
+    master->StencilRun(id, iter, num_stencils, stencils, stencil_sizes);
+    delete[] stencils;
+    delete[] stencil_sizes;
+    return;
+  }
+  // The stencil objects are on the stack of the caller
+  for (int i = 0; i < num_stencils; ++i) {
+    void *sobj = PoolAllocate(stencil_sizes[i]);
+    memcpy(sobj, stencils[i], stencil_sizes[i]);
+    stencils[i] = sobj;
+  }
+  vector<Grid*> reads, writes;
+  vector<Grid*> halos;
+  for (int i = 0; i < num_grids; ++i) {
+    GridMPI *g = GridMPI::FromInfo(grids[i]);
+    if (modes[i] & PS_GRID_READ) reads.push_back(g);
+    if (modes[i] & PS_GRID_WRITE) writes.push_back(g);
+    if ((modes[i] & PS_GRID_HALO) &&
+        std::find(halos.begin(), halos.end(), g) == halos.end()) {
+      halos.push_back(g);
+    }
+  }
+  // Halo exchanges are separate tasks so that they can be moved
+  // ahead of independent runs. The halo is written, which orders the
+  // exchange after the previous accesses and before the run.
+  FOREACH (it, halos.begin(), halos.end()) {
+    graph->Add(TASK_EXCHANGE,
+               boost::bind(&Master::PrefetchHalo, master,
+                           static_cast<GridMPI*>(*it)),
+               vector<Grid*>(1, *it), vector<Grid*>(1, *it), false);
+  }
+  graph->Add(TASK_RUN,
+             boost::bind(&Master::StencilRun, master, id, iter,
+                         num_stencils, stencils, stencil_sizes),
+             reads, writes, false,
+             boost::bind(&ReleaseStencils, num_stencils, stencils,
+                         stencil_sizes));
+}
+
+void GridReduce(void *buf, PSReduceOp op, __PSGridMPI *g) {
+  GridMPI *gm = GridMPI::FromInfo(g);
+  if (graph == NULL) {
+    master->GridReduce(buf, op, gm);
+    return;
+  }
+  graph->Add(TASK_REDUCE,
+             boost::bind(&Master::GridReduce, master, buf, op, gm),
+             vector<Grid*>(1, gm), vector<Grid*>(), false);
+  // The value is read as soon as this returns
+  graph->Flush(gm);
+}
+
+__PSDomain DomainMasked(__PSDomain dom, void *mask) {
+  GridMPI *gm = GridMPI::FromInfo(mask);
+  // The mask is read now
+  if (graph) graph->Flush(gm);
+  dom.mask = master->DomainMask(dom, gm);
+  return dom;
+}
+
+} // namespace
+
 
 template <class T>
 static T *__PSGridGetAddr(void *g, const IndexArray &indices) {
-  GridMPI *gm = (GridMPI*)g;
+  GridMPI *gm = GridMPI::FromInfo(g);
   return (T*)(gm->GetAddress(indices));
 }
 template <class T>
@@ -74,12 +171,25 @@ extern "C" {
     gs = rt->gs();
     if (rt->IsMaster()) {
       master = static_cast<Master*>(rt->proc());
+      if (rt->deferred()) graph = new TaskGraph();
     } else {
       rt->Listen();
     }
   }
 
   void PSFinalize() {
+    if (graph) {
+      graph->Flush();
+      LOG_INFO() << *graph << "\n";
+      delete graph;
+      graph = NULL;
+    }
+    // All processes run the same kernels, so their profiles are
+    // either all empty or not
+    if (!KernelProfile::GetInstance()->empty()) {
+      master->ReduceKernelProfile();
+      KernelProfile::GetInstance()->Print(std::cerr);
+    }
     master->Finalize();
   }
 
@@ -132,6 +242,18 @@ extern "C" {
     return d;
   }
 
+  PSDomain1D PSDomain1DMasked(PSDomain1D dom, void *mask) {
+    return DomainMasked(dom, mask);
+  }
+
+  PSDomain2D PSDomain2DMasked(PSDomain2D dom, void *mask) {
+    return DomainMasked(dom, mask);
+  }
+
+  PSDomain3D PSDomain3DMasked(PSDomain3D dom, void *mask) {
+    return DomainMasked(dom, mask);
+  }
+
   void __PSDomainSetLocalSize(__PSDomain *dom) {
     IndexArray local_min = gs->my_offset();
     IndexArray global_min(dom->min);
@@ -151,53 +273,84 @@ extern "C" {
     std::ostringstream ss;
     if (master) ss << *master << "\n";
     ss << *gs << "\n";
+    ss << "Buffer pool: " << BufferPool::GetInstance()->GetStats() << "\n";
+    if (master) master->MemoryReport(ss);
+    if (graph) ss << *graph << "\n";
     fprintf(out, "%s", ss.str().c_str());
   }
 
+  double PSGetHaloExchangeTime() {
+    return master->HaloExchangeTime();
+  }
+
+  double PSGetAttainableBandwidth() {
+    return master->PeakBandwidth();
+  }
+
   
   int __PSGridGetID(__PSGridMPI *g) {
-    return ((GridMPI *)g)->id();
+    return GridMPI::FromInfo(g)->id();
   }
 
   __PSGridMPI *__PSGetGridByID(int id) {
-    return (__PSGridMPI*)gs->FindGrid(id);
+    return static_cast<GridMPI*>(gs->FindGrid(id))->info();
   }
 
   void PSGridFree(void *p) {
-    master->GridDelete((GridMPI*)p);
+    GridMPI *gm = GridMPI::FromInfo(p);
+    if (graph) graph->Flush(gm);
+    master->GridDelete(gm);
   }
 
   void PSGridCopyin(void *g, const void *buf) {
-    master->GridCopyin((GridMPI*)g, buf);
+    GridMPI *gm = GridMPI::FromInfo(g);
+    if (graph == NULL) {
+      master->GridCopyin(gm, buf);
+      return;
+    }
+    // buf may be modified once this returns
+    size_t s = gm->size().accumulate(gm->num_dims()) * gm->elm_size();
+    void *copy = PoolAllocate(s);
+    memcpy(copy, buf, s);
+    graph->Add(TASK_COPYIN,
+               boost::bind(&Master::GridCopyin, master, gm, copy),
+               vector<Grid*>(), vector<Grid*>(1, gm), true,
+               boost::bind(&PoolFree, copy));
     return;
   }
 
   void PSGridCopyout(void *g, void *buf) {
-    master->GridCopyout((GridMPI*)g, buf);;
+    GridMPI *gm = GridMPI::FromInfo(g);
+    if (graph == NULL) {
+      master->GridCopyout(gm, buf);
+      return;
+    }
+    graph->Add(TASK_COPYOUT,
+               boost::bind(&Master::GridCopyout, master, gm, buf),
+               vector<Grid*>(1, gm), vector<Grid*>(), false);
+    graph->Flush(gm);
     return;
   }
 
   PSIndex PSGridDim(void *p, int d) {
-    Grid *g = (Grid *)p;    
-    return g->size_[d];
+    return static_cast<__PSGridMPI*>(p)->dim[d];
   }
 
   void __PSStencilRun(int id, int iter, int num_stencils, ...) {
-    //master->StencilRun(id, stencil_obj_size, stencil_obj, iter);
-    void **stencils = new void*[num_stencils];
-    unsigned *stencil_sizes = new unsigned[num_stencils];
     va_list vl;
     va_start(vl, num_stencils);
-    for (int i = 0; i < num_stencils; ++i) {
-      unsigned stencil_size = (unsigned)va_arg(vl, size_t);
-      void *sobj = va_arg(vl, void*);
-      stencils[i] = sobj;
-      stencil_sizes[i] = stencil_size;
-    }
+    StencilRun(id, iter, 0, NULL, NULL, num_stencils, vl);
+    va_end(vl);
+    return;
+  }
+
+  void __PSStencilRunWithAccess(int id, int iter, int num_grids,
+                                __PSGridMPI **grids, const int *modes,
+                                int num_stencils, ...) {
+    va_list vl;
+    va_start(vl, num_stencils);
+    StencilRun(id, iter, num_grids, grids, modes, num_stencils, vl);
     va_end(vl);
-    master->StencilRun(id, iter, num_stencils, stencils, stencil_sizes);
-    delete[] stencils;
-    delete[] stencil_sizes;
     return;
   }
 
@@ -205,7 +358,9 @@ extern "C" {
                        int reuse) {
     // NOTE: This should be very rare. Not sure it should actually be
     // supported either.
-    PSAssert(0 && "Not implemented yet");
+    LOG_ERROR() << "Stencils accessing grids at other than neighbor "
+                << "offsets are not supported\n";
+    PSAbort(1);
     return;
   }
   
@@ -227,47 +382,53 @@ extern "C" {
                   << gs->global_size() << "\n";
       return NULL;
     }
-    return master->GridNew(
+    GridMPI *g = master->GridNew(
         type, elm_size, dim, gsize,
         IndexArray(), stencil_offset_min, stencil_offset_max,
         attr);
+    return g->info();
+  }
+
+  __PSGridMPI* __PSGridNewSoAMPI(PSType type, int elm_size, int dim,
+                                 const PSVectorInt size,
+                                 int attr,
+                                 const PSVectorInt global_offset,
+                                 const PSVectorInt stencil_offset_min,
+                                 const PSVectorInt stencil_offset_max,
+                                 int lanes, int num_members,
+                                 const size_t *member_layout) {
+    PSAssert(global_offset == NULL);
+    // Bricks of points are not interleaved
+    if (attr & PS_GRID_ATTRIBUTE_BRICK) {
+      LOG_ERROR() << "SoA grids cannot be stored in bricks\n";
+      PSAbort(1);
+    }
+    IndexArray gsize = IndexArray(size);
+    if (gsize > gs->global_size()) {
+      LOG_ERROR() << "Cannot create grids (size: " << gsize
+                  << " larger than the grid space ("
+                  << gs->global_size() << "\n";
+      return NULL;
+    }
+    GridMPI *g = master->GridNewSoA(
+        type, elm_size, dim, gsize,
+        IndexArray(), stencil_offset_min, stencil_offset_max,
+        attr, lanes, num_members, member_layout);
+    return g->info();
   }
 
-  void __PSGridSwap(void *p) {
+  void __PSGridSwap(__PSGridMPI *g) {
     // Do nothing
     //((GridMPI *)p)->Swap();
     return;
   }
 
-  PSIndex __PSGridGetOffset1D(__PSGridMPI *g, PSIndex i1) {
-    return static_cast<GridMPI*>(g)->CalcOffset<1>(IndexArray(i1));
-  }
-  PSIndex __PSGridGetOffset2D(__PSGridMPI *g, PSIndex i1,
-                              PSIndex i2) {
-    return static_cast<GridMPI*>(g)->CalcOffset<2>(
-        IndexArray(i1, i2));
+  void __PSGridSnapshot(__PSGridMPI *g) {
+    GridMPI::FromInfo(g)->Snapshot();
   }
-  PSIndex __PSGridGetOffset3D(__PSGridMPI *g, PSIndex i1,
-                              PSIndex i2, PSIndex i3) {
-    return static_cast<GridMPI*>(g)->CalcOffset<3>(
-        IndexArray(i1, i2, i3));
-  }
-  PSIndex __PSGridGetOffsetPeriodic1D(__PSGridMPI *g, PSIndex i1) {
-    return static_cast<GridMPI*>(g)->CalcOffsetPeriodic<1>(
-        IndexArray(i1));
-  }
-  PSIndex __PSGridGetOffsetPeriodic2D(__PSGridMPI *g, PSIndex i1,
-                                      PSIndex i2) {
-    return static_cast<GridMPI*>(g)->CalcOffsetPeriodic<2>(
-        IndexArray(i1, i2));
-  }
-  PSIndex __PSGridGetOffsetPeriodic3D(__PSGridMPI *g, PSIndex i1,
-                                      PSIndex i2, PSIndex i3) {
-    return static_cast<GridMPI*>(g)->CalcOffsetPeriodic<3>(
-        IndexArray(i1, i2, i3));
-  }
-  void *__PSGridGetBaseAddr(__PSGridMPI *g) {
-    return static_cast<GridMPI*>(g)->_data();
+
+  void __PSGridReleaseSnapshot(__PSGridMPI *g) {
+    GridMPI::FromInfo(g)->ReleaseSnapshot();
   }
 
   void __PSLoadNeighbor(__PSGridMPI *g,
@@ -276,20 +437,64 @@ extern "C" {
                         int diagonal, int reuse, int overlap,
                         int periodic) {
     if (overlap) LOG_WARNING() << "Overlap possible, but not implemented\n";
-    GridMPI *gm = (GridMPI*)g;
+    GridMPI *gm = GridMPI::FromInfo(g);
     gs->LoadNeighbor(gm, IndexArray(offset_min), IndexArray(offset_max),
                      (bool)diagonal, reuse, periodic);
     return;
   }
 
+  void __PSLoadNeighborMembers(__PSGridMPI *g,
+                               int num_members,
+                               const size_t *member_layout,
+                               const int *offset_min,
+                               const int *offset_max,
+                               int diagonal, int reuse, int overlap,
+                               int periodic) {
+    if (overlap) LOG_WARNING() << "Overlap possible, but not implemented\n";
+    GridMPI *gm = GridMPI::FromInfo(g);
+    std::vector<MemberHalo> members(num_members);
+    for (int m = 0; m < num_members; ++m) {
+      MemberHalo &mh = members[m];
+      mh.offset = member_layout[m * 2];
+      mh.size = member_layout[m * 2 + 1];
+      const int *omin = offset_min + m * PS_MAX_DIM;
+      const int *omax = offset_max + m * PS_MAX_DIM;
+      for (int i = 0; i < PS_MAX_DIM; ++i) {
+        mh.width.bw[i] = (omin[i] <= 0) ? (unsigned)(abs(omin[i])) : 0;
+        mh.width.fw[i] = (omax[i] >= 0) ? (unsigned)(omax[i]) : 0;
+      }
+    }
+    gs->LoadNeighborMembers(gm, members, (bool)diagonal, reuse, periodic);
+    return;
+  }
+
+  void __PSGridSet(__PSGridMPI *g, void *buf, ...) {
+    GridMPI *gm = GridMPI::FromInfo(g);
+    // Pending tasks accessing the grid precede the update
+    if (graph) graph->Flush(gm);
+    int nd = gm->num_dims();
+    va_list vl;
+    va_start(vl, buf);
+    IndexArray index;
+    for (int i = 0; i < nd; ++i) {
+      index[i] = va_arg(vl, PSIndex);
+    }
+    va_end(vl);
+    master->GridSet(gm, buf, index);
+  }
+
+  void __PSGridFlush(__PSGridMPI *g) {
+    if (graph) graph->Flush(GridMPI::FromInfo(g));
+  }
+
   void __PSReduceGridFloat(void *buf, enum PSReduceOp op,
                            __PSGridMPI *g) {
-    master->GridReduce(buf, op, (GridMPI*)g);
+    GridReduce(buf, op, g);
   }
   
   void __PSReduceGridDouble(void *buf, enum PSReduceOp op,
                             __PSGridMPI *g) {
-    master->GridReduce(buf, op, (GridMPI*)g);    
+    GridReduce(buf, op, g);
   }
 
 #if 0
@@ -309,19 +514,6 @@ extern "C" {
     return v;
   }
   
-  void __PSGridSet(__PSGridMPI *g, void *buf, ...) {
-    GridMPI *gm = (GridMPI*)g;
-    int nd = gm->num_dims();
-    va_list vl;
-    va_start(vl, buf);
-    IndexArray index;
-    for (int i = 0; i < nd; ++i) {
-      index[i] = va_arg(vl, PSIndex);
-    }
-    va_end(vl);
-    master->GridSet(gm, buf, index);
-  }
-  
   int __PSIsRoot() {
     return pinfo->IsRoot();
   }
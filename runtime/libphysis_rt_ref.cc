@@ -12,29 +12,170 @@
 
 #include <stdarg.h>
 #include <functional>
+#include <vector>
 #include <boost/function.hpp>
 
 #include "runtime/runtime_ref.h"
+#include "runtime/buffer_pool.h"
+#include "runtime/kernel_profile.h"
+#include "runtime/brick.h"
 
 using namespace physis::runtime;
+using physis::IndexArray;
 
 namespace {
 
 RuntimeRef *rt;
 
+// Returns the number of elements allocated for a grid, which
+// includes padding of color-split grids, of partial bricks and of
+// partial blocks in the SoA layout.
+int64_t GetNumAllocatedElms(const __PSGrid *g) {
+  int64_t n = g->num_elms;
+  if (g->num_bricks[0]) {
+    n = 1;
+    for (int i = 0; i < g->num_dims; i++) {
+      n *= g->num_bricks[i] * PS_BRICK_WIDTH;
+    }
+  } else if (g->color_split) {
+    n = (g->dim[0] + 1) / 2 * 2;
+    for (int i = 1; i < g->num_dims; i++) {
+      n *= g->dim[i];
+    }
+  }
+  if (g->soa_lanes) {
+    n = (n + g->soa_lanes - 1) / g->soa_lanes * g->soa_lanes;
+  }
+  return n;
+}
+
+// Returns the buffer offset of the i'th element in the row-major
+// order.
+PSIndex GetElmOffset(__PSGrid *g, int64_t i) {
+  if (!g->color_split && !g->num_bricks[0]) return i;
+  PSIndex idx[PS_MAX_DIM] = {0, 0, 0};
+  for (int d = 0; d < g->num_dims; d++) {
+    idx[d] = i % g->dim[d];
+    i /= g->dim[d];
+  }
+  if (g->num_bricks[0]) {
+    switch (g->num_dims) {
+      case 1:
+        return __PSGridGetOffsetBrick1D(g, idx[0]);
+      case 2:
+        return __PSGridGetOffsetBrick2D(g, idx[0], idx[1]);
+      default:
+        return __PSGridGetOffsetBrick3D(g, idx[0], idx[1], idx[2]);
+    }
+  }
+  switch (g->num_dims) {
+    case 1:
+      return __PSGridGetOffsetColorSplit1D(g, idx[0]);
+    case 2:
+      return __PSGridGetOffsetColorSplit2D(g, idx[0], idx[1]);
+    default:
+      return __PSGridGetOffsetColorSplit3D(g, idx[0], idx[1], idx[2]);
+  }
+}
+
+// Copies the point at buffer offset e of a grid to or from a
+// buffer holding a single point.
+void CopyPoint(__PSGrid *g, PSIndex e, void *point, bool to_grid) {
+  if (!g->soa_lanes) {
+    char *p = ((char *)g->p0) + e * g->elm_size;
+    if (to_grid) memcpy(p, point, g->elm_size);
+    else memcpy(point, p, g->elm_size);
+    return;
+  }
+  for (int m = 0; m < g->num_members; ++m) {
+    size_t member_offset = g->member_layout[m * 2];
+    size_t member_size = g->member_layout[m * 2 + 1];
+    char *p = ((char *)g->p0) +
+        __PSGridAoSoAOffset(g, e, member_offset, member_size,
+                            g->soa_lanes);
+    char *q = ((char *)point) + member_offset;
+    if (to_grid) memcpy(p, q, member_size);
+    else memcpy(q, p, member_size);
+  }
+}
+
 template <class T>
 void PSReduceGridTemplate(void *buf, PSReduceOp op,
                           __PSGrid *g) {
   boost::function<T (T, T)> func = GetReducer<T>(op);
   T *d = (T *)g->p0;
-  T v = d[0];
+  T v = d[GetElmOffset(g, 0)];
   for (int64_t i = 1; i < g->num_elms; ++i) {
-    v = func(v, d[i]);
+    v = func(v, d[GetElmOffset(g, i)]);
   }
   *((T*)buf) = v;
   return;
 }
 
+// Tests if the point of a mask grid has any nonzero byte.
+struct MaskPoint {
+  __PSGrid *g;
+  std::vector<char> buf;
+  explicit MaskPoint(__PSGrid *g): g(g), buf(g->elm_size) {}
+  bool operator()(const IndexArray &idx) {
+    int64_t i = 0;
+    for (int d = g->num_dims - 1; d >= 0; --d) {
+      i = i * g->dim[d] + idx[d];
+    }
+    CopyPoint(g, GetElmOffset(g, i), &buf[0], false);
+    for (int k = 0; k < g->elm_size; ++k) {
+      if (buf[k]) return true;
+    }
+    return false;
+  }
+};
+
+__PSDomain DomainMasked(__PSDomain dom, __PSGrid *mask) {
+  // Bricks of the brick layout start at zero
+  BrickList *bl = new BrickList(mask->num_dims, IndexArray(dom.local_min),
+                                IndexArray(dom.local_max), IndexArray(0),
+                                MaskPoint(mask));
+  dom.mask = RegisterBrickList(bl);
+  return dom;
+}
+
+__PSGrid* GridNew(int elm_size, int num_dims, PSVectorInt dim,
+                  int layout, bool scratch=false) {
+  __PSGrid *g = (__PSGrid*)malloc(sizeof(__PSGrid));
+  g->elm_size = elm_size;    
+  g->num_dims = num_dims;
+  PSVectorIntCopy(g->dim, dim);
+  g->num_elms = 1;
+  int i;
+  for (i = 0; i < num_dims; i++) {
+    g->num_elms *= dim[i];
+  }
+  g->color_split = layout == PS_GRID_LAYOUT_COLOR_SPLIT;
+  for (i = 0; i < PS_MAX_DIM; i++) {
+    g->num_bricks[i] = layout == PS_GRID_LAYOUT_BRICK && i < num_dims ?
+        __PSBrickCount(dim[i]) : 0;
+  }
+  g->soa_lanes = 0;
+  g->num_members = 0;
+  g->member_layout = NULL;
+  g->scratch = scratch;
+
+  if (scratch) {
+    size_t s = GetNumAllocatedElms(g) * g->elm_size;
+    g->p0 = PoolAllocate(s, MEM_DATA);
+    if (g->p0) memset(g->p0, 0, s);
+  } else {
+    g->p0 = calloc(GetNumAllocatedElms(g), g->elm_size);
+  }
+  if (!g->p0) {
+    return INVALID_GRID;
+  }
+
+  g->p1 = g->p0;
+    
+  return g;
+}
+
 }
 
 #ifdef __cplusplus
@@ -48,54 +189,107 @@ extern "C" {
     rt->Init(argc, argv, grid_num_dims, vl);
   }
   void PSFinalize() {
+    if (!KernelProfile::GetInstance()->empty()) {
+      KernelProfile::GetInstance()->Print(std::cerr);
+    }
     delete rt;
   }
 
+  // No halo on shared memory
+  double PSGetHaloExchangeTime() {
+    return 0.0;
+  }
+
+  double PSGetAttainableBandwidth() {
+    return KernelProfile::GetInstance()->GetPeakBandwidth();
+  }
+
   // Id is not used on shared memory 
   int __PSGridGetID(__PSGrid *g) {
     return 0;
   }
 
   __PSGrid* __PSGridNew(int elm_size, int num_dims, PSVectorInt dim) {
-    __PSGrid *g = (__PSGrid*)malloc(sizeof(__PSGrid));
-    g->elm_size = elm_size;    
-    g->num_dims = num_dims;
-    PSVectorIntCopy(g->dim, dim);
-    g->num_elms = 1;
-    int i;
-    for (i = 0; i < num_dims; i++) {
-      g->num_elms *= dim[i];
-    }
+    return GridNew(elm_size, num_dims, dim, PS_GRID_LAYOUT_ROW_MAJOR);
+  }
+
+  __PSGrid* __PSGridNewColorSplit(int elm_size, int num_dims,
+                                  PSVectorInt dim) {
+    return GridNew(elm_size, num_dims, dim, PS_GRID_LAYOUT_COLOR_SPLIT);
+  }
 
-    g->p0 = calloc(g->num_elms, g->elm_size);
+  __PSGrid* __PSGridNewBrick(int elm_size, int num_dims,
+                             PSVectorInt dim) {
+    return GridNew(elm_size, num_dims, dim, PS_GRID_LAYOUT_BRICK);
+  }
+
+  __PSGrid* __PSGridNewScratch(int elm_size, int num_dims,
+                               PSVectorInt dim) {
+    return GridNew(elm_size, num_dims, dim, PS_GRID_LAYOUT_ROW_MAJOR, true);
+  }
+
+  __PSGrid* __PSGridNewSoA(int elm_size, int num_dims,
+                           PSVectorInt dim, int layout,
+                           int lanes, int num_members,
+                           const size_t *member_layout) {
+    __PSGrid *g = GridNew(elm_size, num_dims, dim, layout);
+    if (g == INVALID_GRID) return g;
+    g->num_members = num_members;
+    g->member_layout = (size_t *)malloc(sizeof(size_t) * num_members * 2);
+    memcpy(g->member_layout, member_layout,
+           sizeof(size_t) * num_members * 2);
+    if (lanes == 0) {
+      // The whole grid is a single block
+      g->soa_lanes = GetNumAllocatedElms(g);
+      return g;
+    }
+    g->soa_lanes = lanes;
+    // Reallocate to pad the last block
+    free(g->p0);
+    g->p0 = g->p1 = calloc(GetNumAllocatedElms(g), g->elm_size);
     if (!g->p0) {
       return INVALID_GRID;
     }
-
-    g->p1 = g->p0;
-    
     return g;
   }
 
   void PSGridFree(void *p) {
     __PSGrid *g = (__PSGrid *)p;        
-    if (g->p0) {
+    if (g->scratch) {
+      PoolFree(g->p0);
+    } else if (g->p0) {
       free(g->p0);
     }
     if (g->p0 != g->p1 && g->p1) {
       free(g->p1);
     }
     g->p0 = g->p1 = NULL;
+    free(g->member_layout);
+    g->member_layout = NULL;
   }
 
   void PSGridCopyin(void *p, const void *src_array) {
     __PSGrid *g = (__PSGrid *)p;
-    memcpy(g->p0, src_array, g->elm_size * g->num_elms);
+    if (!g->color_split && !g->num_bricks[0] && !g->soa_lanes) {
+      memcpy(g->p0, src_array, g->elm_size * g->num_elms);
+      return;
+    }
+    for (int64_t i = 0; i < g->num_elms; ++i) {
+      CopyPoint(g, GetElmOffset(g, i),
+                ((char *)src_array) + i * g->elm_size, true);
+    }
   }
 
   void PSGridCopyout(void *p, void *dst_array) {
     __PSGrid *g = (__PSGrid *)p;
-    memcpy(dst_array, g->p0, g->elm_size * g->num_elms);
+    if (!g->color_split && !g->num_bricks[0] && !g->soa_lanes) {
+      memcpy(dst_array, g->p0, g->elm_size * g->num_elms);
+      return;
+    }
+    for (int64_t i = 0; i < g->num_elms; ++i) {
+      CopyPoint(g, GetElmOffset(g, i),
+                ((char *)dst_array) + i * g->elm_size, false);
+    }
   }
 
   void __PSGridSwap(__PSGrid *g) {
@@ -104,9 +298,22 @@ extern "C" {
     g->p0 = t;
   }
 
+  void __PSGridSnapshot(__PSGrid *g) {
+    PSAssert(g->p0 == g->p1);
+    size_t s = g->elm_size * GetNumAllocatedElms(g);
+    g->p1 = PoolAllocate(s);
+    memcpy(g->p1, g->p0, s);
+  }
+
+  void __PSGridReleaseSnapshot(__PSGrid *g) {
+    if (g->p0 == g->p1) return;
+    PoolFree(g->p1);
+    g->p1 = g->p0;
+  }
+
   void __PSGridMirror(__PSGrid *g) {
     if (g->p0 != g->p1) {
-      memcpy(g->p1, g->p0, g->elm_size * g->num_elms);
+      memcpy(g->p1, g->p0, g->elm_size * GetNumAllocatedElms(g));
     }
   }
 
@@ -130,6 +337,18 @@ extern "C" {
     return d;
   }
 
+  PSDomain1D PSDomain1DMasked(PSDomain1D dom, void *mask) {
+    return DomainMasked(dom, (__PSGrid *)mask);
+  }
+
+  PSDomain2D PSDomain2DMasked(PSDomain2D dom, void *mask) {
+    return DomainMasked(dom, (__PSGrid *)mask);
+  }
+
+  PSDomain3D PSDomain3DMasked(PSDomain3D dom, void *mask) {
+    return DomainMasked(dom, (__PSGrid *)mask);
+  }
+
   void __PSGridSet(__PSGrid *g, void *buf, ...) {
     int nd = g->num_dims;
     va_list vl;
@@ -142,8 +361,7 @@ extern "C" {
       base_offset *= g->dim[i];
     }
     va_end(vl);
-    offset *= g->elm_size;
-    memcpy(((char *)g->p0) + offset, buf, g->elm_size);
+    CopyPoint(g, GetElmOffset(g, offset), buf, true);
   }
 
   
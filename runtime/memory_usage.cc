@@ -0,0 +1,83 @@
+// Copyright 2011-2012, RIKEN AICS.
+// All rights reserved.
+//
+// This file is distributed under the BSD license. See LICENSE.txt for
+// details.
+
+#include "runtime/memory_usage.h"
+
+namespace physis {
+namespace runtime {
+
+const char *GetMemoryCategoryName(MEMORY_CATEGORY cat) {
+  switch (cat) {
+    case MEM_DATA:
+      return "data";
+    case MEM_HALO:
+      return "halo";
+    case MEM_STAGING:
+      return "staging";
+    case MEM_POOL:
+      return "pool";
+    default:
+      return "unknown";
+  }
+}
+
+MemoryUsage::MemoryUsage(): total(0), peak_total(0) {
+  for (int i = 0; i < MEM_NUM_CATEGORIES; ++i) {
+    bytes[i] = 0;
+    peak[i] = 0;
+  }
+}
+
+std::ostream &MemoryUsage::Print(std::ostream &os) const {
+  os << "{";
+  for (int i = 0; i < MEM_NUM_CATEGORIES; ++i) {
+    os << GetMemoryCategoryName((MEMORY_CATEGORY)i) << ": "
+       << bytes[i] << " (peak " << peak[i] << "), ";
+  }
+  os << "total: " << total << " (peak " << peak_total << ")}";
+  return os;
+}
+
+MemoryAccount::MemoryAccount() {
+  pthread_mutex_init(&mutex_, NULL);
+}
+
+MemoryAccount::~MemoryAccount() {
+  pthread_mutex_destroy(&mutex_);
+}
+
+MemoryAccount *MemoryAccount::GetInstance() {
+  // Never deleted since memory may be released during exit
+  static MemoryAccount *account = new MemoryAccount();
+  return account;
+}
+
+void MemoryAccount::Add(MEMORY_CATEGORY cat, size_t bytes) {
+  pthread_mutex_lock(&mutex_);
+  usage_.bytes[cat] += bytes;
+  usage_.peak[cat] = std::max(usage_.peak[cat], usage_.bytes[cat]);
+  usage_.total += bytes;
+  usage_.peak_total = std::max(usage_.peak_total, usage_.total);
+  pthread_mutex_unlock(&mutex_);
+}
+
+void MemoryAccount::Subtract(MEMORY_CATEGORY cat, size_t bytes) {
+  pthread_mutex_lock(&mutex_);
+  PSAssert(usage_.bytes[cat] >= (long)bytes);
+  usage_.bytes[cat] -= bytes;
+  usage_.total -= bytes;
+  pthread_mutex_unlock(&mutex_);
+}
+
+MemoryUsage MemoryAccount::Get() const {
+  pthread_mutex_lock(&mutex_);
+  MemoryUsage mu = usage_;
+  pthread_mutex_unlock(&mutex_);
+  return mu;
+}
+
+} // namespace runtime
+} // namespace physis
@@ -0,0 +1,74 @@
+// Copyright 2011-2012, RIKEN AICS.
+// All rights reserved.
+//
+// This file is distributed under the BSD license. See LICENSE.txt for
+// details.
+
+#ifndef PHYSIS_RUNTIME_MEMORY_USAGE_H_
+#define PHYSIS_RUNTIME_MEMORY_USAGE_H_
+
+#include <pthread.h>
+#include <ostream>
+
+#include "runtime/runtime_common.h"
+
+namespace physis {
+namespace runtime {
+
+//! Categories of host memory allocated by the runtime.
+enum MEMORY_CATEGORY {
+  //! Grid data buffers including in-grid halo
+  MEM_DATA = 0,
+  //! Halo send and receive buffers
+  MEM_HALO,
+  //! Transient buffers for copies, RPCs and reductions
+  MEM_STAGING,
+  //! Freed buffers cached by the buffer pool
+  MEM_POOL,
+  MEM_NUM_CATEGORIES
+};
+
+const char *GetMemoryCategoryName(MEMORY_CATEGORY cat);
+
+//! Bytes allocated by category.
+/*!
+  Counters are long so that they can be reduced across processes
+  as PS_LONG.
+ */
+struct MemoryUsage {
+  //! Bytes currently allocated
+  long bytes[MEM_NUM_CATEGORIES];
+  //! Maximum of bytes
+  long peak[MEM_NUM_CATEGORIES];
+  //! Bytes currently allocated in all categories
+  long total;
+  //! Maximum of total
+  long peak_total;
+  MemoryUsage();
+  std::ostream &Print(std::ostream &os) const;
+};
+
+//! Per-process accounting of runtime memory.
+class MemoryAccount {
+ public:
+  MemoryAccount();
+  ~MemoryAccount();
+  //! Returns the process-wide account.
+  static MemoryAccount *GetInstance();
+  void Add(MEMORY_CATEGORY cat, size_t bytes);
+  void Subtract(MEMORY_CATEGORY cat, size_t bytes);
+  MemoryUsage Get() const;
+ protected:
+  mutable pthread_mutex_t mutex_;
+  MemoryUsage usage_;
+};
+
+} // namespace runtime
+} // namespace physis
+
+inline std::ostream &operator<<(std::ostream &os,
+                                const physis::runtime::MemoryUsage &mu) {
+  return mu.Print(os);
+}
+
+#endif /* PHYSIS_RUNTIME_MEMORY_USAGE_H_ */
@@ -12,7 +12,17 @@ namespace physis {
 namespace runtime {
 
 int PS_MPI_Init(int *argc, char ***argv) {
+#ifdef _OPENMP
+  // Only the master thread calls MPI; worker threads just run
+  // sweeps and pack halos.
+  int provided;
+  CHECK_MPI(MPI_Init_thread(argc, argv, MPI_THREAD_FUNNELED, &provided));
+  if (provided < MPI_THREAD_FUNNELED) {
+    LOG_WARNING() << "MPI does not support MPI_THREAD_FUNNELED\n";
+  }
+#else
   CHECK_MPI(MPI_Init(argc, argv));
+#endif
   return MPI_SUCCESS;
 }
 
@@ -80,14 +90,14 @@ int PS_MPI_Barrier(MPI_Comm comm) {
   return MPI_SUCCESS;
 }
 
-int PS_MPI_Test(MPI_Request *req) {
-  // TODO
-  //CHECK_MPI(MPI_Test(req));
+int PS_MPI_Test(MPI_Request *req, int *flag) {
+  CHECK_MPI(MPI_Test(req, flag, MPI_STATUS_IGNORE));
   return MPI_SUCCESS;
 }
 
-int PS_MPI_Wait() {
-  // TODO
+int PS_MPI_Wait(MPI_Request *req) {
+  LOG_VERBOSE() << "MPI_Wait\n";
+  CHECK_MPI(MPI_Wait(req, MPI_STATUS_IGNORE));
   return MPI_SUCCESS;
 }
 } // namespace runtime
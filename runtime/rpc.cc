@@ -7,6 +7,8 @@
 #include "runtime/runtime_common.h"
 #include "runtime/rpc.h"
 #include "runtime/grid_util.h"
+#include "runtime/buffer_pool.h"
+#include "runtime/kernel_profile.h"
 #include "runtime/grid_space_mpi.h"
 
 namespace physis {
@@ -71,12 +73,44 @@ void Client::Listen() {
         StencilRun(req.opt);
         LOG_DEBUG() << "Client: run done\n";
         break;
+      case FUNC_PREFETCH_HALO:
+        LOG_DEBUG() << "Client: halo prefetch requested ("
+                    << req.opt << ")\n";
+        PrefetchHalo(req.opt);
+        LOG_DEBUG() << "Client: halo prefetch done\n";
+        break;
       case FUNC_GRID_REDUCE:
         LOG_DEBUG() << "Client: grid reduce requested ("
                     << req.opt << ")\n";
         GridReduce(req.opt);
         LOG_DEBUG() << "Client: grid reduce done\n";
         break;
+      case FUNC_MEMORY_REPORT:
+        LOG_DEBUG() << "Client: memory report requested\n";
+        MemoryReport();
+        LOG_DEBUG() << "Client: memory report done\n";
+        break;
+      case FUNC_DOMAIN_MASK:
+        LOG_DEBUG() << "Client: domain mask requested ("
+                    << req.opt << ")\n";
+        DomainMask(req.opt);
+        LOG_DEBUG() << "Client: domain mask done\n";
+        break;
+      case FUNC_HALO_TIME:
+        LOG_DEBUG() << "Client: halo exchange time requested\n";
+        HaloExchangeTime();
+        LOG_DEBUG() << "Client: halo exchange time done\n";
+        break;
+      case FUNC_PEAK_BANDWIDTH:
+        LOG_DEBUG() << "Client: peak bandwidth requested\n";
+        PeakBandwidth();
+        LOG_DEBUG() << "Client: peak bandwidth done\n";
+        break;
+      case FUNC_KERNEL_PROFILE:
+        LOG_DEBUG() << "Client: kernel profile requested\n";
+        ReduceKernelProfile();
+        LOG_DEBUG() << "Client: kernel profile done\n";
+        break;
       case FUNC_INVALID:
         LOG_INFO() << "Client: invaid request\n";
         PSAbort(1);
@@ -86,7 +120,7 @@ void Client::Listen() {
     }
   }
   LOG_INFO() << "Client listening terminated.\n";
-  MPI_Finalize();
+  ipc_->Finalize();
   exit(EXIT_SUCCESS);
   return;
 }
@@ -107,7 +141,7 @@ void Master::NotifyCall(enum RT_FUNC_KIND fkind, int opt) {
 void Master::Finalize() {
   LOG_DEBUG() << "[" << rank() << "] Finalize\n";
   NotifyCall(FUNC_FINALIZE);
-  MPI_Finalize();
+  ipc_->Finalize();
 }
 
 void Client::Finalize() {
@@ -139,7 +173,7 @@ GridMPI *Master::GridNew(PSType type, int elm_size,
   RequestNEW req = {type, elm_size, num_dims, size,
                     false, global_offset,
                     stencil_offset_min, stencil_offset_max,
-                    attr};
+                    attr, 0, 0};
   ipc_->Bcast(&req, sizeof(RequestNEW), rank());  
   GridMPI *g = gs_->CreateGrid
       (type, elm_size, num_dims, size,
@@ -147,15 +181,46 @@ GridMPI *Master::GridNew(PSType type, int elm_size,
   return g;
 }
 
+GridMPI *Master::GridNewSoA(PSType type, int elm_size,
+                            int num_dims, const IndexArray &size,
+                            const IndexArray &global_offset,
+                            const IndexArray &stencil_offset_min,
+                            const IndexArray &stencil_offset_max,
+                            int attr, int lanes, int num_members,
+                            const size_t *member_layout) {
+  LOG_DEBUG() << "[" << rank() << "] New SoA\n";
+  NotifyCall(FUNC_NEW);
+  RequestNEW req = {type, elm_size, num_dims, size,
+                    false, global_offset,
+                    stencil_offset_min, stencil_offset_max,
+                    attr, lanes, num_members};
+  ipc_->Bcast(&req, sizeof(RequestNEW), rank());
+  ipc_->Bcast(const_cast<size_t*>(member_layout),
+              sizeof(size_t) * num_members * 2, rank());
+  GridMPI *g = gs_->CreateGrid
+      (type, elm_size, num_dims, size,
+       global_offset, stencil_offset_min, stencil_offset_max, attr);
+  g->SetMemberLayout(lanes, num_members, member_layout);
+  return g;
+}
+
 void Client::GridNew() {
   LOG_DEBUG() << "[" << rank() << "] Create\n";
   RequestNEW req;
   ipc_->Bcast(&req, sizeof(RequestNEW), GetMasterRank());
-  static_cast<GridSpaceMPI*>(gs_)->CreateGrid(
+  std::vector<size_t> member_layout(req.num_members * 2);
+  if (req.num_members) {
+    ipc_->Bcast(&member_layout[0], sizeof(size_t) * req.num_members * 2,
+                GetMasterRank());
+  }
+  GridMPI *g = static_cast<GridSpaceMPI*>(gs_)->CreateGrid(
       req.type, req.elm_size, req.num_dims, req.size,
       req.global_offset,
       req.stencil_offset_min, req.stencil_offset_max,
       req.attr);
+  if (req.num_members) {
+    g->SetMemberLayout(req.soa_lanes, req.num_members, &member_layout[0]);
+  }
   LOG_DEBUG() << "[" << rank() << "] Create done\n";
   return;
 }
@@ -177,16 +242,13 @@ void Client::GridDelete(int id) {
 void Master::GridCopyinLocal(GridMPI *g, const void *buf) {
   if (g->empty()) return;
 
-  size_t s = ((GridMPI*)g)->local_real_size().accumulate(g->num_dims()) *
-      g->elm_size();
-  PSAssert(g->buffer()->size() == s);
+  PSAssert(g->buffer()->size() == g->GetLocalBufferRealSize());
 
   void *tmp_buf = NULL;
   void *grid_dst = g->buffer()->Get();
   
-  if (g->HasHalo()) {
-    tmp_buf = malloc(g->GetLocalBufferSize());
-    assert(tmp_buf);
+  if (!g->IsPacked()) {
+    tmp_buf = PoolAllocate(g->GetLocalBufferSize());
     grid_dst = tmp_buf;
   }
   
@@ -194,9 +256,9 @@ void Master::GridCopyinLocal(GridMPI *g, const void *buf) {
                  g->size(), grid_dst,
                  g->local_offset(), g->local_size());
   
-  if (g->HasHalo()) {
+  if (!g->IsPacked()) {
     g->Copyin(grid_dst);
-    free(tmp_buf);
+    PoolFree(tmp_buf);
   }
 }
 
@@ -245,16 +307,15 @@ void Client::GridCopyin(int id) {
     return;
   }
   // receive the subregion for this process
-  Buffer *dst_buf = g->buffer();
-  if (g->HasHalo()) {
-    dst_buf = new BufferHost();
-    dst_buf->EnsureCapacity(g->GetLocalBufferSize());
+  void *dst_buf = g->buffer()->Get();
+  if (!g->IsPacked()) {
+    dst_buf = PoolAllocate(g->GetLocalBufferSize());
   }
-  ipc_->Recv(dst_buf->Get(), g->GetLocalBufferSize(),
+  ipc_->Recv(dst_buf, g->GetLocalBufferSize(),
              GetMasterRank());  
-  if (g->HasHalo()) {
-    g->Copyin(dst_buf->Get());
-    delete dst_buf;
+  if (!g->IsPacked()) {
+    g->Copyin(dst_buf);
+    PoolFree(dst_buf);
   }
   return;
 }
@@ -265,9 +326,8 @@ void Master::GridCopyoutLocal(GridMPI *g, void *buf) {
   const void *grid_src = g->buffer()->Get();
   void *tmp_buf = NULL;
   
-  if (g->HasHalo()) {
-    tmp_buf = malloc(g->GetLocalBufferSize());
-    assert(tmp_buf);
+  if (!g->IsPacked()) {
+    tmp_buf = PoolAllocate(g->GetLocalBufferSize());
     g->Copyout(tmp_buf);
     grid_src = tmp_buf;
   }
@@ -276,7 +336,7 @@ void Master::GridCopyoutLocal(GridMPI *g, void *buf) {
                 g->size(), grid_src, g->local_offset(),
                 g->local_size());
   
-  if (g->HasHalo()) free(tmp_buf);
+  if (!g->IsPacked()) PoolFree(tmp_buf);
   
   return;
 }
@@ -323,20 +383,52 @@ void Client::GridCopyout(int id) {
     LOG_DEBUG() << "No copy needed because this grid is empty.\n";
     return;
   }
-  Buffer *sbuf = g->buffer();
-  if (g->HasHalo()) {
-    sbuf = new BufferHost();
-    sbuf->EnsureCapacity(g->GetLocalBufferSize());
-    g->Copyout(sbuf->Get());
+  void *sbuf = g->buffer()->Get();
+  void *tmp_buf = NULL;
+  if (!g->IsPacked()) {
+    tmp_buf = PoolAllocate(g->GetLocalBufferSize());
+    g->Copyout(tmp_buf);
+    sbuf = tmp_buf;
   } 
-  ipc_->Send(sbuf->Get(),  g->GetLocalBufferSize(),
+  ipc_->Send(sbuf,  g->GetLocalBufferSize(),
              GetMasterRank());
-  if (g->HasHalo()) {
-    free(sbuf);
-  }
+  PoolFree(tmp_buf);
   return;
 }
 
+// The first member of each stencil object is its domain. Returns
+// false if this process has no part in the run. Masked domains
+// cover only their active bricks.
+static bool SetActiveRegion(GridSpaceMPI *gs, int num_stencils,
+                            void **stencils) {
+  IndexArray region_min, region_max;
+  region_min.Set(PSINDEX_MAX);
+  region_max.Set(PSINDEX_MIN);
+  std::vector<int> masks;
+  for (int i = 0; i < num_stencils; ++i) {
+    const __PSDomain *dom = (const __PSDomain*)stencils[i];
+    if (dom->mask) {
+      const BrickList *bl = FindBrickList(dom->mask);
+      region_min.SetNoMoreThan(bl->global_active_min());
+      region_max.SetNoLessThan(bl->global_active_max());
+    } else {
+      region_min.SetNoMoreThan(IndexArray(dom->min));
+      region_max.SetNoLessThan(IndexArray(dom->max));
+    }
+    masks.push_back(dom->mask);
+  }
+  bool active = gs->SetActiveRegion(region_min, region_max);
+  gs->SetActiveMasks(masks);
+  return active;
+}
+
+// Prefetched halos are loaded only by the processes running the
+// stencils, so all processes drop them unless every process loaded
+// its own.
+static void DropUnusedHalos(GridSpaceMPI *gs, int iter) {
+  if (iter <= 0 || !gs->IsActiveRegionFull()) gs->DropPrefetchedHalos();
+}
+
 void Master::StencilRun(int id, int iter, int num_stencils,
                         void **stencils,
                         unsigned *stencil_sizes) {
@@ -351,12 +443,28 @@ void Master::StencilRun(int id, int iter, int num_stencils,
   for (int i = 0; i < num_stencils; ++i) {
     ipc_->Bcast(stencils[i], stencil_sizes[i], rank());
   }
-  LOG_DEBUG() << "Calling the stencil function\n";
-  // call the stencil obj
-  stencil_runs_[id](iter, stencils);
+  // Processes away from the domains do not take part
+  if (SetActiveRegion(gs_, num_stencils, stencils)) {
+    LOG_DEBUG() << "Calling the stencil function\n";
+    // call the stencil obj
+    stencil_runs_[id](iter, stencils);
+  }
+  DropUnusedHalos(gs_, iter);
+  gs_->ClearActiveRegion();
   return;
 }
 
+void Master::PrefetchHalo(GridMPI *g) {
+  LOG_DEBUG() << "Master PrefetchHalo(" << g->id() << ")\n";
+  NotifyCall(FUNC_PREFETCH_HALO, g->id());
+  gs_->PrefetchHalo(g);
+}
+
+void Client::PrefetchHalo(int id) {
+  GridMPI *g = static_cast<GridMPI*>(gs_->FindGrid(id));
+  gs_->PrefetchHalo(g);
+}
+
 void Client::StencilRun(int id) {
   LOG_DEBUG() << "Client StencilRun(" << id << ")\n";
 
@@ -371,12 +479,19 @@ void Client::StencilRun(int id) {
              GetMasterRank());
   void **stencils = new void*[num_stencils];
   for (int i = 0; i < num_stencils; ++i) {
-    void *sbuf = malloc(stencil_sizes[i]);
+    void *sbuf = PoolAllocate(stencil_sizes[i]);
     ipc_->Bcast(sbuf, stencil_sizes[i], GetMasterRank());
     stencils[i] = sbuf;
   }
-  LOG_DEBUG() << "Calling the stencil function\n";
-  stencil_runs_[id](iter, stencils);
+  if (SetActiveRegion(gs_, num_stencils, stencils)) {
+    LOG_DEBUG() << "Calling the stencil function\n";
+    stencil_runs_[id](iter, stencils);
+  }
+  DropUnusedHalos(gs_, iter);
+  gs_->ClearActiveRegion();
+  for (int i = 0; i < num_stencils; ++i) {
+    PoolFree(stencils[i]);
+  }
   delete[] stencil_sizes;
   delete[] stencils;
   return;
@@ -396,11 +511,11 @@ void Client::GridGet(int id) {
   IndexArray index;
   ipc_->Recv(&index, sizeof(IndexArray), GetMasterRank());
   LOG_DEBUG() << "Get index: " << index << "\n";
-  void *buf = malloc(g->elm_size());
+  void *buf = PoolAllocate(g->elm_size());
   g->Get(index, buf);
   ipc_->Send(buf, g->elm_size(), GetMasterRank());
   LOG_DEBUG() << "Client GridGet done\n";
-  free(buf);
+  PoolFree(buf);
   return;
 }
 
@@ -441,12 +556,12 @@ void Client::GridSet(int id) {
   IndexArray index;
   ipc_->Recv(&index, sizeof(IndexArray), GetMasterRank());
   LOG_DEBUG() << "Set index: " << index << "\n";
-  void *buf = malloc(g->elm_size());
+  void *buf = PoolAllocate(g->elm_size());
   ipc_->Recv(buf, g->elm_size(), GetMasterRank());
   //memcpy(g->GetAddress(index), buf, g->elm_size());
   g->Set(index, buf);
   LOG_DEBUG() << "Client GridSet done\n";
-  free(buf);
+  PoolFree(buf);
   return;
 }
 
@@ -489,5 +604,72 @@ void Master::GridReduce(void *buf, PSReduceOp op, GridMPI *g) {
   LOG_DEBUG() << "Master GridReduce done\n";
 }
 
+void Client::MemoryReport() {
+  MemoryUsage min, max, sum;
+  gs_->ReduceMemoryUsage(min, max, sum);
+}
+
+void Master::MemoryReport(std::ostream &os) {
+  NotifyCall(FUNC_MEMORY_REPORT);
+  MemoryUsage min, max, sum;
+  gs_->ReduceMemoryUsage(min, max, sum);
+  os << "Memory usage in bytes (min/max/sum over "
+     << gs_->num_procs() << " processes)\n";
+  for (int i = 0; i < MEM_NUM_CATEGORIES; ++i) {
+    os << "  " << GetMemoryCategoryName((MEMORY_CATEGORY)i) << ": "
+       << min.bytes[i] << "/" << max.bytes[i] << "/" << sum.bytes[i]
+       << ", peak: "
+       << min.peak[i] << "/" << max.peak[i] << "/" << sum.peak[i]
+       << "\n";
+  }
+  os << "  total: " << min.total << "/" << max.total << "/" << sum.total
+     << ", peak: " << min.peak_total << "/" << max.peak_total << "/"
+     << sum.peak_total << "\n";
+  gs_->PrintGridMemoryUsage(os);
+}
+
+void Client::DomainMask(int id) {
+  LOG_DEBUG() << "Client DomainMask(" << id << ")\n";
+  GridMPI *g = static_cast<GridMPI*>(gs_->FindGrid(id));
+  __PSDomain dom;
+  ipc_->Bcast(&dom, sizeof(__PSDomain), GetMasterRank());
+  gs_->MaskDomain(dom, g);
+}
+
+int Master::DomainMask(const __PSDomain &dom, GridMPI *mask) {
+  LOG_DEBUG() << "Master DomainMask\n";
+  NotifyCall(FUNC_DOMAIN_MASK, mask->id());
+  __PSDomain t = dom;
+  ipc_->Bcast(&t, sizeof(__PSDomain), rank());
+  return gs_->MaskDomain(dom, mask);
+}
+
+void Client::HaloExchangeTime() {
+  gs_->ReduceHaloExchangeTime();
+}
+
+double Master::HaloExchangeTime() {
+  NotifyCall(FUNC_HALO_TIME);
+  return gs_->ReduceHaloExchangeTime();
+}
+
+void Client::PeakBandwidth() {
+  KernelProfile::GetInstance()->GetPeakBandwidth(ipc_, GetMasterRank());
+}
+
+double Master::PeakBandwidth() {
+  NotifyCall(FUNC_PEAK_BANDWIDTH);
+  return KernelProfile::GetInstance()->GetPeakBandwidth(ipc_, rank());
+}
+
+void Client::ReduceKernelProfile() {
+  KernelProfile::GetInstance()->Reduce(ipc_, GetMasterRank());
+}
+
+void Master::ReduceKernelProfile() {
+  NotifyCall(FUNC_KERNEL_PROFILE);
+  KernelProfile::GetInstance()->Reduce(ipc_, rank());
+}
+
 } // namespace runtime
 } // namespace physis
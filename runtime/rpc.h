@@ -21,7 +21,9 @@ enum RT_FUNC_KIND {
   FUNC_COPYIN, FUNC_COPYOUT,
   FUNC_GET, FUNC_SET,
   FUNC_RUN, FUNC_FINALIZE, FUNC_BARRIER,
-  FUNC_GRID_REDUCE
+  FUNC_GRID_REDUCE, FUNC_MEMORY_REPORT, FUNC_DOMAIN_MASK,
+  FUNC_HALO_TIME, FUNC_PEAK_BANDWIDTH, FUNC_KERNEL_PROFILE,
+  FUNC_PREFETCH_HALO
 };
 
 struct Request {
@@ -41,6 +43,13 @@ struct RequestNEW {
   IndexArray stencil_offset_min;
   IndexArray stencil_offset_max;
   int attr;
+  //! Number of points interleaved per member in the SoA layout.
+  int soa_lanes;
+  //! Number of members in the SoA layout; zero for the AoS layout.
+  /*!
+    The member layout follows the request if non-zero.
+   */
+  int num_members;
 };
 
 class Client: public Proc {
@@ -62,7 +71,13 @@ class Client: public Proc {
   virtual void GridSet(int id);
   virtual void GridGet(int id);  
   virtual void StencilRun(int id);
+  virtual void PrefetchHalo(int id);
   virtual void GridReduce(int id);
+  virtual void MemoryReport();
+  virtual void DomainMask(int id);
+  virtual void HaloExchangeTime();
+  virtual void PeakBandwidth();
+  virtual void ReduceKernelProfile();
   static int GetMasterRank() {
     return Proc::GetRootRank();
   }
@@ -87,6 +102,20 @@ class Master: public Proc {
                            const IndexArray &stencil_offset_min,
                            const IndexArray &stencil_offset_max,
                            int attr);
+  //! Creates a grid of a user-defined type in the SoA layout.
+  /*!
+    \param lanes Number of points interleaved per member.
+    \param num_members Number of members of each point.
+    \param member_layout Pairs of the offset and size of each member.
+   */
+  virtual GridMPI *GridNewSoA(PSType type, int elm_size,
+                              int num_dims,
+                              const IndexArray &size,
+                              const IndexArray &global_offset,
+                              const IndexArray &stencil_offset_min,
+                              const IndexArray &stencil_offset_max,
+                              int attr, int lanes, int num_members,
+                              const size_t *member_layout);
   virtual void GridDelete(GridMPI *g);
   virtual void GridCopyin(GridMPI *g, const void *buf);
   virtual void GridCopyinLocal(GridMPI *g, const void *buf);  
@@ -96,7 +125,33 @@ class Master: public Proc {
   virtual void GridGet(GridMPI *g, void *buf, const IndexArray &index);  
   virtual void StencilRun(int id, int iter, int num_stencils,
                           void **stencils, unsigned *stencil_sizes);
+  //! Exchanges the halo of a grid in all processes ahead of a run.
+  /*!
+    The halo is not exchanged again by the next run loading it
+    unless a run in between is skipped by some process.
+   */
+  virtual void PrefetchHalo(GridMPI *g);
   virtual void GridReduce(void *buf, PSReduceOp op, GridMPI *g);
+  //! Prints the memory usage of all processes.
+  /*!
+    Counters are reduced into the minimum, maximum and sum across
+    processes. The usage of each grid is printed only for the master
+    process.
+   */
+  virtual void MemoryReport(std::ostream &os);
+  //! Builds the active bricks of a masked domain in all processes.
+  /*!
+    \param dom The domain.
+    \param mask Grid whose nonzero points are active.
+    \return Handle of the brick list.
+   */
+  virtual int DomainMask(const __PSDomain &dom, GridMPI *mask);
+  //! Returns the maximum halo exchange time across processes.
+  virtual double HaloExchangeTime();
+  //! Returns the attainable bandwidth of all processes in GB/s.
+  virtual double PeakBandwidth();
+  //! Aggregates the stencil run profiles of all processes.
+  virtual void ReduceKernelProfile();
   static int GetMasterRank() {
     return Proc::GetRootRank();
   }
@@ -5,6 +5,7 @@
 // details.
 
 #include "runtime/runtime.h"
+#include "runtime/kernel_profile.h"
 
 #include <string>
 
@@ -88,6 +89,12 @@ void Runtime::Init(int *argc, char ***argv, int grid_num_dims,
       __ps_trace = stderr;
       LOG_INFO() << "Tracing enabled\n";
   }
+  // Attainable bandwidth for the stencil run profile
+  opts.clear();
+  if (ParseOption(argc, argv, "physis-peak-bandwidth", 1, opts)) {
+    KernelProfile::GetInstance()->set_peak_bandwidth(
+        atof(opts[1].c_str()));
+  }
 }
 
 } // namespace runtime
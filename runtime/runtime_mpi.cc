@@ -6,19 +6,63 @@
 
 #include "runtime/runtime_mpi.h"
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "runtime/ipc_mpi.h"
+#include "runtime/ipc_shm.h"
+#include "runtime/buffer_pool.h"
 #include "runtime/proc.h"
 #include "runtime/rpc.h"
 
 namespace physis {
 namespace runtime {
 
-RuntimeMPI::RuntimeMPI(): Runtime() {
+RuntimeMPI::RuntimeMPI(): Runtime(), deferred_(false) {
 }
 
 RuntimeMPI::~RuntimeMPI() {
 }
 
+// Set the placement of grid buffers with these options:
+// --physis-numa-policy default|first-touch|bind|interleave
+// --physis-huge-pages
+static void ParseNUMAOptions(int *argc, char ***argv) {
+  BufferNUMAConfig config;
+  vector<string> opts;
+  if (ParseOption(argc, argv, "physis-numa-policy", 1, opts)) {
+    const string &policy = opts[1];
+    if (policy == "default") {
+      config.policy = NUMA_DEFAULT;
+    } else if (policy == "first-touch") {
+      config.policy = NUMA_FIRST_TOUCH;
+    } else if (policy == "bind") {
+      config.policy = NUMA_BIND;
+    } else if (policy == "interleave") {
+      config.policy = NUMA_INTERLEAVE;
+    } else {
+      LOG_ERROR() << "Unknown NUMA policy: " << policy << "\n";
+      PSAbort(1);
+    }
+  }
+  opts.clear();
+  if (ParseOption(argc, argv, "physis-huge-pages", 0, opts)) {
+    config.huge_pages = true;
+  }
+  SetBufferNUMAConfig(config);
+}
+
+// Limit the memory cached by the buffer pool with:
+// --physis-pool-max-cached <MiB>
+static void ParsePoolOptions(int *argc, char ***argv) {
+  vector<string> opts;
+  if (ParseOption(argc, argv, "physis-pool-max-cached", 1, opts)) {
+    size_t mb = physis::toInteger(opts[1]);
+    BufferPool::GetInstance()->set_max_cached_bytes(mb << 20);
+  }
+}
+
 void RuntimeMPI::Init(int *argc, char ***argv, int grid_num_dims,
                       va_list vl) {
   Runtime::Init(argc, argv, grid_num_dims, vl);
@@ -31,12 +75,45 @@ void RuntimeMPI::Init(int *argc, char ***argv, int grid_num_dims,
       = va_arg(vl, __PSStencilRunClientFunction*);
   va_end(vl);
 
-  InterProcComm *ipc = InterProcCommMPI::GetInstance();
-  ipc->Init(argc, argv);
+  // Node-local runs can bypass MPI with the shared memory
+  // communicator.
+  InterProcComm *ipc = NULL;
+  if (InterProcCommSHM::IsRequested(*argc, *argv)) {
+    ipc = InterProcCommSHM::GetInstance();
+  } else {
+    ipc = InterProcCommMPI::GetInstance();
+  }
+  if (ipc->Init(argc, argv) != InterProcComm::IPC_SUCCESS) {
+    LOG_ERROR() << "Failed to initialize inter-process communication\n";
+    PSAbort(1);
+  }
     
   int num_procs = ipc->GetNumProcs();
   int rank = ipc->GetRank();
 
+  ParseNUMAOptions(argc, argv);
+  ParsePoolOptions(argc, argv);
+  // Defer runs and copies until their results are needed with:
+  // --physis-deferred
+  vector<string> opts;
+  if (ParseOption(argc, argv, "physis-deferred", 0, opts)) {
+    deferred_ = true;
+    LOG_INFO() << "Deferred execution enabled\n";
+  }
+
+  // Align partition boundaries to multiples of n so that each
+  // process owns all the fine points of its coarse points with:
+  // --physis-partition-align <n>
+  PSIndex partition_align = 1;
+  opts.clear();
+  if (ParseOption(argc, argv, "physis-partition-align", 1, opts)) {
+    partition_align = physis::toInteger(opts[1]);
+    if (partition_align < 1) {
+      LOG_ERROR() << "Invalid partition alignment: " << opts[1] << "\n";
+      PSAbort(1);
+    }
+  }
+
   IntArray proc_size;
   proc_size.Set(1);
   int proc_num_dims = GetProcessDim(argc, argv, proc_size);
@@ -49,9 +126,13 @@ void RuntimeMPI::Init(int *argc, char ***argv, int grid_num_dims,
   }
 
   LOG_INFO() << "Process size: " << proc_size << "\n";
+#ifdef _OPENMP
+  LOG_INFO() << "Threads per process: " << omp_get_max_threads() << "\n";
+#endif
 
   gs_ = new GridSpaceMPI(grid_num_dims, grid_size,
-                         proc_num_dims, proc_size, rank);
+                         proc_num_dims, proc_size, rank, ipc,
+                         partition_align);
 
   LOG_INFO() << "Grid space: " << *gs_ << "\n";
 
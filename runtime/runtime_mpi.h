@@ -36,11 +36,14 @@ class RuntimeMPI: public Runtime {
   virtual int IsMaster() {
     return proc_->rank() == Master::GetMasterRank();
   }
+  //! Returns true if runtime calls are deferred into a task graph.
+  bool deferred() const { return deferred_; }
   void Listen();
   
  protected:
   __PSStencilRunClientFunction *client_funcs_;
   Proc *proc_;
+  bool deferred_;
   
 };
 
@@ -0,0 +1,206 @@
+// Copyright 2011-2012, RIKEN AICS.
+// All rights reserved.
+//
+// This file is distributed under the BSD license. See LICENSE.txt for
+// details.
+
+#include "runtime/task_graph.h"
+
+namespace physis {
+namespace runtime {
+
+const char *GetTaskKindName(TASK_KIND kind) {
+  switch (kind) {
+    case TASK_RUN:
+      return "run";
+    case TASK_COPYIN:
+      return "copyin";
+    case TASK_COPYOUT:
+      return "copyout";
+    case TASK_REDUCE:
+      return "reduce";
+    case TASK_EXCHANGE:
+      return "exchange";
+    default:
+      return "unknown";
+  }
+}
+
+std::ostream &TaskGraphStats::Print(std::ostream &os) const {
+  return os << "{tasks: " << num_tasks
+            << ", executed: " << num_executed
+            << ", elided: " << num_elided
+            << ", reordered: " << num_reordered
+            << ", flushes: " << num_flushes << "}";
+}
+
+TaskGraph::TaskGraph(): next_id_(0) {}
+
+TaskGraph::~TaskGraph() {
+  if (!empty()) {
+    LOG_WARNING() << "Dropping " << tasks_.size()
+                  << " pending tasks\n";
+  }
+  FOREACH (it, tasks_.begin(), tasks_.end()) {
+    if (it->second.release) it->second.release();
+  }
+}
+
+void TaskGraph::ElideDeadWriter(Grid *g) {
+  std::map<Grid*, int>::iterator it = last_writer_.find(g);
+  if (it == last_writer_.end() || !IsPending(it->second)) return;
+  Task &w = tasks_[it->second];
+  if (!w.overwrites || w.writes.size() != 1) return;
+  // Readers depend on the writer
+  std::vector<int> &readers = readers_[g];
+  FOREACH (rit, readers.begin(), readers.end()) {
+    if (IsPending(*rit)) return;
+  }
+  LOG_DEBUG() << "Eliding " << GetTaskKindName(w.kind) << " task "
+              << w.id << " overwritten before read\n";
+  if (w.release) w.release();
+  tasks_.erase(w.id);
+  last_writer_.erase(it);
+  ++stats_.num_elided;
+}
+
+int TaskGraph::Add(TASK_KIND kind, const Func &func,
+                   const std::vector<Grid*> &reads,
+                   const std::vector<Grid*> &writes,
+                   bool overwrites, const Func &release) {
+  Task t;
+  t.id = next_id_++;
+  t.kind = kind;
+  t.func = func;
+  t.release = release;
+  t.writes = writes;
+  t.overwrites = overwrites;
+  // Read after write
+  FOREACH (it, reads.begin(), reads.end()) {
+    std::map<Grid*, int>::iterator wit = last_writer_.find(*it);
+    if (wit != last_writer_.end() && IsPending(wit->second)) {
+      t.deps.insert(wit->second);
+    }
+  }
+  FOREACH (it, writes.begin(), writes.end()) {
+    Grid *g = *it;
+    if (overwrites) ElideDeadWriter(g);
+    // Write after write
+    std::map<Grid*, int>::iterator wit = last_writer_.find(g);
+    if (wit != last_writer_.end() && IsPending(wit->second)) {
+      t.deps.insert(wit->second);
+    }
+    // Write after read
+    std::vector<int> &readers = readers_[g];
+    FOREACH (rit, readers.begin(), readers.end()) {
+      if (IsPending(*rit)) t.deps.insert(*rit);
+    }
+  }
+  FOREACH (it, reads.begin(), reads.end()) {
+    // Drop executed readers so that the list does not grow for
+    // grids that are only read
+    std::vector<int> &readers = readers_[*it];
+    std::vector<int> pending;
+    FOREACH (rit, readers.begin(), readers.end()) {
+      if (IsPending(*rit)) pending.push_back(*rit);
+    }
+    pending.push_back(t.id);
+    readers.swap(pending);
+  }
+  FOREACH (it, writes.begin(), writes.end()) {
+    last_writer_[*it] = t.id;
+    readers_[*it].clear();
+  }
+  tasks_.insert(std::make_pair(t.id, t));
+  ++stats_.num_tasks;
+  LOG_DEBUG() << "Deferred " << GetTaskKindName(kind) << " task "
+              << t.id << " (" << t.deps.size() << " dependencies)\n";
+  return t.id;
+}
+
+void TaskGraph::CollectDependencies(int id, std::set<int> &s) const {
+  if (!IsPending(id) || !s.insert(id).second) return;
+  const Task &t = tasks_.find(id)->second;
+  FOREACH (it, t.deps.begin(), t.deps.end()) {
+    CollectDependencies(*it, s);
+  }
+}
+
+int TaskGraph::PickNext(const std::set<int> &ids) const {
+  // Dependencies are always added before their dependents, so the
+  // first ID is always ready.
+  int first = -1;
+  FOREACH (it, ids.begin(), ids.end()) {
+    const Task &t = tasks_.find(*it)->second;
+    bool ready = true;
+    FOREACH (dit, t.deps.begin(), t.deps.end()) {
+      if (ids.count(*dit)) {
+        ready = false;
+        break;
+      }
+    }
+    if (!ready) continue;
+    // Halos are exchanged as early as possible
+    if (t.kind == TASK_EXCHANGE) return t.id;
+    if (first < 0) first = t.id;
+  }
+  return first;
+}
+
+void TaskGraph::Execute(const std::set<int> &ids) {
+  std::set<int> remaining(ids);
+  while (!remaining.empty()) {
+    int id = PickNext(remaining);
+    remaining.erase(id);
+    std::map<int, Task>::iterator tit = tasks_.find(id);
+    PSAssert(tit != tasks_.end());
+    // Removed before running so that it is not counted as pending
+    Task t = tit->second;
+    tasks_.erase(tit);
+    if (tasks_.size() && tasks_.begin()->first < t.id) {
+      ++stats_.num_reordered;
+    }
+    LOG_DEBUG() << "Executing " << GetTaskKindName(t.kind) << " task "
+                << t.id << "\n";
+    t.func();
+    if (t.release) t.release();
+    ++stats_.num_executed;
+  }
+}
+
+void TaskGraph::Flush(Grid *g) {
+  ++stats_.num_flushes;
+  std::set<int> ids;
+  std::map<Grid*, int>::iterator wit = last_writer_.find(g);
+  if (wit != last_writer_.end()) {
+    CollectDependencies(wit->second, ids);
+  }
+  std::vector<int> &readers = readers_[g];
+  FOREACH (it, readers.begin(), readers.end()) {
+    CollectDependencies(*it, ids);
+  }
+  Execute(ids);
+  // No pending task accesses g
+  last_writer_.erase(g);
+  readers_.erase(g);
+}
+
+void TaskGraph::Flush() {
+  ++stats_.num_flushes;
+  std::set<int> ids;
+  FOREACH (it, tasks_.begin(), tasks_.end()) {
+    ids.insert(it->first);
+  }
+  Execute(ids);
+  last_writer_.clear();
+  readers_.clear();
+}
+
+std::ostream &TaskGraph::Print(std::ostream &os) const {
+  os << "TaskGraph {pending: " << tasks_.size()
+     << ", stats: " << stats_ << "}";
+  return os;
+}
+
+} // namespace runtime
+} // namespace physis
@@ -0,0 +1,137 @@
+// Copyright 2011-2012, RIKEN AICS.
+// All rights reserved.
+//
+// This file is distributed under the BSD license. See LICENSE.txt for
+// details.
+
+#ifndef PHYSIS_RUNTIME_TASK_GRAPH_H_
+#define PHYSIS_RUNTIME_TASK_GRAPH_H_
+
+#include <map>
+#include <set>
+#include <vector>
+#include <ostream>
+#include <boost/function.hpp>
+
+#include "runtime/runtime_common.h"
+#include "runtime/grid.h"
+
+namespace physis {
+namespace runtime {
+
+enum TASK_KIND {
+  TASK_RUN, TASK_COPYIN, TASK_COPYOUT, TASK_REDUCE, TASK_EXCHANGE
+};
+
+const char *GetTaskKindName(TASK_KIND kind);
+
+//! Counters of a task graph.
+struct TaskGraphStats {
+  //! Number of tasks added
+  size_t num_tasks;
+  //! Number of tasks executed
+  size_t num_executed;
+  //! Number of tasks dropped since their results were never read
+  size_t num_elided;
+  //! Number of tasks executed ahead of a task added earlier
+  size_t num_reordered;
+  //! Number of Flush calls
+  size_t num_flushes;
+  TaskGraphStats(): num_tasks(0), num_executed(0), num_elided(0),
+                    num_reordered(0), num_flushes(0) {}
+  std::ostream &Print(std::ostream &os) const;
+};
+
+//! Graph of deferred runtime calls.
+/*!
+  Tasks are added with the grids they read and write, and the
+  dependencies are derived from the order of the accesses: a task
+  depends on the last writer of each grid it reads or writes, and on
+  the readers of each grid it writes since the last write. Tasks are
+  not executed until a result is needed, and then only the tasks
+  the result depends on are executed. Independent tasks are left
+  pending, so they are effectively moved after the demanded ones.
+  Among the executed tasks, halo exchanges are moved ahead of the
+  independent tasks added before them.
+
+  A task that overwrites a whole grid drops a pending writer of the
+  grid if no task has read the grid since.
+ */
+class TaskGraph {
+ public:
+  typedef boost::function<void ()> Func;
+  TaskGraph();
+  ~TaskGraph();
+  /*! Adds a task.
+    \param kind Kind of the task.
+    \param func Function executing the task.
+    \param reads Grids read by the task.
+    \param writes Grids written by the task.
+    \param overwrites True if the task replaces all the values of
+    the written grids.
+    \param release Called after the task is executed or dropped; may
+    be empty.
+    \return ID of the task.
+   */
+  int Add(TASK_KIND kind, const Func &func,
+          const std::vector<Grid*> &reads,
+          const std::vector<Grid*> &writes,
+          bool overwrites, const Func &release=Func());
+  //! Executes the tasks accessing a grid and the tasks they depend on.
+  void Flush(Grid *g);
+  //! Executes all the pending tasks.
+  void Flush();
+  bool empty() const { return tasks_.empty(); }
+  const TaskGraphStats &stats() const { return stats_; }
+  std::ostream &Print(std::ostream &os) const;
+ protected:
+  struct Task {
+    int id;
+    TASK_KIND kind;
+    Func func;
+    Func release;
+    std::vector<Grid*> writes;
+    bool overwrites;
+    //! Pending tasks this task depends on when added
+    std::set<int> deps;
+  };
+  bool IsPending(int id) const {
+    return tasks_.find(id) != tasks_.end();
+  }
+  //! Adds the pending tasks a task depends on to a set.
+  void CollectDependencies(int id, std::set<int> &s) const;
+  //! Executes a set of tasks closed under dependencies.
+  void Execute(const std::set<int> &ids);
+  //! Returns the task of a set to execute next.
+  /*!
+    \param ids Tasks not executed yet, closed under dependencies.
+    \return The first ready exchange task if any, or else the ready
+    task added first.
+   */
+  int PickNext(const std::set<int> &ids) const;
+  //! Drops a pending writer made dead by an overwrite of a grid.
+  void ElideDeadWriter(Grid *g);
+  //! Pending tasks by ID
+  std::map<int, Task> tasks_;
+  int next_id_;
+  //! Last task writing each grid
+  std::map<Grid*, int> last_writer_;
+  //! Tasks reading each grid since the last write
+  std::map<Grid*, std::vector<int> > readers_;
+  TaskGraphStats stats_;
+};
+
+} // namespace runtime
+} // namespace physis
+
+inline std::ostream &operator<<(std::ostream &os,
+                                const physis::runtime::TaskGraphStats &s) {
+  return s.Print(os);
+}
+
+inline std::ostream &operator<<(std::ostream &os,
+                                const physis::runtime::TaskGraph &g) {
+  return g.Print(os);
+}
+
+#endif /* PHYSIS_RUNTIME_TASK_GRAPH_H_ */
@@ -0,0 +1,118 @@
+// Copyright 2011-2012, RIKEN AICS.
+// All rights reserved.
+//
+// This file is distributed under the BSD license. See LICENSE.txt for
+// details.
+
+#include <boost/bind.hpp>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "runtime/brick.h"
+
+using namespace ::testing;
+using namespace ::std;
+
+namespace physis {
+namespace runtime {
+
+static bool All(const IndexArray &idx) {
+  return true;
+}
+
+static bool None(const IndexArray &idx) {
+  return false;
+}
+
+static bool Point(const IndexArray &p, const IndexArray &idx) {
+  return idx[0] == p[0] && idx[1] == p[1];
+}
+
+TEST(BrickList, ClippedAtRegionEnds) {
+  BrickList bl(2, IndexArray(0), IndexArray(20, 20), IndexArray(0), All);
+  ASSERT_THAT(bl.num_bricks(), Eq(9));
+  ASSERT_THAT(bl.num_points(), Eq(400u));
+  // Bricks of the first row
+  ASSERT_THAT(bl.brick_max(0)[0], Eq(8));
+  ASSERT_THAT(bl.brick_min(2)[0], Eq(16));
+  ASSERT_THAT(bl.brick_max(2)[0], Eq(20));
+  ASSERT_THAT(bl.brick_max(2)[1], Eq(8));
+  ASSERT_THAT(bl.active_min()[0], Eq(0));
+  ASSERT_THAT(bl.active_max()[1], Eq(20));
+}
+
+TEST(BrickList, ActiveBricks) {
+  BrickList bl(2, IndexArray(0), IndexArray(20, 20), IndexArray(0),
+               boost::bind(Point, IndexArray(10, 17), _1));
+  ASSERT_THAT(bl.num_bricks(), Eq(1));
+  ASSERT_THAT(bl.num_points(), Eq(32u));
+  ASSERT_THAT(bl.brick_min(0)[0], Eq(8));
+  ASSERT_THAT(bl.brick_max(0)[0], Eq(16));
+  ASSERT_THAT(bl.brick_min(0)[1], Eq(16));
+  ASSERT_THAT(bl.brick_max(0)[1], Eq(20));
+  ASSERT_THAT(bl.active_min()[1], Eq(16));
+  ASSERT_THAT(bl.active_max()[1], Eq(20));
+  // Same as the local one unless set
+  ASSERT_THAT(bl.global_active_min()[0], Eq(8));
+  ASSERT_THAT(bl.global_active_max()[0], Eq(16));
+}
+
+TEST(BrickList, NoActiveBrick) {
+  BrickList bl(3, IndexArray(0), IndexArray(16, 16, 16), IndexArray(0),
+               None);
+  ASSERT_THAT(bl.num_bricks(), Eq(0));
+  ASSERT_THAT(bl.num_points(), Eq(0u));
+  // Empty box
+  ASSERT_THAT(bl.active_min()[0], Gt(bl.active_max()[0]));
+}
+
+TEST(BrickList, EmptyRegion) {
+  BrickList bl(3, IndexArray(0, 0, 8), IndexArray(16, 16, 8),
+               IndexArray(0), All);
+  ASSERT_THAT(bl.num_bricks(), Eq(0));
+  ASSERT_THAT(bl.global_active_min()[2], Gt(bl.global_active_max()[2]));
+}
+
+TEST(BrickList, Origin) {
+  // Bricks start at multiples of the width from the origin
+  BrickList bl(1, IndexArray(2), IndexArray(22), IndexArray(0), All);
+  ASSERT_THAT(bl.num_bricks(), Eq(3));
+  ASSERT_THAT(bl.brick_max(0)[0], Eq(8));
+  ASSERT_THAT(bl.brick_max(1)[0], Eq(16));
+  BrickList bl3(1, IndexArray(0), IndexArray(10), IndexArray(3), All);
+  ASSERT_THAT(bl3.num_bricks(), Eq(2));
+  ASSERT_THAT(bl3.brick_max(0)[0], Eq(3));
+  ASSERT_THAT(bl3.brick_max(1)[0], Eq(10));
+}
+
+TEST(BrickList, OriginAfterRegionStart) {
+  // The brick containing the region start begins before the origin
+  BrickList bl(1, IndexArray(0), IndexArray(10), IndexArray(-3), All);
+  ASSERT_THAT(bl.num_bricks(), Eq(2));
+  ASSERT_THAT(bl.brick_max(0)[0], Eq(5));
+  ASSERT_THAT(bl.brick_max(1)[0], Eq(10));
+  BrickList bl2(1, IndexArray(-20), IndexArray(-4), IndexArray(0), All);
+  ASSERT_THAT(bl2.num_bricks(), Eq(3));
+  ASSERT_THAT(bl2.brick_max(0)[0], Eq(-16));
+  ASSERT_THAT(bl2.brick_max(1)[0], Eq(-8));
+  ASSERT_THAT(bl2.brick_max(2)[0], Eq(-4));
+}
+
+TEST(BrickList, Register) {
+  int h1 = RegisterBrickList(
+      new BrickList(1, IndexArray(0), IndexArray(8), IndexArray(0), All));
+  int h2 = RegisterBrickList(
+      new BrickList(1, IndexArray(0), IndexArray(4), IndexArray(0), All));
+  ASSERT_THAT(h1, Gt(0));
+  ASSERT_THAT(h2, Eq(h1 + 1));
+  ASSERT_THAT(FindBrickList(h2)->num_points(), Eq(4u));
+}
+
+} // namespace runtime
+} // namespace physis
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleMock(&argc, argv);
+  return RUN_ALL_TESTS();
+}
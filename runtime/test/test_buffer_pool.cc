@@ -0,0 +1,128 @@
+// Copyright 2011-2012, RIKEN AICS.
+// All rights reserved.
+//
+// This file is distributed under the BSD license. See LICENSE.txt for
+// details.
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "physis/physis_ref.h"
+#include "runtime/buffer_pool.h"
+
+using namespace ::testing;
+using namespace ::std;
+
+namespace physis {
+namespace runtime {
+
+TEST(BufferPool_GetSizeClass, FourClassesPerPowerOfTwo) {
+  ASSERT_THAT(BufferPool::GetSizeClass(1), Eq(64u));
+  ASSERT_THAT(BufferPool::GetSizeClass(64), Eq(64u));
+  ASSERT_THAT(BufferPool::GetSizeClass(65), Eq(80u));
+  ASSERT_THAT(BufferPool::GetSizeClass(100), Eq(112u));
+  ASSERT_THAT(BufferPool::GetSizeClass(128), Eq(128u));
+  ASSERT_THAT(BufferPool::GetSizeClass(129), Eq(160u));
+  ASSERT_THAT(BufferPool::GetSizeClass(1000000), Eq(1048576u));
+}
+
+class BufferPoolTest: public Test {
+ protected:
+  // Not the process-wide one so that each test starts empty
+  BufferPool pool_;
+};
+
+TEST_F(BufferPoolTest, ZeroSize) {
+  ASSERT_THAT(pool_.Allocate(0), IsNull());
+  pool_.Free(NULL);
+  ASSERT_THAT(pool_.GetStats().num_allocs, Eq(0u));
+  ASSERT_THAT(pool_.GetStats().num_frees, Eq(0u));
+}
+
+TEST_F(BufferPoolTest, ReuseWithinSizeClass) {
+  void *p = pool_.Allocate(100);
+  pool_.Free(p);
+  ASSERT_THAT(pool_.GetStats().bytes_cached, Eq(112u));
+  // Same class as 100
+  void *q = pool_.Allocate(110);
+  ASSERT_THAT(q, Eq(p));
+  // Different class
+  void *r = pool_.Allocate(200);
+  ASSERT_THAT(r, Ne(p));
+  BufferPoolStats s = pool_.GetStats();
+  ASSERT_THAT(s.num_allocs, Eq(3u));
+  ASSERT_THAT(s.num_hits, Eq(1u));
+  ASSERT_THAT(s.bytes_cached, Eq(0u));
+  pool_.Free(q);
+  pool_.Free(r);
+}
+
+TEST_F(BufferPoolTest, BytesInUse) {
+  void *p = pool_.Allocate(64);
+  void *q = pool_.Allocate(128);
+  ASSERT_THAT(pool_.GetStats().bytes_in_use, Eq(192u));
+  pool_.Free(p);
+  BufferPoolStats s = pool_.GetStats();
+  ASSERT_THAT(s.bytes_in_use, Eq(128u));
+  ASSERT_THAT(s.peak_bytes_in_use, Eq(192u));
+  ASSERT_THAT(s.bytes_cached, Eq(64u));
+  ASSERT_THAT(s.num_frees, Eq(1u));
+  pool_.Free(q);
+  ASSERT_THAT(pool_.GetStats().bytes_in_use, Eq(0u));
+}
+
+TEST_F(BufferPoolTest, MaxCachedBytes) {
+  pool_.set_max_cached_bytes(200);
+  void *p = pool_.Allocate(100);
+  void *q = pool_.Allocate(100);
+  pool_.Free(p);
+  // Does not fit in the limit; released to the system
+  pool_.Free(q);
+  ASSERT_THAT(pool_.GetStats().bytes_cached, Eq(112u));
+  // Lowering the limit releases cached chunks
+  pool_.set_max_cached_bytes(100);
+  ASSERT_THAT(pool_.GetStats().bytes_cached, Eq(0u));
+}
+
+TEST_F(BufferPoolTest, Trim) {
+  void *p = pool_.Allocate(1000);
+  void *q = pool_.Allocate(5000);
+  pool_.Free(p);
+  pool_.Free(q);
+  ASSERT_THAT(pool_.GetStats().bytes_cached,
+              Eq(BufferPool::GetSizeClass(1000) +
+                 BufferPool::GetSizeClass(5000)));
+  pool_.Trim();
+  ASSERT_THAT(pool_.GetStats().bytes_cached, Eq(0u));
+  // Nothing to reuse
+  p = pool_.Allocate(1000);
+  ASSERT_THAT(pool_.GetStats().num_hits, Eq(0u));
+  pool_.Free(p);
+}
+
+TEST(ScratchGrid, ReusesPoolChunk) {
+  BufferPool *pool = BufferPool::GetInstance();
+  PSVectorInt dim = {10, 10, 10};
+  __PSGrid *g = __PSGridNewScratch(sizeof(float), 3, dim);
+  ASSERT_TRUE(g->scratch);
+  void *p = g->p0;
+  ((float *)p)[999] = 1.0f;
+  PSGridFree(g);
+  free(g);
+  size_t hits = pool->GetStats().num_hits;
+  g = __PSGridNewScratch(sizeof(float), 3, dim);
+  ASSERT_THAT(pool->GetStats().num_hits, Eq(hits + 1));
+  ASSERT_THAT(g->p0, Eq(p));
+  // Zero-filled like grids not in the pool
+  ASSERT_THAT(((float *)g->p0)[999], Eq(0.0f));
+  PSGridFree(g);
+  free(g);
+}
+
+} // namespace runtime
+} // namespace physis
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleMock(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,382 @@
+// Copyright 2011-2012, RIKEN AICS.
+// All rights reserved.
+//
+// This file is distributed under the BSD license. See LICENSE.txt for
+// details.
+
+#include <algorithm>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "runtime/brick.h"
+#include "runtime/grid_space_mpi.h"
+#include "runtime/grid_mpi.h"
+#include "runtime/ipc_shm.h"
+
+using namespace ::testing;
+using namespace ::std;
+
+// Every test runs on all the processes forked by Init, so each test
+// makes the same collective calls on every process.
+
+namespace physis {
+namespace runtime {
+
+class GridSpaceMPITest: public Test {
+ public:
+  void SetUp() {
+    ipc_ = InterProcCommSHM::GetInstance();
+    rank_ = ipc_->GetRank();
+    ASSERT_THAT(ipc_->GetNumProcs(), Eq(4));
+  }
+  void TearDown() {
+    ipc_->Barrier();
+  }
+ protected:
+  // Global linear index of a point wrapped around into the grid
+  static float Wrap(const IndexArray &idx, const IndexArray &size) {
+    IndexArray t;
+    for (int i = 0; i < 3; ++i) {
+      t[i] = (idx[i] % size[i] + size[i]) % size[i];
+    }
+    return (float)(t[0] + t[1] * size[0] + t[2] * size[0] * size[1]);
+  }
+  // Sets the points of a grid owned by this process to v and the
+  // others in the buffer to -1
+  static void Fill(GridMPI *g, float v) {
+    IndexArray min = g->local_real_offset();
+    IndexArray max = min + g->local_real_size();
+    IndexArray lmin = g->local_offset(), lmax = lmin + g->local_size();
+    IndexArray idx;
+    for (idx[2] = min[2]; idx[2] < max[2]; ++idx[2]) {
+      for (idx[1] = min[1]; idx[1] < max[1]; ++idx[1]) {
+        for (idx[0] = min[0]; idx[0] < max[0]; ++idx[0]) {
+          bool local = true;
+          for (int i = 0; i < 3; ++i) {
+            local &= lmin[i] <= idx[i] && idx[i] < lmax[i];
+          }
+          *(float*)g->GetAddress(idx) = local ? v : -1.0f;
+        }
+      }
+    }
+  }
+  InterProcComm *ipc_;
+  int rank_;
+};
+
+TEST_F(GridSpaceMPITest, PeriodicHalo) {
+  // The first dimension is not decomposed, so its halo is wrapped
+  // around locally, and the others are exchanged
+  IndexArray size(8, 8, 8);
+  GridSpaceMPI gs(3, size, 3, IntArray(1, 2, 2), rank_, ipc_);
+  IndexArray smin(-2, -1, -1), smax(2, 1, 1);
+  GridMPI *g = gs.CreateGrid(PS_FLOAT, sizeof(float), 3, size,
+                             IndexArray(0), smin, smax,
+                             PS_GRID_ATTRIBUTE_PERIODIC);
+  ASSERT_THAT(g->halo().bw[0], Eq(2u));
+  ASSERT_THAT(g->halo().fw[0], Eq(2u));
+  IndexArray min = g->local_offset(), max = min + g->local_size();
+  IndexArray idx;
+  for (idx[2] = min[2]; idx[2] < max[2]; ++idx[2]) {
+    for (idx[1] = min[1]; idx[1] < max[1]; ++idx[1]) {
+      for (idx[0] = min[0]; idx[0] < max[0]; ++idx[0]) {
+        *(float*)g->GetAddress(idx) = Wrap(idx, size);
+      }
+    }
+  }
+  gs.LoadNeighbor(g, smin, smax, true, false, true);
+  // Every point of the buffer including the corners of the halo
+  min = g->local_real_offset();
+  max = min + g->local_real_size();
+  for (idx[2] = min[2]; idx[2] < max[2]; ++idx[2]) {
+    for (idx[1] = min[1]; idx[1] < max[1]; ++idx[1]) {
+      for (idx[0] = min[0]; idx[0] < max[0]; ++idx[0]) {
+        ASSERT_THAT(*(float*)g->GetAddress(idx), Eq(Wrap(idx, size)))
+            << "at (" << idx[0] << ", " << idx[1] << ", " << idx[2] << ")";
+      }
+    }
+  }
+}
+
+TEST_F(GridSpaceMPITest, NoHaloOnUndecomposedDimension) {
+  // Non-periodic grids never access beyond the first dimension
+  IndexArray size(8, 8, 8);
+  GridSpaceMPI gs(3, size, 3, IntArray(1, 2, 2), rank_, ipc_);
+  GridMPI *g = gs.CreateGrid(PS_FLOAT, sizeof(float), 3, size,
+                             IndexArray(0), IndexArray(-1, -1, -1),
+                             IndexArray(1, 1, 1), 0);
+  ASSERT_THAT(g->halo().bw[0], Eq(0u));
+  ASSERT_THAT(g->halo().fw[0], Eq(0u));
+  ASSERT_THAT(g->halo().bw[1], Eq(1u));
+  ASSERT_THAT(g->halo().fw[1], Eq(1u));
+}
+
+TEST_F(GridSpaceMPITest, PartitionAlign) {
+  IndexArray size(8, 8, 18);
+  // Not aligned
+  GridSpaceMPI gs1(3, size, 3, IntArray(1, 1, 2), 1, ipc_);
+  ASSERT_THAT(gs1.offsets()[2][1], Eq(9));
+  ASSERT_THAT(gs1.partitions()[2][1], Eq(9));
+  // Units of four points are distributed
+  GridSpaceMPI gs4(3, size, 3, IntArray(1, 1, 2), 1, ipc_, 4);
+  ASSERT_THAT(gs4.partitions()[2][0], Eq(8));
+  ASSERT_THAT(gs4.offsets()[2][1], Eq(8));
+  ASSERT_THAT(gs4.partitions()[2][1], Eq(10));
+  ASSERT_THAT(gs4.my_offset()[2], Eq(8));
+  ASSERT_THAT(gs4.my_size()[2], Eq(10));
+  ASSERT_THAT(gs4.partitions()[0][0], Eq(8));
+}
+
+TEST_F(GridSpaceMPITest, PartitionAlignTooCoarse) {
+  // Two units of four points for four processes; points are
+  // distributed instead so that no process is empty
+  GridSpaceMPI gs(3, IndexArray(8, 8, 6), 3, IntArray(1, 1, 4), 0,
+                  ipc_, 4);
+  ASSERT_THAT(gs.partitions()[2][0], Eq(1));
+  ASSERT_THAT(gs.partitions()[2][1], Eq(1));
+  ASSERT_THAT(gs.partitions()[2][2], Eq(2));
+  ASSERT_THAT(gs.partitions()[2][3], Eq(2));
+}
+
+TEST_F(GridSpaceMPITest, GetLevel) {
+  GridSpaceMPI gs(3, IndexArray(16, 16, 18), 3, IntArray(1, 1, 2), 1,
+                  ipc_, 4);
+  const GridSpaceLevel *lv2 = gs.GetLevel(IndexArray(8, 8, 9));
+  ASSERT_THAT(lv2->ratio[0], Eq(2));
+  ASSERT_THAT(lv2->ratio[2], Eq(2));
+  ASSERT_THAT(lv2->offsets[2][0], Eq(0));
+  ASSERT_THAT(lv2->partitions[2][0], Eq(4));
+  ASSERT_THAT(lv2->offsets[2][1], Eq(4));
+  ASSERT_THAT(lv2->partitions[2][1], Eq(5));
+  ASSERT_THAT(lv2->my_offset[2], Eq(4));
+  ASSERT_THAT(lv2->my_size[2], Eq(5));
+  // The coarse points of a process have their fine points in it
+  ASSERT_THAT(lv2->my_offset[2] * lv2->ratio[2], Eq(gs.my_offset()[2]));
+  // Levels are created once per size
+  ASSERT_THAT(gs.GetLevel(IndexArray(8, 8, 9)), Eq(lv2));
+  const GridSpaceLevel *lv4 = gs.GetLevel(IndexArray(4, 4, 5));
+  ASSERT_THAT(lv4, Ne(lv2));
+  ASSERT_THAT(lv4->ratio[2], Eq(4));
+  ASSERT_THAT(lv4->my_offset[2], Eq(2));
+  ASSERT_THAT(lv4->my_size[2], Eq(3));
+}
+
+TEST_F(GridSpaceMPITest, CoarseGrid) {
+  GridSpaceMPI gs(3, IndexArray(16, 16, 18), 3, IntArray(1, 1, 2), 1,
+                  ipc_, 4);
+  IndexArray size(8, 8, 9);
+  GridMPI *g = gs.CreateGrid(PS_FLOAT, sizeof(float), 3, size,
+                             IndexArray(0), IndexArray(0), IndexArray(0),
+                             PS_GRID_ATTRIBUTE_COARSE);
+  ASSERT_THAT(g->local_offset()[2], Eq(4));
+  ASSERT_THAT(g->local_size()[2], Eq(5));
+  ASSERT_THAT(g->local_size()[0], Eq(8));
+}
+
+TEST_F(GridSpaceMPITest, SetActiveRegion) {
+  IndexArray size(8, 8, 16);
+  for (int r = 0; r < 4; ++r) {
+    GridSpaceMPI gs(3, size, 3, IntArray(1, 1, 4), r, ipc_);
+    // Only the owner of the region without stencils
+    ASSERT_THAT(gs.SetActiveRegion(IndexArray(0), IndexArray(8, 8, 4)),
+                Eq(r == 0));
+    gs.CreateGrid(PS_FLOAT, sizeof(float), 3, size, IndexArray(0),
+                  IndexArray(-1, -1, -1), IndexArray(1, 1, 1), 0);
+    // Widened by the stencil to the neighbors
+    ASSERT_THAT(gs.SetActiveRegion(IndexArray(0), IndexArray(8, 8, 4)),
+                Eq(r <= 1));
+    ASSERT_THAT(gs.SetActiveRegion(IndexArray(0, 0, 12),
+                                   IndexArray(8, 8, 16)),
+                Eq(r >= 2));
+    ASSERT_THAT(gs.SetActiveRegion(IndexArray(0, 0, 7),
+                                   IndexArray(8, 8, 9)),
+                Eq(r == 1 || r == 2));
+  }
+}
+
+TEST_F(GridSpaceMPITest, SetActiveRegionPeriodic) {
+  IndexArray size(8, 8, 16);
+  for (int r = 0; r < 4; ++r) {
+    GridSpaceMPI gs(3, size, 3, IntArray(1, 1, 4), r, ipc_);
+    gs.CreateGrid(PS_FLOAT, sizeof(float), 3, size, IndexArray(0),
+                  IndexArray(-1, -1, -1), IndexArray(1, 1, 1),
+                  PS_GRID_ATTRIBUTE_PERIODIC);
+    ASSERT_TRUE(gs.SetActiveRegion(IndexArray(0), IndexArray(8, 8, 4)));
+  }
+}
+
+TEST_F(GridSpaceMPITest, ActiveRegionHalo) {
+  IndexArray size(8, 8, 16);
+  GridSpaceMPI gs(3, size, 3, IntArray(1, 1, 4), rank_, ipc_);
+  IndexArray smin(-1, -1, -1), smax(1, 1, 1);
+  GridMPI *g = gs.CreateGrid(PS_FLOAT, sizeof(float), 3, size,
+                             IndexArray(0), smin, smax, 0);
+  PSIndex bw = g->local_offset()[2] - 1;
+  PSIndex fw = g->local_offset()[2] + g->local_size()[2];
+  Fill(g, rank_);
+  // Processes 0 and 1 are active, and the others skip the run
+  if (gs.SetActiveRegion(IndexArray(0), IndexArray(8, 8, 4))) {
+    gs.LoadNeighbor(g, smin, smax, false, false, false);
+  }
+  float expected_bw[] = {-1, 0, -1, -1};
+  float expected_fw[] = {1, -1, -1, -1};
+  if (rank_ > 0) {
+    EXPECT_THAT(*(float*)g->GetAddress(IndexArray(0, 0, bw)),
+                Eq(expected_bw[rank_]));
+  }
+  if (rank_ < 3) {
+    EXPECT_THAT(*(float*)g->GetAddress(IndexArray(0, 0, fw)),
+                Eq(expected_fw[rank_]));
+  }
+  // All the halos are exchanged again
+  gs.ClearActiveRegion();
+  gs.LoadNeighbor(g, smin, smax, false, false, false);
+  if (rank_ > 0) {
+    EXPECT_THAT(*(float*)g->GetAddress(IndexArray(7, 7, bw)),
+                Eq(rank_ - 1));
+  }
+  if (rank_ < 3) {
+    EXPECT_THAT(*(float*)g->GetAddress(IndexArray(7, 7, fw)),
+                Eq(rank_ + 1));
+  }
+}
+
+TEST_F(GridSpaceMPITest, PrefetchedHalo) {
+  IndexArray size(8, 8, 16);
+  GridSpaceMPI gs(3, size, 3, IntArray(1, 1, 4), rank_, ipc_);
+  IndexArray smin(-1, -1, -1), smax(1, 1, 1);
+  GridMPI *g = gs.CreateGrid(PS_FLOAT, sizeof(float), 3, size,
+                             IndexArray(0), smin, smax, 0);
+  PSIndex fw = g->local_offset()[2] + g->local_size()[2];
+  IndexArray fw_idx(7, 7, fw);
+  Fill(g, rank_);
+  gs.PrefetchHalo(g);
+  if (rank_ < 3) {
+    EXPECT_THAT(*(float*)g->GetAddress(fw_idx), Eq(rank_ + 1));
+  }
+  // The next load is skipped, so the halo cleared here stays
+  Fill(g, rank_ + 10);
+  gs.LoadNeighbor(g, smin, smax, false, false, false);
+  if (rank_ < 3) {
+    EXPECT_THAT(*(float*)g->GetAddress(fw_idx), Eq(-1));
+  }
+  // Only the first load is skipped
+  gs.LoadNeighbor(g, smin, smax, false, false, false);
+  if (rank_ < 3) {
+    EXPECT_THAT(*(float*)g->GetAddress(fw_idx), Eq(rank_ + 11));
+  }
+  // Dropped halos are exchanged again
+  gs.PrefetchHalo(g);
+  gs.DropPrefetchedHalos();
+  Fill(g, rank_ + 20);
+  gs.LoadNeighbor(g, smin, smax, false, false, false);
+  if (rank_ < 3) {
+    EXPECT_THAT(*(float*)g->GetAddress(fw_idx), Eq(rank_ + 21));
+  }
+}
+
+TEST_F(GridSpaceMPITest, MaskedHalo) {
+  IndexArray size(8, 8, 16);
+  GridSpaceMPI gs(3, size, 3, IntArray(1, 1, 4), rank_, ipc_);
+  IndexArray smin(-1, -1, -1), smax(1, 1, 1);
+  GridMPI *g = gs.CreateGrid(PS_FLOAT, sizeof(float), 3, size,
+                             IndexArray(0), smin, smax, 0);
+  GridMPI *mask = gs.CreateGrid(PS_INT, sizeof(int), 3, size,
+                                IndexArray(0), IndexArray(0),
+                                IndexArray(0), 0);
+  // Active only at z == 5, which process 1 owns
+  IndexArray min = mask->local_offset(), max = min + mask->local_size();
+  IndexArray idx;
+  for (idx[2] = min[2]; idx[2] < max[2]; ++idx[2]) {
+    for (idx[1] = min[1]; idx[1] < max[1]; ++idx[1]) {
+      for (idx[0] = min[0]; idx[0] < max[0]; ++idx[0]) {
+        *(int*)mask->GetAddress(idx) = idx[2] == 5;
+      }
+    }
+  }
+  __PSDomain dom = {{0, 0, 0}, {8, 8, 16}, {0, 0, 0}, {0, 0, 0}, 0};
+  int handle = gs.MaskDomain(dom, mask);
+  const BrickList *bl = FindBrickList(handle);
+  // Not to skip the collective calls below on failures
+  EXPECT_THAT(bl->num_bricks(), Eq(rank_ == 1 ? 1 : 0));
+  EXPECT_THAT(bl->global_active_min()[2], Eq(4));
+  EXPECT_THAT(bl->global_active_max()[2], Eq(8));
+  EXPECT_THAT(bl->global_active_max()[0], Eq(8));
+
+  PSIndex bw = g->local_offset()[2] - 1;
+  PSIndex fw = g->local_offset()[2] + g->local_size()[2];
+  Fill(g, rank_);
+  // Processes 0 to 2 are active, but only process 1 reads its halos
+  if (gs.SetActiveRegion(bl->global_active_min(),
+                         bl->global_active_max())) {
+    gs.SetActiveMasks(std::vector<int>(1, handle));
+    gs.LoadNeighbor(g, smin, smax, false, false, false);
+  }
+  gs.ClearActiveRegion();
+  float expected_bw[] = {-1, 0, -1, -1};
+  float expected_fw[] = {-1, 2, -1, -1};
+  if (rank_ > 0) {
+    EXPECT_THAT(*(float*)g->GetAddress(IndexArray(0, 0, bw)),
+                Eq(expected_bw[rank_]));
+  }
+  if (rank_ < 3) {
+    EXPECT_THAT(*(float*)g->GetAddress(IndexArray(0, 0, fw)),
+                Eq(expected_fw[rank_]));
+  }
+}
+
+TEST_F(GridSpaceMPITest, BrickedHalo) {
+  IndexArray size(16, 16, 16);
+  GridSpaceMPI gs(3, size, 3, IntArray(1, 2, 2), rank_, ipc_);
+  IndexArray smin(-1, -1, -1), smax(1, 1, 1);
+  GridMPI *g = gs.CreateGrid(PS_FLOAT, sizeof(float), 3, size,
+                             IndexArray(0), smin, smax,
+                             PS_GRID_ATTRIBUTE_BRICK);
+  EXPECT_TRUE(g->bricked());
+  // The backward halo is padded so that the bricks of the buffer
+  // start at the local offset
+  EXPECT_THAT(g->halo().bw[1], Eq((unsigned)PS_BRICK_WIDTH));
+  EXPECT_THAT(g->halo().fw[1], Eq(1u));
+  IndexArray min = g->local_offset(), max = min + g->local_size();
+  IndexArray idx;
+  for (idx[2] = min[2]; idx[2] < max[2]; ++idx[2]) {
+    for (idx[1] = min[1]; idx[1] < max[1]; ++idx[1]) {
+      for (idx[0] = min[0]; idx[0] < max[0]; ++idx[0]) {
+        *(float*)g->GetAddress(idx) = Wrap(idx, size);
+      }
+    }
+  }
+  gs.LoadNeighbor(g, smin, smax, true, false, false);
+  // The points within the stencil widths
+  for (int i = 1; i < 3; ++i) {
+    min[i] = std::max(min[i] - 1, (PSIndex)0);
+    max[i] = std::min(max[i] + 1, size[i]);
+  }
+  for (idx[2] = min[2]; idx[2] < max[2]; ++idx[2]) {
+    for (idx[1] = min[1]; idx[1] < max[1]; ++idx[1]) {
+      for (idx[0] = min[0]; idx[0] < max[0]; ++idx[0]) {
+        ASSERT_THAT(*(float*)g->GetAddress(idx), Eq(Wrap(idx, size)))
+            << "at (" << idx[0] << ", " << idx[1] << ", " << idx[2] << ")";
+      }
+    }
+  }
+}
+
+} // namespace runtime
+} // namespace physis
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleMock(&argc, argv);
+  physis::runtime::InterProcComm *ipc =
+      physis::runtime::InterProcCommSHM::GetInstance();
+  if (ipc->Init(&argc, &argv) != physis::runtime::InterProcComm::IPC_SUCCESS) {
+    return 1;
+  }
+  int b = RUN_ALL_TESTS();
+  // The exit status of the forked processes is not collected
+  int failed = 0;
+  ipc->Reduce(&b, &failed, 1, PS_INT, PS_MAX, 0);
+  ipc->Finalize();
+  return ipc->GetRank() == 0 ? failed : b;
+}
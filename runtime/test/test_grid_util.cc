@@ -0,0 +1,145 @@
+// Copyright 2011-2012, RIKEN AICS.
+// All rights reserved.
+//
+// This file is distributed under the BSD license. See LICENSE.txt for
+// details.
+
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "runtime/grid_util.h"
+
+using namespace ::testing;
+using namespace ::std;
+
+namespace physis {
+namespace runtime {
+
+class CopySubgridBrickTest: public Test {
+ public:
+  void SetUp() {
+    // 16x24x16 points
+    num_bricks_ = IndexArray(2, 3, 2);
+    grid_.assign(num_bricks_.accumulate(3) * PS_BRICK_WIDTH *
+                 PS_BRICK_WIDTH * PS_BRICK_WIDTH, -1);
+    offset_ = IndexArray(3, 5, 7);
+    size_ = IndexArray(10, 12, 6);
+    subgrid_.resize(size_.accumulate(3));
+    for (size_t i = 0; i < subgrid_.size(); ++i) subgrid_[i] = i;
+  }
+ protected:
+  int &At(PSIndex i, PSIndex j, PSIndex k) {
+    return grid_[__PSBrickOffset3D(i, j, k, num_bricks_[0],
+                                   num_bricks_[1])];
+  }
+  bool InSubgrid(PSIndex i, PSIndex j, PSIndex k) const {
+    return offset_[0] <= i && i < offset_[0] + size_[0] &&
+        offset_[1] <= j && j < offset_[1] + size_[1] &&
+        offset_[2] <= k && k < offset_[2] + size_[2];
+  }
+  IndexArray num_bricks_;
+  vector<int> grid_;
+  IndexArray offset_;
+  IndexArray size_;
+  vector<int> subgrid_;
+};
+
+TEST_F(CopySubgridBrickTest, Copyin) {
+  CopyinSubgridBrick(sizeof(int), 3, &grid_[0], num_bricks_,
+                     &subgrid_[0], offset_, size_);
+  for (PSIndex k = 0; k < 16; ++k) {
+    for (PSIndex j = 0; j < 24; ++j) {
+      for (PSIndex i = 0; i < 16; ++i) {
+        int expected = InSubgrid(i, j, k) ?
+            subgrid_[GridCalcOffset3D(i - offset_[0], j - offset_[1],
+                                      k - offset_[2], size_)] : -1;
+        ASSERT_THAT(At(i, j, k), Eq(expected))
+            << "at (" << i << ", " << j << ", " << k << ")";
+      }
+    }
+  }
+}
+
+TEST_F(CopySubgridBrickTest, RoundTrip) {
+  CopyinSubgridBrick(sizeof(int), 3, &grid_[0], num_bricks_,
+                     &subgrid_[0], offset_, size_);
+  vector<int> out(subgrid_.size(), -1);
+  CopyoutSubgridBrick(sizeof(int), 3, &grid_[0], num_bricks_,
+                      &out[0], offset_, size_);
+  ASSERT_THAT(out, ContainerEq(subgrid_));
+}
+
+TEST_F(CopySubgridBrickTest, SameAsRowMajor) {
+  // Copying out of the brick layout gives the same sub grid as
+  // copying out of the row-major layout of the same points
+  IndexArray grid_size(16, 24, 16);
+  vector<int> row_major(grid_size.accumulate(3));
+  for (PSIndex k = 0; k < 16; ++k) {
+    for (PSIndex j = 0; j < 24; ++j) {
+      for (PSIndex i = 0; i < 16; ++i) {
+        int v = GridCalcOffset3D(i, j, k, grid_size);
+        row_major[v] = v;
+        At(i, j, k) = v;
+      }
+    }
+  }
+  vector<int> expected(subgrid_.size()), out(subgrid_.size());
+  CopyoutSubgrid(sizeof(int), 3, &row_major[0], grid_size,
+                 &expected[0], offset_, size_);
+  CopyoutSubgridBrick(sizeof(int), 3, &grid_[0], num_bricks_,
+                      &out[0], offset_, size_);
+  ASSERT_THAT(out, ContainerEq(expected));
+}
+
+TEST_F(CopySubgridBrickTest, RoundTrip2D) {
+  IndexArray nb(3, 2);
+  vector<float> grid(nb.accumulate(2) * PS_BRICK_WIDTH * PS_BRICK_WIDTH);
+  IndexArray offset(7, 1), size(17, 14);
+  vector<float> in(size.accumulate(2)), out(in.size());
+  for (size_t i = 0; i < in.size(); ++i) in[i] = i * 0.5f;
+  CopyinSubgridBrick(sizeof(float), 2, &grid[0], nb, &in[0],
+                     offset, size);
+  ASSERT_THAT(grid[__PSBrickOffset2D(7 + 16, 1 + 13, nb[0])],
+              Eq(in[13 * 17 + 16]));
+  CopyoutSubgridBrick(sizeof(float), 2, &grid[0], nb, &out[0],
+                      offset, size);
+  ASSERT_THAT(out, ContainerEq(in));
+}
+
+TEST_F(CopySubgridBrickTest, Member) {
+  struct Point {
+    int x;
+    float y;
+  };
+  IndexArray nb(1, 1, 1);
+  vector<Point> grid(PS_BRICK_WIDTH * PS_BRICK_WIDTH * PS_BRICK_WIDTH);
+  for (size_t i = 0; i < grid.size(); ++i) {
+    grid[i].x = i;
+    grid[i].y = 0.0f;
+  }
+  IndexArray offset(1, 2, 3), size(4, 5, 2);
+  vector<float> in(size.accumulate(3)), out(in.size());
+  for (size_t i = 0; i < in.size(); ++i) in[i] = i + 0.5f;
+  CopyinSubgridMemberBrick(sizeof(Point), 3, &grid[0], nb, &in[0],
+                           offset, size, offsetof(Point, y),
+                           sizeof(float));
+  // The other member is kept
+  for (size_t i = 0; i < grid.size(); ++i) {
+    ASSERT_THAT(grid[i].x, Eq((int)i));
+  }
+  ASSERT_THAT(grid[__PSBrickOffset3D(1, 2, 3, 1, 1)].y, Eq(in[0]));
+  CopyoutSubgridMemberBrick(sizeof(Point), 3, &grid[0], nb, &out[0],
+                            offset, size, offsetof(Point, y),
+                            sizeof(float));
+  ASSERT_THAT(out, ContainerEq(in));
+}
+
+} // namespace runtime
+} // namespace physis
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleMock(&argc, argv);
+  return RUN_ALL_TESTS();
+}
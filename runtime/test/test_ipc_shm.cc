@@ -0,0 +1,141 @@
+// Copyright 2011-2012, RIKEN AICS.
+// All rights reserved.
+//
+// This file is distributed under the BSD license. See LICENSE.txt for
+// details.
+
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "runtime/ipc_shm.h"
+
+using namespace ::testing;
+using namespace ::std;
+
+// Every test runs on all the processes forked by Init, so each test
+// makes the same collective calls on every process.
+
+namespace physis {
+namespace runtime {
+
+class InterProcCommSHMTest: public Test {
+ public:
+  void SetUp() {
+    ipc_ = InterProcCommSHM::GetInstance();
+    rank_ = ipc_->GetRank();
+    num_procs_ = ipc_->GetNumProcs();
+    next_ = (rank_ + 1) % num_procs_;
+    prev_ = (rank_ + num_procs_ - 1) % num_procs_;
+  }
+  void TearDown() {
+    ipc_->Barrier();
+  }
+ protected:
+  InterProcComm *ipc_;
+  int rank_;
+  int num_procs_;
+  int next_;
+  int prev_;
+};
+
+TEST_F(InterProcCommSHMTest, SendLargerThanRing) {
+  // Run with a ring smaller than the messages so that they are
+  // pushed and pulled in pieces
+  vector<int> out(4096), in(4096, -1);
+  for (size_t i = 0; i < out.size(); ++i) out[i] = rank_ * 10000 + i;
+  ipc_->Send(&out[0], out.size() * sizeof(int), next_);
+  ipc_->Recv(&in[0], in.size() * sizeof(int), prev_);
+  for (size_t i = 0; i < in.size(); ++i) {
+    ASSERT_THAT(in[i], Eq((int)(prev_ * 10000 + i)));
+  }
+}
+
+TEST_F(InterProcCommSHMTest, MessagesInOrder) {
+  int out[3] = {rank_, rank_ + 100, rank_ + 200};
+  for (int i = 0; i < 3; ++i) {
+    ipc_->Send(&out[i], sizeof(int), next_);
+  }
+  for (int i = 0; i < 3; ++i) {
+    int in = -1;
+    ipc_->Recv(&in, sizeof(int), prev_);
+    ASSERT_THAT(in, Eq(prev_ + i * 100));
+  }
+}
+
+TEST_F(InterProcCommSHMTest, TagsDoNotMatch) {
+  // The request is sent first, but the data message is received
+  // first since they have different tags
+  int req = 1000 + rank_, data = rank_;
+  ipc_->Send(&req, sizeof(int), next_, InterProcComm::TAG_REQUEST);
+  ipc_->Send(&data, sizeof(int), next_, InterProcComm::TAG_DATA);
+  int in = -1;
+  ipc_->Recv(&in, sizeof(int), prev_, InterProcComm::TAG_DATA);
+  ASSERT_THAT(in, Eq(prev_));
+  ipc_->Recv(&in, sizeof(int), InterProcComm::ANY_SOURCE,
+             InterProcComm::TAG_REQUEST);
+  ASSERT_THAT(in, Eq(1000 + prev_));
+}
+
+TEST_F(InterProcCommSHMTest, IsendIrecv) {
+  vector<double> out(1000), in(1000, 0.0);
+  for (size_t i = 0; i < out.size(); ++i) out[i] = rank_ + i * 0.5;
+  void *rreq = ipc_->CreateRequest();
+  void *sreq = ipc_->CreateRequest();
+  ipc_->Irecv(&in[0], in.size() * sizeof(double), prev_, rreq);
+  ipc_->Isend(&out[0], out.size() * sizeof(double), next_, sreq);
+  ipc_->Wait(sreq);
+  ipc_->Wait(rreq);
+  ASSERT_THAT(ipc_->Test(rreq), Eq(InterProcComm::IPC_SUCCESS));
+  ipc_->DeleteRequest(sreq);
+  ipc_->DeleteRequest(rreq);
+  for (size_t i = 0; i < in.size(); ++i) {
+    ASSERT_THAT(in[i], DoubleEq(prev_ + i * 0.5));
+  }
+}
+
+TEST_F(InterProcCommSHMTest, Bcast) {
+  int root = num_procs_ - 1;
+  vector<long> v(100, -1);
+  if (rank_ == root) {
+    for (size_t i = 0; i < v.size(); ++i) v[i] = i * 3;
+  }
+  ipc_->Bcast(&v[0], v.size() * sizeof(long), root);
+  for (size_t i = 0; i < v.size(); ++i) {
+    ASSERT_THAT(v[i], Eq((long)(i * 3)));
+  }
+}
+
+TEST_F(InterProcCommSHMTest, Reduce) {
+  int iv[2] = {rank_ + 1, -rank_};
+  int isum[2] = {0, 0}, imax[2] = {0, 0};
+  ipc_->Reduce(iv, isum, 2, PS_INT, PS_SUM, 0);
+  ipc_->Reduce(iv, imax, 2, PS_INT, PS_MAX, 0);
+  double dv = rank_ * 0.25, dmin = -1.0;
+  ipc_->Reduce(&dv, &dmin, 1, PS_DOUBLE, PS_MIN, 0);
+  if (rank_ != 0) return;
+  ASSERT_THAT(isum[0], Eq(num_procs_ * (num_procs_ + 1) / 2));
+  ASSERT_THAT(isum[1], Eq(-num_procs_ * (num_procs_ - 1) / 2));
+  ASSERT_THAT(imax[0], Eq(num_procs_));
+  ASSERT_THAT(imax[1], Eq(0));
+  ASSERT_THAT(dmin, DoubleEq(0.0));
+}
+
+} // namespace runtime
+} // namespace physis
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleMock(&argc, argv);
+  physis::runtime::InterProcComm *ipc =
+      physis::runtime::InterProcCommSHM::GetInstance();
+  if (ipc->Init(&argc, &argv) != physis::runtime::InterProcComm::IPC_SUCCESS) {
+    return 1;
+  }
+  int b = RUN_ALL_TESTS();
+  // The exit status of the forked processes is not collected
+  int failed = 0;
+  ipc->Reduce(&b, &failed, 1, PS_INT, PS_MAX, 0);
+  ipc->Finalize();
+  return ipc->GetRank() == 0 ? failed : b;
+}
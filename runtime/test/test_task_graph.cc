@@ -0,0 +1,154 @@
+// Copyright 2011-2012, RIKEN AICS.
+// All rights reserved.
+//
+// This file is distributed under the BSD license. See LICENSE.txt for
+// details.
+
+#include <vector>
+#include <boost/bind.hpp>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "runtime/task_graph.h"
+
+using namespace ::testing;
+using namespace ::std;
+
+namespace physis {
+namespace runtime {
+
+static void Record(vector<int> *log, int id) {
+  log->push_back(id);
+}
+
+class TaskGraphTest: public Test {
+ public:
+  void SetUp() {
+    // The graph only compares the grid pointers
+    a_ = reinterpret_cast<Grid*>(&grids_[0]);
+    b_ = reinterpret_cast<Grid*>(&grids_[1]);
+    c_ = reinterpret_cast<Grid*>(&grids_[2]);
+  }
+ protected:
+  //! Adds a task recording its ID when executed and when released.
+  int Add(TASK_KIND kind, const vector<Grid*> &reads,
+          const vector<Grid*> &writes, bool overwrites) {
+    int id = graph_.stats().num_tasks;
+    return graph_.Add(kind, boost::bind(Record, &executed_, id),
+                      reads, writes, overwrites,
+                      boost::bind(Record, &released_, id));
+  }
+  static vector<Grid*> Grids() {
+    return vector<Grid*>();
+  }
+  static vector<Grid*> Grids(Grid *g) {
+    return vector<Grid*>(1, g);
+  }
+  TaskGraph graph_;
+  int grids_[3];
+  Grid *a_, *b_, *c_;
+  vector<int> executed_;
+  vector<int> released_;
+};
+
+TEST_F(TaskGraphTest, Deferred) {
+  Add(TASK_COPYIN, Grids(), Grids(a_), true);
+  Add(TASK_RUN, Grids(a_), Grids(b_), false);
+  ASSERT_TRUE(executed_.empty());
+  ASSERT_FALSE(graph_.empty());
+  graph_.Flush();
+  ASSERT_THAT(executed_, ElementsAre(0, 1));
+  ASSERT_THAT(released_, ElementsAre(0, 1));
+  ASSERT_TRUE(graph_.empty());
+}
+
+TEST_F(TaskGraphTest, FlushGridRunsOnlyDependencies) {
+  Add(TASK_COPYIN, Grids(), Grids(a_), true);
+  Add(TASK_COPYIN, Grids(), Grids(b_), true);
+  Add(TASK_RUN, Grids(a_), Grids(c_), false);
+  graph_.Flush(c_);
+  ASSERT_THAT(executed_, ElementsAre(0, 2));
+  // Task 2 ran before task 1
+  ASSERT_THAT(graph_.stats().num_reordered, Eq(1u));
+  graph_.Flush();
+  ASSERT_THAT(executed_, ElementsAre(0, 2, 1));
+}
+
+TEST_F(TaskGraphTest, WriteAfterRead) {
+  Add(TASK_RUN, Grids(a_), Grids(b_), false);
+  Add(TASK_COPYIN, Grids(), Grids(a_), true);
+  // The copyin must wait for the read of the old values
+  graph_.Flush(a_);
+  ASSERT_THAT(executed_, ElementsAre(0, 1));
+  ASSERT_THAT(graph_.stats().num_elided, Eq(0u));
+}
+
+TEST_F(TaskGraphTest, WriteAfterWrite) {
+  Add(TASK_RUN, Grids(), Grids(a_), false);
+  Add(TASK_RUN, Grids(a_), Grids(a_), false);
+  graph_.Flush(a_);
+  ASSERT_THAT(executed_, ElementsAre(0, 1));
+}
+
+TEST_F(TaskGraphTest, ElideDeadCopyin) {
+  Add(TASK_COPYIN, Grids(), Grids(a_), true);
+  Add(TASK_COPYIN, Grids(), Grids(a_), true);
+  // The first copyin is dropped but still released
+  ASSERT_THAT(graph_.stats().num_elided, Eq(1u));
+  ASSERT_THAT(released_, ElementsAre(0));
+  graph_.Flush();
+  ASSERT_THAT(executed_, ElementsAre(1));
+  ASSERT_THAT(graph_.stats().num_executed, Eq(1u));
+}
+
+TEST_F(TaskGraphTest, KeepCopyinRead) {
+  Add(TASK_COPYIN, Grids(), Grids(a_), true);
+  Add(TASK_RUN, Grids(a_), Grids(b_), false);
+  Add(TASK_COPYIN, Grids(), Grids(a_), true);
+  ASSERT_THAT(graph_.stats().num_elided, Eq(0u));
+  graph_.Flush();
+  ASSERT_THAT(executed_, ElementsAre(0, 1, 2));
+}
+
+TEST_F(TaskGraphTest, KeepPartialWrite) {
+  // A run may write only part of the grid
+  Add(TASK_RUN, Grids(), Grids(a_), false);
+  Add(TASK_COPYIN, Grids(), Grids(a_), true);
+  ASSERT_THAT(graph_.stats().num_elided, Eq(0u));
+  graph_.Flush();
+  ASSERT_THAT(executed_, ElementsAre(0, 1));
+}
+
+TEST_F(TaskGraphTest, KeepExecutedCopyin) {
+  Add(TASK_COPYIN, Grids(), Grids(a_), true);
+  graph_.Flush(a_);
+  Add(TASK_COPYIN, Grids(), Grids(a_), true);
+  graph_.Flush();
+  ASSERT_THAT(executed_, ElementsAre(0, 1));
+  ASSERT_THAT(graph_.stats().num_elided, Eq(0u));
+}
+
+TEST_F(TaskGraphTest, ExchangeAheadOfIndependentRun) {
+  Add(TASK_RUN, Grids(a_), Grids(a_), false);
+  Add(TASK_EXCHANGE, Grids(b_), Grids(b_), false);
+  Add(TASK_RUN, Grids(b_), Grids(c_), false);
+  graph_.Flush();
+  ASSERT_THAT(executed_, ElementsAre(1, 0, 2));
+}
+
+TEST_F(TaskGraphTest, ExchangeAfterWriter) {
+  Add(TASK_RUN, Grids(b_), Grids(a_), false);
+  Add(TASK_EXCHANGE, Grids(a_), Grids(a_), false);
+  Add(TASK_RUN, Grids(a_), Grids(c_), false);
+  graph_.Flush(c_);
+  ASSERT_THAT(executed_, ElementsAre(0, 1, 2));
+}
+
+} // namespace runtime
+} // namespace physis
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleMock(&argc, argv);
+  return RUN_ALL_TESTS();
+}
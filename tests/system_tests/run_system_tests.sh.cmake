@@ -389,9 +389,18 @@ function generate_translation_configurations_mpi()
 {
     if [ $# -gt 0 ]; then
 		echo $1
-    else
-		generate_empty_translation_configuration
+		return
     fi
+    local new_configs=$(generate_empty_translation_configuration)
+	# Thread-parallel sweeps over loops peeled in all dimensions. The
+	# threads runtime is not built without OpenMP.
+	if ls @CMAKE_BINARY_DIR@/runtime/libphysis_rt_mpi_threads.* > /dev/null 2>&1; then
+		local c=config.mpi.0
+		echo "MPI_THREADS = true" > $c
+		echo "OPT_LOOP_PEELING = true" >> $c
+		new_configs="$new_configs $c"
+	fi
+    echo $new_configs
 }
 
 function generate_translation_configurations_mpi_cuda()
@@ -590,6 +599,7 @@ function compile()
 {
     local src=$1
     local target=$2
+    local cfg=$3
 	local input_suffix=$(get_suffix $src)
     local src_file_base=${src%.c*}.$target
     if [ "@MPI_FOUND@" = "TRUE" ]; then
@@ -662,10 +672,15 @@ function compile()
 				return 0
 			fi
 			local src_file="$src_file_base".$input_suffix
-			c_compile $src_file -c -I@CMAKE_SOURCE_DIR@/include $MPI_CFLAGS $CFLAGS &&
 			local lib_name=physis_rt_mpi
+			local threads_cflags=""
 			if [ $target = "mpi2" ]; then lib_name=physis_rt_mpi2; fi
-			mpic++ "$src_file_base".o -l$lib_name $LDFLAGS -o $exe_name
+			if grep -q '^ *MPI_THREADS *= *true' $cfg; then
+				lib_name=physis_rt_mpi_threads
+				threads_cflags=$OPENMP_CFLAGS
+			fi
+			c_compile $src_file -c -I@CMAKE_SOURCE_DIR@/include $MPI_CFLAGS $threads_cflags $CFLAGS &&
+			mpic++ $threads_cflags "$src_file_base".o -l$lib_name $LDFLAGS -lrt -o $exe_name
 			;;
 		mpi-cuda)
 			if [ "@MPI_FOUND@" != "TRUE" -o "@CUDA_FOUND@" != "TRUE" ]; then
@@ -805,6 +820,60 @@ function do_mpirun()
     $MPIRUN -np $np $mfile_option $* --physis-proc $proc_dim --physis-nlp $PHYSIS_NLP
 }
 
+# Runs an MPI executable with the shared memory communicator instead
+# of mpirun, using the same process configuration as do_mpirun.
+function do_shmrun()
+{
+    local proc_dim_list=$1
+    shift
+    local dim=$1
+    shift
+    local proc_dim=$(echo $proc_dim_list | cut -d, -f$dim)
+    local np=$(($(echo $proc_dim | sed 's/x/*/g')))
+    echo "[EXECUTE] $* --physis-shm $np --physis-proc $proc_dim" >&2
+    $* --physis-shm $np --physis-proc $proc_dim
+}
+
+# Compares two outputs number by number. Reductions may sum in a
+# different order with different communicators, so numbers are
+# compared with a relative tolerance.
+function compare_outputs()
+{
+	awk 'NR == FNR { a[FNR] = $0; n = FNR; next }
+		{
+			if (!(FNR in a)) exit 1
+			na = split(a[FNR], x); nb = split($0, y)
+			if (na != nb) exit 1
+			for (i = 1; i <= na; ++i) {
+				if (x[i] == y[i]) continue
+				if (x[i] !~ /^[-+.0-9eE]+$/ || y[i] !~ /^[-+.0-9eE]+$/) exit 1
+				d = x[i] - y[i]; if (d < 0) d = -d
+				m = x[i] < 0 ? -x[i] : x[i]
+				if (d > 1e-5 * m && d > 1e-12) exit 1
+			}
+		}
+		END { if (FNR != n) exit 1 }' $1 $2
+}
+
+# Runs an MPI executable with the shared memory communicator and
+# compares its output with the output of the MPI run.
+function execute_shm()
+{
+	local exename=$1
+	echo "[EXECUTE] Executing $exename with the shared memory communicator"
+	if ! do_shmrun $2 $3 ./$exename $TRACE > $exename.shm.out 2> $exename.shm.err; then
+		cat $exename.shm.err
+		return 1
+	fi
+	if ! compare_outputs $exename.out $exename.shm.out; then
+		diff $exename.out $exename.shm.out > $exename.shm.out.diff
+		print_error "Output differs from the MPI run. Diff saved at: $(pwd)/$exename.shm.out.diff"
+		return 1
+	fi
+	echo "[EXECUTE] Shared memory output matches the MPI output."
+	rm $exename.shm.out $exename.shm.err
+}
+
 function execute()
 {
     local target=$2
@@ -840,6 +909,9 @@ function execute()
 		cat $exename.err
 		return 1
     fi
+    if [ $target = "mpi" ]; then
+		if ! execute_shm $exename $3 $4; then return 1; fi
+    fi
     execute_reference $1 $2
     local ref_output=$(get_reference_exe_name $1 $2).out
     if [ -f "$ref_output" ]; then
@@ -1076,7 +1148,7 @@ function do_test()
 		fi
 		if [ "$STAGE" = "TRANSLATE" ]; then return; fi
 		echo "[COMPILE] Processing $SHORTNAME for $TARGET target"
-		if compile $SHORTNAME $TARGET; then
+		if compile $SHORTNAME $TARGET $cfg; then
 			echo "[COMPILE] SUCCESS"
 		else
 			echo "[COMPILE] FAIL"
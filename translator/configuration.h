@@ -27,7 +27,13 @@ class Configuration: public pu::Configuration {
     MPI_OPENMP_DIVISION,
     MPI_OPENMP_CACHESIZE,
     TRACE_KERNEL,
-    CUDA_KERNEL_ERROR_CHECK
+    CUDA_KERNEL_ERROR_CHECK,
+    RED_BLACK_COLOR_SPLIT,
+    NON_TEMPORAL_STORE,
+    SOA_LAYOUT,
+    SOA_LANE_WIDTH,
+    MPI_THREADS,
+    SNAPSHOT_IN_PLACE_UPDATES
     };
   Configuration() {
     AddKey(CUDA_BLOCK_SIZE, "CUDA_BLOCK_SIZE");
@@ -39,6 +45,12 @@ class Configuration: public pu::Configuration {
     auto_tuning_ = false; /* set default value */
     AddKey(TRACE_KERNEL, "TRACE_KERNEL");
     AddKey(CUDA_KERNEL_ERROR_CHECK, "CUDA_KERNEL_ERROR_CHECK");    
+    AddKey(RED_BLACK_COLOR_SPLIT, "RED_BLACK_COLOR_SPLIT");
+    AddKey(NON_TEMPORAL_STORE, "NON_TEMPORAL_STORE");
+    AddKey(SOA_LAYOUT, "SOA_LAYOUT");
+    AddKey(SOA_LANE_WIDTH, "SOA_LANE_WIDTH");
+    AddKey(MPI_THREADS, "MPI_THREADS");
+    AddKey(SNAPSHOT_IN_PLACE_UPDATES, "SNAPSHOT_IN_PLACE_UPDATES");
   }
   virtual ~Configuration() {}
   const pu::LuaValue *Lookup(ConfigKey key) const {
@@ -67,6 +79,10 @@ class Configuration: public pu::Configuration {
   int SetPat(int pat);
   /** print configuration */
   virtual std::ostream &print(std::ostream &os) const;
+  /** print all configuration values of the current pattern */
+  std::ostream &PrintPattern(std::ostream &os) const {
+    return tmptbl_.print(os);
+  }
   /** lookup parameter value
    * @param[in]  key_name
    * @param[out] value
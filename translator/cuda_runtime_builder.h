@@ -20,6 +20,16 @@ class CUDARuntimeBuilder: public ReferenceRuntimeBuilder {
  public:
   CUDARuntimeBuilder(SgScopeStatement *global_scope):
       ReferenceRuntimeBuilder(global_scope) {}
+  //! Always returns "p0" as the CUDA runtime takes no snapshots.
+  virtual string GetReadBufferName(GridVarAttribute *gva, bool is_kernel) {
+    return "p0";
+  }
+  //! Uses the modulo of the default since __PSWrapIndex is host only.
+  virtual SgExpression *BuildGridPeriodicIndex(SgExpression *grid_ref,
+                                               int dim,
+                                               SgExpression *index) {
+    return RuntimeBuilder::BuildGridPeriodicIndex(grid_ref, dim, index);
+  }
   virtual SgExpression *BuildGridRefInRunKernel(
       SgInitializedName *gv,
       SgFunctionDeclaration *run_kernel);
@@ -29,6 +29,8 @@ const string GridType::name = "GridType";
 const string GridType::get_name = "get";
 const string GridType::get_periodic_name = "get_periodic";
 const string GridType::emit_name = "emit";
+const string GridType::emit_dirichlet_name = "emitDirichlet";
+const string GridType::emit_neumann_name = "emitNeumann";
 const string GridType::set_name = "set";
 
 unsigned GridType::GetRankFromTypeName(const string &tname) {
@@ -355,10 +357,13 @@ bool Grid::IsIntrinsicCall(SgFunctionCallExp *ce) {
 const std::string GridVarAttribute::name = "GridVar";
 
 GridVarAttribute::GridVarAttribute(GridType *gt):
-    gt_(gt), sr_(gt_->rank()) {}
+    gt_(gt), sr_(gt_->rank()), point_access_(false),
+    out_of_place_(false), periodic_(false), color_split_(false) {}
 
 GridVarAttribute::GridVarAttribute(const GridVarAttribute &x):
-    gt_(x.gt_), sr_(x.sr_), member_sr_(x.member_sr_) {}
+    gt_(x.gt_), sr_(x.sr_), member_sr_(x.member_sr_),
+    point_access_(x.point_access_), out_of_place_(x.out_of_place_),
+    periodic_(x.periodic_), color_split_(x.color_split_) {}
 
 void GridVarAttribute::AddStencilIndexList(const StencilIndexList &sil) {
   sr_.insert(sil);
@@ -597,6 +602,14 @@ SgInitializedName *GridGetAnalysis::IsGet(SgExpression *exp,
   }
 }
 
+// Returns the offset call of a grid get in the SoA layout.
+static SgFunctionCallExp *GetSoAOffsetCall(SgExpression *get_exp) {
+  SgFunctionCallExp *offset_call =
+      isSgFunctionCallExp(isSgAddOp(get_exp)->get_rhs_operand());
+  PSAssert(offset_call);
+  return offset_call;
+}
+
 SgExpression *GridGetAnalysis::GetOffset(SgExpression *get_exp) {
   if (isSgPointerDerefExp(get_exp)) {
     get_exp = isSgPointerDerefExp(get_exp)->get_operand();
@@ -610,6 +623,10 @@ SgExpression *GridGetAnalysis::GetOffset(SgExpression *get_exp) {
     offset = isSgFunctionCallExp(get_exp)->
         get_args()->get_expressions()[1];
     PSAssert(offset);
+  } else if (isSgAddOp(get_exp)) {
+    // SoA layout: (char *)g->p0 + __PSGridSoAOffset(g, offset, ...)
+    offset = GetSoAOffsetCall(get_exp)->get_args()->get_expressions()[1];
+    PSAssert(offset);
   }
   return offset;
 }
@@ -627,6 +644,9 @@ SgExpression *GridGetAnalysis::GetGridExp(SgExpression *get_exp) {
     g = isSgFunctionCallExp(get_exp)->
         get_args()->get_expressions()[0];
     PSAssert(g);
+  } else if (isSgAddOp(get_exp)) {
+    g = isSgAddOp(get_exp)->get_lhs_operand();
+    PSAssert(g);
   } else {
     LOG_ERROR() << "Unsupported grid get: "
                 << get_exp->unparseToString() << "\n";
@@ -655,6 +675,13 @@ SgInitializedName *GridGetAnalysis::GetGridVar(SgExpression *get_exp) {
   } else if (isSgFunctionCallExp(get_exp)) {
     gvref = isSgVarRefExp(isSgFunctionCallExp(get_exp)->
                           get_args()->get_expressions()[0]);
+  } else if (isSgAddOp(get_exp)) {
+    SgExpression *x =
+        GetSoAOffsetCall(get_exp)->get_args()->get_expressions()[0];
+    if (isSgAddressOfOp(x)) {
+      x = isSgAddressOfOp(x)->get_operand();
+    }
+    gvref = isSgVarRefExp(x);
   } else {
     LOG_ERROR() << "Unsupported grid get: "
                 << get_exp->unparseToString() << "\n";
@@ -98,6 +98,8 @@ class GridType: public AstAttribute {
   static const string get_name;
   static const string get_periodic_name;
   static const string emit_name;
+  static const string emit_dirichlet_name;
+  static const string emit_neumann_name;
   static const string set_name;  
  private:
   //! Identify the type of the grid points
@@ -114,12 +116,16 @@ class Grid {
                     SgExpressionPtrList::const_iterator size_end);
   bool _isReadWrite;
   SgExpression *attribute_;
+  bool periodic_;
+  bool color_split_;
+  bool scratch_;
   
  public:
   
   Grid(GridType *gt, SgFunctionCallExp *newCall):
       gt(gt), newCall(newCall), stencil_range_(gt->rank()),
-      _isReadWrite(false), attribute_(NULL) {
+      _isReadWrite(false), attribute_(NULL), periodic_(false),
+      color_split_(false), scratch_(false) {
     SgExpressionPtrList &args = newCall->get_args()->get_expressions();
     size_t num_dims = gt->rank();
     PSAssert(args.size() == num_dims ||
@@ -195,6 +201,15 @@ class Grid {
     return stencil_range_;
   }
   virtual void SetStencilRange(const StencilRange &sr);
+  //! Returns true if any stencil accesses the grid periodically.
+  bool periodic() const { return periodic_; }
+  void set_periodic(bool b) { periodic_ = b; }
+  //! Returns true if the grid is stored in the color-split layout.
+  bool color_split() const { return color_split_; }
+  void set_color_split(bool b) { color_split_ = b; }
+  //! Returns true if the grid lives only within a single stencil run.
+  bool scratch() const { return scratch_; }
+  void set_scratch(bool b) { scratch_ = b; }
 
   static bool IsIntrinsicCall(SgFunctionCallExp *call);
 };
@@ -215,9 +230,31 @@ class GridVarAttribute: public AstAttribute {
   void AddMemberStencilIndexList(const string &member,
                                  const IntVector &indices,
                                  const StencilIndexList &sil);
+  //! Records a get of whole points, i.e., not of a member.
+  void AddPointAccess() { point_access_ = true; }
   GridType *gt() { return gt_; }
   StencilRange &sr() { return sr_; }
   MemberStencilRangeMap &member_sr() { return member_sr_; }
+  //! Returns true if whole points are read with get.
+  bool point_access() const { return point_access_; }
+  //! Returns true if the grid must be read from a snapshot.
+  /*!
+    Set for a grid that is both read and written by a kernel with
+    accesses to other points than the self point. Such a kernel is
+    run with the reads redirected to a copy taken before the sweep.
+   */
+  bool out_of_place() const { return out_of_place_; }
+  void set_out_of_place(bool b) { out_of_place_ = b; }
+  //! Returns true if the grid is read with PSGridGetPeriodic.
+  bool periodic() const { return periodic_; }
+  void set_periodic(bool b) { periodic_ = b; }
+  //! Returns true if the grid is stored in the color-split layout.
+  /*!
+    Set for grids bound to red-black stencils, and for any other
+    grid variable that may refer to such grids.
+   */
+  bool color_split() const { return color_split_; }
+  void set_color_split(bool b) { color_split_ = b; }
   //ArrayMemberStencilRangeMap &array_member_sr() { return array_member_sr_; }
   
  protected:
@@ -225,6 +262,10 @@ class GridVarAttribute: public AstAttribute {
   StencilRange sr_;
   MemberStencilRangeMap member_sr_;
   //ArrayMemberStencilRangeMap array_member_sr_;
+  bool point_access_;
+  bool out_of_place_;
+  bool periodic_;
+  bool color_split_;
 };
 
 class GridOffsetAnalysis {
@@ -265,8 +306,9 @@ class GridOffsetAnalysis {
 class GridOffsetAttribute: public AstAttribute {
  public:
   GridOffsetAttribute(int num_dim, bool periodic,
-                      const StencilIndexList *sil): 
-    rank_(num_dim), periodic_(periodic), sil_(NULL) {
+                      const StencilIndexList *sil,
+                      bool linear=true):
+    rank_(num_dim), periodic_(periodic), sil_(NULL), linear_(linear) {
     if (sil) {
       sil_ = new StencilIndexList();
       *sil_ = *sil;
@@ -275,12 +317,18 @@ class GridOffsetAttribute: public AstAttribute {
   virtual ~GridOffsetAttribute() {}
   GridOffsetAttribute *copy() {
     GridOffsetAttribute *a= new GridOffsetAttribute(
-        rank_, periodic_, sil_);
+        rank_, periodic_, sil_, linear_);
     return a;
   }
   static const std::string name;
   bool periodic() const { return periodic_; }
   int rank() const { return rank_; }
+  //! Returns true if the offset is linear in the indices.
+  /*!
+    Offsets in the color-split and brick layouts are not, so they
+    cannot be decomposed into a base offset and constant distances.
+   */
+  bool linear() const { return linear_; }
   /*  
   void SetStencilIndexList(const StencilIndexList &sil) {
     sil_ = sil;
@@ -291,6 +339,7 @@ class GridOffsetAttribute: public AstAttribute {
   int rank_;
   bool periodic_;  
   StencilIndexList *sil_;
+  bool linear_;
 };
 
 class GridGetAnalysis {
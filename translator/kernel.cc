@@ -64,6 +64,12 @@ static void analyzeGridAccess(SgFunctionDeclaration *decl,
 void Kernel::analyzeGridWrites(TranslationContext &tx) {
   SgFunctionCallExpPtrList calls =
       tx.getGridEmitCalls(decl->get_definition());
+  // Boundary conditions emit the faces
+  SgFunctionCallExpPtrList bc_calls =
+      tx.getGridEmitDirichletCalls(decl->get_definition());
+  calls.insert(calls.end(), bc_calls.begin(), bc_calls.end());
+  bc_calls = tx.getGridEmitNeumannCalls(decl->get_definition());
+  calls.insert(calls.end(), bc_calls.begin(), bc_calls.end());
   set<SgInitializedName*> gvs;
   BOOST_FOREACH (SgFunctionCallExp *fc, calls) {
     gvs.insert(GridType::getGridVarUsedInFuncCall(fc));
@@ -87,6 +93,14 @@ void Kernel::analyzeGridReads(TranslationContext &tx) {
     gvs.insert(GridType::getGridVarUsedInFuncCall(fc));
   }
   analyzeGridAccess(decl, tx, gvs, rGrids, rGridVars);
+  // Neumann conditions read the points next to the faces
+  calls =
+      tx.getGridEmitNeumannCalls(decl->get_definition());
+  gvs.clear();
+  BOOST_FOREACH (SgFunctionCallExp *fc, calls) {
+    gvs.insert(GridType::getGridVarUsedInFuncCall(fc));
+  }
+  analyzeGridAccess(decl, tx, gvs, rGrids, rGridVars);
 }
 
 static void CollectionReadWriteGrids(SgFunctionDefinition *fdef,
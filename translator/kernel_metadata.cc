@@ -0,0 +1,205 @@
+// Copyright 2011-2012, RIKEN AICS.
+// All rights reserved.
+//
+// This file is distributed under the BSD license. See LICENSE.txt for
+// details.
+
+#include "translator/kernel_metadata.h"
+
+#include <fstream>
+
+#include "translator/rose_util.h"
+#include "translator/grid.h"
+#include "translator/kernel.h"
+#include "translator/translation_context.h"
+
+namespace si = SageInterface;
+
+namespace physis {
+namespace translator {
+
+size_t GetTypeSize(SgType *t) {
+  if (isSgTypedefType(t)) {
+    return GetTypeSize(isSgTypedefType(t)->get_base_type());
+  }
+  if (isSgModifierType(t)) {
+    return GetTypeSize(isSgModifierType(t)->get_base_type());
+  }
+  if (isSgTypeFloat(t) || isSgTypeInt(t)) return 4;
+  if (isSgTypeDouble(t) || isSgTypeLong(t)) return 8;
+  if (isSgArrayType(t)) {
+    SgArrayType *at = isSgArrayType(t);
+    SgValueExp *len = isSgValueExp(at->get_index());
+    if (len == NULL) return 0;
+    return GetTypeSize(at->get_base_type()) *
+        si::getIntegerConstantValue(len);
+  }
+  if (isSgClassType(t)) {
+    SgClassDeclaration *decl = isSgClassDeclaration(
+        isSgClassType(t)->get_declaration()->get_definingDeclaration());
+    if (decl == NULL) return 0;
+    // Point members are only float and double, so no padding is
+    // assumed
+    size_t s = 0;
+    FOREACH (it, decl->get_definition()->get_members().begin(),
+             decl->get_definition()->get_members().end()) {
+      SgVariableDeclaration *vd = isSgVariableDeclaration(*it);
+      if (vd == NULL) continue;
+      s += GetTypeSize(vd->get_variables()[0]->get_type());
+    }
+    return s;
+  }
+  return 0;
+}
+
+static bool IsFloatingPointType(SgType *t) {
+  t = t->stripTypedefsAndModifiers();
+  return isSgTypeFloat(t) || isSgTypeDouble(t);
+}
+
+static int CountFlops(SgFunctionDeclaration *func,
+                      std::set<SgFunctionDeclaration*> &visited) {
+  SgFunctionDeclaration *decl = isSgFunctionDeclaration(
+      func->get_definingDeclaration());
+  if (decl == NULL || !visited.insert(decl).second) return 0;
+  int flops = 0;
+  Rose_STL_Container<SgNode*> ops =
+      NodeQuery::querySubTree(decl, V_SgBinaryOp);
+  FOREACH (it, ops.begin(), ops.end()) {
+    SgBinaryOp *op = isSgBinaryOp(*it);
+    if (!(isSgAddOp(op) || isSgSubtractOp(op) ||
+          isSgMultiplyOp(op) || isSgDivideOp(op) ||
+          isSgPlusAssignOp(op) || isSgMinusAssignOp(op) ||
+          isSgMultAssignOp(op) || isSgDivAssignOp(op))) continue;
+    if (IsFloatingPointType(op->get_type())) ++flops;
+  }
+  std::vector<SgFunctionCallExp*> calls =
+      si::querySubTree<SgFunctionCallExp>(decl);
+  FOREACH (it, calls.begin(), calls.end()) {
+    SgFunctionDeclaration *callee =
+        (*it)->getAssociatedFunctionDeclaration();
+    if (callee) flops += CountFlops(callee, visited);
+  }
+  return flops;
+}
+
+int CountFlops(SgFunctionDeclaration *func) {
+  std::set<SgFunctionDeclaration*> visited;
+  return CountFlops(func, visited);
+}
+
+// Returns the bytes read per point of a grid parameter
+static size_t GetReadSize(GridVarAttribute *gva) {
+  GridType *gt = gva->gt();
+  size_t elm_size = GetTypeSize(gt->point_type());
+  if (!gt->IsUserDefinedPointType() || gva->point_access()) {
+    return elm_size;
+  }
+  // Each distinct member element is read
+  size_t s = 0;
+  FOREACH (it, gva->member_sr().begin(), gva->member_sr().end()) {
+    SgVariableDeclaration *vd = isSgVariableDeclaration(
+        rose_util::FindMember(gt->point_def(), it->first.first));
+    if (vd == NULL) return elm_size;
+    SgType *mt = vd->get_variables()[0]->get_type();
+    // Indices select an element of an array member
+    while (it->first.second.size() && isSgArrayType(mt)) {
+      mt = isSgArrayType(mt)->get_base_type();
+    }
+    s += GetTypeSize(mt);
+  }
+  return s;
+}
+
+KernelMetadata::KernelMetadata(StencilMap *sm, TranslationContext *tx):
+    kernel_name_(sm->getKernel()->get_name().str()),
+    map_name_(sm->GetMapName()), num_dims_(sm->getNumDim()),
+    red_black_(sm->IsRedBlackVariant()),
+    bytes_per_point_(0.0), flops_per_point_(0.0) {
+  Kernel *kernel = tx->findKernel(sm->getKernel());
+  PSAssert(kernel);
+  FOREACH (it, sm->grid_params().begin(), sm->grid_params().end()) {
+    SgInitializedName *gp = *it;
+    GridVarAttribute *gva =
+        rose_util::GetASTAttribute<GridVarAttribute>(gp);
+    PSAssert(gva);
+    GridAccessMetadata g;
+    g.name = gp->get_name().str();
+    g.type_name = gva->gt()->type_name();
+    g.elm_size = GetTypeSize(gva->gt()->point_type());
+    g.read = kernel->isGridParamRead(gp);
+    g.written = kernel->isGridParamModified(gp);
+    g.read_size = g.read ? GetReadSize(gva) : 0;
+    IntVector offset_min, offset_max;
+    g.neighbor_access = gva->sr().GetNeighborAccess(offset_min, offset_max);
+    g.diagonal = gva->sr().IsNeighborAccessDiagonalAccessed();
+    FOREACH (oit, offset_min.begin(), offset_min.end()) {
+      g.halo_bw.push_back(*oit < 0 ? -(*oit) : 0);
+    }
+    FOREACH (oit, offset_max.begin(), offset_max.end()) {
+      g.halo_fw.push_back(*oit > 0 ? *oit : 0);
+    }
+    bytes_per_point_ += g.read_size;
+    if (g.written) bytes_per_point_ += g.elm_size;
+    grids_.push_back(g);
+  }
+  flops_per_point_ = CountFlops(sm->getKernel());
+}
+
+static std::ostream &PrintIntVector(std::ostream &os, const IntVector &v) {
+  StringJoin sj;
+  FOREACH (it, v.begin(), v.end()) {
+    sj << *it;
+  }
+  return os << "{" << sj.str() << "}";
+}
+
+std::ostream &KernelMetadata::Print(std::ostream &os) const {
+  os << "  {kernel = \"" << kernel_name_ << "\", map = \"" << map_name_
+     << "\", dims = " << num_dims_
+     << ", red_black = " << (red_black_ ? "true" : "false")
+     << ",\n   bytes_per_point = " << bytes_per_point_
+     << ", flops_per_point = " << flops_per_point_
+     << ",\n   grids = {\n";
+  FOREACH (it, grids_.begin(), grids_.end()) {
+    os << "     {name = \"" << it->name << "\", type = \"" << it->type_name
+       << "\", elm_size = " << it->elm_size
+       << ", read_size = " << it->read_size
+       << ", read = " << (it->read ? "true" : "false")
+       << ", written = " << (it->written ? "true" : "false");
+    if (it->neighbor_access) {
+      os << ",\n      halo_bw = ";
+      PrintIntVector(os, it->halo_bw);
+      os << ", halo_fw = ";
+      PrintIntVector(os, it->halo_fw);
+      os << ", diagonal = " << (it->diagonal ? "true" : "false");
+    }
+    os << "},\n";
+  }
+  os << "   }},\n";
+  return os;
+}
+
+bool WriteKernelMetadata(TranslationContext &tx, const string &path) {
+  std::ofstream out(path.c_str());
+  if (!out) {
+    LOG_ERROR() << "Failed to open " << path << "\n";
+    return false;
+  }
+  out << "-- Kernel metadata generated by physisc\n"
+      << "kernels = {\n";
+  // Ordered by ID so that the output is deterministic
+  std::map<int, StencilMap*> maps;
+  FOREACH (it, tx.mapBegin(), tx.mapEnd()) {
+    maps.insert(std::make_pair(it->second->getID(), it->second));
+  }
+  FOREACH (it, maps.begin(), maps.end()) {
+    out << KernelMetadata(it->second, &tx);
+  }
+  out << "}\n";
+  LOG_INFO() << "Kernel metadata written to " << path << "\n";
+  return true;
+}
+
+} // namespace translator
+} // namespace physis
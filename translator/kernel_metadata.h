@@ -0,0 +1,89 @@
+// Copyright 2011-2012, RIKEN AICS.
+// All rights reserved.
+//
+// This file is distributed under the BSD license. See LICENSE.txt for
+// details.
+
+#ifndef PHYSIS_TRANSLATOR_KERNEL_METADATA_H_
+#define PHYSIS_TRANSLATOR_KERNEL_METADATA_H_
+
+#include "translator/translator_common.h"
+#include "translator/map.h"
+
+namespace physis {
+namespace translator {
+
+class TranslationContext;
+
+//! Accesses of a grid parameter by a stencil kernel.
+struct GridAccessMetadata {
+  string name;
+  string type_name;
+  //! Size of a point
+  size_t elm_size;
+  //! Bytes read per point; less than elm_size when only some
+  //! members of a user-defined point are read
+  size_t read_size;
+  bool read;
+  bool written;
+  //! False if the read offsets are not constant
+  bool neighbor_access;
+  bool diagonal;
+  IntVector halo_bw;
+  IntVector halo_fw;
+};
+
+//! Static cost model of a stencil map.
+/*!
+  Bytes per point are the compulsory traffic assuming every point of
+  each grid is loaded and stored once per sweep, i.e., perfect reuse
+  of the neighbor points. Flops per point count the floating-point
+  arithmetic operators in the kernel and the kernels it calls, each
+  counted once regardless of control flow.
+ */
+class KernelMetadata {
+ public:
+  KernelMetadata(StencilMap *sm, TranslationContext *tx);
+  const string &kernel_name() const { return kernel_name_; }
+  int num_dims() const { return num_dims_; }
+  double bytes_per_point() const { return bytes_per_point_; }
+  double flops_per_point() const { return flops_per_point_; }
+  const std::vector<GridAccessMetadata> &grids() const { return grids_; }
+  //! Prints as a Lua table.
+  std::ostream &Print(std::ostream &os) const;
+ protected:
+  string kernel_name_;
+  string map_name_;
+  int num_dims_;
+  bool red_black_;
+  double bytes_per_point_;
+  double flops_per_point_;
+  std::vector<GridAccessMetadata> grids_;
+};
+
+//! Returns the size of a type in bytes; zero if unknown.
+size_t GetTypeSize(SgType *t);
+
+//! Counts floating-point arithmetic operators in a function.
+/*!
+  Calls to other functions defined in the same file are followed.
+ */
+int CountFlops(SgFunctionDeclaration *func);
+
+//! Writes the metadata of all the stencil maps as a Lua file.
+/*!
+  \param tx The translation context.
+  \param path Output file path.
+  \return True upon success.
+ */
+bool WriteKernelMetadata(TranslationContext &tx, const string &path);
+
+} // namespace translator
+} // namespace physis
+
+inline std::ostream &operator<<(std::ostream &os,
+                                const physis::translator::KernelMetadata &m) {
+  return m.Print(os);
+}
+
+#endif /* PHYSIS_TRANSLATOR_KERNEL_METADATA_H_ */
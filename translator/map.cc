@@ -147,6 +147,27 @@ void StencilMap::SetGridPeriodic(SgInitializedName *gv) {
   grid_periodic_set_.insert(gv);
 }
 
+const BoundaryCondition *StencilMap::GetBoundaryCondition(
+    SgInitializedName *gv, int dim) const {
+  const BoundaryCondition *dirichlet = NULL;
+  FOREACH (it, boundary_conditions_.begin(), boundary_conditions_.end()) {
+    if (it->gv != gv) continue;
+    if (it->kind == BoundaryCondition::kNeumann) {
+      if (it->dim == dim) return &(*it);
+    } else {
+      dirichlet = &(*it);
+    }
+  }
+  return dirichlet;
+}
+
+bool StencilMap::HasBoundaryFace(int dim) const {
+  FOREACH (it, boundary_conditions_.begin(), boundary_conditions_.end()) {
+    if (GetBoundaryCondition(it->gv, dim)) return true;
+  }
+  return false;
+}
+
 SgVarRefExp *KernelLoopAnalysis::GetLoopVar(SgForStatement *loop) {
   SgExpression *incr = loop->get_increment();
   SgVarRefExp *v = rose_util::GetUniqueVarRefExp(incr);
@@ -25,6 +25,32 @@ class TranslationContext;
 typedef pair<SgInitializedName*, string> GridMember;
 typedef map<GridMember, StencilRange> GridMemberRangeMap;
 
+//! Boundary condition emitted by a stencil kernel.
+/*!
+  Boundary conditions are not evaluated per point. The kernel is
+  only applied to the points inside the faces with conditions, and
+  the faces are emitted by separate loops after the sweep.
+ */
+struct BoundaryCondition {
+  enum Kind {kDirichlet, kNeumann};
+  Kind kind;
+  //! Grid parameter of the kernel
+  SgInitializedName *gv;
+  //! Copy of the value expression
+  SgExpression *value;
+  //! Dimension (>=1) of the faces of Neumann conditions
+  /*!
+    Dirichlet conditions apply to the faces of every dimension that
+    has no Neumann condition for the same grid.
+   */
+  int dim;
+  BoundaryCondition(Kind kind, SgInitializedName *gv,
+                    SgExpression *value, int dim=0):
+      kind(kind), gv(gv), value(value), dim(dim) {}
+};
+
+typedef vector<BoundaryCondition> BoundaryConditionVector;
+
 class StencilMap {
  public:
   enum Type {kNormal, kRedBlack, kRed, kBlack};
@@ -83,6 +109,23 @@ class StencilMap {
   */
   void SetGridPeriodic(SgInitializedName *gv);
 
+  const BoundaryConditionVector &boundary_conditions() const {
+    return boundary_conditions_;
+  }
+  void AddBoundaryCondition(const BoundaryCondition &bc) {
+    boundary_conditions_.push_back(bc);
+  }
+  //! Returns the boundary condition of a grid on the faces of a dimension.
+  /*!
+    \param gv Grid param name.
+    \param dim Dimension (>=1).
+    \return The condition, or NULL if the faces have no condition.
+   */
+  const BoundaryCondition *GetBoundaryCondition(SgInitializedName *gv,
+                                                int dim) const;
+  //! Returns true if any grid has a condition on the faces of a dimension.
+  bool HasBoundaryFace(int dim) const;
+
   //! Returns true if red-black stencil is used.
   bool IsRedBlack() const {
     return type_ == kRedBlack;
@@ -122,6 +165,7 @@ class StencilMap {
   SgInitializedNamePtrList grid_params_;  
   SgFunctionCallExp *fc_;
   std::set<SgInitializedName*> grid_periodic_set_;
+  BoundaryConditionVector boundary_conditions_;
   
 
  private:
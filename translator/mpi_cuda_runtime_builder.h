@@ -26,6 +26,10 @@ class MPICUDARuntimeBuilder: public MPIRuntimeBuilder {
  public:
   MPICUDARuntimeBuilder(SgScopeStatement *global_scope):
       MPIRuntimeBuilder(global_scope) {}
+  //! Always returns "p0" as the MPI-CUDA runtime takes no snapshots.
+  virtual string GetReadBufferName(GridVarAttribute *gva, bool is_kernel) {
+    return "p0";
+  }
 };
 
 } // namespace translator
@@ -8,6 +8,7 @@
 
 #include "translator/mpi_runtime_builder.h"
 #include "translator/rose_util.h"
+#include "translator/translation_util.h"
 
 namespace sb = SageBuilder;
 namespace si = SageInterface;
@@ -93,6 +94,85 @@ SgFunctionCallExp *BuildLoadNeighbor(SgExpression *grid_var,
   return fc;
 }
 
+SgFunctionCallExp *BuildLoadNeighborMembers(
+    SgExpression *grid_var,
+    GridType *gt,
+    map<string, StencilRange> &member_sr,
+    SgScopeStatement *scope,
+    SgExpression *reuse,
+    SgExpression *overlap,
+    bool is_periodic) {
+  SgFunctionSymbol *load_neighbor_func
+      = si::lookupFunctionSymbolInParentScopes("__PSLoadNeighborMembers");
+  PSAssert(load_neighbor_func);
+  // Generate code like this
+  // size_t members[] = {(size_t)&((type *)0)->x, sizeof(...), ...};
+  // int offset_min[] = {...}; int offset_max[] = {...};
+  // __PSLoadNeighborMembers(g, num_members, members, offset_min,
+  //                         offset_max, ...);
+  SgExprListExp *layout = sb::buildExprListExp();
+  SgExprListExp *min_init = sb::buildExprListExp();
+  SgExprListExp *max_init = sb::buildExprListExp();
+  int num_members = 0;
+  bool diag_needed = false;
+  FOREACH (it, member_sr.begin(), member_sr.end()) {
+    const string &member_name = it->first;
+    StencilRange &sr = it->second;
+    IntVector offset_min, offset_max;
+    PSAssert(sr.GetNeighborAccess(offset_min, offset_max));
+    // Each member has PS_MAX_DIM offsets
+    for (int i = 0; i < PS_MAX_DIM; ++i) {
+      si::appendExpression(min_init, rose_util::BuildIntLikeVal(
+          i < (int)offset_min.size() ? offset_min[i] : 0));
+      si::appendExpression(max_init, rose_util::BuildIntLikeVal(
+          i < (int)offset_max.size() ? offset_max[i] : 0));
+    }
+    diag_needed |= sr.IsNeighborAccessDiagonalAccessed();
+    si::appendExpression(layout, BuildPointMemberOffset(gt, member_name));
+    // sizeof(((type *)0)->member)
+    si::appendExpression(
+        layout,
+        sb::buildSizeOfOp(
+            sb::buildArrowExp(
+                sb::buildCastExp(sb::buildIntVal(0),
+                                 sb::buildPointerType(gt->point_type())),
+                sb::buildVarRefExp(member_name, gt->point_def()))));
+    ++num_members;
+  }
+  SgType *size_type = BuildSizeType(si::getGlobalScope(gt->point_def()));
+  SgVariableDeclaration *layout_decl =
+      sb::buildVariableDeclaration(
+          "members",
+          sb::buildArrayType(size_type, sb::buildIntVal(num_members * 2)),
+          sb::buildAggregateInitializer(layout), scope);
+  si::appendStatement(layout_decl, scope);
+  SgType *offset_type =
+      sb::buildArrayType(sb::buildIntType(),
+                         sb::buildIntVal(num_members * PS_MAX_DIM));
+  SgVariableDeclaration *offset_min_decl =
+      sb::buildVariableDeclaration(
+          "offset_min", offset_type,
+          sb::buildAggregateInitializer(min_init, offset_type), scope);
+  si::appendStatement(offset_min_decl, scope);
+  SgVariableDeclaration *offset_max_decl =
+      sb::buildVariableDeclaration(
+          "offset_max", offset_type,
+          sb::buildAggregateInitializer(max_init, offset_type), scope);
+  si::appendStatement(offset_max_decl, scope);
+  SgExprListExp *load_neighbor_args =
+      sb::buildExprListExp(grid_var,
+                           sb::buildIntVal(num_members),
+                           sb::buildVarRefExp(layout_decl),
+                           sb::buildVarRefExp(offset_min_decl),
+                           sb::buildVarRefExp(offset_max_decl),
+                           sb::buildIntVal(diag_needed),
+                           reuse, overlap,
+                           sb::buildIntVal(is_periodic));
+  SgFunctionCallExp *fc = sb::buildFunctionCallExp(load_neighbor_func,
+                                                   load_neighbor_args);
+  return fc;
+}
+
 SgFunctionCallExp *BuildActivateRemoteGrid(SgExpression *grid_var,
                                            bool active) {
   SgFunctionSymbol *fs
@@ -130,7 +210,42 @@ SgFunctionCallExp *MPIRuntimeBuilder::BuildDomainSetLocalSize(
   return fc;
 }
 
+SgExpression *MPIRuntimeBuilder::BuildGridRealDim(
+    SgExpression *grid_ref, int dim) {
+  // Grid buffers include halo, so the stride is the length of the
+  // local buffer rather than the global size.
+  SgFunctionSymbol *fs
+      = si::lookupFunctionSymbolInParentScopes(PS_GRID_REAL_DIM_NAME, gs_);
+  PSAssert(fs);
+  if (!si::isPointerType(grid_ref->get_type()))
+    grid_ref = sb::buildAddressOfOp(grid_ref);
+  SgExprListExp *args = sb::buildExprListExp(
+      grid_ref, sb::buildIntVal(dim - 1));
+  return sb::buildFunctionCallExp(fs, args);
+}
 
+SgExpression *MPIRuntimeBuilder::BuildGridPeriodicIndex(
+    SgExpression *grid_ref, int dim, SgExpression *index) {
+  SgFunctionSymbol *fs
+      = si::lookupFunctionSymbolInParentScopes(
+          "__PSGridMPIPeriodicIndex", gs_);
+  PSAssert(fs);
+  grid_ref = si::copyExpression(grid_ref);
+  if (!si::isPointerType(grid_ref->get_type()))
+    grid_ref = sb::buildAddressOfOp(grid_ref);
+  SgExprListExp *args = sb::buildExprListExp(
+      grid_ref, index, sb::buildIntVal(dim - 1));
+  return sb::buildFunctionCallExp(fs, args);
+}
+
+SgExpression *MPIRuntimeBuilder::BuildGridPeriodicDistance(
+    SgExpression *grid_ref, int dim, SgExpression *index,
+    SgExpression *neighbor) {
+  // The index is shifted by the halo as well
+  return sb::buildSubtractOp(
+      BuildGridPeriodicIndex(grid_ref, dim, neighbor),
+      BuildGridPeriodicIndex(grid_ref, dim, index));
+}
 
 } // namespace translator
 } // namespace physis
@@ -18,12 +18,29 @@ namespace translator {
 
 class MPIRuntimeBuilder: public ReferenceRuntimeBuilder {
  public:
-  MPIRuntimeBuilder(SgScopeStatement *global_scope):
-      ReferenceRuntimeBuilder(global_scope) {}
+  //! Constructor.
+  /*!
+    \param global_scope Global scope.
+    \param soa True if local buffers of user-defined point types are
+    stored in the SoA layout.
+    \param soa_lanes Number of points interleaved per member in the
+    SoA layout; zero means the whole local buffer.
+   */
+  MPIRuntimeBuilder(SgScopeStatement *global_scope,
+                    bool soa=false, int soa_lanes=0):
+      ReferenceRuntimeBuilder(global_scope, false, soa, soa_lanes) {}
   virtual ~MPIRuntimeBuilder() {}
   virtual SgFunctionCallExp *BuildIsRoot();
   virtual SgFunctionCallExp *BuildGetGridByID(SgExpression *id_exp);
   virtual SgFunctionCallExp *BuildDomainSetLocalSize(SgExpression *dom);
+  virtual SgExpression *BuildGridRealDim(SgExpression *grid_ref, int dim);
+  virtual SgExpression *BuildGridPeriodicIndex(SgExpression *grid_ref,
+                                               int dim,
+                                               SgExpression *index);
+  virtual SgExpression *BuildGridPeriodicDistance(SgExpression *grid_ref,
+                                                  int dim,
+                                                  SgExpression *index,
+                                                  SgExpression *neighbor);
 };
 
 SgFunctionCallExp *BuildCallLoadSubgrid(SgExpression *grid_var,
@@ -39,6 +56,18 @@ SgFunctionCallExp *BuildLoadNeighbor(SgExpression *grid_var,
                                      SgExpression *reuse,
                                      SgExpression *overlap,
                                      bool is_periodic);
+//! Build a call to load the halo of members of user-defined points.
+/*!
+  \param member_sr Stencil range of each member to load.
+ */
+SgFunctionCallExp *BuildLoadNeighborMembers(
+    SgExpression *grid_var,
+    GridType *gt,
+    map<string, StencilRange> &member_sr,
+    SgScopeStatement *scope,
+    SgExpression *reuse,
+    SgExpression *overlap,
+    bool is_periodic);
 SgFunctionCallExp *BuildActivateRemoteGrid(SgExpression *grid_var,
                                            bool active);
 
@@ -8,6 +8,8 @@
 
 #include "translator/mpi_translator.h"
 
+#include <boost/foreach.hpp>
+
 #include "translator/translation_context.h"
 #include "translator/translation_util.h"
 #include "translator/mpi_runtime_builder.h"
@@ -24,6 +26,7 @@ MPITranslator::MPITranslator(const Configuration &config):
     flag_mpi_overlap_(false) {
   grid_type_name_ = "__PSGridMPI";
   grid_create_name_ = "__PSGridNewMPI";
+  soa_grid_create_name_ = "__PSGridNewSoAMPI";
   target_specific_macro_ = "PHYSIS_MPI";
   get_addr_name_ = "__PSGridGetAddr";
   get_addr_no_halo_name_ = "__PSGridGetAddrNoHalo";
@@ -37,6 +40,10 @@ MPITranslator::MPITranslator(const Configuration &config):
   if (flag_mpi_overlap_) {
     LOG_INFO() << "Overlapping enabled\n";
   }
+  // The loops are parallelized by the optimizer
+  if (config.LookupFlag(Configuration::MPI_THREADS)) {
+    LOG_INFO() << "Thread-parallel sweeps enabled\n";
+  }
   
   validate_ast_ = true;
 }
@@ -202,9 +209,10 @@ void MPITranslator::TranslateRun(SgFunctionCallExp *node,
     count_exp = sb::buildIntVal(1);
   }
   si::appendExpression(args, count_exp);
-  // number of stencils
-  si::appendExpression(args,
-                       sb::buildIntVal(run->stencils().size()));
+  // Grids accessed by the stencils, appended after the iteration
+  // count if the run is passed with its accesses
+  SgExpressionPtrList access_grids, access_modes;
+  SgExprListExp *stencil_args = sb::buildExprListExp();
   
   ENUMERATE(i, it, run->stencils().begin(), run->stencils().end()) {
     //SgExpression *stencil_arg = it->first;
@@ -215,9 +223,49 @@ void MPITranslator::TranslateRun(SgFunctionCallExp *node,
     SgVariableDeclaration *sdecl
         = rose_util::buildVarDecl("s" + toString(i), stencil_type,
                                   stencil_arg, tmp_block);
-    si::appendExpression(args, sb::buildSizeOfOp(stencil_type));
-    si::appendExpression(args, sb::buildAddressOfOp(
+    si::appendExpression(stencil_args, sb::buildSizeOfOp(stencil_type));
+    si::appendExpression(stencil_args, sb::buildAddressOfOp(
         sb::buildVarRefExp(sdecl)));
+    AppendGridAccesses(stencil, sdecl, i == 0, access_grids,
+                       access_modes);
+  }
+
+  if (access_grids.size() && target_specific_macro_ == "PHYSIS_MPI") {
+    // Generate code like this
+    // __PSGridMPI *__PSRunGrids[] = {s0.g, s0.h};
+    // int __PSRunGridModes[] = {5, 3};
+    // __PSStencilRunWithAccess(0, iter, 2, __PSRunGrids,
+    //                          __PSRunGridModes, 1, sizeof(s0), &s0);
+    SgType *grid_type =
+        si::lookupNamedTypeInParentScopes(grid_type_name_, global_scope_);
+    PSAssert(grid_type);
+    SgVariableDeclaration *grids_decl = sb::buildVariableDeclaration(
+        "__PSRunGrids",
+        sb::buildArrayType(sb::buildPointerType(grid_type)),
+        sb::buildAggregateInitializer(
+            sb::buildExprListExp(access_grids)),
+        tmp_block);
+    si::appendStatement(grids_decl, tmp_block);
+    SgVariableDeclaration *modes_decl = sb::buildVariableDeclaration(
+        "__PSRunGridModes", sb::buildArrayType(sb::buildIntType()),
+        sb::buildAggregateInitializer(
+            sb::buildExprListExp(access_modes)),
+        tmp_block);
+    si::appendStatement(modes_decl, tmp_block);
+    SgFunctionSymbol *fs = si::lookupFunctionSymbolInParentScopes(
+        "__PSStencilRunWithAccess", global_scope_);
+    PSAssert(fs);
+    ref = sb::buildFunctionRefExp(fs);
+    si::appendExpression(args, sb::buildIntVal(access_grids.size()));
+    si::appendExpression(args, sb::buildVarRefExp(grids_decl));
+    si::appendExpression(args, sb::buildVarRefExp(modes_decl));
+  }
+  // number of stencils
+  si::appendExpression(args,
+                       sb::buildIntVal(run->stencils().size()));
+  FOREACH (it, stencil_args->get_expressions().begin(),
+           stencil_args->get_expressions().end()) {
+    si::appendExpression(args, si::copyExpression(*it));
   }
 
   si::appendStatement(
@@ -227,6 +275,137 @@ void MPITranslator::TranslateRun(SgFunctionCallExp *node,
   si::replaceStatement(getContainingStatement(node), tmp_block);
 }
 
+// Returns true if a kernel may write a grid parameter either
+// directly or through the inner kernels it calls. Grids passed to an
+// inner kernel through local variables are assumed to be the
+// parameter.
+static bool MayWriteGridParam(TranslationContext *tx, Kernel *k,
+                              SgInitializedName *gp) {
+  if (k->isGridParamModified(gp)) return true;
+  vector<SgFunctionCallExp*> calls =
+      si::querySubTree<SgFunctionCallExp>(k->getDef());
+  FOREACH (it, calls.begin(), calls.end()) {
+    SgFunctionCallExp *call = *it;
+    if (!isSgFunctionRefExp(call->get_function())) continue;
+    Kernel *inner = tx->findKernel(
+        rose_util::getFuncDeclFromFuncRef(call->get_function()));
+    if (inner == NULL) continue;
+    SgExpressionPtrList &args = call->get_args()->get_expressions();
+    SgInitializedNamePtrList &params = inner->getArgs();
+    for (size_t i = 0; i < args.size() && i < params.size(); ++i) {
+      if (tx->findGridType(args[i]->get_type()) == NULL) continue;
+      SgVarRefExp *vref = isSgVarRefExp(rose_util::removeCasts(args[i]));
+      if (vref) {
+        SgInitializedName *v = vref->get_symbol()->get_declaration();
+        if (v != gp && isSgFunctionParameterList(v->get_parent())) {
+          continue;
+        }
+      }
+      if (MayWriteGridParam(tx, inner, params[i])) return true;
+    }
+  }
+  return false;
+}
+
+bool MPITranslator::IsNeighborHaloLoaded(StencilMap *s,
+                                         SgInitializedName *gp) {
+  // Same conditions as GenerateLoadRemoteGridRegion
+  Kernel *k = tx_->findKernel(s->getKernel());
+  if (!k->isGridParamRead(gp) || s->IsGridPeriodic(gp)) return false;
+  GridVarAttribute *gva =
+      rose_util::GetASTAttribute<GridVarAttribute>(gp);
+  StencilRange &sr = gva->sr();
+  return sr.IsNeighborAccess() && sr.num_dims() == s->getNumDim() &&
+      !sr.IsZero();
+}
+
+void MPITranslator::AppendGridAccesses(StencilMap *s,
+                                       SgVariableDeclaration *sdecl,
+                                       bool first,
+                                       SgExpressionPtrList &grids,
+                                       SgExpressionPtrList &modes) {
+  Kernel *k = tx_->findKernel(s->getKernel());
+  PSAssert(k);
+  FOREACH (it, s->grid_params().begin(), s->grid_params().end()) {
+    SgInitializedName *gp = *it;
+    // Reads are assumed since accesses in inner kernels are not
+    // analyzed; a spurious read only adds a dependency
+    int mode = 1;  // PS_GRID_READ
+    if (MayWriteGridParam(tx_, k, gp)) mode |= 2;  // PS_GRID_WRITE
+    // Halos loaded by the first stencil are loaded before any kernel
+    // of the run writes a grid, so they can be exchanged in advance
+    if (first && IsNeighborHaloLoaded(s, gp)) mode |= 4;  // PS_GRID_HALO
+    grids.push_back(rt_builder_->BuildStencilFieldRef(
+        sb::buildVarRefExp(sdecl), gp->get_name()));
+    modes.push_back(sb::buildIntVal(mode));
+  }
+}
+
+bool MPITranslator::IsMemberHaloExchangeEligible(GridVarAttribute *gva) {
+  // Only the MPI runtime stores points of user-defined types as
+  // structs or member arrays that can be packed per member
+  return target_specific_macro_ == "PHYSIS_MPI" &&
+      gva->gt()->IsUserDefinedPointType() &&
+      !gva->member_sr().empty() && !gva->point_access();
+}
+
+void MPITranslator::GenerateLoadNeighborMembers(
+    GridVarAttribute *gva,
+    SgExpression *gvref,
+    SgExpression *reuse,
+    bool is_periodic,
+    SgStatementPtrList &statements,
+    vector<SgIntVal*> &overlap_flags) {
+  // Merge the ranges of array elements of each member
+  map<string, StencilRange> merged_sr;
+  FOREACH (it, gva->member_sr().begin(), gva->member_sr().end()) {
+    const string &member = it->first.first;
+    if (!isContained(merged_sr, member)) {
+      merged_sr.insert(make_pair(member, StencilRange(gva->gt()->rank())));
+    }
+    merged_sr.find(member)->second.merge(it->second);
+  }
+  map<string, StencilRange> member_sr;
+  FOREACH (it, merged_sr.begin(), merged_sr.end()) {
+    // Members only read at the center point need no exchange
+    if (it->second.IsZero()) {
+      LOG_DEBUG() << "Member " << it->first
+                  << " accessed without offsets; no exchange needed\n";
+      continue;
+    }
+    LOG_DEBUG() << "Member " << it->first << " stencil range: "
+                << it->second << "\n";
+    member_sr.insert(*it);
+  }
+  if (member_sr.empty()) {
+    si::deleteAST(gvref);
+    si::deleteAST(reuse);
+    return;
+  }
+  SgBasicBlock *bb = sb::buildBasicBlock();
+  statements.push_back(bb);
+  SgIntVal *overlap_arg = sb::buildIntVal(0);
+  overlap_flags.push_back(overlap_arg);
+  SgFunctionCallExp *load_neighbor_call
+      = BuildLoadNeighborMembers(gvref, gva->gt(), member_sr, bb,
+                                 reuse, overlap_arg, is_periodic);
+  rose_util::AppendExprStatement(bb, load_neighbor_call);
+}
+
+bool MPITranslator::IsGridUnmodifiedInRun(Run *run, SgInitializedName *gv) {
+  const GridSet *gs = tx_->findGrid(gv);
+  if (gs == NULL || gs->empty()) return false;
+  // Externally passed grids may alias any grid
+  if (gs->find(NULL) != gs->end()) return false;
+  FOREACH (sit, run->stencils().begin(), run->stencils().end()) {
+    Kernel *kernel = tx_->findKernel(sit->second->getKernel());
+    FOREACH (git, gs->begin(), gs->end()) {
+      if (!kernel->IsGridUnmodified(*git)) return false;
+    }
+  }
+  return true;
+}
+
 void MPITranslator::GenerateLoadRemoteGridRegion(
     StencilMap *smap,
     SgVariableDeclaration *stencil_decl,
@@ -251,9 +430,9 @@ void MPITranslator::GenerateLoadRemoteGridRegion(
       LOG_DEBUG() << "Not read in this kernel\n";
       continue;
     }
-    bool read_only = !kernel->isGridParamWritten(grid_param);
-    // Read-only grids are loaded just once at the beginning of the
-    // loop
+    // Grids that no stencil of the run modifies are loaded just once
+    // at the beginning of the loop
+    bool read_only = IsGridUnmodifiedInRun(run, grid_param);
     SgExpression *reuse = NULL;
     if (read_only) {
       reuse = sb::buildGreaterThanOp(sb::buildVarRefExp(loop_var_name),
@@ -284,6 +463,12 @@ void MPITranslator::GenerateLoadRemoteGridRegion(
         LOG_DEBUG() << "Stencil just accesses own buffer; no exchange needed\n";
         continue;
       }
+      overlap_width = std::max(sr.GetMaxWidth(), overlap_width);
+      if (IsMemberHaloExchangeEligible(gva)) {
+        GenerateLoadNeighborMembers(gva, gvref, reuse, is_periodic,
+                                    statements, overlap_flags);
+        continue;
+      }
       // Create an inner scope for declaring variables
       SgBasicBlock *bb = sb::buildBasicBlock();
       statements.push_back(bb);
@@ -293,7 +478,6 @@ void MPITranslator::GenerateLoadRemoteGridRegion(
           = BuildLoadNeighbor(gvref, sr, bb, reuse, overlap_arg,
                               is_periodic);
       rose_util::AppendExprStatement(bb, load_neighbor_call);
-      overlap_width = std::max(sr.GetMaxWidth(), overlap_width);
     } else {
       // EXPERIMENTAL
       LOG_WARNING()
@@ -502,8 +686,13 @@ void MPITranslator::appendNewArgExtra(SgExprListExp *args,
                                       SgVariableDeclaration *dim_decl) {
   LOG_DEBUG() << "Append New extra arg for "
               << *g << "\n";
-  // attribute
-  si::appendExpression(args, sb::buildIntVal(0));
+  // attribute; periodic grids have halo on every dimension
+  SgExpression *attr =
+      sb::buildIntVal(g->periodic() ? PS_GRID_ATTRIBUTE_PERIODIC : 0);
+  // Attributes given to the new call, e.g., PS_GRID_ATTRIBUTE_COARSE
+  SgExpression *user_attr = g->BuildAttributeExpr();
+  if (user_attr) attr = sb::buildBitOrOp(user_attr, attr);
+  si::appendExpression(args, attr);
   // global offset
   si::appendExpression(args, rose_util::buildNULL(global_scope_));
 
@@ -532,10 +721,21 @@ void MPITranslator::appendNewArgExtra(SgExprListExp *args,
   return;
 }
 
+void MPITranslator::appendNewArgSoA(SgExprListExp *args, int grid_layout,
+                                    int num_members,
+                                    SgVariableDeclaration *layout_decl) {
+  // The layout of the local buffer is given by the attribute
+  si::appendExpression(args, sb::buildIntVal(soa_lane_width_));
+  si::appendExpression(args, sb::buildIntVal(num_members));
+  si::appendExpression(args, sb::buildVarRefExp(layout_decl));
+}
+
 // REFACTORING: This should be common among all translators.
 bool MPITranslator::TranslateGetHost(SgFunctionCallExp *node,
                                      SgInitializedName *gv) {
   GridType *gt = tx_->findGridType(gv->get_type());
+  // Members of SoA grids are translated by the reference translator
+  if (soa_layout_ && gt->IsUserDefinedPointType()) return false;
   int nd = gt->rank();
   SgScopeStatement *scope = getContainingScopeStatement(node);    
   SgVarRefExp *g = sb::buildVarRefExp(gv->get_name(), scope);
@@ -548,9 +748,21 @@ bool MPITranslator::TranslateGetHost(SgFunctionCallExp *node,
   SgExpression *get = rt_builder_->BuildGridGet(
       g, rose_util::GetASTAttribute<GridVarAttribute>(gv),
       gt, &indices, NULL, false, false);
-  si::replaceExpression(node, get, true);
   rose_util::CopyASTAttribute<GridGetAttribute>(
       get, node, false);  
+  if (target_specific_macro_ != "PHYSIS_MPI") {
+    si::replaceExpression(node, get, true);
+    return true;
+  }
+  // Generate code like this
+  // (__PSGridFlush(g), ((float *)g->p0)[offset])
+  // so that deferred runs writing the grid are done before the read
+  SgFunctionSymbol *flush_fs = si::lookupFunctionSymbolInParentScopes(
+      "__PSGridFlush", global_scope_);
+  PSAssert(flush_fs);
+  SgExpression *flush = sb::buildFunctionCallExp(
+      flush_fs, sb::buildExprListExp(si::copyExpression(g)));
+  si::replaceExpression(node, sb::buildCommaOpExp(flush, get), true);
   return true;
 }
 
@@ -558,6 +770,8 @@ bool MPITranslator::TranslateGetKernel(SgFunctionCallExp *node,
                                        SgInitializedName *gv,
                                        bool is_periodic) {
   GridType *gt = tx_->findGridType(gv->get_type());
+  // Members of SoA grids are translated by the reference translator
+  if (soa_layout_ && gt->IsUserDefinedPointType()) return false;
   int nd = gt->rank();
   SgScopeStatement *scope = si::getEnclosingFunctionDefinition(node);
   SgExpressionPtrList args;
@@ -569,8 +783,13 @@ bool MPITranslator::TranslateGetKernel(SgFunctionCallExp *node,
       rose_util::GetASTAttribute<GridGetAttribute>(
           node)->GetStencilIndexList());
 
+  // Grids updated by the kernel are read from the snapshot taken by
+  // the run kernel
+  GridVarAttribute *gva = rose_util::GetASTAttribute<GridVarAttribute>(gv);
+  string base_addr_name = (gva && gva->out_of_place()) ?
+      "__PSGridGetReadAddr" : "__PSGridGetBaseAddr";
   SgFunctionCallExp *base_addr = sb::buildFunctionCallExp(
-      si::lookupFunctionSymbolInParentScopes("__PSGridGetBaseAddr"),
+      si::lookupFunctionSymbolInParentScopes(base_addr_name),
       sb::buildExprListExp(sb::buildVarRefExp(gv->get_name(),
                                               scope)));
   SgExpression *x = sb::buildPntrArrRefExp(
@@ -619,6 +838,57 @@ void MPITranslator::TranslateEmit(SgFunctionCallExp *node,
   si::replaceExpression(node, emit);
 }
 
+SgBasicBlock *MPITranslator::BuildRunKernelBody(
+    StencilMap *s, SgFunctionParameterList *param,
+    vector<SgVariableDeclaration*> &indices) {
+  SgBasicBlock *block =
+      ReferenceTranslator::BuildRunKernelBody(s, param, indices);
+  if (!rose_util::IsCLikeLanguage()) return block;
+
+  SgFunctionSymbol *kernel_sym = rose_util::getFunctionSymbol(s->getKernel());
+  SgFunctionCallExp *kernel_call = NULL;
+  vector<SgFunctionCallExp*> calls =
+      si::querySubTree<SgFunctionCallExp>(block);
+  FOREACH (it, calls.begin(), calls.end()) {
+    if ((*it)->getAssociatedFunctionSymbol() == kernel_sym) {
+      kernel_call = *it;
+      break;
+    }
+  }
+  PSAssert(kernel_call);
+
+  // Generate code like this
+  // __PSGridMPI __PSGridLocal_g = *s->g;
+  // ...
+  //       kernel(i, j, k, &__PSGridLocal_g);
+  SgType *grid_type =
+      si::lookupNamedTypeInParentScopes(grid_type_name_, global_scope_);
+  PSAssert(grid_type);
+  SgExpressionPtrList args = kernel_call->get_args()->get_expressions();
+  SgStatementPtrList local_decls;
+  FOREACH (it, args.begin(), args.end()) {
+    SgExpression *arg = *it;
+    if (!GridType::isGridType(arg->get_type())) continue;
+    SgBinaryOp *field_ref = isSgBinaryOp(arg);
+    PSAssert(field_ref);
+    SgVarRefExp *field = isSgVarRefExp(field_ref->get_rhs_operand());
+    PSAssert(field);
+    SgVariableDeclaration *local_grid = sb::buildVariableDeclaration(
+        "__PSGridLocal_" + field->get_symbol()->get_name().getString(),
+        grid_type,
+        sb::buildAssignInitializer(
+            sb::buildPointerDerefExp(si::copyExpression(arg)),
+            grid_type),
+        block);
+    local_decls.push_back(local_grid);
+    si::replaceExpression(
+        arg, sb::buildAddressOfOp(sb::buildVarRefExp(local_grid)));
+  }
+  si::prependStatementList(local_decls, block);
+
+  return block;
+}
+
 void MPITranslator::FixAST() {
   if (validate_ast_) {
     si::fixVariableReferences(project_);
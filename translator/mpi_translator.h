@@ -30,11 +30,24 @@ class MPITranslator: public ReferenceTranslator {
                             Run *run);
   virtual void BuildRunBody(
       SgBasicBlock *block, Run *run, SgFunctionDeclaration *run_func);
+  //! Builds the loop nest of a run kernel.
+  /*!
+    Grid layouts are copied to local variables before the loop nest
+    so that the strides used in offset computation are loop
+    invariant.
+   */
+  virtual SgBasicBlock *BuildRunKernelBody(
+      StencilMap *s, SgFunctionParameterList *param,
+      vector<SgVariableDeclaration*> &indices);
   virtual SgFunctionDeclaration *BuildRun(Run *run);
   virtual SgExprListExp *generateNewArg(GridType *gt, Grid *g,
                                         SgVariableDeclaration *dim_decl);
   virtual void appendNewArgExtra(SgExprListExp *args, Grid *g,
                                  SgVariableDeclaration *dim_decl);
+  //! Appends the lanes and the member layout; no layout argument.
+  virtual void appendNewArgSoA(SgExprListExp *args, int grid_layout,
+                               int num_members,
+                               SgVariableDeclaration *layout_decl);
   virtual bool TranslateGetKernel(SgFunctionCallExp *node,
                                   SgInitializedName *gv,
                                   bool is_periodic);
@@ -49,6 +62,47 @@ class MPITranslator: public ReferenceTranslator {
       SgStatementPtrList &statements,
       bool &overlap_eligible,
       int &overlap_width);
+  //! Appends the grids accessed by a stencil and their access modes.
+  /*!
+    \param s The stencil map object.
+    \param sdecl Declaration of the stencil object.
+    \param first True if the stencil is the first one of the run.
+    \param grids Field references to the grids of the stencil object.
+    \param modes Access modes of the grids.
+   */
+  virtual void AppendGridAccesses(StencilMap *s,
+                                  SgVariableDeclaration *sdecl,
+                                  bool first,
+                                  SgExpressionPtrList &grids,
+                                  SgExpressionPtrList &modes);
+  //! Returns true if a stencil loads the halo of a grid parameter.
+  /*!
+    Only non-periodic neighbor accesses are included, whose halos
+    the runtime can exchange ahead of the run.
+   */
+  virtual bool IsNeighborHaloLoaded(StencilMap *s, SgInitializedName *gp);
+  //! Returns true if the halo of a grid can be exchanged per member.
+  /*!
+    Requires all reads of the grid to be member accesses of a
+    user-defined point type.
+   */
+  virtual bool IsMemberHaloExchangeEligible(GridVarAttribute *gva);
+  //! Returns true if no stencil of a run may modify a grid.
+  /*!
+    Halos of such grids are loaded only at the first iteration.
+   */
+  virtual bool IsGridUnmodifiedInRun(Run *run, SgInitializedName *gv);
+  //! Generates halo loading of members accessed with neighbor offsets.
+  /*!
+    All the members are exchanged together with a single call.
+   */
+  virtual void GenerateLoadNeighborMembers(
+      GridVarAttribute *gva,
+      SgExpression *gvref,
+      SgExpression *reuse,
+      bool is_periodic,
+      SgStatementPtrList &statements,
+      vector<SgIntVal*> &overlap_flags);
   virtual void ProcessStencilMap(StencilMap *smap, SgVarRefExp *stencils,
                                  int stencil_index, Run *run,
                                  SgScopeStatement *function_body,
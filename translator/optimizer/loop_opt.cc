@@ -110,13 +110,13 @@ static bool IsLoopInvariant(SgInitializedName *v,
 static bool IsLoopInvariant(SgFunctionCallExp *e, SgForStatement *loop,
                             VarStack &stack) {
   std::string func_name = rose_util::getFuncName(e);
-  if (func_name == "PSGridDim") {
+  if (func_name == PS_GRID_DIM_NAME || func_name == PS_GRID_REAL_DIM_NAME) {
     SgExpressionPtrList &args = e->get_args()->get_expressions();
     FOREACH (it, ++(args.begin()), args.end()) {
       SgExpression *arg_expr = *it;
       if (!IsLoopInvariant(arg_expr, loop, stack)) return false;
     }
-    LOG_DEBUG() << "Call to PSGridDim is invariant\n";
+    LOG_DEBUG() << "Call to " << func_name << " is invariant\n";
     return true;
   }
   return false;
@@ -541,7 +541,7 @@ static SgExpression *GetLoopInvariantExpression(SgForStatement *loop,
   } else if (isSgFunctionCallExp(exp)) {
     SgFunctionCallExp *call = isSgFunctionCallExp(exp);
     std::string func_name = rose_util::getFuncName(call);
-    if (func_name == "PSGridDim") {
+    if (func_name == PS_GRID_DIM_NAME || func_name == PS_GRID_REAL_DIM_NAME) {
       SgFunctionCallExp *call = isSgFunctionCallExp(si::copyExpression(exp));
       SgExpressionPtrList &args = call->get_args()->get_expressions();
       FOREACH (it, args.begin(), args.end()) {
@@ -27,58 +27,315 @@ namespace pass {
 static void RemoveDeadConditional(SgForStatement *loop,
                                   int dim, int peel_size_first,
                                   int peel_size_last,
+                                  SgInitializedName *peel_last_grid,
                                   RunKernelLoopAttribute::Kind type);
 
-//! Return true if a given get MAY be guarded by a conditional node.
+// Bounds on the depth of variable definitions followed
+static const int kMaxDefinitionDepth = 8;
+
+//! Affine form of an index expression.
+/*!
+  Represents var * i + grid_dim * PSGridDim(grid, dim-1) + constant,
+  where i is the loop induction variable.
+ */
+struct AffineIndex {
+  long var;
+  long grid_dim;
+  long constant;
+  SgInitializedName *grid;
+  AffineIndex(): var(0), grid_dim(0), constant(0), grid(NULL) {}
+};
+
+static bool IsRefToVar(SgVarRefExp *vref, SgInitializedName *var) {
+  return vref->get_symbol()->get_declaration() == var;
+}
+
+//! Adds sign * exp to an affine index.
 /*!
-  This is a conservative analysis. It is SAFE to always return true.
+  \return false if the expression is not affine in the loop variable
+  and the grid size.
+ */
+static bool AnalyzeAffineIndex(SgExpression *exp,
+                               SgInitializedName *loop_var,
+                               int dim, long sign, int depth,
+                               AffineIndex &a) {
+  if (isSgCastExp(exp)) {
+    return AnalyzeAffineIndex(isSgCastExp(exp)->get_operand(),
+                              loop_var, dim, sign, depth, a);
+  } else if (isSgUnaryAddOp(exp)) {
+    return AnalyzeAffineIndex(isSgUnaryAddOp(exp)->get_operand(),
+                              loop_var, dim, sign, depth, a);
+  } else if (isSgMinusOp(exp)) {
+    return AnalyzeAffineIndex(isSgMinusOp(exp)->get_operand(),
+                              loop_var, dim, -sign, depth, a);
+  } else if (isSgAddOp(exp) || isSgSubtractOp(exp)) {
+    SgBinaryOp *bop = isSgBinaryOp(exp);
+    return AnalyzeAffineIndex(bop->get_lhs_operand(), loop_var, dim,
+                              sign, depth, a) &&
+        AnalyzeAffineIndex(bop->get_rhs_operand(), loop_var, dim,
+                           isSgAddOp(exp) ? sign : -sign, depth, a);
+  } else if (isSgValueExp(exp)) {
+    if (!si::isStrictIntegerType(exp->get_type())) return false;
+    a.constant += sign * si::getIntegerConstantValue(isSgValueExp(exp));
+    return true;
+  } else if (isSgVarRefExp(exp)) {
+    SgVarRefExp *vref = isSgVarRefExp(exp);
+    if (IsRefToVar(vref, loop_var)) {
+      a.var += sign;
+      return true;
+    }
+    if (depth >= kMaxDefinitionDepth) return false;
+    SgExpression *vdef =
+        GetDeterministicDefinition(vref->get_symbol()->get_declaration());
+    if (vdef == NULL) return false;
+    return AnalyzeAffineIndex(vdef, loop_var, dim, sign, depth + 1, a);
+  } else if (isSgFunctionCallExp(exp)) {
+    SgFunctionCallExp *call = isSgFunctionCallExp(exp);
+    if (rose_util::getFuncName(call) != "PSGridDim") return false;
+    SgExpressionPtrList &args = call->get_args()->get_expressions();
+    SgValueExp *dim_arg = isSgValueExp(args[1]);
+    if (dim_arg == NULL ||
+        (int)si::getIntegerConstantValue(dim_arg) != dim - 1) {
+      return false;
+    }
+    vector<SgVarRefExp*> grid_refs = si::querySubTree<SgVarRefExp>(args[0]);
+    if (grid_refs.size() != 1) return false;
+    SgInitializedName *grid =
+        grid_refs[0]->get_symbol()->get_declaration();
+    // Sizes of different grids are not related
+    if (a.grid && a.grid != grid) return false;
+    a.grid = grid;
+    a.grid_dim += sign;
+    return true;
+  }
+  return false;
+}
+
+//! Returns the comparison operator with its operands swapped.
+static VariantT MirrorComparison(VariantT op) {
+  switch (op) {
+    case V_SgLessThanOp: return V_SgGreaterThanOp;
+    case V_SgLessOrEqualOp: return V_SgGreaterOrEqualOp;
+    case V_SgGreaterThanOp: return V_SgLessThanOp;
+    case V_SgGreaterOrEqualOp: return V_SgLessOrEqualOp;
+    default: return op;
+  }
+}
+
+static bool IsComparison(const SgExpression *exp) {
+  return isSgEqualityOp(exp) || isSgNotEqualOp(exp) ||
+      isSgLessThanOp(exp) || isSgLessOrEqualOp(exp) ||
+      isSgGreaterThanOp(exp) || isSgGreaterOrEqualOp(exp);
+}
+
+//! A comparison of the loop variable, i OP bound.
+struct BoundaryPredicate {
+  VariantT op;
+  //! Either a constant or PSGridDim(grid) minus a constant
+  AffineIndex bound;
+};
+
+//! Analyzes a comparison as a predicate on the loop variable.
+/*!
+  Predicates such as x == 0, x > PSGridDim(g, 0) - 2 and 1 > x - 1
+  are accepted, where x may be a variable defined from the loop
+  variable. Bounds relative to the domain minimum, such as
+  x < dom_min + 1, are not accepted, since the kernel cannot refer to
+  the domain of the loop.
+
+  \param cmp A comparison expression.
+  \param loop_var The loop induction variable.
+  \param dim The dimension of the loop.
+  \param pred The predicate normalized to i OP bound.
+  \return true if the comparison is a boundary predicate.
+ */
+static bool AnalyzeBoundaryPredicate(const SgExpression *cmp,
+                                     SgInitializedName *loop_var,
+                                     int dim, BoundaryPredicate &pred) {
+  if (!IsComparison(cmp)) return false;
+  const SgBinaryOp *bop = isSgBinaryOp(cmp);
+  // lhs - rhs OP 0
+  AffineIndex d;
+  if (!AnalyzeAffineIndex(bop->get_lhs_operand(), loop_var, dim,
+                          1, 0, d) ||
+      !AnalyzeAffineIndex(bop->get_rhs_operand(), loop_var, dim,
+                          -1, 0, d)) {
+    return false;
+  }
+  pred.op = cmp->variantT();
+  if (d.var == -1) {
+    d.var = 1;
+    d.grid_dim = -d.grid_dim;
+    d.constant = -d.constant;
+    pred.op = MirrorComparison(pred.op);
+  }
+  if (d.var != 1) return false;
+  pred.bound = d;
+  pred.bound.var = 0;
+  pred.bound.grid_dim = -d.grid_dim;
+  pred.bound.constant = -d.constant;
+  if (pred.bound.grid_dim != 0 && pred.bound.grid_dim != 1) return false;
+  return true;
+}
+
+//! Evaluates v OP c for all v in [lo, hi].
+/*!
+  \return 1 if always true, 0 if always false, -1 otherwise.
+ */
+static int EvaluateComparison(VariantT op, bool has_lo, long lo,
+                              bool has_hi, long hi, long c) {
+  switch (op) {
+    case V_SgLessThanOp:
+      if (has_hi && hi < c) return 1;
+      if (has_lo && lo >= c) return 0;
+      break;
+    case V_SgLessOrEqualOp:
+      if (has_hi && hi <= c) return 1;
+      if (has_lo && lo > c) return 0;
+      break;
+    case V_SgGreaterThanOp:
+      if (has_lo && lo > c) return 1;
+      if (has_hi && hi <= c) return 0;
+      break;
+    case V_SgGreaterOrEqualOp:
+      if (has_lo && lo >= c) return 1;
+      if (has_hi && hi < c) return 0;
+      break;
+    case V_SgEqualityOp:
+    case V_SgNotEqualOp: {
+      int eq = -1;
+      if ((has_hi && hi < c) || (has_lo && lo > c)) {
+        eq = 0;
+      } else if (has_lo && has_hi && lo == c && hi == c) {
+        eq = 1;
+      }
+      if (eq < 0 || op == V_SgEqualityOp) return eq;
+      return !eq;
+    }
+    default:
+      break;
+  }
+  return -1;
+}
+
+//! Evaluates a boundary predicate in a peeled loop.
+/*!
+  The first loop runs [0, peel_size_first), the main loop
+  [peel_size_first, N - peel_size_last), and the last loop
+  [N - peel_size_last, N), where N is the size of peel_last_grid. Any
+  of them may be cut short by the end of the loop, so the first loop
+  is not known to be below N - peel_size_last.
+
+  \return 1 if always true, 0 if always false, -1 otherwise.
+ */
+static int EvaluateBoundaryPredicate(const BoundaryPredicate &pred,
+                                     int peel_size_first,
+                                     int peel_size_last,
+                                     SgInitializedName *peel_last_grid,
+                                     RunKernelLoopAttribute::Kind kind) {
+  const AffineIndex &b = pred.bound;
+  if (b.grid_dim == 0) {
+    // Indices are non-negative
+    long hi = peel_size_first - 1;
+    return EvaluateComparison(
+        pred.op, true,
+        kind == RunKernelLoopAttribute::FIRST ? 0 : peel_size_first,
+        kind == RunKernelLoopAttribute::FIRST, hi, b.constant);
+  }
+  // Compare i - N with the constant
+  if (b.grid != peel_last_grid) return -1;
+  switch (kind) {
+    case RunKernelLoopAttribute::MAIN:
+      return EvaluateComparison(pred.op, false, 0,
+                                true, -(peel_size_last + 1), b.constant);
+    case RunKernelLoopAttribute::LAST:
+      return EvaluateComparison(pred.op, true, -peel_size_last,
+                                true, -1, b.constant);
+    default:
+      return -1;
+  }
+}
+
+//! Return true if a condition has a boundary predicate for a get.
+/*!
+  Backward accesses are guarded by predicates with constants, which
+  are resolved by peeling the first iterations, and forward accesses
+  by predicates with the size of the accessed grid, which are
+  resolved by peeling the last iterations.
   
   \param get_exp A GridGet expression.
-  \param if_stmt An if node that is a parent of the get expression.
+  \param cond A conditional expression guarding the get.
+  \param loop_var The loop induction variable.
   \param dim The dimension with off-region access.
-  \return true if the conditional node may guard the get.
+  \param offset The offset of the get in the dimension.
  */
-static bool MayGuardGridAccess(const SgExpression *get_exp,
-                               const SgIfStmt *if_stmt,
-                               int dim) {
-  return true;
+static bool HasBoundaryPredicate(const SgExpression *get_exp,
+                                 SgNode *cond,
+                                 SgInitializedName *loop_var,
+                                 int dim, int offset) {
+  vector<SgExpression*> exps = si::querySubTree<SgExpression>(cond);
+  FOREACH (it, exps.begin(), exps.end()) {
+    BoundaryPredicate pred;
+    if (!AnalyzeBoundaryPredicate(*it, loop_var, dim, pred)) continue;
+    if (offset < 0 && pred.bound.grid_dim == 0) return true;
+    if (offset > 0 && pred.bound.grid_dim == 1 &&
+        pred.bound.grid ==
+        GridGetAnalysis::GetGridVar(const_cast<SgExpression*>(get_exp))) {
+      return true;
+    }
+  }
+  return false;
 }
 
-//! Return true if a given get MAY be guarded by a conditional node.
+//! Return true if a given get is guarded by a boundary predicate.
 /*!
-  This is a conservative analysis. It is SAFE to always return true.
-  
   \param get_exp A GridGet expression.
-  \param cond_exp A conditional expression that is a parent of the
-  get. 
+  \param if_stmt An if node that is a parent of the get expression.
+  \param loop_var The loop induction variable.
   \param dim The dimension with off-region access.
-  \return true if the conditional node may guard the get.
+  \param offset The offset of the get in the dimension.
+  \return true if the conditional node guards the get.
  */
 static bool MayGuardGridAccess(const SgExpression *get_exp,
-                               const SgConditionalExp *cond_exp,
-                               int dim) {
-  return true;
+                               const SgIfStmt *if_stmt,
+                               SgInitializedName *loop_var,
+                               int dim, int offset) {
+  // The get is evaluated regardless of the condition
+  if (si::isAncestor(if_stmt->get_conditional(),
+                     const_cast<SgExpression*>(get_exp))) {
+    return false;
+  }
+  return HasBoundaryPredicate(get_exp, if_stmt->get_conditional(),
+                              loop_var, dim, offset);
 }
 
-//! Return true if a given get MAY be guarded by a conditional node.
+//! Return true if a given get is guarded by a boundary predicate.
 /*!
-  This is a conservative analysis. It is SAFE to always return true.
-  
   \param get_exp A GridGet expression.
-  \param switch_stmt A switch statment that is a parent of the get. 
+  \param cond_exp A conditional expression that is a parent of the
+  get. 
+  \param loop_var The loop induction variable.
   \param dim The dimension with off-region access.
-  \return true if the conditional node may guard the get.
+  \param offset The offset of the get in the dimension.
+  \return true if the conditional node guards the get.
  */
 static bool MayGuardGridAccess(const SgExpression *get_exp,
-                               const SgSwitchStatement *switch_stmt,
-                               int dim) {
-  return true;
+                               const SgConditionalExp *cond_exp,
+                               SgInitializedName *loop_var,
+                               int dim, int offset) {
+  if (si::isAncestor(cond_exp->get_conditional_exp(),
+                     const_cast<SgExpression*>(get_exp))) {
+    return false;
+  }
+  return HasBoundaryPredicate(get_exp, cond_exp->get_conditional_exp(),
+                              loop_var, dim, offset);
 }
 
 static int FindProfitablePeelSize(const SgExpression *grid_get,
                                   const StencilIndexList &index_list,
                                   int loop_dim,
-                                  SgStatement *loop_body) {
+                                  SgStatement *loop_body,
+                                  SgInitializedName *loop_var) {
   if (!StencilIndexRegularOrder(index_list)) return 0;
   ssize_t offset = index_list[loop_dim-1].offset;
   if (offset == 0) {
@@ -91,18 +348,17 @@ static int FindProfitablePeelSize(const SgExpression *grid_get,
     // found. 
     // If it is guarded by a condition with the loop induction
     // variable, this can be optimized by peeling the first loop
-    // offset iterations.
+    // offset iterations. Switch statements are not resolved by
+    // RemoveDeadConditional, so peeling does not pay off.
     SgNode *parent = grid_get->get_parent();
     while (parent != loop_body) {
       PSAssert(parent);
       if ((isSgIfStmt(parent) &&
-           MayGuardGridAccess(grid_get, isSgIfStmt(parent), loop_dim)) ||
+           MayGuardGridAccess(grid_get, isSgIfStmt(parent), loop_var,
+                              loop_dim, offset)) ||
           (isSgConditionalExp(parent) &&
            MayGuardGridAccess(grid_get, isSgConditionalExp(parent),
-                              loop_dim)) ||
-          (isSgSwitchStatement(parent) &&
-           MayGuardGridAccess(grid_get, isSgSwitchStatement(parent),
-                              loop_dim))) {
+                              loop_var, loop_dim, offset))) {
         LOG_DEBUG() << "Profitable access found: "
                     << grid_get->unparseToString() << "\n";
         return offset;
@@ -146,9 +402,12 @@ static SgForStatement* PeelFirstIterations(SgForStatement *loop,
   RenameLastStatementLabel(peeled_iterations);
   LOG_DEBUG() << "Label renaming done\n";
   
-  // Modify the termination condition to i < peel_size
+  // Modify the termination condition to i < min(end, peel_size)
+  // so that the peeled iterations do not run past a short loop
   SgStatement *original_cond = peeled_iterations->get_test();
-  SgExpression *loop_end = sb::buildIntVal(peel_size);
+  SgExpression *loop_end = rose_util::BuildMin(
+      si::copyExpression(KernelLoopAnalysis::GetLoopEnd(loop)),
+      sb::buildIntVal(peel_size));
   SgStatement *cond =
       sb::buildExprStatement(
           sb::buildLessThanOp(si::copyExpression(loop_var),
@@ -243,6 +502,19 @@ static SgForStatement* PeelLastIterations(SgForStatement *loop,
   
   // Prepend the peeled iterations
   si::insertStatementAfter(loop, peeled_iterations);
+
+  // The peeled iterations continue from where the original loop
+  // stops, so the initialization is removed unless it is already
+  // removed by peeling the first iterations
+  if (KernelLoopAnalysis::GetLoopBegin(peeled_iterations)) {
+    SgStatementPtrList empty_statement;
+    SgForInitStatement *empty_init =
+        sb::buildForInitStatement(empty_statement);
+    SgForInitStatement *original_init =
+        peeled_iterations->get_for_init_stmt();
+    si::replaceStatement(original_init, empty_init);
+    si::removeStatement(original_init);
+  }
   
   // Set the loop begin and end of the peeled iterations.
   // The end is not affected; only the beginning needs to be
@@ -262,6 +534,8 @@ static void PeelLoop(
       rose_util::GetASTAttribute<RunKernelLoopAttribute>(loop);
   int dim = loop_attr->dim();
   SgStatement *loop_body = loop->get_loop_body();
+  SgInitializedName *loop_var =
+      KernelLoopAnalysis::GetLoopVar(loop)->get_symbol()->get_declaration();
   std::vector<SgNode*> grid_gets =
       rose_util::QuerySubTreeAttribute<GridGetAttribute>(loop);
   int peel_size_first = 0;
@@ -274,7 +548,7 @@ static void PeelLoop(
     const StencilIndexList &sil =
         *grid_get_attr->GetStencilIndexList();
     int peel_size = FindProfitablePeelSize(grid_get, sil, dim,
-                                           loop_body);
+                                           loop_body, loop_var);
     if (peel_size == 0) continue;
     // Find target peel size for first iterations
     if (peel_size < 0) {
@@ -304,7 +578,8 @@ static void PeelLoop(
     RemoveDeadConditional(
         peeled_loop,
         rose_util::GetASTAttribute<RunKernelLoopAttribute>(loop)->dim(),
-        peel_size_first, peel_size_last, RunKernelLoopAttribute::FIRST);
+        peel_size_first, peel_size_last, peel_last_grid,
+        RunKernelLoopAttribute::FIRST);
   } else {
     LOG_DEBUG() << "No profitable iteration found at the loop beginning.\n";
   }
@@ -314,7 +589,8 @@ static void PeelLoop(
     RemoveDeadConditional(
         peeled_loop,
         rose_util::GetASTAttribute<RunKernelLoopAttribute>(loop)->dim(),
-        peel_size_first, peel_size_last, RunKernelLoopAttribute::LAST);
+        peel_size_first, peel_size_last, peel_last_grid,
+        RunKernelLoopAttribute::LAST);
     
   } else {
     LOG_DEBUG() << "No profitable iteration found at the loop end.\n";
@@ -324,64 +600,12 @@ static void PeelLoop(
     RemoveDeadConditional(
         loop,
         rose_util::GetASTAttribute<RunKernelLoopAttribute>(loop)->dim(),
-        peel_size_first, peel_size_last, RunKernelLoopAttribute::MAIN);
+        peel_size_first, peel_size_last, peel_last_grid,
+        RunKernelLoopAttribute::MAIN);
   }
   
 }
 
-// Return 0 on success
-static int FindExresssionReferencingLoopVar(SgBinaryOp *bop,
-                                            SgInitializedName *loop_var,
-                                            SgExpression *&v_expr,
-                                            SgExpression *&c_expr) {
-  SgExpression *lhs = bop->get_lhs_operand();
-  SgExpression *rhs = bop->get_rhs_operand();  
-  vector<SgVarRefExp*> vrefs = si::querySubTree<SgVarRefExp>(lhs);
-  bool ref = false;
-  FOREACH (it, vrefs.begin(), vrefs.end()) {
-    if ((*it)->get_symbol()->get_declaration() == loop_var) {
-      v_expr = lhs;
-      c_expr = rhs;
-      return 0;
-    }
-  }
-  vrefs = si::querySubTree<SgVarRefExp>(rhs);
-  ref = false;
-  FOREACH (it, vrefs.begin(), vrefs.end()) {
-    if ((*it)->get_symbol()->get_declaration() == loop_var) {
-      v_expr = rhs;
-      c_expr = lhs;
-      return 0;
-    }
-  }
-
-  LOG_DEBUG() << "No reference to " << loop_var->unparseToString() <<
-      " found in " << bop->unparseToString() << "\n";
-  return -1;
-}
-
-static bool IsRefToVar(SgVarRefExp *vref, SgInitializedName *var) {
-  return vref->get_symbol()->get_declaration() == var;
-}
-
-static SgBinaryOp *FlipComparatorOp(SgBinaryOp *bop) {
-  SgBinaryOp *flipped_op = NULL;
-  SgExpression *lhs = si::copyExpression(bop->get_lhs_operand());
-  SgExpression *rhs = si::copyExpression(bop->get_rhs_operand());
-  if (isSgGreaterThanOp(bop)) {
-    flipped_op = sb::buildLessOrEqualOp(lhs, rhs);
-  } else if (isSgGreaterOrEqualOp(bop)) {
-    flipped_op = sb::buildLessThanOp(lhs, rhs);
-  } else if (isSgLessThanOp(bop)) {
-    flipped_op = sb::buildGreaterOrEqualOp(lhs, rhs);
-  } else if (isSgLessOrEqualOp(bop)) {
-    flipped_op = sb::buildGreaterThanOp(lhs, rhs);
-  }
-  LOG_DEBUG() << bop->unparseToString() << " flipped to "
-              << flipped_op->unparseToString() << "\n";
-  return flipped_op;
-}
-
 static SgExpression *BuildTrue() {
   return sb::buildIntVal(1);
 }
@@ -390,75 +614,6 @@ static SgExpression *BuildFalse() {
   return sb::buildIntVal(0);
 }
 
-//! Return true if expression is like "PSGridDim() - i", where i is
-//! integer constant.
-static int InvolveGridSize(SgExpression *exp, int dim) {
-  SgSubtractOp *sop = isSgSubtractOp(exp);
-  if (!sop) return -1;
-  SgFunctionCallExp *lhs = isSgFunctionCallExp(sop->get_lhs_operand());
-  SgValueExp *rhs = isSgValueExp(sop->get_rhs_operand());
-  if (lhs == NULL || rhs == NULL) return -1;
-  if (!si::isStrictIntegerType(rhs->get_type())) return -1;
-  string func_name = rose_util::getFuncName(lhs);
-  if (func_name != "PSGridDim") return -1;
-  SgValueExp *dim_arg =
-      isSgValueExp(lhs->get_args()->get_expressions()[1]);
-  PSAssert(dim_arg);
-  //LOG_DEBUG() << "Dim arg: " << dim_arg->unparseToString() << "\n";
-  if ((int)si::getIntegerConstantValue(dim_arg) != dim-1) return -1;
-  return si::getIntegerConstantValue(rhs);
-}
-
-static int Evaluate(SgBinaryOp *op,
-                    SgExpression *rhs,
-                    int peel_size_first, int peel_size_last,
-                    RunKernelLoopAttribute::Kind kind,
-                    int dim) {
-  int minus_offset = InvolveGridSize(rhs, dim);
-  if (minus_offset > 0) {
-    if (isSgEqualityOp(op)) {
-      switch (kind) {
-        case RunKernelLoopAttribute::FIRST:
-        case RunKernelLoopAttribute::MAIN:
-          if (minus_offset <= peel_size_last) {
-            return 0;
-          } else {
-            return -1;
-          }
-        case RunKernelLoopAttribute::LAST:
-          if (minus_offset > peel_size_last) {
-            return 0;
-          } else {
-            return -1;
-          }
-      }
-    }
-  } else if (isSgValueExp(rhs)) {
-    int val = si::getIntegerConstantValue(isSgValueExp(rhs));
-    if (isSgEqualityOp(op)) {
-      switch (kind) {
-        case RunKernelLoopAttribute::FIRST:
-          if (val < peel_size_first) {
-            return -1;
-          } else {
-            return 0;
-          }
-        case RunKernelLoopAttribute::MAIN:
-        case RunKernelLoopAttribute::LAST:
-          if (val < peel_size_first) {
-            return 0;
-          }
-          return -1;
-      }
-    }
-  }
-
-  
-  LOG_DEBUG() << "No static evaluation done for "
-              << rhs->unparseToString() << "\n";
-  return -1;    
-}
-
 static SgIfStmt *IsIfConditional(SgExpression *expr) {
   SgExprStatement *cond = isSgExprStatement(expr->get_parent());
   if (!cond) return false;
@@ -471,153 +626,98 @@ static SgIfStmt *IsIfConditional(SgExpression *expr) {
   }
 }
 
-static void RemoveDeadConditional(SgForStatement *loop,
+//! Folds the first boundary predicate that is constant in a loop.
+/*!
+  \return true if a predicate is folded.
+ */
+static bool FoldBoundaryPredicate(SgForStatement *loop,
                                   int dim,
                                   int peel_size_first,
                                   int peel_size_last,
+                                  SgInitializedName *peel_last_grid,
                                   RunKernelLoopAttribute::Kind kind) {
-  vector<SgBinaryOp*> bin_ops = si::querySubTree<SgBinaryOp>(loop);
+  vector<SgExpression*> exps = si::querySubTree<SgExpression>(loop);
   SgInitializedName *loop_var =
       KernelLoopAnalysis::GetLoopVar(loop)->get_symbol()->get_declaration();
-  FOREACH (it, bin_ops.begin(), bin_ops.end()) {
-    SgBinaryOp *bin_op = isSgBinaryOp(si::copyExpression(*it));
-    if (!(isSgEqualityOp(bin_op))) continue;
-    LOG_DEBUG() << "Optimizing " << bin_op->unparseToString() << "?\n";    
-    vector<SgExpression*> nested_exprs = si::querySubTree<SgExpression>(bin_op);
-    SgVarRefExp *loop_var_ref = NULL;
-    bool safe_to_opt = true;
-    FOREACH (nested_exprs_it, nested_exprs.begin(), nested_exprs.end()) {
-      SgExpression *nested_expr = *nested_exprs_it;
-      if (nested_expr == bin_op) continue;
-      if (isSgVarRefExp(nested_expr)) {
-        SgVarRefExp *vref = isSgVarRefExp(nested_expr);
-        if (!IsRefToVar(isSgVarRefExp(nested_expr), loop_var)) {
-          // non loop var ref found; assumes non safe conditional
-          LOG_DEBUG() << "Non loop var found\n";
-          SgExpression *vdef =
-              GetDeterministicDefinition(vref->get_symbol()->get_declaration());
-          if (vdef) {
-            LOG_DEBUG() << "Deterministic def found\n";
-            si::replaceExpression(vref, si::copyExpression(vdef));
-          } else {
-            safe_to_opt = false;            
-            break;
-          }
-        } else {
-          if (loop_var_ref) {
-            // multiple references to loop var found; not assumed;
-            LOG_DEBUG() << "multiple var ref found\n";
-            safe_to_opt = false;
-            break;
-          } else {
-            loop_var_ref = isSgVarRefExp(nested_expr);
-          }
-        }
-      } else if (isSgValueExp(nested_expr) ||
-                 isSgAddOp(nested_expr) || isSgSubtractOp(nested_expr) ||
-                 isSgUnaryAddOp(nested_expr)) {
-        LOG_DEBUG() << "Valid expression: " <<
-            nested_expr->unparseToString() << "\n";
-        continue;
-      } else {
-        // not assumed expression
-        LOG_DEBUG() << "Having " << nested_expr->unparseToString()
-                    << " not assumed.\n";
-        break;
-      }
-    }
-    if (!safe_to_opt) {
-      LOG_DEBUG() << "Not possible to optimize\n";
-      continue;
-    }
-    // If no ref found, removing not possible
-    if (!loop_var_ref) {
-      LOG_DEBUG() << "No ref to loop var found; not possible to optimize\n";
+  FOREACH (it, exps.begin(), exps.end()) {
+    SgExpression *cmp = *it;
+    // The loop test is not a guard
+    if (si::isAncestor(loop->get_test(), cmp)) continue;
+    BoundaryPredicate pred;
+    if (!AnalyzeBoundaryPredicate(cmp, loop_var, dim, pred)) continue;
+    int evaluated_result = EvaluateBoundaryPredicate(
+        pred, peel_size_first, peel_size_last, peel_last_grid, kind);
+    if (evaluated_result < 0) {
+      LOG_DEBUG() << "Static evaluation not possible: "
+                  << cmp->unparseToString() << "\n";
       continue;
     }
-    SgExpression *v_expr = NULL, *c_expr = NULL;
-    PSAssert(FindExresssionReferencingLoopVar(bin_op, loop_var,
-                                              v_expr, c_expr) == 0);
-    LOG_DEBUG() << "v_expr: " << v_expr->unparseToString()
-                << ", c_expr: " << c_expr->unparseToString() << "\n";
-
-    //v_expr = si::copyExpression(v_expr);
-    //c_expr = si::copyExpression(c_expr);
-    SgBinaryOp *top_expr = bin_op;
-    // Move the terms other than loop var ref to RHS
-    while (true) {
-      if (isSgVarRefExp(v_expr) &&
-          IsRefToVar(isSgVarRefExp(v_expr), loop_var)) {
-        break;
-      } else if (isSgBinaryOp(v_expr)) {
-        SgExpression *v_expr_child = NULL;
-        SgExpression *c_expr_child = NULL;
-        PSAssert(FindExresssionReferencingLoopVar(isSgBinaryOp(v_expr), loop_var,
-                                                  v_expr_child, c_expr_child) == 0);
-        if (isSgAddOp(v_expr)) {
-          c_expr = sb::buildSubtractOp(c_expr, si::copyExpression(c_expr_child));
-        } else {
-          // subtract
-          if (v_expr_child == isSgSubtractOp(v_expr)->get_lhs_operand()) {
-            c_expr = sb::buildAddOp(c_expr, si::copyExpression(c_expr_child));
-          } else {
-            c_expr = sb::buildSubtractOp(c_expr, si::copyExpression(c_expr_child));
-            top_expr = FlipComparatorOp(top_expr);
-          }
-        }
-        v_expr = v_expr_child;
-      } else if (isSgUnaryAddOp(v_expr)) {
-        LOG_DEBUG() << "UnaryAdd: " << v_expr->unparseToString() << "\n";
-        v_expr = isSgUnaryAddOp(v_expr)->get_operand();
-        continue;
+    LOG_DEBUG() << "Replacing " << cmp->unparseToString()
+                << " with " << evaluated_result << "\n";
+    SgIfStmt *if_stmt = IsIfConditional(cmp);
+    if (if_stmt) {
+      // The taken body is moved, not copied, so that the
+      // comparisons in an else-if chain are found by the next query
+      SgStatement *body;
+      if (evaluated_result) {
+        body = if_stmt->get_true_body();
+        if_stmt->set_true_body(NULL);
       } else {
-        LOG_ERROR() << "Invalid AST node: " << v_expr->unparseToString() << "\n";
-        PSAbort(1);
+        body = if_stmt->get_false_body();
+        if_stmt->set_false_body(NULL);
       }
-    }
-    si::constantFolding(c_expr);
-    LOG_DEBUG() << "RHS: " << c_expr->unparseToString() << "\n";
-    LOG_DEBUG() << "OPERATOR: " << top_expr->unparseToString() << "\n";
-    int evaluated_result = Evaluate(top_expr, c_expr,
-                                    peel_size_first, peel_size_last,
-                                    kind, dim);
-    if (evaluated_result >= 0) {
-      LOG_DEBUG() << "Static evaluation done: " << evaluated_result << "\n";
-      LOG_DEBUG() << "Replacing " << bin_op->unparseToString()
-                  << " with " << evaluated_result << "\n";
-      SgIfStmt *if_stmt = IsIfConditional(*it);
-      if (if_stmt) {
-        if (evaluated_result) {
-          si::replaceStatement(if_stmt,
-                               si::copyStatement(if_stmt->get_true_body()),
-                               true);
-        } else {
-          si::replaceStatement(if_stmt,
-                               si::copyStatement(if_stmt->get_false_body()),
-                               true);
-        }
+      if (body) {
+        si::replaceStatement(if_stmt, body, true);
       } else {
-        si::replaceExpression(*it, evaluated_result? BuildTrue() : BuildFalse());
+        si::removeStatement(if_stmt);
       }
     } else {
-      LOG_DEBUG() << "Static evaluation not possible\n";
+      si::replaceExpression(cmp, evaluated_result ? BuildTrue() : BuildFalse());
     }
+    return true;
+  }
+  return false;
+}
+
+static void RemoveDeadConditional(SgForStatement *loop,
+                                  int dim,
+                                  int peel_size_first,
+                                  int peel_size_last,
+                                  SgInitializedName *peel_last_grid,
+                                  RunKernelLoopAttribute::Kind kind) {
+  // Folding may remove or expose other comparisons, so the loop is
+  // queried again after each folding until nothing changes
+  while (FoldBoundaryPredicate(loop, dim, peel_size_first,
+                               peel_size_last, peel_last_grid, kind)) {
   }
 }
 
 void loop_peeling(
     SgProject *proj,
     physis::translator::TranslationContext *tx,
-    physis::translator::RuntimeBuilder *builder) {
+    physis::translator::RuntimeBuilder *builder,
+    bool peel_outermost) {
   pre_process(proj, tx, __FUNCTION__);
 
-  vector<SgForStatement*> target_loops = FindInnermostLoops(proj);
+  // Loops of all dimensions are peeled, innermost first, so that
+  // guards on outer indices are resolved into boundary slabs of the
+  // outer loops. Loops copied by peeling are not peeled again. The
+  // outermost loops are skipped when peel_outermost is false.
+  std::vector<SgNode*> loops =
+      rose_util::QuerySubTreeAttribute<RunKernelLoopAttribute>(proj);
+  std::multimap<int, SgForStatement*> target_loops;
+  FOREACH (it, loops.begin(), loops.end()) {
+    SgForStatement *loop = isSgForStatement(*it);
+    PSAssert(loop);
+    if (!peel_outermost && IsOutermostLoop(loop)) continue;
+    target_loops.insert(std::make_pair(
+        rose_util::GetASTAttribute<RunKernelLoopAttribute>(loop)->dim(),
+        loop));
+  }
   
   FOREACH (it, target_loops.begin(), target_loops.end()) {
-    SgForStatement *target_loop = *it;
-    RunKernelLoopAttribute *loop_attr =
-        rose_util::GetASTAttribute<RunKernelLoopAttribute>(target_loop);
-    LOG_DEBUG() << "Loop dimension: " << loop_attr->dim() << "\n";
+    SgForStatement *target_loop = it->second;
+    LOG_DEBUG() << "Loop dimension: " << it->first << "\n";
     SgFunctionDeclaration *run_kernel_func =
         si::getEnclosingFunctionDeclaration(target_loop);
     PeelLoop(run_kernel_func, target_loop, builder);    
@@ -17,9 +17,39 @@ void MPIOptimizer::DoStage1() {
 }
 
 void MPIOptimizer::DoStage2() {
+  // The passes below build strides and periodic indices through the
+  // runtime builder, so they respect the halo-shifted local buffers.
   if (config_->LookupFlag("OPT_KERNEL_INLINING")) {
     pass::kernel_inlining(proj_, tx_, builder_);
   }
+  bool threads = config_->LookupFlag(Configuration::MPI_THREADS);
+  if (config_->LookupFlag("OPT_LOOP_PEELING")) {
+    // Peeling the outermost loops would leave the main loop with no
+    // initialization, which OpenMP cannot split
+    pass::loop_peeling(proj_, tx_, builder_, !threads);
+  }
+  // Unconditional get should be placed before register blocking
+  if (config_->LookupFlag("OPT_UNCONDITIONAL_GET")) {
+    pass::unconditional_get(proj_, tx_, builder_);
+  }
+  if (config_->LookupFlag("OPT_REGISTER_BLOCKING")) {
+    pass::register_blocking(proj_, tx_, builder_);
+  }
+  if (config_->LookupFlag("OPT_OFFSET_CSE")) {
+    pass::offset_cse(proj_, tx_, builder_);
+  }
+  if (config_->LookupFlag("OPT_OFFSET_SPATIAL_CSE")) {
+    pass::offset_spatial_cse(proj_, tx_, builder_);
+  }
+  if (config_->LookupFlag("OPT_LOOP_OPT")) {
+    pass::loop_opt(proj_, tx_, builder_);
+    pass::primitive_optimization(proj_, tx_, builder_);
+  }
+  // Parallelized last since the passes above copy and rewrite the
+  // loops
+  if (threads) {
+    pass::thread_parallel_loops(proj_, tx_, builder_);
+  }
 }
 
 } // namespace optimizer
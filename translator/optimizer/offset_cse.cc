@@ -112,15 +112,9 @@ static SgExpression *build_offset_periodic(SgExpression *offset_exp,
               << offset_periodic->unparseToString() << "\n";
 #else
   // Use modulus
-  SgExpression *x = sb::buildModOp(
-      sb::buildAddOp(offset_d,
-                     builder->BuildGridDim(
-                         si::copyExpression(gvref), dim)),
-      builder->BuildGridDim(
-          si::copyExpression(gvref), dim));
-  offset_periodic = sb::buildSubtractOp(
-      x,
-      si::copyExpression(extract_index_var(offset_d)));
+  offset_periodic = builder->BuildGridPeriodicDistance(
+      gvref, dim, si::copyExpression(extract_index_var(offset_d)),
+      offset_d);
 #endif
   LOG_DEBUG() << "Offset exp periodic: "
               << offset_periodic->unparseToString() << "\n";
@@ -162,7 +156,7 @@ static void replace_offset(SgVariableDeclaration *base_offset,
       }
       dim_offset = sb::buildMultiplyOp(
           dim_offset,
-          builder->BuildGridDim(
+          builder->BuildGridRealDim(
               si::copyExpression(gvref), i));
     }
     si::constantFolding(new_offset_expr);
@@ -239,6 +233,10 @@ static GridOffsetMap find_candidates(SgForStatement *loop) {
     GridOffsetAttribute *attr =
         rose_util::GetASTAttribute<GridOffsetAttribute>(offset_expr);
     PSAssert(attr);
+    if (!attr->linear()) {
+      LOG_DEBUG() << "Ignoring non-linear offset\n";
+      continue;
+    }
     SgVarRefExp *gref = GridOffsetAnalysis::GetGridVar(offset_expr);
     LOG_DEBUG() << "gref: " << gref->unparseToString() << "\n";
     SgVariableSymbol *vs = gref->get_symbol();
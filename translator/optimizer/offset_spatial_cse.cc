@@ -157,7 +157,8 @@ static void insert_offset_increment_stmt(SgVariableDeclaration *vdecl,
   ENUMERATE (i, it, sil->begin(), sil->end()) {
     const StencilIndex &si = *it;
     if (dim == si.dim) break;
-    SgExpression *d = builder->BuildGridDim(si::copyExpression(grid_ref), i+1);
+    SgExpression *d = builder->BuildGridRealDim(
+        si::copyExpression(grid_ref), i+1);
     increment = increment ? sb::buildMultiplyOp(increment, d) : d;
   }
   
@@ -171,24 +172,13 @@ static void insert_offset_increment_stmt(SgVariableDeclaration *vdecl,
         (SgExpression*)sb::buildAddOp(si::copyExpression(loop_var),
                                       sb::buildIntVal(offset)):
         (SgExpression*)si::copyExpression(loop_var);
-    SgExpression *e =
-        sb::buildModOp(
-            sb::buildAddOp(
-                sb::buildAddOp(offset_expr,
-                               sb::buildIntVal(rb? 2 : 1)),
-                builder->BuildGridDim(
-                    si::copyExpression(grid_ref), loop_attr->dim())),
-            builder->BuildGridDim(
-                si::copyExpression(grid_ref), loop_attr->dim()));
+    SgExpression *e = builder->BuildGridPeriodicIndex(
+        grid_ref, loop_attr->dim(),
+        sb::buildAddOp(offset_expr, sb::buildIntVal(rb? 2 : 1)));
     e = sb::buildSubtractOp(
         e,
-        sb::buildModOp(
-            sb::buildAddOp(
-                si::copyExpression(offset_expr),
-                builder->BuildGridDim(
-                    si::copyExpression(grid_ref), loop_attr->dim())),
-            builder->BuildGridDim(
-                si::copyExpression(grid_ref), loop_attr->dim())));
+        builder->BuildGridPeriodicIndex(
+            grid_ref, loop_attr->dim(), si::copyExpression(offset_expr)));
     increment = increment? sb::buildMultiplyOp(increment, e) : e;
   }
   // loop over the unit-stride dimension
@@ -358,6 +348,12 @@ void offset_spatial_cse(
                     << offset_expr->unparseToString() << "\n";
         continue;
       }
+      if (!rose_util::GetASTAttribute<GridOffsetAttribute>(
+              offset_expr)->linear()) {
+        LOG_DEBUG() << "Ignoring non-linear offset "
+                    << offset_expr->unparseToString() << "\n";
+        continue;
+      }
       PSAssert(offset_expr);
       do_offset_spatial_cse(offset_expr, target_loop, builder);
     }
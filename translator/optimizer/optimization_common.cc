@@ -44,6 +44,17 @@ vector<SgForStatement*> FindInnermostLoops(SgNode *proj) {
   return target_loops;
 }
 
+bool IsOutermostLoop(SgForStatement *loop) {
+  for (SgNode *p = loop->get_parent(); p && !isSgFunctionDefinition(p);
+       p = p->get_parent()) {
+    if (isSgForStatement(p) &&
+        rose_util::GetASTAttribute<RunKernelLoopAttribute>(p)) {
+      return false;
+    }
+  }
+  return true;
+}
+
 static SgInitializedName *GetVariable(SgVarRefExp *e) {
   return e->get_symbol()->get_declaration();
 }
@@ -109,13 +120,15 @@ void GetVariableSrc(SgInitializedName *v,
 static bool IsSafeToEliminate(SgExpression *exp) {
   LOG_DEBUG() << "Safe to eliminate?: " << exp->unparseToString() << "\n";
   
-  // Conservatively assumes func call except for PSGridDim is unsafe
+  // Conservatively assumes func call except for PSGridDim and
+  // __PSGridRealDim is unsafe
   const vector<SgFunctionCallExp*> &exprs
       = si::querySubTree<SgFunctionCallExp>(exp);
   FOREACH (it, exprs.begin(), exprs.end()) {
     SgFunctionCallExp *call = *it;
     std::string func_name = rose_util::getFuncName(call);
-    if (func_name != "PSGridDim") {
+    if (func_name != PS_GRID_DIM_NAME &&
+        func_name != PS_GRID_REAL_DIM_NAME) {
       return false;
     }
   }
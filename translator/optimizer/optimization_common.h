@@ -16,6 +16,9 @@ namespace optimizer {
 //! Find innermost kernel loops
 extern vector<SgForStatement*> FindInnermostLoops(SgNode *proj);
 
+//! Returns true if a kernel loop is not nested in another kernel loop
+extern bool IsOutermostLoop(SgForStatement *loop);
+
 //! Find expressions that are assigned to variable v
 extern void GetVariableSrc(SgInitializedName *v,
                            vector<SgExpression*> &src_exprs);
@@ -86,10 +86,17 @@ extern void kernel_inlining(
     physis::translator::TranslationContext *tx,
     physis::translator::RuntimeBuilder *builder);
 
+//! Peel boundary iterations of run kernel loops.
+/*!
+  \param peel_outermost False to leave the loops of the outermost
+  dimension intact so that they keep the canonical form required by
+  thread_parallel_loops.
+ */
 extern void loop_peeling(
     SgProject *proj,
     physis::translator::TranslationContext *tx,
-    physis::translator::RuntimeBuilder *builder);
+    physis::translator::RuntimeBuilder *builder,
+    bool peel_outermost=true);
 
 extern void register_blocking(
     SgProject *proj,
@@ -169,6 +176,18 @@ extern void loop_opt(
     physis::translator::TranslationContext *tx,
     physis::translator::RuntimeBuilder *builder);
 
+//! Parallelize the outermost loops of run kernels with OpenMP.
+/*!
+  A parallel-for pragma is put on the main loop of the outermost
+  dimension, and the induction variables of the inner loops are made
+  private. This must run after the loops are transformed by the other
+  passes.
+ */
+extern void thread_parallel_loops(
+    SgProject *proj,
+    physis::translator::TranslationContext *tx,
+    physis::translator::RuntimeBuilder *builder);
+
 } // namespace pass
 } // namespace optimizer
 } // namespace translator
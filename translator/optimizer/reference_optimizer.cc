@@ -30,6 +30,8 @@ void ReferenceOptimizer::DoStage2() {
   if (config_->LookupFlag("OPT_REGISTER_BLOCKING")) {
     pass::register_blocking(proj_, tx_, builder_);
   }
+  // Offsets of color-split grids are not linear in the indices, so
+  // they are skipped by the offset passes.
   if (config_->LookupFlag("OPT_OFFSET_CSE")) {
     pass::offset_cse(proj_, tx_, builder_);
   }
@@ -0,0 +1,91 @@
+// Copyright 2011-2012, RIKEN AICS.
+// All rights reserved.
+//
+// This file is distributed under the BSD license. See LICENSE.txt for
+// details.
+
+#include "translator/optimizer/optimization_passes.h"
+#include "translator/optimizer/optimization_common.h"
+#include "translator/rose_util.h"
+#include "translator/runtime_builder.h"
+#include "translator/translation_util.h"
+
+#include <algorithm>
+
+namespace si = SageInterface;
+namespace sb = SageBuilder;
+
+namespace physis {
+namespace translator {
+namespace optimizer {
+namespace pass {
+
+static void InsertParallelPragma(SgForStatement *loop) {
+  // Generate code like this
+  // #pragma omp parallel for schedule(static) private(j, i)
+  // for (k = ...) {
+  //   for (j = ...) {
+  //     for (i = ...) {
+  // The static schedule splits the slowest dimension the same way
+  // as the parallel first touch of grid buffers in the runtime, so
+  // each thread sweeps pages local to its NUMA node.
+  if (KernelLoopAnalysis::GetLoopBegin(loop) == NULL) {
+    LOG_WARNING() << "Loop without initialization not parallelized: "
+                  << loop->unparseToString() << "\n";
+    return;
+  }
+  // The inner loops, including the ones copied by peeling, share
+  // the induction variables
+  vector<string> private_vars;
+  vector<SgNode*> inner_loops =
+      rose_util::QuerySubTreeAttribute<RunKernelLoopAttribute>(
+          loop->get_loop_body());
+  FOREACH (it, inner_loops.begin(), inner_loops.end()) {
+    SgForStatement *inner_loop = isSgForStatement(*it);
+    PSAssert(inner_loop);
+    string name = KernelLoopAnalysis::GetLoopVar(inner_loop)->
+        get_symbol()->get_name().getString();
+    if (std::find(private_vars.begin(), private_vars.end(), name) ==
+        private_vars.end()) {
+      private_vars.push_back(name);
+    }
+  }
+  string pragma = "omp parallel for schedule(static)";
+  if (private_vars.size() > 0) {
+    pragma += " private(";
+    FOREACH (it, private_vars.begin(), private_vars.end()) {
+      if (it != private_vars.begin()) pragma += ", ";
+      pragma += *it;
+    }
+    pragma += ")";
+  }
+  LOG_DEBUG() << "Parallelizing loop with #pragma " << pragma << "\n";
+  si::insertStatementBefore(
+      loop, sb::buildPragmaDeclaration(pragma, si::getScope(loop)));
+}
+
+void thread_parallel_loops(
+    SgProject *proj,
+    physis::translator::TranslationContext *tx,
+    physis::translator::RuntimeBuilder *builder) {
+  pre_process(proj, tx, __FUNCTION__);
+
+  vector<SgNode*> loops =
+      rose_util::QuerySubTreeAttribute<RunKernelLoopAttribute>(proj);
+  FOREACH (it, loops.begin(), loops.end()) {
+    SgForStatement *loop = isSgForStatement(*it);
+    PSAssert(loop);
+    if (!rose_util::GetASTAttribute<RunKernelLoopAttribute>(loop)->IsMain() ||
+        !IsOutermostLoop(loop)) {
+      continue;
+    }
+    InsertParallelPragma(loop);
+  }
+
+  post_process(proj, tx, __FUNCTION__);
+}
+
+} // namespace pass
+} // namespace optimizer
+} // namespace translator
+} // namespace physis
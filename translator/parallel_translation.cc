@@ -0,0 +1,76 @@
+// Copyright 2011-2012, RIKEN AICS.
+// All rights reserved.
+//
+// This file is distributed under the BSD license. See LICENSE.txt for
+// details.
+
+#include "translator/parallel_translation.h"
+
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <iostream>
+#include <map>
+
+namespace physis {
+namespace translator {
+
+int TranslatePatterns(int npattern, int njobs,
+                      const boost::function<int (int)> &translate) {
+  if (njobs <= 1) {
+    for (int i = 0; i < npattern; ++i) {
+      int b = translate(i);
+      if (b) return b;
+    }
+    return 0;
+  }
+  LOG_INFO() << "Translating " << npattern << " patterns with "
+             << njobs << " workers\n";
+  std::map<pid_t, int> workers;
+  int next = 0;
+  int b = 0;
+  while (true) {
+    /* no new worker after a failure */
+    while (!b && next < npattern && (int)workers.size() < njobs) {
+      /* not to duplicate buffered output in the worker */
+      std::cerr.flush();
+      std::cout.flush();
+      fflush(NULL);
+      pid_t pid = fork();
+      if (pid == 0) {
+        int r = translate(next);
+        std::cerr.flush();
+        std::cout.flush();
+        fflush(NULL);
+        _exit(r ? 1 : 0);
+      }
+      if (pid < 0) {
+        LOG_ERROR() << next << ": Failed to fork a worker.\n";
+        b = 1;
+        break;
+      }
+      workers.insert(std::make_pair(pid, next++));
+    }
+    if (workers.empty()) break;
+    int status;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid < 0) {
+      if (errno == EINTR) continue;
+      LOG_ERROR() << "Failed to wait for workers.\n";
+      return 1;
+    }
+    std::map<pid_t, int>::iterator it = workers.find(pid);
+    if (it == workers.end()) continue;
+    if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+      LOG_ERROR() << it->second << ": Worker failure.\n";
+      b = 1;
+    }
+    workers.erase(it);
+  }
+  return b;
+}
+
+} // namespace translator
+} // namespace physis
@@ -0,0 +1,35 @@
+// Copyright 2011-2012, RIKEN AICS.
+// All rights reserved.
+//
+// This file is distributed under the BSD license. See LICENSE.txt for
+// details.
+
+#ifndef PHYSIS_TRANSLATOR_PARALLEL_TRANSLATION_H_
+#define PHYSIS_TRANSLATOR_PARALLEL_TRANSLATION_H_
+
+#include <boost/function.hpp>
+
+#include "translator/translator_common.h"
+
+namespace physis {
+namespace translator {
+
+//! Translates auto-tuning patterns, in worker processes if njobs > 1.
+/*!
+  Each worker is forked after the base code is generated, so it
+  starts from the parsed and analyzed AST and translates its pattern
+  independently of the others. Processes are used since ROSE is not
+  thread safe. No new worker is started after a failure.
+
+  \param npattern Number of patterns.
+  \param njobs Maximum number of concurrent workers.
+  \param translate Translation of a pattern, returning 0 upon success.
+  \return 0 upon success.
+ */
+int TranslatePatterns(int npattern, int njobs,
+                      const boost::function<int (int)> &translate);
+
+} // namespace translator
+} // namespace physis
+
+#endif /* PHYSIS_TRANSLATOR_PARALLEL_TRANSLATION_H_ */
@@ -30,6 +30,7 @@
 #define PS_DOMAIN_INTERNAL_TYPE_NAME "__PSDomain"
 #define PS_INDEX_TYPE_NAME "PSIndex"
 #define PS_GRID_DIM_NAME "PSGridDim"
+#define PS_GRID_REAL_DIM_NAME "__PSGridRealDim"
 #define PSF_GRID_NEW_NAME "PSGridNew"
 #define PS_GRID_GET_ID_NAME "__PSGridGetID"
 #define PSF_GRID_GET_ID_NAME "PSGridGetID"
@@ -4,8 +4,10 @@
 // This file is distributed under the BSD license. See LICENSE.txt for
 // details.
 
+#include <unistd.h>
 #include <boost/program_options.hpp>
 #include <boost/foreach.hpp>
+#include <boost/function.hpp>
 
 #include "translator/config.h"
 #include "translator/reference_translator.h"
@@ -42,6 +44,9 @@
 #include "translator/cuda_hm_runtime_builder.h"
 #endif
 #include "translator/fortran_output_fix.h"
+#include "translator/kernel_metadata.h"
+#include "translator/translation_cache.h"
+#include "translator/parallel_translation.h"
 
 using std::string;
 namespace bpo = boost::program_options;
@@ -64,6 +69,13 @@ struct CommandLineOptions {
   bool mpi_openmp_numa_trans;
   bool cuda_hm_trans;
   std::pair<bool, string> config_file_path;
+  //! Maximum number of worker processes translating auto-tuning
+  //! patterns; zero means the number of online processors
+  int num_jobs;
+  //! Cache directory of translated auto-tuning patterns
+  string cache_dir;
+  //! Writes the cost model of each stencil map
+  bool kernel_metadata;
   CommandLineOptions(): ref_trans(false), cuda_trans(false),
                         mpi_trans(false),
                         //mpi2_trans(false),
@@ -73,7 +85,8 @@ struct CommandLineOptions {
                         mpi_openmp_trans(false),
                         mpi_openmp_numa_trans(false),
                         cuda_hm_trans(false),
-                        config_file_path(std::make_pair(false, "")) {}
+                        config_file_path(std::make_pair(false, "")),
+                        num_jobs(0), kernel_metadata(false) {}
 };
 
 void parseOptions(int argc, char *argv[], CommandLineOptions &opts,
@@ -83,6 +96,13 @@ void parseOptions(int argc, char *argv[], CommandLineOptions &opts,
   desc.add_options()("help", "Produce help message");
   desc.add_options()("config", bpo::value<string>(),
                      "Read configuration file");
+  desc.add_options()("jobs", bpo::value<int>(),
+                     "Number of processes translating auto-tuning patterns");
+  desc.add_options()("cache-dir", bpo::value<string>(),
+                     "Cache translated auto-tuning patterns in a directory");
+  desc.add_options()("kernel-metadata",
+                     "Write the cost model of each stencil map to "
+                     "<source>.<target>.kernels.lua");
   desc.add_options()("ref", "Reference translation");
 #ifdef CUDA_TRANSLATOR_ENABLED  
   desc.add_options()("cuda", "CUDA translation");
@@ -135,6 +155,18 @@ void parseOptions(int argc, char *argv[], CommandLineOptions &opts,
                 << opts.config_file_path.second << ".\n";    
   }
 
+  if (vm.count("jobs")) {
+    opts.num_jobs = vm["jobs"].as<int>();
+  }
+
+  if (vm.count("cache-dir")) {
+    opts.cache_dir = vm["cache-dir"].as<string>();
+  }
+
+  if (vm.count("kernel-metadata")) {
+    opts.kernel_metadata = true;
+  }
+
   if (vm.count("ref")) {
     LOG_DEBUG() << "Reference translation.\n";
     opts.ref_trans = true;
@@ -246,11 +278,17 @@ void set_output_filename(SgFile *file, string suffix) {
 }
 
 static pt::RuntimeBuilder *GetRTBuilder(SgProject *proj,
-                                        CommandLineOptions &opts) {
+                                        CommandLineOptions &opts,
+                                        pt::Configuration &config) {
   pt::RuntimeBuilder *builder = NULL;
   SgScopeStatement *gs = si::getFirstGlobalScope(proj);
   if (opts.ref_trans) {
-    builder = new pt::ReferenceRuntimeBuilder(gs);
+    double soa_lanes = 0;
+    config.Lookup("SOA_LANE_WIDTH", soa_lanes);
+    builder = new pt::ReferenceRuntimeBuilder(
+        gs, config.LookupFlag(pt::Configuration::RED_BLACK_COLOR_SPLIT),
+        config.LookupFlag(pt::Configuration::SOA_LAYOUT),
+        (int)soa_lanes);
   } else if (opts.cuda_trans) {
     builder = new pt::CUDARuntimeBuilder(gs);
 #ifdef CUDA_HM_TRANSLATOR_ENABLED    
@@ -258,7 +296,11 @@ static pt::RuntimeBuilder *GetRTBuilder(SgProject *proj,
     builder = new pt::CUDAHMRuntimeBuilder(gs);
 #endif    
   } else if (opts.mpi_trans) {
-    builder = new pt::MPIRuntimeBuilder(gs);
+    double soa_lanes = 0;
+    config.Lookup("SOA_LANE_WIDTH", soa_lanes);
+    builder = new pt::MPIRuntimeBuilder(
+        gs, config.LookupFlag(pt::Configuration::SOA_LAYOUT),
+        (int)soa_lanes);
   // } else if (opts.mpi2_trans) {
   //   builder = new pt::MPIRuntimeBuilder(gs);
 #ifdef MPI_CUDA_TRANSLATOR_ENABLED    
@@ -427,6 +469,64 @@ static void SetDynamicLinkLib(
   si::prependStatement(vdecl, sc);
   si::attachArbitraryText(vdecl, "#include <dlfcn.h>");
 }
+/** translator of a pattern into a dynamic link library source,
+ *  used after the base code is generated
+ */
+struct PatternTranslator {
+  SgProject *proj;
+  SgFile *file;  /* main source file */
+  TranslationContext *tx;
+  RuntimeBuilder *rt_builder;
+  CommandLineOptions *opts;
+  Configuration *config;
+  std::vector<SgFunctionDeclaration *> *orig;  /* original kernel functions */
+  string dl_filename_suffix;
+  TranslationCache *cache;
+  /** translate a pattern
+   * @param[in] i ... index of pattern
+   * @return    0 upon success
+   */
+  int operator()(int i) const {
+    config->SetPat(i);
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%05d.", i);
+    set_output_filename(file, buf + dl_filename_suffix);
+    std::ostringstream pattern;
+    config->PrintPattern(pattern);
+    if (cache->Fetch(pattern.str(), file->get_unparse_output_filename())) {
+      LOG_INFO() << i << ": Reusing cached translation.\n";
+      return 0;
+    }
+    ReplaceCloneRunKernelFunc(proj, *orig);
+
+    pto::Optimizer *optimizer = GetOptimizer(tx, proj, rt_builder,
+                                             *opts, config);
+    LOG_INFO() << i << ":Performing optimization Stage 2\n";
+    optimizer->Stage2();
+    LOG_INFO() << i << ":Optimization Stage 2 done\n";
+    delete optimizer;
+
+#if 1 /* add optimize parameter as comment */
+    string debug_comment = "\n";
+    for (int ii = 0; !config->at_params_pattern[ii].empty(); ++ii) {
+      snprintf(buf, sizeof(buf), "  %s = %d\n",
+               config->at_params_pattern[ii].c_str(),
+               config->LookupFlag(config->at_params_pattern[ii]));
+      debug_comment += buf;
+    }
+    si::attachComment(si::getLastStatement(si::getFirstGlobalScope(proj)),
+                      debug_comment, PreprocessingInfo::after);
+#endif
+    int b = backend(proj);  /* optimized kernel function */
+    LOG_INFO() << i << ": Code generation complete.\n";
+    if (b) {
+      LOG_ERROR() << i << ": Backend failure.\n";
+      return b;
+    }
+    cache->Store(pattern.str(), file->get_unparse_output_filename());
+    return 0;
+  }
+};
 
 } // namespace translator
 } // namespace physis
@@ -582,7 +682,14 @@ int main(int argc, char *argv[]) {
   }
 
   pt::TranslationContext tx(proj);
-  pt::RuntimeBuilder *rt_builder = GetRTBuilder(proj, opts);
+  // Static cost model of each stencil map, used by profiling tools
+  if (opts.kernel_metadata) {
+    pt::WriteKernelMetadata(
+        tx, pt::generate_output_filename(
+            GetMainSourceFile(proj)->get_sourceFileNameWithoutPath(),
+            filename_target_suffix + ".kernels.lua"));
+  }
+  pt::RuntimeBuilder *rt_builder = GetRTBuilder(proj, opts, config);
   pto::Optimizer *optimizer =
       GetOptimizer(&tx, proj, rt_builder, opts, &config);
   
@@ -618,40 +725,33 @@ int main(int argc, char *argv[]) {
       return b;
     }
 
-    /* output dynamic link libraries */
-    for (int i = 0; i < config.npattern(); ++i) {
-      pt::ReplaceCloneRunKernelFunc(proj, orig);
-      config.SetPat(i);
-
-      optimizer = GetOptimizer(&tx, proj, rt_builder, opts, &config);
-      LOG_INFO() << i << ":Performing optimization Stage 2\n";
-      optimizer->Stage2();
-      LOG_INFO() << i << ":Optimization Stage 2 done\n";
-      delete optimizer;
-
-      char buf[32];
-#if 1 /* add optimize parameter as comment */
-      string debug_comment = "\n";
-      for (int ii = 0; !config.at_params_pattern[ii].empty(); ++ii) {
-        snprintf(buf, sizeof(buf), "  %s = %d\n",
-                 config.at_params_pattern[ii].c_str(),
-                 config.LookupFlag(config.at_params_pattern[ii]));
-        debug_comment += buf;
-      }
-      si::attachComment(si::getLastStatement(si::getFirstGlobalScope(proj)),
-                        debug_comment, PreprocessingInfo::after);
-#endif
-      snprintf(buf, sizeof(buf), "%05d.", i);
-      pt::set_output_filename(GetMainSourceFile(proj),
-                              buf + dl_filename_suffix);
-      b = backend(proj);  /* optimized kernel function */
-      LOG_INFO() << i << ": Code generation complete.\n";
-      if (b) {
-        LOG_ERROR() << i << ": Backend failure.\n";
-        trans->Finish();
-        return b;
+    /* Patterns are cached by the code common to them and their
+       configuration values */
+    pt::TranslationCache cache(opts.cache_dir);
+    if (cache.enabled()) {
+      cache.AddKey(dl_filename_suffix);
+      cache.AddFileKey(
+          GetMainSourceFile(proj)->get_unparse_output_filename());
+      FOREACH (it, orig.begin(), orig.end()) {
+        cache.AddKey((*it)->unparseToString());
       }
     }
+
+    /* output dynamic link libraries */
+    pt::PatternTranslator pat_trans;
+    pat_trans.proj = proj;
+    pat_trans.file = GetMainSourceFile(proj);
+    pat_trans.tx = &tx;
+    pat_trans.rt_builder = rt_builder;
+    pat_trans.opts = &opts;
+    pat_trans.config = &config;
+    pat_trans.orig = &orig;
+    pat_trans.dl_filename_suffix = dl_filename_suffix;
+    pat_trans.cache = &cache;
+    int njobs = opts.num_jobs;
+    if (njobs <= 0) njobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    njobs = std::min(njobs, config.npattern());
+    b = pt::TranslatePatterns(config.npattern(), njobs, pat_trans);
     LOG_DEBUG() << "AT code generation done.\n";
     trans->Finish();
     return b;
@@ -21,8 +21,10 @@ namespace physis {
 namespace translator {
 
 ReferenceRuntimeBuilder::ReferenceRuntimeBuilder(
-    SgScopeStatement *global_scope):
-    RuntimeBuilder(global_scope) {
+    SgScopeStatement *global_scope, bool color_split, bool soa,
+    int soa_lanes):
+    RuntimeBuilder(global_scope), color_split_(color_split),
+    soa_(soa), soa_lanes_(soa_lanes) {
   dom_type_ = isSgTypedefType(
       si::lookupNamedTypeInParentScopes(PS_DOMAIN_INTERNAL_TYPE_NAME,
                                         gs_));
@@ -69,6 +71,14 @@ SgBasicBlock *ReferenceRuntimeBuilder::BuildGridSet(
   return tb;
 }
 
+// Kernels read out-of-place grids from the snapshot taken by
+// __PSGridSnapshot, which is p1. It is the same as p0 when no
+// snapshot is taken.
+string ReferenceRuntimeBuilder::GetReadBufferName(GridVarAttribute *gva,
+                                                  bool is_kernel) {
+  return (is_kernel && gva && gva->out_of_place()) ? "p1" : "p0";
+}
+
 SgExpression *ReferenceRuntimeBuilder::BuildGridGet(
     SgExpression *gvref,
     GridVarAttribute *gva,
@@ -81,7 +91,7 @@ SgExpression *ReferenceRuntimeBuilder::BuildGridGet(
       BuildGridOffset(gvref, gt->rank(), offset_exprs,
                       is_kernel, is_periodic, sil);
   gvref = si::copyExpression(gvref);
-  SgExpression *field = sb::buildVarRefExp("p0");
+  SgExpression *field = sb::buildVarRefExp(GetReadBufferName(gva, is_kernel));
   SgExpression *p0 =
       (si::isPointerType(gvref->get_type())) ?
       isSgExpression(sb::buildArrowExp(gvref, field)) :
@@ -96,6 +106,59 @@ SgExpression *ReferenceRuntimeBuilder::BuildGridGet(
   return p0;
 }
 
+bool ReferenceRuntimeBuilder::IsSoA(const GridType *gt) const {
+  return soa_ && gt->IsUserDefinedPointType();
+}
+
+static SgType *GetPointMemberType(GridType *gt, const string &name) {
+  const SgDeclarationStatementPtrList &members =
+      gt->point_def()->get_members();
+  FOREACH (it, members.begin(), members.end()) {
+    SgVariableDeclaration *member_decl = isSgVariableDeclaration(*it);
+    if (member_decl && ru::GetName(member_decl) == name) {
+      return ru::GetType(member_decl);
+    }
+  }
+  LOG_ERROR() << "Member not found: " << name << "\n";
+  PSAbort(1);
+  return NULL;
+}
+
+SgExpression *ReferenceRuntimeBuilder::BuildGridSoAMember(
+    SgExpression *gvref, GridType *gt, SgExpression *offset,
+    const string &member_name, const string &buf_name) {
+  /*
+    *(type *)((char *)g->p0 + __PSGridSoAOffset(g, offset,
+                                                member_offset,
+                                                member_size))
+  */
+  SgType *member_type = GetPointMemberType(gt, member_name);
+  SgExpression *field = sb::buildVarRefExp(buf_name);
+  SgExpression *p0 =
+      (si::isPointerType(gvref->get_type())) ?
+      isSgExpression(sb::buildArrowExp(si::copyExpression(gvref), field)) :
+      isSgExpression(sb::buildDotExp(si::copyExpression(gvref), field));
+  p0 = sb::buildCastExp(p0, sb::buildPointerType(sb::buildCharType()));
+  if (!si::isPointerType(gvref->get_type())) {
+    gvref = sb::buildAddressOfOp(gvref);
+  }
+  SgExprListExp *args = sb::buildExprListExp(
+      gvref, offset, BuildPointMemberOffset(gt, member_name),
+      sb::buildSizeOfOp(member_type));
+  string func_name = "__PSGridSoAOffset";
+  if (soa_lanes_ > 0) {
+    func_name = "__PSGridAoSoAOffset";
+    si::appendExpression(args, sb::buildIntVal(soa_lanes_));
+  }
+  SgFunctionSymbol *fs
+      = si::lookupFunctionSymbolInParentScopes(func_name, gs_);
+  PSAssert(fs);
+  SgExpression *x = sb::buildAddOp(
+      p0, sb::buildFunctionCallExp(fs, args));
+  x = sb::buildCastExp(x, sb::buildPointerType(member_type));
+  return sb::buildPointerDerefExp(x);
+}
+
 SgExpression *ReferenceRuntimeBuilder::BuildGridGet(
     SgExpression *gvref,
     GridVarAttribute *gva,    
@@ -105,6 +168,18 @@ SgExpression *ReferenceRuntimeBuilder::BuildGridGet(
     bool is_kernel,
     bool is_periodic,
     const string &member_name) {
+  if (IsSoA(gt)) {
+    SgExpression *offset =
+        BuildGridOffset(gvref, gt->rank(), offset_exprs,
+                        is_kernel, is_periodic, sil);
+    SgExpression *x = BuildGridSoAMember(
+        si::copyExpression(gvref), gt, offset, member_name,
+        GetReadBufferName(gva, is_kernel));
+    GridGetAttribute *gga = new GridGetAttribute(
+        gt, NULL, gva, is_kernel, is_periodic, sil, member_name);
+    ru::AddASTAttribute<GridGetAttribute>(x, gga);
+    return x;
+  }
   SgExpression *x = BuildGridGet(gvref, gva, gt, offset_exprs,
                                  sil, is_kernel,
                                  is_periodic);
@@ -151,6 +226,24 @@ SgExpression *ReferenceRuntimeBuilder::BuildGridEmit(
   int nd = attr->gt()->rank();
   StencilIndexList sil;
   StencilIndexListInitSelf(sil, nd);
+  if (IsSoA(attr->gt())) {
+    if (!attr->is_member_access()) {
+      LOG_ERROR() << "Emitting whole points not supported in the SoA layout: "
+                  << attr->gv()->get_name().getString() << "\n";
+      PSAbort(1);
+    }
+    SgExpression *offset = BuildGridOffset(
+        si::copyExpression(grid_exp),
+        nd, offset_exprs, true, false, &sil);
+    SgExpression *lhs = BuildGridSoAMember(grid_exp, attr->gt(), offset,
+                                           attr->member_name());
+    const vector<string> &array_offsets = attr->array_offsets();
+    FOREACH (it, array_offsets.begin(), array_offsets.end()) {
+      SgExpression *e = ru::ParseString(*it, scope);
+      lhs = sb::buildPntrArrRefExp(lhs, e);
+    }
+    return sb::buildAssignOp(lhs, emit_val);
+  }
   string dst_buf_name = "p0";
   SgExpression *p1 =
       sb::buildArrowExp(grid_exp, sb::buildVarRefExp(dst_buf_name));
@@ -192,6 +285,16 @@ SgFunctionCallExp *ReferenceRuntimeBuilder::BuildGridDim(
   return grid_dim;
 }
 
+SgExpression *ReferenceRuntimeBuilder::BuildGridPeriodicIndex(
+    SgExpression *grid_ref, int dim, SgExpression *index) {
+  SgFunctionSymbol *fs
+      = si::lookupFunctionSymbolInParentScopes("__PSWrapIndex", gs_);
+  PSAssert(fs);
+  SgExprListExp *args = sb::buildExprListExp(
+      index, BuildGridDim(si::copyExpression(grid_ref), dim));
+  return sb::buildFunctionCallExp(fs, args);
+}
+
 SgExpression *ReferenceRuntimeBuilder::BuildGridRefInRunKernel(
     SgInitializedName *gv,
     SgFunctionDeclaration *run_kernel) {
@@ -217,6 +320,31 @@ SgExpression *ReferenceRuntimeBuilder::BuildGridRefInRunKernel(
   return grid_ref;
 }
 
+// Grids are referenced either with a variable, or with a field of
+// the stencil struct in run kernels, possibly with address-of and
+// casts.
+static SgInitializedName *GetGridVarFromRef(SgExpression *gvref) {
+  while (true) {
+    if (isSgCastExp(gvref) || isSgAddressOfOp(gvref)) {
+      gvref = isSgUnaryOp(gvref)->get_operand();
+    } else if (isSgArrowExp(gvref) || isSgDotExp(gvref)) {
+      gvref = isSgBinaryOp(gvref)->get_rhs_operand();
+    } else {
+      break;
+    }
+  }
+  if (!isSgVarRefExp(gvref)) return NULL;
+  return si::convertRefToInitializedName(isSgVarRefExp(gvref));
+}
+
+bool ReferenceRuntimeBuilder::IsColorSplit(SgExpression *gvref) {
+  if (!color_split_) return false;
+  SgInitializedName *gv = GetGridVarFromRef(gvref);
+  GridVarAttribute *gva =
+      gv ? ru::GetASTAttribute<GridVarAttribute>(gv) : NULL;
+  return gva && gva->color_split();
+}
+
 SgExpression *ReferenceRuntimeBuilder::BuildGridOffset(
     SgExpression *gvref,
     int num_dim,
@@ -228,6 +356,11 @@ SgExpression *ReferenceRuntimeBuilder::BuildGridOffset(
     __PSGridGetOffsetND(g, i)
   */
   std::string func_name = "__PSGridGetOffset";
+  bool linear = true;
+  if (IsColorSplit(gvref)) {
+    func_name += "ColorSplit";
+    linear = false;
+  }
   if (is_periodic) func_name += "Periodic";
   func_name += toString(num_dim) + "D";
   if (!si::isPointerType(gvref->get_type())) {
@@ -244,7 +377,7 @@ SgExpression *ReferenceRuntimeBuilder::BuildGridOffset(
       sb::buildFunctionCallExp(fs, offset_params);
   ru::AddASTAttribute<GridOffsetAttribute>(
       offset_fc, new GridOffsetAttribute(
-          num_dim, is_periodic, sil));
+          num_dim, is_periodic, sil, linear));
   return offset_fc;
 }
 
@@ -357,6 +490,26 @@ SgExpression *ReferenceRuntimeBuilder::BuildStencilFieldRef(
 }
 
 
+SgExpression *ReferenceRuntimeBuilder::BuildStencilDomOwnsFace(
+    SgExpression *stencil, int dim, bool fw) {
+  // __PSDomainOwnsFace(&s->dom, dim - 1, fw)
+  SgFunctionSymbol *fs
+      = si::lookupFunctionSymbolInParentScopes("__PSDomainOwnsFace", gs_);
+  PSAssert(fs);
+  SgExpression *dom = BuildStencilFieldRef(stencil, GetStencilDomName());
+  SgExprListExp *args = sb::buildExprListExp(
+      sb::buildAddressOfOp(dom), sb::buildIntVal(dim - 1),
+      sb::buildIntVal(fw ? 1 : 0));
+  return sb::buildFunctionCallExp(fs, args);
+}
+
+SgExpression *ReferenceRuntimeBuilder::BuildStencilDomMaskRef(
+    SgExpression *stencil) {
+  // s.dom.mask
+  return BuildDomFieldRef(
+      BuildStencilFieldRef(stencil, GetStencilDomName()), "mask");
+}
+
 SgExpression *ReferenceRuntimeBuilder::BuildStencilDomMinRef(
     SgExpression *stencil) {
   SgExpression *exp =
@@ -432,11 +585,18 @@ SgClassDeclaration *ReferenceRuntimeBuilder::BuildStencilMapType(StencilMap *s)
   FOREACH(it, arg_begin, args.end()) {
     SgInitializedName *a = *it;
     SgType *type = a->get_type();
-    si::appendStatement(
-        ru::BuildVariableDeclaration(a->get_name(),
-                                     type, NULL, def),
-        def);
+    SgVariableDeclaration *field_decl =
+        ru::BuildVariableDeclaration(a->get_name(), type, NULL, def);
+    si::appendStatement(field_decl, def);
     if (GridType::isGridType(type)) {
+      // Grid references in run kernels are of the fields, which
+      // have the same layout as the kernel parameters
+      GridVarAttribute *gva = ru::GetASTAttribute<GridVarAttribute>(a);
+      if (gva && gva->color_split()) {
+        GridVarAttribute *field_gva = gva->copy();
+        ru::AddASTAttribute<GridVarAttribute>(
+            field_decl->get_variables()[0], field_gva);
+      }
       si::appendStatement(
           ru::BuildVariableDeclaration(
               a->get_name() + "_index",
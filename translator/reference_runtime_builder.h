@@ -18,7 +18,20 @@ namespace translator {
 
 class ReferenceRuntimeBuilder: public RuntimeBuilder {
  public:
-  ReferenceRuntimeBuilder(SgScopeStatement *global_scope);
+  //! Constructor.
+  /*!
+    \param global_scope Global scope.
+    \param color_split True if grids of red-black stencils store red
+    and black points in separate arrays.
+    \param soa True if grids of user-defined point types are stored
+    in the SoA layout.
+    \param soa_lanes Number of points interleaved per member in the
+    SoA layout; zero means the whole grid.
+   */
+  ReferenceRuntimeBuilder(SgScopeStatement *global_scope,
+                          bool color_split=false,
+                          bool soa=false,
+                          int soa_lanes=0);
   virtual ~ReferenceRuntimeBuilder() {}
   virtual SgFunctionCallExp *BuildGridGetID(SgExpression *grid_var);
   virtual SgBasicBlock *BuildGridSet(
@@ -26,6 +39,13 @@ class ReferenceRuntimeBuilder: public RuntimeBuilder {
       const SgExpressionPtrList &indices, SgExpression *val);
   virtual SgFunctionCallExp *BuildGridDim(SgExpression *grid_ref,
                                           int dim);
+  //! Build __PSWrapIndex(index, PSGridDim(grid_ref, dim - 1)).
+  /*!
+    Compares and adds instead of the integer division of the default.
+   */
+  virtual SgExpression *BuildGridPeriodicIndex(SgExpression *grid_ref,
+                                               int dim,
+                                               SgExpression *index);
   virtual SgExpression *BuildGridRefInRunKernel(
       SgInitializedName *gv,
       SgFunctionDeclaration *run_kernel);
@@ -129,16 +149,52 @@ class ReferenceRuntimeBuilder: public RuntimeBuilder {
       SgExpression *stencil);
   virtual SgExpression *BuildStencilDomMaxRef(
       SgExpression *stencil, int dim);
+  //! Build an expression telling if the process owns a domain face.
+  /*!
+    The local part of a domain is either the part in the process or
+    a brick of a masked domain, so the face is tested at runtime.
+   */
+  virtual SgExpression *BuildStencilDomOwnsFace(SgExpression *stencil,
+                                                int dim, bool fw);
+  virtual SgExpression *BuildStencilDomMaskRef(SgExpression *stencil);
   
   virtual SgClassDeclaration *BuildStencilMapType(StencilMap *s);
   virtual SgFunctionDeclaration *BuildMap(StencilMap *stencil);
   
  protected:
   static const std::string  grid_type_name_;
+  bool color_split_;
+  bool soa_;
+  int soa_lanes_;
   SgTypedefType *dom_type_;
+  //! Returns true if a grid reference is of a color-split grid.
+  bool IsColorSplit(SgExpression *gvref);
   SgClassDeclaration *GetGridDecl();
   virtual SgExpression *BuildDomFieldRef(SgExpression *domain,
                                          string fname);
+  //! Returns true if grids of a type are stored in the SoA layout.
+  bool IsSoA(const GridType *gt) const;
+  //! Build an access to a member of a point in the SoA layout.
+  /*!
+    \param gvref Grid reference.
+    \param gt Grid type.
+    \param offset Element offset of the point.
+    \param member_name Name of the member.
+    \param buf_name Name of the buffer field to read.
+    \return Expression like "*(type *)((char *)g->p0 + __PSGridSoAOffset(...))".
+   */
+  virtual SgExpression *BuildGridSoAMember(SgExpression *gvref,
+                                           GridType *gt,
+                                           SgExpression *offset,
+                                           const string &member_name,
+                                           const string &buf_name="p0");
+  //! Returns the name of the buffer field a get reads.
+  /*!
+    \param gva Attribute of the grid variable; may be NULL.
+    \param is_kernel True if the get is in a kernel.
+    \return "p1" for out-of-place grids in kernels; "p0" otherwise.
+   */
+  virtual string GetReadBufferName(GridVarAttribute *gva, bool is_kernel);
   
   
 };
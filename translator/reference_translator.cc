@@ -12,10 +12,13 @@
 #include "translator/rose_util.h"
 #include "translator/ast_processing.h"
 #include "translator/translation_context.h"
+#include "translator/translation_util.h"
 #include "translator/reference_runtime_builder.h"
 #include "translator/runtime_builder.h"
 #include "translator/physis_names.h"
 #include "translator/rose_fortran.h"
+#include "translator/kernel_metadata.h"
+#include "translator/stencil_analysis.h"
 
 namespace si = SageInterface;
 namespace sb = SageBuilder;
@@ -28,16 +31,118 @@ namespace translator {
 ReferenceTranslator::ReferenceTranslator(const Configuration &config):
     Translator(config),
     flag_constant_grid_size_optimization_(true),
+    flag_non_temporal_store_(false),
+    soa_layout_(false),
+    soa_lane_width_(0),
+    flag_boundary_face_loops_(false),
+    flag_masked_domains_(false),
     validate_ast_(true),
-    grid_create_name_("__PSGridNew") {
+    fused_reduce_(NULL),
+    grid_create_name_("__PSGridNew"),
+    soa_grid_create_name_("__PSGridNewSoA"),
+    color_split_layout_(false) {
   target_specific_macro_ = "PHYSIS_REF";
 }
 
 ReferenceTranslator::~ReferenceTranslator() {
 }
 
+// Returns the parameter of the last stencil in a run that emits the
+// grid reduced by rd, or NULL if there is no such parameter.
+static SgInitializedName *FindReducedGridParam(Run *run, Reduce *rd,
+                                               TranslationContext *tx) {
+  StencilMap *s = run->stencils().back().second;
+  SgInitializedName *gv = rd->GetGrid()->get_symbol()->get_declaration();
+  Kernel *k = tx->findKernel(s->getKernel());
+  PSAssert(k);
+  for (unsigned i = 0; i < s->grid_args().size(); ++i) {
+    if (s->grid_args()[i] == gv &&
+        k->isGridParamModified(s->grid_params()[i])) {
+      return s->grid_params()[i];
+    }
+  }
+  return NULL;
+}
+
 void ReferenceTranslator::Translate() {
   defineMacro(target_specific_macro_);
+
+  // Color-split storage is only supported by the reference runtime
+  if (target_specific_macro_ == "PHYSIS_REF" &&
+      config_.LookupFlag(Configuration::RED_BLACK_COLOR_SPLIT)) {
+    LOG_INFO() << "Red-black grids stored in color-split layout\n";
+    color_split_layout_ = true;
+    AnalyzeColorSplitGrids(*tx_);
+  }
+
+  // Snapshots are only taken by the CPU runtimes. Kernels that update
+  // a grid in place with neighbor reads keep reading the single
+  // buffer unless snapshots are requested.
+  if ((target_specific_macro_ == "PHYSIS_REF" ||
+       target_specific_macro_ == "PHYSIS_MPI") &&
+      ru::IsCLikeLanguage()) {
+    bool snapshot =
+        config_.LookupFlag(Configuration::SNAPSHOT_IN_PLACE_UPDATES);
+    FOREACH (it, tx_->mapBegin(), tx_->mapEnd()) {
+      AnalyzeInPlaceUpdate(*(it->second), *tx_, snapshot);
+    }
+  }
+
+  // Scratch grids are only supported by the reference runtime, and
+  // only in the plain row-major layout
+  if (target_specific_macro_ == "PHYSIS_REF" && ru::IsCLikeLanguage()) {
+    AnalyzeScratchGrids(*tx_);
+  }
+
+  // Non-temporal stores are only supported by the CPU runtimes
+  if ((target_specific_macro_ == "PHYSIS_REF" ||
+       target_specific_macro_ == "PHYSIS_MPI" ||
+       target_specific_macro_ == "PHYSIS_MPI_OPENMP") &&
+      ru::IsCLikeLanguage() &&
+      config_.LookupFlag(Configuration::NON_TEMPORAL_STORE)) {
+    LOG_INFO() << "Write-only grids emitted with non-temporal stores\n";
+    flag_non_temporal_store_ = true;
+    // Kernels are translated before the runs, so the grids reduced by
+    // fused reductions are found in advance
+    if (target_specific_macro_ == "PHYSIS_REF" && !config_.auto_tuning()) {
+      FOREACH (it, tx_->run_map().begin(), tx_->run_map().end()) {
+        Reduce *rd = FindFusableReduce(it->first, it->second);
+        if (rd) {
+          fused_reduce_grids_.insert(
+              FindReducedGridParam(it->second, rd, tx_));
+        }
+      }
+    }
+  }
+
+  // Boundary face loops are only generated by the CPU run kernels
+  // built with BuildRunKernel
+  if ((target_specific_macro_ == "PHYSIS_REF" ||
+       target_specific_macro_ == "PHYSIS_MPI") &&
+      ru::IsCLikeLanguage()) {
+    flag_boundary_face_loops_ = true;
+  }
+
+  // Masked domains are only supported by the CPU runtimes
+  if ((target_specific_macro_ == "PHYSIS_REF" ||
+       target_specific_macro_ == "PHYSIS_MPI") &&
+      ru::IsCLikeLanguage()) {
+    flag_masked_domains_ = true;
+  }
+
+  // SoA storage is only supported by the CPU runtimes
+  if ((target_specific_macro_ == "PHYSIS_REF" ||
+       target_specific_macro_ == "PHYSIS_MPI") &&
+      ru::IsCLikeLanguage() &&
+      config_.LookupFlag(Configuration::SOA_LAYOUT)) {
+    double lanes;
+    if (config_.Lookup("SOA_LANE_WIDTH", lanes)) {
+      soa_lane_width_ = (int)lanes;
+    }
+    LOG_INFO() << "User-defined point types stored in SoA layout"
+               << " (lane width: " << soa_lane_width_ << ")\n";
+    soa_layout_ = true;
+  }
   
   FOREACH(it, tx_->gridTypeBegin(),
           tx_->gridTypeEnd()) {
@@ -183,6 +288,15 @@ void ReferenceTranslator::appendNewArgExtra(SgExprListExp *args,
   return;
 }
 
+void ReferenceTranslator::appendNewArgSoA(
+    SgExprListExp *args, int grid_layout, int num_members,
+    SgVariableDeclaration *layout_decl) {
+  si::appendExpression(args, sb::buildIntVal(grid_layout));
+  si::appendExpression(args, sb::buildIntVal(soa_lane_width_));
+  si::appendExpression(args, sb::buildIntVal(num_members));
+  si::appendExpression(args, sb::buildVarRefExp(layout_decl));
+}
+
 void ReferenceTranslator::TranslateNew(SgFunctionCallExp *node,
                                        GridType *gt) {
   Grid *g = tx_->findGrid(node);
@@ -198,9 +312,46 @@ void ReferenceTranslator::TranslateNew(SgFunctionCallExp *node,
   si::appendStatement(dimDecl, tmpBlock);
 
   SgExprListExp *new_args = generateNewArg(gt, g, dimDecl);
+  bool color_split = color_split_layout_ && g->color_split();
+  string grid_create_name = color_split ?
+      "__PSGridNewColorSplit" : grid_create_name_;
+
+  if (soa_layout_ && gt->IsUserDefinedPointType()) {
+    // Generate code like this
+    // size_t layout[] = {(size_t)&((type *)0)->x, sizeof(float), ...};
+    // __PSGridNewSoA(sizeof(type), rank, dims, grid_layout, lanes,
+    //                num_members, layout);
+    SgExprListExp *layout = sb::buildExprListExp();
+    int num_members = 0;
+    const SgDeclarationStatementPtrList &members =
+        gt->point_def()->get_members();
+    FOREACH (it, members.begin(), members.end()) {
+      SgVariableDeclaration *member_decl = isSgVariableDeclaration(*it);
+      if (!member_decl) continue;
+      si::appendExpression(
+          layout, BuildPointMemberOffset(gt, ru::GetName(member_decl)));
+      si::appendExpression(
+          layout, sb::buildSizeOfOp(ru::GetType(member_decl)));
+      ++num_members;
+    }
+    SgVariableDeclaration *layout_decl =
+        sb::buildVariableDeclaration(
+            "layout",
+            sb::buildArrayType(BuildSizeType(global_scope_),
+                               sb::buildIntVal(num_members * 2)),
+            sb::buildAggregateInitializer(layout), tmpBlock);
+    si::appendStatement(layout_decl, tmpBlock);
+    int grid_layout = color_split ?
+        PS_GRID_LAYOUT_COLOR_SPLIT : PS_GRID_LAYOUT_ROW_MAJOR;
+    appendNewArgSoA(new_args, grid_layout, num_members, layout_decl);
+    grid_create_name = soa_grid_create_name_;
+  } else if (g->scratch() && grid_create_name == "__PSGridNew") {
+    // __PSGridNewScratch(sizeof(type), rank, dims);
+    grid_create_name = "__PSGridNewScratch";
+  }
 
   SgFunctionSymbol *grid_new
-      = si::lookupFunctionSymbolInParentScopes(grid_create_name_,
+      = si::lookupFunctionSymbolInParentScopes(grid_create_name,
                                                global_scope_);
   
   // sb::build a call to grid_new
@@ -238,6 +389,14 @@ void ReferenceTranslator::TranslateGet(SgFunctionCallExp *node,
     (type*)(g->p0)[offset]
   */
   GridType *gt = tx_->findGridType(gv->get_type());
+  // Members of SoA grids are translated when visiting the enclosing
+  // dot expression
+  if (soa_layout_ && gt->IsUserDefinedPointType() &&
+      !isSgDotExp(node->get_parent())) {
+    LOG_ERROR() << "Getting whole points not supported in the SoA layout: "
+                << node->unparseToString() << "\n";
+    PSAbort(1);
+  }
   const StencilIndexList *sil =
       rose_util::GetASTAttribute<GridGetAttribute>(node)->GetStencilIndexList();
   SgExpressionPtrList args;
@@ -251,6 +410,31 @@ void ReferenceTranslator::TranslateGet(SgFunctionCallExp *node,
   si::replaceExpression(node, p0);
 }
 
+void ReferenceTranslator::Visit(SgExpression *node) {
+  // Replace get(g, offset).x with the member access in the SoA layout
+  SgDotExp *dot = isSgDotExp(node);
+  if (!soa_layout_ || dot == NULL) return;
+  SgExpression *get_exp = dot->get_lhs_operand();
+  GridGetAttribute *gga =
+      rose_util::GetASTAttribute<GridGetAttribute>(get_exp);
+  if (gga == NULL || !gga->gt()->IsUserDefinedPointType()) return;
+  SgVarRefExp *mem_ref = isSgVarRefExp(dot->get_rhs_operand());
+  PSAssert(mem_ref);
+  SgExpressionPtrList args;
+  rose_util::CopyExpressionPtrList(
+      GridOffsetAnalysis::GetIndices(GridGetAnalysis::GetOffset(get_exp)),
+      args);
+  SgInitializedName *gv = GridGetAnalysis::GetGridVar(get_exp);
+  SgExpression *member_get =
+      rt_builder_->BuildGridGet(
+          sb::buildVarRefExp(gv->get_name(), si::getScope(node)),
+          rose_util::GetASTAttribute<GridVarAttribute>(gv),
+          gga->gt(), &args, gga->GetStencilIndexList(),
+          gga->in_kernel(), gga->is_periodic(),
+          rose_util::GetName(mem_ref));
+  si::replaceExpression(dot, member_get);
+}
+
 void ReferenceTranslator::RemoveEmitDummyExp(SgExpression *emit) {
   // For EmitUtype, dummy pointer dereference needs to be removed,
   // i.e., (*(type *)emit_exp) -> emit_exp
@@ -261,6 +445,15 @@ void ReferenceTranslator::RemoveEmitDummyExp(SgExpression *emit) {
   si::replaceExpression(deref_exp, si::copyExpression(emit));
 }
 
+bool ReferenceTranslator::IsNonTemporalGrid(Kernel *k, SgInitializedName *gv,
+                                            GridType *gt) {
+  if (!k) return false;
+  if (fused_reduce_grids_.count(gv)) return false;
+  if (!(isSgTypeFloat(gt->point_type()) ||
+        isSgTypeDouble(gt->point_type()))) return false;
+  return k->isGridParamModified(gv) && !k->isGridParamRead(gv);
+}
+
 void ReferenceTranslator::TranslateEmit(SgFunctionCallExp *node,
                                         GridEmitAttribute *attr) {
   bool is_grid_type_specific_call =
@@ -283,6 +476,24 @@ void ReferenceTranslator::TranslateEmit(SgFunctionCallExp *node,
                                  attr, &args, emit_val,
                                  si::getScope(node));
 
+  // g->p0[offset] = value -> __PSStreamFloat(&g->p0[offset], value)
+  SgAssignOp *emit_assign = isSgAssignOp(emit);
+  if (flag_non_temporal_store_ && is_grid_type_specific_call &&
+      !attr->is_member_access() && emit_assign &&
+      IsNonTemporalGrid(tx_->findKernel(getContainingFunction(node)),
+                        attr->gv(), gt)) {
+    SgFunctionSymbol *fs =
+        si::lookupFunctionSymbolInParentScopes(
+            isSgTypeFloat(gt->point_type()) ?
+            "__PSStreamFloat" : "__PSStreamDouble", global_scope_);
+    PSAssert(fs);
+    emit = sb::buildFunctionCallExp(
+        fs, sb::buildExprListExp(
+            sb::buildAddressOfOp(
+                si::copyExpression(emit_assign->get_lhs_operand())),
+            si::copyExpression(emit_assign->get_rhs_operand())));
+  }
+
   si::replaceExpression(node, emit);
   
   if (!is_grid_type_specific_call) {
@@ -291,6 +502,26 @@ void ReferenceTranslator::TranslateEmit(SgFunctionCallExp *node,
 
 }
 
+void ReferenceTranslator::TranslateBoundaryEmit(SgFunctionCallExp *node,
+                                                SgInitializedName *gv) {
+  if (!flag_boundary_face_loops_) {
+    Translator::TranslateBoundaryEmit(node, gv);
+    return;
+  }
+  SgFunctionDeclaration *kernel = getContainingFunction(node);
+  bool is_mapped = false;
+  FOREACH (it, tx_->mapBegin(), tx_->mapEnd()) {
+    if (it->second->getKernel() == kernel) is_mapped = true;
+  }
+  if (!is_mapped) {
+    LOG_ERROR() << "Boundary conditions must be set in mapped kernels: "
+                << node->unparseToString() << "\n";
+    PSAbort(1);
+  }
+  // The faces are emitted by the run kernel
+  si::removeStatement(si::getEnclosingStatement(node));
+}
+
 static SgType *GetDomType(StencilMap *sm) {
   SgType *t = sm->getDom()->get_type();
   PSAssert(t);
@@ -476,6 +707,16 @@ static SgExpression *BuildRedBlackInitOffset(
   return rb_offset;
 }
 
+// Returns the number of points of a face excluded from the sweep,
+// i.e., one if the process owns the face, and zero otherwise.
+static SgExpression *BuildFaceWidth(RuntimeBuilder *builder,
+                                    SgInitializedName *stencil_param,
+                                    int dim, bool fw) {
+  SgExpression *owns = builder->BuildStencilDomOwnsFace(
+      sb::buildVarRefExp(stencil_param), dim, fw);
+  return owns ? owns : sb::buildIntVal(1);
+}
+
 SgBasicBlock* ReferenceTranslator::BuildRunKernelBody(
     StencilMap *s, SgFunctionParameterList *param,
     vector<SgVariableDeclaration*> &indices) {
@@ -523,6 +764,13 @@ SgBasicBlock* ReferenceTranslator::BuildRunKernelBody(
             rt_builder_->BuildStencilDomMaxRef(
                 sb::buildVarRefExp(stencil_param), i+1),
             sb::buildIntVal(1));
+    // Faces with boundary conditions are emitted after the sweep
+    if (flag_boundary_face_loops_ && s->HasBoundaryFace(i+1)) {
+      loop_begin = sb::buildAddOp(
+          loop_begin, BuildFaceWidth(rt_builder_, stencil_param, i+1, false));
+      loop_end = sb::buildSubtractOp(
+          loop_end, BuildFaceWidth(rt_builder_, stencil_param, i+1, true));
+    }
     SgExpression *incr =
         sb::buildIntVal((i == 0 && s->IsRedBlackVariant()) ? 2 : 1);
     SgBasicBlock *inner_block = sb::buildBasicBlock();
@@ -547,6 +795,356 @@ SgBasicBlock* ReferenceTranslator::BuildRunKernelBody(
   return block;
 }
 
+// Returns the name of the reduction operator if it is a constant,
+// e.g., PS_SUM; otherwise returns an empty string.
+static string GetReduceOpName(Reduce *rd) {
+  SgEnumVal *op = isSgEnumVal(
+      rd->reduce_call()->get_args()->get_expressions()[1]);
+  if (!op) return "";
+  return op->get_name().getString();
+}
+
+static SgExpression *BuildReduceInitVal(const string &op, SgType *t) {
+  bool is_float = isSgTypeFloat(t);
+  if (op == "PS_MAX") {
+    return is_float ? (SgExpression*)sb::buildFloatVal(-FLT_MAX) :
+        (SgExpression*)sb::buildDoubleVal(-DBL_MAX);
+  } else if (op == "PS_MIN") {
+    return is_float ? (SgExpression*)sb::buildFloatVal(FLT_MAX) :
+        (SgExpression*)sb::buildDoubleVal(DBL_MAX);
+  } else if (op == "PS_SUM") {
+    return is_float ? (SgExpression*)sb::buildFloatVal(0.0f) :
+        (SgExpression*)sb::buildDoubleVal(0.0);
+  } else {
+    return is_float ? (SgExpression*)sb::buildFloatVal(1.0f) :
+        (SgExpression*)sb::buildDoubleVal(1.0);
+  }
+}
+
+static SgExpression *BuildReduceOp(const string &op, SgExpression *x,
+                                   SgExpression *y) {
+  if (op == "PS_MAX") {
+    return ru::BuildMax(x, y);
+  } else if (op == "PS_MIN") {
+    return ru::BuildMin(x, y);
+  } else if (op == "PS_SUM") {
+    return sb::buildAddOp(x, y);
+  } else {
+    return sb::buildMultiplyOp(x, y);
+  }
+}
+
+static SgFunctionSymbol *GetReduceGridFunc(SgType *elm_type,
+                                           SgScopeStatement *scope) {
+  SgFunctionSymbol *reduce_grid_func = NULL;
+  if (isSgTypeFloat(elm_type)) {
+    PSAssert(reduce_grid_func = 
+             si::lookupFunctionSymbolInParentScopes(
+                 "__PSReduceGridFloat", scope));
+  } else if (isSgTypeDouble(elm_type)) {
+    PSAssert(reduce_grid_func = 
+             si::lookupFunctionSymbolInParentScopes(
+                 "__PSReduceGridDouble", scope));
+  } else {
+    LOG_ERROR() << "Unsupported element type.";
+    PSAbort(1);
+  }
+  return reduce_grid_func;
+}
+
+void ReferenceTranslator::AppendStreamFence(StencilMap *s,
+                                            SgScopeStatement *body) {
+  if (!flag_non_temporal_store_) return;
+  Kernel *k = tx_->findKernel(s->getKernel());
+  bool has_nt_grid = false;
+  FOREACH (it, s->grid_params().begin(), s->grid_params().end()) {
+    GridType *gt = tx_->findGridType(*it);
+    if (gt && IsNonTemporalGrid(k, *it, gt)) has_nt_grid = true;
+  }
+  if (!has_nt_grid) return;
+  SgFunctionSymbol *fs =
+      si::lookupFunctionSymbolInParentScopes("__PSStreamFence",
+                                             global_scope_);
+  PSAssert(fs);
+  ru::AppendExprStatement(
+      body, sb::buildFunctionCallExp(fs, sb::buildExprListExp()));
+}
+
+void ReferenceTranslator::AddGridSnapshots(StencilMap *s,
+                                           SgFunctionDeclaration *run_func) {
+  if (!ru::IsCLikeLanguage() || s->IsRedBlackVariant()) return;
+  // Generate code like this
+  // __PSGridSnapshot(s->g);
+  // for (...) {
+  //   kernel(i, j, k, s->g);
+  // }
+  // __PSGridReleaseSnapshot(s->g);
+  SgScopeStatement *body = run_func->get_definition()->get_body();
+  SgFunctionSymbol *snapshot_fs =
+      si::lookupFunctionSymbolInParentScopes("__PSGridSnapshot",
+                                             global_scope_);
+  SgFunctionSymbol *release_fs =
+      si::lookupFunctionSymbolInParentScopes("__PSGridReleaseSnapshot",
+                                             global_scope_);
+  SgStatementPtrList snapshots;
+  FOREACH (it, s->grid_params().begin(), s->grid_params().end()) {
+    GridVarAttribute *gva = ru::GetASTAttribute<GridVarAttribute>(*it);
+    if (!(gva && gva->out_of_place())) continue;
+    PSAssert(snapshot_fs && release_fs);
+    snapshots.push_back(
+        sb::buildExprStatement(
+            sb::buildFunctionCallExp(
+                snapshot_fs, sb::buildExprListExp(
+                    rt_builder_->BuildGridRefInRunKernel(*it, run_func)))));
+    ru::AppendExprStatement(
+        body, sb::buildFunctionCallExp(
+            release_fs, sb::buildExprListExp(
+                rt_builder_->BuildGridRefInRunKernel(*it, run_func))));
+  }
+  si::prependStatementList(snapshots, body);
+}
+
+void ReferenceTranslator::AddBrickLoop(StencilMap *s,
+                                       SgFunctionDeclaration *run_func) {
+  if (!flag_masked_domains_) return;
+  SgInitializedName *stencil_param = run_func->get_args()[0];
+  SgBasicBlock *sweep = run_func->get_definition()->get_body();
+  // Generate code like this
+  // __PSDomain __PSBrickDom = s->dom;
+  // int __PSNumBricks = s->dom.mask ? __PSDomainGetNumBricks(&s->dom) : 1;
+  // int __PSBrick;
+  // for (__PSBrick = 0; __PSBrick <= __PSNumBricks - 1; __PSBrick++) {
+  //   if (__PSBrickDom.mask) __PSDomainSetBrick(&__PSBrickDom, __PSBrick);
+  //   for (k = __PSBrickDom.local_min[2]; ...) {
+  //     ...
+  //   }
+  // }
+  // Only the domain is copied, so the grids are still accessed
+  // through the stencil parameter.
+  SgType *dom_type = si::lookupNamedTypeInParentScopes("__PSDomain",
+                                                       global_scope_);
+  PSAssert(dom_type);
+  SgBasicBlock *body = sb::buildBasicBlock();
+  si::replaceStatement(sweep, body);
+  SgVarRefExp *dom_field = isSgVarRefExp(
+      isSgBinaryOp(rt_builder_->BuildStencilFieldRef(
+          sb::buildVarRefExp(stencil_param), GetStencilDomName()))->
+      get_rhs_operand());
+  PSAssert(dom_field);
+  SgVariableDeclaration *brick_dom = sb::buildVariableDeclaration(
+      "__PSBrickDom", dom_type,
+      sb::buildAssignInitializer(
+          rt_builder_->BuildStencilFieldRef(
+              sb::buildVarRefExp(stencil_param), GetStencilDomName()),
+          dom_type),
+      body);
+  si::appendStatement(brick_dom, body);
+  SgExpression *mask = rt_builder_->BuildStencilDomMaskRef(
+      sb::buildVarRefExp(stencil_param));
+  PSAssert(mask);
+  SgExpression *num_bricks = sb::buildConditionalExp(
+      mask,
+      BuildDomainGetNumBricks(
+          sb::buildAddressOfOp(
+              rt_builder_->BuildStencilFieldRef(
+                  sb::buildVarRefExp(stencil_param), GetStencilDomName()))),
+      sb::buildIntVal(1));
+  SgVariableDeclaration *num_bricks_decl = sb::buildVariableDeclaration(
+      "__PSNumBricks", sb::buildIntType(),
+      sb::buildAssignInitializer(num_bricks, sb::buildIntType()), body);
+  si::appendStatement(num_bricks_decl, body);
+  SgVariableDeclaration *brick = sb::buildVariableDeclaration(
+      "__PSBrick", sb::buildIntType(), NULL, body);
+  si::appendStatement(brick, body);
+
+  // The sweep and the face loops cover the brick
+  BOOST_FOREACH (SgBinaryOp *field_ref,
+                 si::querySubTree<SgBinaryOp>(sweep)) {
+    if (!(isSgArrowExp(field_ref) || isSgDotExp(field_ref))) continue;
+    SgVarRefExp *stencil = isSgVarRefExp(field_ref->get_lhs_operand());
+    SgVarRefExp *field = isSgVarRefExp(field_ref->get_rhs_operand());
+    if (!(stencil && field &&
+          si::convertRefToInitializedName(stencil) == stencil_param &&
+          field->get_symbol() == dom_field->get_symbol())) continue;
+    si::replaceExpression(field_ref, sb::buildVarRefExp(brick_dom));
+  }
+
+  SgBasicBlock *loop_body = sb::buildBasicBlock();
+  SgExpression *brick_mask = sb::buildDotExp(
+      sb::buildVarRefExp(brick_dom),
+      si::copyExpression(isSgBinaryOp(mask)->get_rhs_operand()));
+  si::appendStatement(
+      sb::buildIfStmt(
+          brick_mask,
+          sb::buildExprStatement(
+              BuildDomainSetBrick(
+                  sb::buildAddressOfOp(sb::buildVarRefExp(brick_dom)),
+                  sb::buildVarRefExp(brick))),
+          NULL),
+      loop_body);
+  si::appendStatement(sweep, loop_body);
+  si::appendStatement(
+      ru::BuildForLoop(brick->get_variables()[0], sb::buildIntVal(0),
+                       sb::buildSubtractOp(sb::buildVarRefExp(num_bricks_decl),
+                                           sb::buildIntVal(1)),
+                       sb::buildIntVal(1), loop_body),
+      body);
+}
+
+// Build a boundary value in a run kernel. The kernel parameters are
+// replaced with the loop indices and the fields of the stencil.
+static SgExpression *BuildBoundaryValue(
+    StencilMap *s, SgExpression *value, SgInitializedName *stencil_param,
+    const vector<SgVariableDeclaration*> &indices) {
+  // The value refers to the parameters of the kernel definition
+  const SgInitializedNamePtrList &params = isSgFunctionDeclaration(
+      s->getKernel()->get_definingDeclaration())->get_args();
+  // The stencil fields after the domain are the kernel parameters
+  // after the indices, followed by IDs for grids. See BuildKernelCall.
+  std::map<SgInitializedName*, SgVariableDeclaration*> fields;
+  SgDeclarationStatementPtrList &members =
+      s->GetStencilTypeDefinition()->get_members();
+  unsigned param_index = s->getNumDim();
+  FOREACH (it, ++(members.begin()), members.end()) {
+    SgVariableDeclaration *d = isSgVariableDeclaration(*it);
+    PSAssert(d && param_index < params.size());
+    fields[params[param_index++]] = d;
+    // skip the grid id
+    if (GridType::isGridType(d->get_variables()[0]->get_type())) {
+      ++it;
+    }
+  }
+  SgExpression *v = si::copyExpression(value);
+  BOOST_FOREACH (SgVarRefExp *vref, si::querySubTree<SgVarRefExp>(v)) {
+    SgInitializedName *p = si::convertRefToInitializedName(vref);
+    SgExpression *x = NULL;
+    for (int i = 0; i < s->getNumDim(); ++i) {
+      if (params[i] == p) x = sb::buildVarRefExp(indices[i]);
+    }
+    if (isContained(fields, p)) {
+      x = ru::BuildFieldRef(sb::buildVarRefExp(stencil_param),
+                            sb::buildVarRefExp(fields[p]));
+    }
+    // Global variables are left as they are
+    if (x == NULL) continue;
+    if (vref == v) return x;
+    si::replaceExpression(vref, x);
+  }
+  return v;
+}
+
+SgExpression *ReferenceTranslator::BuildBoundaryFaceEmit(
+    StencilMap *s, const BoundaryCondition &bc, int dim, bool fw,
+    SgFunctionDeclaration *run_func,
+    const vector<SgVariableDeclaration*> &indices) {
+  SgInitializedName *stencil_param = run_func->get_args()[0];
+  GridType *gt = tx_->findGridType(bc.gv);
+  PSAssert(gt);
+  int nd = s->getNumDim();
+  SgExpressionPtrList args;
+  for (int i = 0; i < nd; ++i) {
+    args.push_back(sb::buildVarRefExp(indices[i]));
+  }
+  SgExpression *val = BuildBoundaryValue(s, bc.value, stencil_param,
+                                         indices);
+  if (bc.kind == BoundaryCondition::kNeumann) {
+    // Generate code like this
+    // g[i0, i1, i2] = g[i0+1, i1, i2] + v;
+    // The point next to the face is read after the sweep, so the
+    // current buffer is read even when the grid is out of place.
+    StencilIndexList sil;
+    StencilIndexListInitSelf(sil, nd);
+    sil[dim-1].offset = fw ? -1 : 1;
+    SgExpressionPtrList inner_args;
+    for (int i = 0; i < nd; ++i) {
+      SgExpression *x = sb::buildVarRefExp(indices[i]);
+      if (i == dim - 1) {
+        x = fw ? (SgExpression*)sb::buildSubtractOp(x, sb::buildIntVal(1)) :
+            (SgExpression*)sb::buildAddOp(x, sb::buildIntVal(1));
+      }
+      inner_args.push_back(x);
+    }
+    SgExpression *inner = rt_builder_->BuildGridGet(
+        rt_builder_->BuildGridRefInRunKernel(bc.gv, run_func),
+        ru::GetASTAttribute<GridVarAttribute>(bc.gv), gt,
+        &inner_args, &sil, false, false);
+    val = sb::buildAddOp(inner, val);
+  }
+  GridEmitAttribute attr(gt, bc.gv);
+  return rt_builder_->BuildGridEmit(
+      rt_builder_->BuildGridRefInRunKernel(bc.gv, run_func), &attr,
+      &args, val, run_func->get_definition()->get_body());
+}
+
+void ReferenceTranslator::AppendBoundaryFaceLoops(
+    StencilMap *s, SgFunctionDeclaration *run_func,
+    const vector<SgVariableDeclaration*> &indices) {
+  const BoundaryConditionVector &bcs = s->boundary_conditions();
+  if (!flag_boundary_face_loops_ || bcs.empty()) return;
+  SgInitializedName *stencil_param = run_func->get_args()[0];
+  SgScopeStatement *body = run_func->get_definition()->get_body();
+  int nd = s->getNumDim();
+  // Generate code like this
+  // if (__PSDomainOwnsFace(&s->dom, 0, 0)) {
+  //   i0 = s->dom.local_min[0];
+  //   for (i2 = s->dom.local_min[2]; i2 <= s->dom.local_max[2]-1; i2++) {
+  //     for (i1 = s->dom.local_min[1]; i1 <= s->dom.local_max[1]-1; i1++) {
+  //       g[i0, i1, i2] = v;
+  //     }
+  //   }
+  // }
+  // The condition is omitted when the process always owns the face.
+  for (int dim = 1; dim <= nd; ++dim) {
+    for (int fw = 0; fw < 2; ++fw) {
+      SgBasicBlock *emits = sb::buildBasicBlock();
+      FOREACH (it, bcs.begin(), bcs.end()) {
+        // Neumann conditions replace Dirichlet ones on their faces
+        if (s->GetBoundaryCondition(it->gv, dim) != &(*it)) continue;
+        ru::AppendExprStatement(
+            emits, BuildBoundaryFaceEmit(s, *it, dim, fw, run_func,
+                                         indices));
+      }
+      if (emits->get_statements().empty()) continue;
+      SgBasicBlock *face = sb::buildBasicBlock();
+      SgExpression *face_index = fw ?
+          sb::buildSubtractOp(
+              rt_builder_->BuildStencilDomMaxRef(
+                  sb::buildVarRefExp(stencil_param), dim),
+              sb::buildIntVal(1)) :
+          rt_builder_->BuildStencilDomMinRef(
+              sb::buildVarRefExp(stencil_param), dim);
+      ru::AppendExprStatement(
+          face, sb::buildAssignOp(sb::buildVarRefExp(indices[dim-1]),
+                                  face_index));
+      SgScopeStatement *parent_block = face;
+      for (int i = nd; i >= 1; --i) {
+        if (i == dim) continue;
+        SgBasicBlock *inner_block = sb::buildBasicBlock();
+        SgExpression *loop_end =
+            sb::buildSubtractOp(
+                rt_builder_->BuildStencilDomMaxRef(
+                    sb::buildVarRefExp(stencil_param), i),
+                sb::buildIntVal(1));
+        si::appendStatement(
+            ru::BuildForLoop(indices[i-1]->get_variables()[0],
+                             rt_builder_->BuildStencilDomMinRef(
+                                 sb::buildVarRefExp(stencil_param), i),
+                             loop_end, sb::buildIntVal(1), inner_block),
+            parent_block);
+        parent_block = inner_block;
+      }
+      si::appendStatement(emits, parent_block);
+      SgExpression *owns = rt_builder_->BuildStencilDomOwnsFace(
+          sb::buildVarRefExp(stencil_param), dim, fw);
+      if (owns) {
+        si::appendStatement(sb::buildIfStmt(owns, face, NULL), body);
+      } else {
+        si::appendStatement(face, body);
+      }
+    }
+  }
+}
+
 // TODO: Move this to the RT builder
 SgFunctionDeclaration *ReferenceTranslator::BuildRunKernel(StencilMap *s) {
   SgFunctionParameterList *parlist = sb::buildFunctionParameterList();
@@ -578,6 +1176,10 @@ SgFunctionDeclaration *ReferenceTranslator::BuildRunKernel(StencilMap *s) {
   vector<SgVariableDeclaration*> indices;
   si::replaceStatement(runFunc->get_definition()->get_body(),
                        BuildRunKernelBody(s, parlist, indices));
+  AppendBoundaryFaceLoops(s, runFunc, indices);
+  AddBrickLoop(s, runFunc);
+  AppendStreamFence(s, runFunc->get_definition()->get_body());
+  AddGridSnapshots(s, runFunc);
   // Parameters and variable declarations need to be put forward in Fortran
   if (ru::IsFortranLikeLanguage()) {
     SgScopeStatement *body = runFunc->get_definition()->get_body();
@@ -597,6 +1199,101 @@ SgFunctionDeclaration *ReferenceTranslator::BuildRunKernel(StencilMap *s) {
   return runFunc;
 }
 
+SgFunctionDeclaration *ReferenceTranslator::BuildRunKernelReduce(
+    StencilMap *s, Reduce *rd, Run *run) {
+  // Generate code like this
+  // static void __PSStencilRun_kernel_reduce_0(
+  //     const struct __PSStencil_kernel *const s, float *reduce_buf) {
+  //   float acc = 0.0f;
+  //   for (...) {
+  //     kernel(i, j, k, s->g);
+  //     float v = ((float *)s->g->p0)[__PSGridGetOffset3D(s->g, i, j, k)];
+  //     acc = acc + v;
+  //   }
+  //   *reduce_buf = acc;
+  // }
+  // The reference runtime runs the sweep in a single thread, so the
+  // whole reduction is held in one partial.
+  SgInitializedName *gp = FindReducedGridParam(run, rd, tx_);
+  PSAssert(gp);
+  GridType *gt = tx_->findGridType(rd->GetGrid());
+  SgType *point_type = gt->point_type();
+  string op = GetReduceOpName(rd);
+  
+  SgFunctionParameterList *parlist = sb::buildFunctionParameterList();
+  SgInitializedName *stencil_param =
+      sb::buildInitializedName(
+          getStencilArgName(),
+          sb::buildConstType(sb::buildPointerType(
+              sb::buildConstType(s->stencil_type()))));
+  si::appendArg(parlist, stencil_param);
+  SgInitializedName *buf_param =
+      sb::buildInitializedName("reduce_buf",
+                               sb::buildPointerType(point_type));
+  si::appendArg(parlist, buf_param);
+  
+  SgFunctionDeclaration *runFunc = ru::BuildFunctionDeclaration(
+      s->GetRunName() + "_reduce_" + toString(run->id()),
+      sb::buildVoidType(), parlist, global_scope_);
+  rose_util::SetFunctionStatic(runFunc);
+  si::attachComment(runFunc, "Generated by " + string(__FUNCTION__));
+  vector<SgVariableDeclaration*> indices;
+  SgBasicBlock *body = BuildRunKernelBody(s, parlist, indices);
+  si::replaceStatement(runFunc->get_definition()->get_body(), body);
+
+  SgVariableDeclaration *acc =
+      sb::buildVariableDeclaration(
+          "acc", point_type,
+          sb::buildAssignInitializer(BuildReduceInitVal(op, point_type),
+                                     point_type),
+          body);
+  si::prependStatement(acc, body);
+
+  // Accumulate each point right after it is emitted by the kernel
+  SgForStatement *inner_loop = NULL;
+  BOOST_FOREACH (SgForStatement *loop,
+                 si::querySubTree<SgForStatement>(body)) {
+    RunKernelLoopAttribute *attr =
+        ru::GetASTAttribute<RunKernelLoopAttribute>(loop);
+    if (attr && attr->dim() == 1) inner_loop = loop;
+  }
+  PSAssert(inner_loop);
+  SgBasicBlock *inner_body = isSgBasicBlock(inner_loop->get_loop_body());
+  PSAssert(inner_body);
+  SgExpressionPtrList offset_exprs;
+  for (int i = 0; i < s->getNumDim(); ++i) {
+    offset_exprs.push_back(sb::buildVarRefExp(indices[i]));
+  }
+  StencilIndexList sil;
+  StencilIndexListInitSelf(sil, s->getNumDim());
+  SgExpression *emitted =
+      rt_builder_->BuildGridGet(
+          rt_builder_->BuildGridRefInRunKernel(gp, runFunc),
+          ru::GetASTAttribute<GridVarAttribute>(gp),
+          gt, &offset_exprs, &sil, true, false);
+  SgVariableDeclaration *v =
+      sb::buildVariableDeclaration(
+          "v", point_type,
+          sb::buildAssignInitializer(emitted, point_type),
+          inner_body);
+  si::appendStatement(v, inner_body);
+  si::appendStatement(
+      sb::buildAssignStatement(
+          sb::buildVarRefExp(acc),
+          BuildReduceOp(op, sb::buildVarRefExp(acc), sb::buildVarRefExp(v))),
+      inner_body);
+
+  si::appendStatement(
+      sb::buildAssignStatement(
+          sb::buildPointerDerefExp(sb::buildVarRefExp(buf_param)),
+          sb::buildVarRefExp(acc)),
+      body);
+  AppendStreamFence(s, body);
+  rose_util::AddASTAttribute(runFunc,
+                             new RunKernelAttribute(s, stencil_param));
+  return runFunc;
+}
+
 void ReferenceTranslator::BuildRunBody(
     SgBasicBlock *block, Run *run, SgFunctionDeclaration *run_func) {
   si::attachComment(block, "Generated by " + string(__FUNCTION__));
@@ -617,6 +1314,59 @@ void ReferenceTranslator::BuildRunBody(
           sb::buildPlusPlusOp(sb::buildVarRefExp(lv)),
           loopBody);
 
+  // The reduction following the run is fused into the final sweep of
+  // the last stencil if the stencil covers the whole grid without a
+  // mask. Otherwise, the grid is reduced separately after the run.
+  int last_index = run->stencils().size() - 1;
+  SgVariableDeclaration *fused_decl = NULL;
+  SgFunctionSymbol *fused_fs = NULL;
+  SgExpression *reduced_grid = NULL;
+  if (fused_reduce_) {
+    StencilMap *s = run->stencils().back().second;
+    SgFunctionDeclaration *fused_kernel =
+        BuildRunKernelReduce(s, fused_reduce_, run);
+    InsertStencilSpecificFunc(s, fused_kernel);
+    fused_fs = rose_util::getFunctionSymbol(fused_kernel);
+    SgExpression *stencil =
+        sb::buildVarRefExp("s" + toString(last_index), block);
+    SgVariableSymbol *grid_field =
+        si::lookupVariableSymbolInParentScopes(
+            FindReducedGridParam(run, fused_reduce_, tx_)->get_name(),
+            s->GetStencilTypeDefinition());
+    PSAssert(grid_field);
+    reduced_grid = ru::BuildFieldRef(stencil,
+                                     sb::buildVarRefExp(grid_field));
+    SgExpression *cond = sb::buildGreaterThanOp(
+        sb::buildVarRefExp("iter", block), sb::buildIntVal(0));
+    if (flag_masked_domains_) {
+      cond = sb::buildAndOp(
+          cond,
+          sb::buildEqualityOp(
+              rt_builder_->BuildStencilDomMaskRef(
+                  si::copyExpression(stencil)),
+              sb::buildIntVal(0)));
+    }
+    for (int d = 1; d <= s->getNumDim(); ++d) {
+      cond = sb::buildAndOp(
+          cond,
+          sb::buildEqualityOp(
+              rt_builder_->BuildStencilDomMinRef(
+                  si::copyExpression(stencil), d),
+              sb::buildIntVal(0)));
+      cond = sb::buildAndOp(
+          cond,
+          sb::buildEqualityOp(
+              rt_builder_->BuildStencilDomMaxRef(
+                  si::copyExpression(stencil), d),
+              rt_builder_->BuildGridDim(
+                  si::copyExpression(reduced_grid), d)));
+    }
+    fused_decl = sb::buildVariableDeclaration(
+        "fused", sb::buildIntType(),
+        sb::buildAssignInitializer(cond, sb::buildIntType()), block);
+    si::appendStatement(fused_decl, block);
+  }
+
   ENUMERATE(i, it, run->stencils().begin(), run->stencils().end()) {
     StencilMap *s = it->second;
     SgFunctionSymbol *fs = rose_util::getFunctionSymbol(s->run());
@@ -631,6 +1381,26 @@ void ReferenceTranslator::BuildRunBody(
           sb::buildIntVal(s->IsBlack() ? 1 : 0));
     }
     SgFunctionCallExp *c = sb::buildFunctionCallExp(fs, args);
+    if (fused_decl && i == last_index) {
+      // if (fused && i == iter - 1) run_reduce(&s, reduce_buf);
+      // else run(&s);
+      SgExpression *is_last = sb::buildAndOp(
+          sb::buildVarRefExp(fused_decl),
+          sb::buildEqualityOp(
+              sb::buildVarRefExp(lv),
+              sb::buildSubtractOp(sb::buildVarRefExp("iter", block),
+                                  sb::buildIntVal(1))));
+      SgFunctionCallExp *fc = sb::buildFunctionCallExp(
+          fused_fs,
+          sb::buildExprListExp(
+              sb::buildAddressOfOp(si::copyExpression(stencil)),
+              sb::buildVarRefExp("reduce_buf", block)));
+      si::appendStatement(
+          sb::buildIfStmt(is_last, sb::buildExprStatement(fc),
+                          sb::buildExprStatement(c)),
+          loopBody);
+      continue;
+    }
     si::appendStatement(sb::buildExprStatement(c), loopBody);
     // Call both Red and Black versions for MapRedBlack
     if (s->IsRedBlack()) {
@@ -644,6 +1414,26 @@ void ReferenceTranslator::BuildRunBody(
     //appendGridSwap(s, stencilName, false, loopBody);
   }
 
+  if (fused_decl) {
+    // if (!fused) __PSReduceGridFloat(reduce_buf, op, s.g);
+    GridType *gt = tx_->findGridType(fused_reduce_->GetGrid());
+    SgFunctionSymbol *reduce_grid_func =
+        GetReduceGridFunc(gt->point_type(), global_scope_);
+    SgFunctionCallExp *rc = sb::buildFunctionCallExp(
+        reduce_grid_func,
+        sb::buildExprListExp(
+            sb::buildVarRefExp("reduce_buf", block),
+            si::copyExpression(
+                fused_reduce_->reduce_call()->get_args()->
+                get_expressions()[1]),
+            reduced_grid));
+    SgStatement *fallback =
+        sb::buildIfStmt(sb::buildNotOp(sb::buildVarRefExp(fused_decl)),
+                        sb::buildExprStatement(rc), NULL);
+    TraceStencilRun(run, sb::buildBasicBlock(loop, fallback), block);
+    return;
+  }
+
   TraceStencilRun(run, loop, block);
   return;
 }
@@ -684,6 +1474,9 @@ void ReferenceTranslator::TraceStencilRun(Run *run,
         cur_scope);
     rose_util::AppendExprStatement(
         cur_scope, BuildTraceStencilPost(sb::buildVarRefExp("f")));
+    SgFunctionCallExp *prof = BuildProfileStencilRun(
+        run, sb::buildVarRefExp("f"), cur_scope);
+    if (prof) rose_util::AppendExprStatement(cur_scope, prof);
     si::appendStatement(
         sb::buildReturnStmt(sb::buildVarRefExp("f")), cur_scope); /* return f; */
   } else {
@@ -694,6 +1487,48 @@ void ReferenceTranslator::TraceStencilRun(Run *run,
   return;
 }
 
+// Generate code like this:
+// __PSProfileStencilRun("kernel1, kernel2",
+//     iter * (__PSDomainGetNumPoints(&s0.dom, 3) * 8.0 + ...),
+//     iter * (__PSDomainGetNumPoints(&s0.dom, 3) * 13.0 + ...), f);
+SgFunctionCallExp *ReferenceTranslator::BuildProfileStencilRun(
+    Run *run, SgExpression *time, SgScopeStatement *cur_scope) {
+  if (!ru::IsCLikeLanguage()) return NULL;
+  StringJoin sj;
+  SgExpression *bytes = NULL;
+  SgExpression *flops = NULL;
+  ENUMERATE(i, it, run->stencils().begin(), run->stencils().end()) {
+    StencilMap *sm = it->second;
+    string stencil_name = "s" + toString(i);
+    if (si::lookupVariableSymbolInParentScopes(stencil_name, cur_scope)
+        == NULL) {
+      LOG_DEBUG() << "Stencil " << stencil_name
+                  << " not found; no profiling\n";
+      return NULL;
+    }
+    KernelMetadata md(sm, tx_);
+    sj << md.kernel_name();
+    SgExpression *dom = rt_builder_->BuildStencilFieldRef(
+        sb::buildVarRefExp(stencil_name, cur_scope), GetStencilDomName());
+    SgExpression *num_points =
+        BuildDomainGetNumPoints(sb::buildAddressOfOp(dom), md.num_dims());
+    SgExpression *b = sb::buildMultiplyOp(
+        num_points, sb::buildDoubleVal(md.bytes_per_point()));
+    SgExpression *f = sb::buildMultiplyOp(
+        si::copyExpression(num_points),
+        sb::buildDoubleVal(md.flops_per_point()));
+    bytes = bytes ? sb::buildAddOp(bytes, b) : b;
+    flops = flops ? sb::buildAddOp(flops, f) : f;
+  }
+  if (bytes == NULL) return NULL;
+  SgExpression *iter = sb::buildVarRefExp("iter", cur_scope);
+  return physis::translator::BuildProfileStencilRun(
+      sb::buildStringVal(sj.str()),
+      sb::buildMultiplyOp(iter, bytes),
+      sb::buildMultiplyOp(si::copyExpression(iter), flops),
+      time);
+}
+
 SgFunctionDeclaration *ReferenceTranslator::BuildRun(Run *run) {
   // setup the parameter list
   SgFunctionParameterList *parlist = sb::buildFunctionParameterList();
@@ -712,6 +1547,13 @@ SgFunctionDeclaration *ReferenceTranslator::BuildRun(Run *run) {
                   sb::buildInitializedName("s" + toString(i),
                                            stencilType));
   }
+  if (fused_reduce_) {
+    GridType *gt = tx_->findGridType(fused_reduce_->GetGrid());
+    si::appendArg(parlist,
+                  sb::buildInitializedName(
+                      "reduce_buf",
+                      sb::buildPointerType(gt->point_type())));
+  }
 
   // Declare and define the function
   SgFunctionDeclaration *runFunc =
@@ -1252,6 +2094,20 @@ void ReferenceTranslator::TranslateRun(SgFunctionCallExp *node,
   if (ru::IsFortranLikeLanguage()) {
     return;
   }
+
+  // Reduction fusion is only supported by the reference runtime. The
+  // MPI runtimes reduce grids with __PSReduceGrid* on every process
+  // followed by a reduction over the processes, and their kernels may
+  // be run by multiple threads, which would need per-thread partials;
+  // neither is generated by the fused kernel, so MPI runs are never
+  // fused.
+  if (target_specific_macro_ == "PHYSIS_REF" && !config_.auto_tuning()) {
+    fused_reduce_ = FindFusableReduce(node, run);
+    if (fused_reduce_) {
+      LOG_INFO() << "Fusing reduction into the stencil run: "
+                 << fused_reduce_->reduce_call()->unparseToString() << "\n";
+    }
+  }
   
   SgFunctionDeclaration *runFunc = BuildRun(run);
   si::insertStatementBefore(getContainingFunction(node), runFunc);
@@ -1279,9 +2135,54 @@ void ReferenceTranslator::TranslateRun(SgFunctionCallExp *node,
   for (int i = 0; i < num_remaining_args; ++i) {
     si::appendExpression(args, si::copyExpression(original_args.at(i)));
   }
+  if (fused_reduce_) {
+    // Pass the reduction buffer to the run, and drop the original
+    // reduction call
+    SgFunctionCallExp *rdcall = fused_reduce_->reduce_call();
+    si::appendExpression(
+        args,
+        si::copyExpression(rdcall->get_args()->get_expressions()[0]));
+    SgStatement *rdstmt = si::getEnclosingStatement(rdcall);
+    rose_util::RemoveASTAttribute<Reduce>(rdcall);
+    si::removeStatement(rdstmt);
+    fused_reduce_ = NULL;
+  }
   si::replaceExpression(node, sb::buildFunctionCallExp(ref, args));
 }
 
+Reduce *ReferenceTranslator::FindFusableReduce(SgFunctionCallExp *node,
+                                               Run *run) {
+  SgExprStatement *run_stmt = isSgExprStatement(node->get_parent());
+  if (!run_stmt) return NULL;
+  SgExprStatement *next_stmt =
+      isSgExprStatement(si::getNextStatement(run_stmt));
+  if (!next_stmt) return NULL;
+  SgFunctionCallExp *call = isSgFunctionCallExp(next_stmt->get_expression());
+  if (!call) return NULL;
+  Reduce *rd = rose_util::GetASTAttribute<Reduce>(call);
+  if (!rd || !rd->IsGrid() || !rd->GetGrid()) return NULL;
+  if (run->stencils().back().second->IsRedBlackVariant()) return NULL;
+  // Boundary faces are emitted after the fused sweep
+  if (run->stencils().back().second->boundary_conditions().size()) {
+    return NULL;
+  }
+  SgInitializedName *gp = FindReducedGridParam(run, rd, tx_);
+  if (!gp) return NULL;
+  // The fused sweep takes no snapshot
+  GridVarAttribute *gva = ru::GetASTAttribute<GridVarAttribute>(gp);
+  if (gva && gva->out_of_place()) return NULL;
+  SgType *point_type = tx_->findGridType(rd->GetGrid())->point_type();
+  if (!(isSgTypeFloat(point_type) || isSgTypeDouble(point_type))) {
+    return NULL;
+  }
+  string op = GetReduceOpName(rd);
+  if (!(op == "PS_MAX" || op == "PS_MIN" || op == "PS_SUM" ||
+        op == "PS_PROD")) {
+    return NULL;
+  }
+  return rd;
+}
+
 // ReferenceRuntimeBuilder* ReferenceTranslator::GetRuntimeBuilder() const {
 //   LOG_DEBUG() << "Using reference runtime builder\n";
 //   return new ReferenceRuntimeBuilder();
@@ -1323,22 +2224,8 @@ void ReferenceTranslator::TranslateReduceGrid(Reduce *rd) {
   GridType *gt = tx_->findGridType(gv);
   SgType *elm_type = gt->point_type();
   
-  SgFunctionSymbol *reduce_grid_func;
-
-  if (isSgTypeFloat(elm_type)) {
-    PSAssert(reduce_grid_func = 
-             si::lookupFunctionSymbolInParentScopes(
-                 "__PSReduceGridFloat",
-                 global_scope_));
-  } else if (isSgTypeDouble(elm_type)) {
-    PSAssert(reduce_grid_func = 
-             si::lookupFunctionSymbolInParentScopes(
-                 "__PSReduceGridDouble",
-                 global_scope_));
-  } else {
-    LOG_ERROR() << "Unsupported element type.";
-    PSAbort(1);
-  }
+  SgFunctionSymbol *reduce_grid_func =
+      GetReduceGridFunc(elm_type, global_scope_);
 
   SgFunctionCallExp *original_rdcall = rd->reduce_call();
   SgFunctionCallExp *new_call =
@@ -25,6 +25,25 @@ class ReferenceTranslator : public Translator {
   // If this flag is on, the Translator replace grid_dim[xyz] to the constant
   // value of grid size when it's feasible.
   bool flag_constant_grid_size_optimization_;
+  // If this flag is on, grids that are only written in a kernel are
+  // emitted with non-temporal stores.
+  bool flag_non_temporal_store_;
+  // Grid parameters reduced by a fused reduction in the sweep that
+  // emits them. They are not emitted with non-temporal stores since
+  // the reduction reads them back.
+  std::set<SgInitializedName*> fused_reduce_grids_;
+  // If this flag is on, grids of user-defined point types are stored
+  // in the SoA layout.
+  bool soa_layout_;
+  // Number of points interleaved per member in the SoA layout. Zero
+  // means the whole grid.
+  int soa_lane_width_;
+  // If this flag is on, boundary conditions are emitted by loops over
+  // the domain faces after the sweep.
+  bool flag_boundary_face_loops_;
+  // If this flag is on, run kernels sweep the active bricks of
+  // masked domains one by one.
+  bool flag_masked_domains_;
 
  public:
   ReferenceTranslator(const Configuration &config);
@@ -58,6 +77,16 @@ class ReferenceTranslator : public Translator {
                                         SgVariableDeclaration *dim_decl);
   virtual void appendNewArgExtra(SgExprListExp *args, Grid *g,
                                  SgVariableDeclaration *dim_decl);
+  //! Appends the arguments specific to grid creation in the SoA layout.
+  /*!
+    \param args Arguments of the grid creation call.
+    \param grid_layout Layout of the points; one of __PSGridLayout.
+    \param num_members Number of members of the point type.
+    \param layout_decl Array of the offset and size of each member.
+   */
+  virtual void appendNewArgSoA(SgExprListExp *args, int grid_layout,
+                               int num_members,
+                               SgVariableDeclaration *layout_decl);
   virtual void TranslateGet(SgFunctionCallExp *node,
                             SgInitializedName *gv,
                             bool is_kernel,
@@ -65,9 +94,89 @@ class ReferenceTranslator : public Translator {
   virtual void TranslateEmit(SgFunctionCallExp *node,
                              GridEmitAttribute *attr);
   virtual void RemoveEmitDummyExp(SgExpression *emit);
+  virtual void TranslateBoundaryEmit(SgFunctionCallExp *node,
+                                     SgInitializedName *gv);
+  //! Translates member accesses of grid gets in the SoA layout.
+  virtual void Visit(SgExpression *node);
   virtual void TranslateSet(SgFunctionCallExp *node, SgInitializedName *gv);
   virtual void TranslateMap(SgFunctionCallExp *node, StencilMap *s);
   virtual SgFunctionDeclaration *BuildRunKernel(StencilMap *s);
+  //! Build a run kernel that also reduces an emitted grid.
+  /*!
+    The reduction is accumulated right after each point is emitted,
+    and the partial result is stored to the buffer parameter at the
+    end of the sweep.
+    
+    \param s The stencil map object.
+    \param rd The grid reduction fused into the kernel.
+    \param run The stencil run whose final sweep is fused.
+    \return The run kernel function.
+   */
+  virtual SgFunctionDeclaration *BuildRunKernelReduce(StencilMap *s,
+                                                      Reduce *rd, Run *run);
+  //! Appends a fence for non-temporal stores of a stencil.
+  /*!
+    Nothing is appended unless the stencil emits a grid with
+    non-temporal stores.
+    
+    \param s The stencil map object.
+    \param body The body of a run kernel.
+   */
+  virtual void AppendStreamFence(StencilMap *s, SgScopeStatement *body);
+  //! Returns true if a grid parameter is emitted with non-temporal stores.
+  /*!
+    The grid must be of float or double, written but never read in
+    the kernel, and not reduced by a fused reduction.
+   */
+  bool IsNonTemporalGrid(Kernel *k, SgInitializedName *gv, GridType *gt);
+  //! Brackets the sweep of a run kernel with grid snapshots.
+  /*!
+    Kernels read out-of-place grids from a snapshot taken before the
+    sweep so that neighbor reads do not see points already updated
+    in the same sweep. Nothing is added if no grid is out of place.
+    
+    \param s The stencil map object.
+    \param run_func The run kernel.
+   */
+  virtual void AddGridSnapshots(StencilMap *s,
+                                SgFunctionDeclaration *run_func);
+  //! Wraps the sweep of a run kernel with a loop over bricks.
+  /*!
+    The sweep and the boundary face loops are run for each active
+    brick of a masked domain with a copy of the domain whose local
+    part is the brick. Unmasked domains are swept once as a whole.
+    
+    \param s The stencil map object.
+    \param run_func The run kernel.
+   */
+  virtual void AddBrickLoop(StencilMap *s, SgFunctionDeclaration *run_func);
+  //! Appends loops emitting the boundary conditions of a stencil.
+  /*!
+    Each face with conditions is emitted by a loop over the other
+    dimensions of the domain, which runs only on the processes
+    owning the face. The sweep of the kernel excludes the faces.
+    
+    \param s The stencil map object.
+    \param run_func The run kernel.
+    \param indices Loop index variables of the run kernel.
+   */
+  virtual void AppendBoundaryFaceLoops(
+      StencilMap *s, SgFunctionDeclaration *run_func,
+      const vector<SgVariableDeclaration*> &indices);
+  //! Build an emit of a boundary condition at a face point.
+  /*!
+    \param s The stencil map object.
+    \param bc The boundary condition.
+    \param dim Dimension of the face (>=1).
+    \param fw True for the upper face.
+    \param run_func The run kernel.
+    \param indices Loop index variables of the run kernel.
+    \return Expression implementing the emit.
+   */
+  virtual SgExpression *BuildBoundaryFaceEmit(
+      StencilMap *s, const BoundaryCondition &bc, int dim, bool fw,
+      SgFunctionDeclaration *run_func,
+      const vector<SgVariableDeclaration*> &indices);
   virtual SgFunctionDeclaration *BuildRunInteriorKernel(StencilMap *s) {
     return NULL;
   }
@@ -104,6 +213,19 @@ class ReferenceTranslator : public Translator {
       SgBasicBlock *block, Run *run, SgFunctionDeclaration *run_func);
   virtual SgFunctionDeclaration *BuildRun(Run *run);
   virtual void TranslateRun(SgFunctionCallExp *node, Run *run);
+  //! Finds a grid reduction that can be fused into a stencil run.
+  /*!
+    The reduction must immediately follow the run and reduce a grid
+    of float or double emitted by the last stencil of the run. Only
+    used for the reference target, whose sweeps are single threaded.
+    
+    \param node The call to the stencil run.
+    \param run The stencil run.
+    \return The fusable reduction, or NULL if not found.
+   */
+  virtual Reduce *FindFusableReduce(SgFunctionCallExp *node, Run *run);
+  //! Reduction fused into the run being translated; NULL if none.
+  Reduce *fused_reduce_;
 
   /** generate dlopen and dlsym code
    * @param[in] run
@@ -147,9 +269,27 @@ class ReferenceTranslator : public Translator {
 
   virtual void optimizeConstantSizedGrids();
   string grid_create_name_;
+  //! Name of the function to create grids in the SoA layout.
+  string soa_grid_create_name_;
+  //! True if grids of red-black stencils are stored color split.
+  bool color_split_layout_;
   virtual std::string GetStencilDomName() const;
   virtual void TraceStencilRun(Run *run, SgScopeStatement *loop,
                                SgScopeStatement *cur_scope);
+  //! Builds a call to record the cost and time of a stencil run.
+  /*!
+    The bytes and flops of the run are computed from the static cost
+    model of each stencil map and the number of points in its local
+    domain.
+    
+    \param run The stencil run.
+    \param time The elapsed time of the run.
+    \param cur_scope The scope where the stencils are declared.
+    
+eturn The call expression; NULL if the stencils are not found.
+   */
+  virtual SgFunctionCallExp *BuildProfileStencilRun(
+      Run *run, SgExpression *time, SgScopeStatement *cur_scope);
   virtual void FixGridType();
 };
 
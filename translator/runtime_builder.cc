@@ -30,6 +30,43 @@ SgFunctionCallExp *BuildTraceStencilPost(SgExpression *time) {
   return fc;
 }
 
+SgFunctionCallExp *BuildProfileStencilRun(SgExpression *name,
+                                          SgExpression *bytes,
+                                          SgExpression *flops,
+                                          SgExpression *time) {
+  SgFunctionSymbol *fs
+      = si::lookupFunctionSymbolInParentScopes("__PSProfileStencilRun");
+  SgFunctionCallExp *fc =
+      sb::buildFunctionCallExp(
+          fs, sb::buildExprListExp(name, bytes, flops, time));
+  return fc;
+}
+
+SgFunctionCallExp *BuildDomainGetNumPoints(SgExpression *dom,
+                                           int num_dims) {
+  SgFunctionSymbol *fs
+      = si::lookupFunctionSymbolInParentScopes("__PSDomainGetNumPoints");
+  SgFunctionCallExp *fc =
+      sb::buildFunctionCallExp(
+          fs, sb::buildExprListExp(dom, sb::buildIntVal(num_dims)));
+  return fc;
+}
+
+SgFunctionCallExp *BuildDomainGetNumBricks(SgExpression *dom) {
+  SgFunctionSymbol *fs
+      = si::lookupFunctionSymbolInParentScopes("__PSDomainGetNumBricks");
+  PSAssert(fs);
+  return sb::buildFunctionCallExp(fs, sb::buildExprListExp(dom));
+}
+
+SgFunctionCallExp *BuildDomainSetBrick(SgExpression *dom,
+                                       SgExpression *brick) {
+  SgFunctionSymbol *fs
+      = si::lookupFunctionSymbolInParentScopes("__PSDomainSetBrick");
+  PSAssert(fs);
+  return sb::buildFunctionCallExp(fs, sb::buildExprListExp(dom, brick));
+}
+
 SgVariableDeclaration *BuildStopwatch(const std::string &name,
                                       SgScopeStatement *scope,
                                       SgScopeStatement *global_scope) {
@@ -97,6 +134,36 @@ SgExprListExp *RuntimeBuilder::BuildStencilOffset(const StencilRange &sr,
   return exp_list;
 }
 
+SgExpression *RuntimeBuilder::BuildGridRealDim(SgExpression *grid_ref,
+                                               int dim) {
+  return BuildGridDim(grid_ref, dim);
+}
+
+SgExpression *RuntimeBuilder::BuildGridPeriodicIndex(SgExpression *grid_ref,
+                                                     int dim,
+                                                     SgExpression *index) {
+  return sb::buildModOp(
+      sb::buildAddOp(index,
+                     BuildGridDim(si::copyExpression(grid_ref), dim)),
+      BuildGridDim(si::copyExpression(grid_ref), dim));
+}
+
+SgExpression *RuntimeBuilder::BuildStencilDomOwnsFace(SgExpression *stencil,
+                                                      int dim, bool fw) {
+  return NULL;
+}
+
+SgExpression *RuntimeBuilder::BuildStencilDomMaskRef(SgExpression *stencil) {
+  return NULL;
+}
+
+SgExpression *RuntimeBuilder::BuildGridPeriodicDistance(
+    SgExpression *grid_ref, int dim, SgExpression *index,
+    SgExpression *neighbor) {
+  return sb::buildSubtractOp(
+      BuildGridPeriodicIndex(grid_ref, dim, neighbor), index);
+}
+
 SgExprListExp *RuntimeBuilder::BuildStencilOffsetMax(const StencilRange &sr) {
   return BuildStencilOffset(sr, true);
 }
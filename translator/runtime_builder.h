@@ -20,6 +20,15 @@ namespace translator {
 
 SgFunctionCallExp *BuildTraceStencilPre(SgExpression *msg);
 SgFunctionCallExp *BuildTraceStencilPost(SgExpression *time);
+SgFunctionCallExp *BuildProfileStencilRun(SgExpression *name,
+                                          SgExpression *bytes,
+                                          SgExpression *flops,
+                                          SgExpression *time);
+SgFunctionCallExp *BuildDomainGetNumPoints(SgExpression *dom,
+                                           int num_dims);
+SgFunctionCallExp *BuildDomainGetNumBricks(SgExpression *dom);
+SgFunctionCallExp *BuildDomainSetBrick(SgExpression *dom,
+                                       SgExpression *brick);
 
 SgVariableDeclaration *BuildStopwatch(const std::string &name,
                                       SgScopeStatement *scope,
@@ -44,6 +53,67 @@ class RuntimeBuilder {
   virtual SgFunctionCallExp *BuildGridDim(
       SgExpression *grid_ref,
       int dim) = 0;
+  //! Build an expression of the length of a grid buffer.
+  /*!
+    This is the stride used to linearize grid indices, which is
+    larger than the logical grid size when the buffer includes
+    halo. Defaults to BuildGridDim.
+    
+    \param grid_ref Grid reference.
+    \param dim Dimension (>=1).
+    \return Length of the buffer in the dimension.
+   */
+  virtual SgExpression *BuildGridRealDim(
+      SgExpression *grid_ref,
+      int dim);
+  //! Build an expression of the buffer position of a periodic index.
+  /*!
+    Defaults to (index + dim) % dim.
+    
+    \param grid_ref Grid reference.
+    \param dim Dimension (>=1).
+    \param index Index expression, used without cloning.
+    \return Position of the index within the buffer.
+   */
+  virtual SgExpression *BuildGridPeriodicIndex(
+      SgExpression *grid_ref,
+      int dim, SgExpression *index);
+  //! Build an expression of the buffer distance to a periodic neighbor.
+  /*!
+    Defaults to the buffer position of the neighbor minus the index,
+    which is within the grid.
+    
+    \param grid_ref Grid reference.
+    \param dim Dimension (>=1).
+    \param index Index expression, used without cloning.
+    \param neighbor Index expression of the neighbor, used without
+    cloning.
+    eturn Distance from the index to the neighbor in the buffer.
+   */
+  virtual SgExpression *BuildGridPeriodicDistance(
+      SgExpression *grid_ref,
+      int dim, SgExpression *index, SgExpression *neighbor);
+  //! Build an expression telling if the process owns a domain face.
+  /*!
+    A face is owned when the local part of the domain of a stencil
+    includes it. Defaults to NULL, meaning that the process always
+    owns the faces since it computes the whole domain.
+    
+    \param stencil Stencil reference.
+    \param dim Dimension (>=1).
+    \param fw True for the upper face.
+    \return Non-zero int expression if owned, or NULL.
+   */
+  virtual SgExpression *BuildStencilDomOwnsFace(
+      SgExpression *stencil, int dim, bool fw);
+  //! Build an expression of the brick list handle of a stencil domain.
+  /*!
+    Defaults to NULL, meaning that masked domains are not supported.
+    
+    \param stencil Stencil reference.
+    \return Int expression, which is zero if the domain is not masked.
+   */
+  virtual SgExpression *BuildStencilDomMaskRef(SgExpression *stencil);
   //!
   /*!
     \param
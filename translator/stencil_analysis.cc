@@ -8,6 +8,7 @@
 
 #include "translator/stencil_analysis.h"
 
+#include <algorithm>
 #include <boost/foreach.hpp>
 
 #include "translator/translation_context.h"
@@ -139,6 +140,13 @@ bool AnalyzeStencilIndex(SgExpression *arg, StencilIndex &idx,
     }
   }
 
+  // Restriction and prolongation between grids of different levels
+  if (isSgMultiplyOp(arg) || isSgDivideOp(arg)) {
+    LOG_ERROR() << "Scaled stencil indices are not supported: "
+                << arg->unparseToString() << "\n";
+    return false;
+  }
+
   LOG_WARNING() << "Invalid stencil index: "
                 << arg->unparseToString() << " ("
                 << arg->class_name() << ")\n";
@@ -161,6 +169,7 @@ static void PropagateStencilRangeToGrid(StencilMap &sm, TranslationContext &tx)
         continue;
       } 
       g->SetStencilRange(gva->sr());
+      if (gva->periodic()) g->set_periodic(true);
       LOG_DEBUG() << "Grid stencil range: "
                   << *g << ", " << g->stencil_range() << "\n";
     }
@@ -195,15 +204,15 @@ static void AddIndex(SgExpression *get,
                      StencilIndexList &sil) {
   string member;
   IntVector indices;
+  GridVarAttribute *gva =
+      rose_util::GetASTAttribute<GridVarAttribute>(gv);
   // Collect member-specific information
   if (GetGridMember(get, member, indices)) {
     LOG_DEBUG() << "Access to member: " << member << "\n";
-    GridVarAttribute *gva =
-        rose_util::GetASTAttribute<GridVarAttribute>(gv);
     gva->AddMemberStencilIndexList(member, indices, sil);
-  }    
-  GridVarAttribute *gva =
-      rose_util::GetASTAttribute<GridVarAttribute>(gv);
+  } else {
+    gva->AddPointAccess();
+  }
   gva->AddStencilIndexList(sil);
   return;
 }
@@ -274,12 +283,285 @@ void AnalyzeStencilRange(StencilMap &sm, TranslationContext &tx) {
     LOG_DEBUG() << "Setting stencil index list for "
                 << get->unparseToString() << "\n";
     gga->SetStencilIndexList(&stencil_indices);
-    if (is_periodic) sm.SetGridPeriodic(gv);
+    if (is_periodic) {
+      sm.SetGridPeriodic(gv);
+      rose_util::GetASTAttribute<GridVarAttribute>(gv)->set_periodic(true);
+    }
   }
   PropagateStencilRangeToGrid(sm, tx);
   LOG_DEBUG() << "Analysis of a stencil map done\n";
 }
 
+// Assumption: AnalyzeStencilRange is already done for sm
+void AnalyzeInPlaceUpdate(StencilMap &sm, TranslationContext &tx,
+                          bool snapshot) {
+  // Red-black stencils are in-place updates by design
+  if (sm.IsRedBlackVariant()) return;
+  Kernel *kernel = tx.findKernel(sm.getKernel());
+  PSAssert(kernel);
+  FOREACH (it, sm.grid_params().begin(), sm.grid_params().end()) {
+    SgInitializedName *gp = *it;
+    if (!(kernel->isGridParamRead(gp) &&
+          kernel->isGridParamModified(gp))) continue;
+    GridVarAttribute *gva =
+        rose_util::GetASTAttribute<GridVarAttribute>(gp);
+    PSAssert(gva);
+    // Point-wise updates only read the point to be written, so
+    // the single buffer can be updated in place.
+    if (gva->sr().IsZero()) {
+      LOG_DEBUG() << "In-place update of " << gp->get_name()
+                  << " in " << kernel->GetName() << "\n";
+      continue;
+    }
+    if (!snapshot) {
+      LOG_WARNING() << "Grid " << gp->get_name() << " is updated in place by "
+                    << kernel->GetName() << " with neighbor reads, "
+                    << "which may see points updated in the same sweep; "
+                    << "set SNAPSHOT_IN_PLACE_UPDATES to read the values "
+                    << "before the sweep\n";
+      continue;
+    }
+    LOG_INFO() << "Grid " << gp->get_name() << " is updated by "
+               << kernel->GetName()
+               << " with neighbor reads; reading a snapshot\n";
+    gva->set_out_of_place(true);
+  }
+}
+
+void AnalyzeColorSplitGrids(TranslationContext &tx) {
+  vector<SgNode*> grid_vars =
+      rose_util::QuerySubTreeAttribute<GridVarAttribute>(tx.project());
+  // Seeds with the grids bound to red-black stencils
+  FOREACH (it, tx.mapBegin(), tx.mapEnd()) {
+    StencilMap *sm = it->second;
+    if (!sm->IsRedBlackVariant()) continue;
+    BOOST_FOREACH (SgInitializedName *gp, sm->grid_params()) {
+      BOOST_FOREACH (Grid *g, *tx.findGrid(gp)) {
+        if (g == NULL) {
+          LOG_INFO() << "Cannot use the color-split layout for "
+                     << "externally passed grid.\n";
+          continue;
+        }
+        g->set_color_split(true);
+      }
+    }
+  }
+  // A variable may refer to multiple grids, which then must have
+  // the same layout
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    BOOST_FOREACH (SgNode *node, grid_vars) {
+      const GridSet *gs = tx.findGrid(isSgInitializedName(node));
+      bool color_split = false;
+      BOOST_FOREACH (Grid *g, *gs) {
+        if (g && g->color_split()) color_split = true;
+      }
+      if (!color_split) continue;
+      BOOST_FOREACH (Grid *g, *gs) {
+        if (g == NULL || g->color_split()) continue;
+        g->set_color_split(true);
+        changed = true;
+      }
+    }
+  }
+  BOOST_FOREACH (SgNode *node, grid_vars) {
+    SgInitializedName *gn = isSgInitializedName(node);
+    BOOST_FOREACH (Grid *g, *tx.findGrid(gn)) {
+      if (g == NULL || !g->color_split()) continue;
+      LOG_DEBUG() << "Color-split grid variable: " << gn->get_name() << "\n";
+      rose_util::GetASTAttribute<GridVarAttribute>(gn)->set_color_split(true);
+      break;
+    }
+  }
+}
+
+// Returns the variable a grid is assigned to when created
+static SgInitializedName *GetGridNewVar(SgFunctionCallExp *new_call) {
+  SgNode *parent = new_call->get_parent();
+  if (isSgAssignInitializer(parent)) {
+    return isSgInitializedName(parent->get_parent());
+  }
+  SgAssignOp *aop = isSgAssignOp(parent);
+  if (!(aop && aop->get_rhs_operand() == new_call)) return NULL;
+  SgVarRefExp *vref = isSgVarRefExp(aop->get_lhs_operand());
+  return vref ? si::convertRefToInitializedName(vref) : NULL;
+}
+
+// Returns the run a grid variable is passed to through a stencil map
+// given directly to the run, or NULL if the reference is not such
+// an argument
+static Run *FindRunOfMapArg(SgVarRefExp *vref, TranslationContext &tx) {
+  SgFunctionCallExp *map_call =
+      isSgFunctionCallExp(vref->get_parent()->get_parent());
+  if (!(map_call && tx.findMap(map_call))) return NULL;
+  SgFunctionCallExp *run_call =
+      isSgFunctionCallExp(map_call->get_parent()->get_parent());
+  if (!run_call) return NULL;
+  TranslationContext::RunMap::iterator it = tx.run_map().find(run_call);
+  return it == tx.run_map().end() ? NULL : it->second;
+}
+
+// Returns true if a reference to a grid variable is the argument of
+// PSGridFree
+static bool IsFreeArg(SgVarRefExp *vref, TranslationContext &tx) {
+  SgNode *arg = vref;
+  while (isSgCastExp(arg->get_parent())) arg = arg->get_parent();
+  SgFunctionCallExp *call =
+      isSgFunctionCallExp(arg->get_parent()->get_parent());
+  return call && tx.IsFree(call) == vref;
+}
+
+// Returns true if a grid variable is only used in a single run that
+// both writes and reads it
+static bool IsLocalToRun(SgInitializedName *gv, SgFunctionCallExp *new_call,
+                         TranslationContext &tx) {
+  SgFunctionDefinition *func = si::getEnclosingFunctionDefinition(new_call);
+  if (!func) return false;
+  Run *run = NULL;
+  BOOST_FOREACH (SgVarRefExp *vref, si::querySubTree<SgVarRefExp>(func)) {
+    if (si::convertRefToInitializedName(vref) != gv) continue;
+    SgAssignOp *aop = isSgAssignOp(vref->get_parent());
+    if (aop && aop->get_lhs_operand() == vref &&
+        aop->get_rhs_operand() == new_call) continue;
+    if (IsFreeArg(vref, tx)) continue;
+    Run *r = FindRunOfMapArg(vref, tx);
+    if (r == NULL || (run && run != r)) {
+      LOG_DEBUG() << "Grid " << gv->get_name() << " escapes at "
+                  << vref->get_parent()->unparseToString() << "\n";
+      return false;
+    }
+    run = r;
+  }
+  if (run == NULL) return false;
+  bool written = false, read = false;
+  FOREACH (it, run->stencils().begin(), run->stencils().end()) {
+    StencilMap *sm = it->second;
+    Kernel *kernel = tx.findKernel(sm->getKernel());
+    PSAssert(kernel);
+    for (unsigned i = 0; i < sm->grid_args().size(); ++i) {
+      if (sm->grid_args()[i] != gv) continue;
+      written |= kernel->isGridParamModified(sm->grid_params()[i]);
+      read |= kernel->isGridParamRead(sm->grid_params()[i]);
+    }
+  }
+  return written && read;
+}
+
+void AnalyzeScratchGrids(TranslationContext &tx) {
+  FOREACH (it, tx.grid_new_map().begin(), tx.grid_new_map().end()) {
+    SgFunctionCallExp *new_call = it->first;
+    Grid *g = it->second;
+    SgInitializedName *gv = GetGridNewVar(new_call);
+    // Only local variables that hold no other grid
+    if (gv == NULL || isSgGlobal(gv->get_scope()) ||
+        isSgFunctionParameterList(gv->get_parent()) ||
+        si::isStatic(gv->get_declaration())) {
+      continue;
+    }
+    const GridSet *gs = tx.findGrid(gv);
+    if (!(gs && gs->size() == 1 && *gs->begin() == g)) continue;
+    if (!IsLocalToRun(gv, new_call, tx)) continue;
+    LOG_INFO() << "Grid " << gv->get_name()
+               << " is temporary to a stencil run\n";
+    g->set_scratch(true);
+  }
+}
+
+// Returns true if a boundary value can be evaluated out of the kernel
+static bool IsValidBoundaryValue(SgExpression *value,
+                                 SgFunctionDeclaration *kernel) {
+  const SgInitializedNamePtrList &params = kernel->get_args();
+  BOOST_FOREACH (SgVarRefExp *vref, si::querySubTree<SgVarRefExp>(value)) {
+    SgInitializedName *v = si::convertRefToInitializedName(vref);
+    if (std::find(params.begin(), params.end(), v) != params.end()) {
+      if (GridType::isGridType(v->get_type())) return false;
+      continue;
+    }
+    if (!isSgGlobal(v->get_scope())) return false;
+  }
+  BOOST_FOREACH (SgFunctionCallExp *call,
+                 si::querySubTree<SgFunctionCallExp>(value)) {
+    if (GridType::isGridTypeSpecificCall(call)) return false;
+  }
+  return true;
+}
+
+void AnalyzeBoundaryConditions(StencilMap &sm, TranslationContext &tx) {
+  if (!rose_util::IsCLikeLanguage()) return;
+  SgFunctionDeclaration *kernel = isSgFunctionDeclaration(
+      sm.getKernel()->get_definingDeclaration());
+  PSAssert(kernel && kernel->get_definition());
+  SgFunctionDefinition *kernel_def = kernel->get_definition();
+  const SgInitializedNamePtrList &params = kernel->get_args();
+  SgFunctionCallExpPtrList calls =
+      tx.getGridEmitDirichletCalls(kernel_def);
+  SgFunctionCallExpPtrList neumann_calls =
+      tx.getGridEmitNeumannCalls(kernel_def);
+  calls.insert(calls.end(), neumann_calls.begin(), neumann_calls.end());
+  BOOST_FOREACH (SgFunctionCallExp *call, calls) {
+    LOG_DEBUG() << "Boundary condition: " << call->unparseToString() << "\n";
+    SgExprStatement *stmt = isSgExprStatement(call->get_parent());
+    if (!(stmt && stmt->get_parent() == kernel_def->get_body())) {
+      LOG_ERROR() << "Boundary conditions must be unconditional statements: "
+                  << call->unparseToString() << "\n";
+      PSAbort(1);
+    }
+    if (sm.IsRedBlackVariant()) {
+      LOG_ERROR() << "Boundary conditions not supported in red-black stencils: "
+                  << call->unparseToString() << "\n";
+      PSAbort(1);
+    }
+    SgInitializedNamePtrList::const_iterator param_it =
+        std::find(params.begin(), params.end(),
+                  GridType::getGridVarUsedInFuncCall(call));
+    if (param_it == params.end()) {
+      LOG_ERROR() << "Boundary conditions must be set on grid parameters: "
+                  << call->unparseToString() << "\n";
+      PSAbort(1);
+    }
+    // Grid parameters of the stencil map are of the declaration
+    // referenced by the map call
+    SgInitializedName *gv =
+        sm.getKernel()->get_args()[param_it - params.begin()];
+    SgExpressionPtrList &args = call->get_args()->get_expressions();
+    if (!IsValidBoundaryValue(args[0], kernel)) {
+      LOG_ERROR() << "Boundary values may only refer to kernel parameters "
+                  << "and global variables: "
+                  << call->unparseToString() << "\n";
+      PSAbort(1);
+    }
+    BoundaryCondition bc(BoundaryCondition::kDirichlet, gv,
+                         si::copyExpression(args[0]));
+    if (GridType::GetGridFuncName(call) == GridType::emit_neumann_name) {
+      int dim;
+      if (!(rose_util::GetIntLikeVal(args[1], dim) &&
+            dim >= 0 && dim < sm.getNumDim())) {
+        LOG_ERROR() << "Invalid dimension of Neumann condition: "
+                    << call->unparseToString() << "\n";
+        PSAbort(1);
+      }
+      if (tx.findGridType(gv->get_type())->IsUserDefinedPointType()) {
+        LOG_ERROR() << "Neumann conditions not supported for "
+                    << "user-defined point types: "
+                    << call->unparseToString() << "\n";
+        PSAbort(1);
+      }
+      bc.kind = BoundaryCondition::kNeumann;
+      bc.dim = dim + 1;
+    }
+    FOREACH (it, sm.boundary_conditions().begin(),
+             sm.boundary_conditions().end()) {
+      if (it->gv == gv && it->kind == bc.kind && it->dim == bc.dim) {
+        LOG_ERROR() << "Duplicate boundary condition: "
+                    << call->unparseToString() << "\n";
+        PSAbort(1);
+      }
+    }
+    sm.AddBoundaryCondition(bc);
+  }
+}
+
 static SgInitializedName *FindInitializedName(const string &name,
                                               SgScopeStatement *scope) {
   SgVariableSymbol *vs = si::lookupVariableSymbolInParentScopes(
@@ -18,6 +18,49 @@ namespace translator {
 bool AnalyzeStencilIndex(SgExpression *arg, StencilIndex &idx,
                          SgFunctionDeclaration *kernel);
 void AnalyzeStencilRange(StencilMap &sm, TranslationContext &tx);
+//! Finds grids that cannot be updated in place by a stencil map.
+/*!
+  A grid both read and written by a kernel is updated in place
+  exactly only when every read is at the point being written.
+  Otherwise reads may see points already updated in the same sweep,
+  which in-place kernels such as Gauss-Seidel rely on. Such grid
+  variables are marked as out of place, so that reads see the values
+  before the sweep, only if snapshot is true; a warning is issued
+  otherwise.
+  \param sm The stencil map to analyze.
+  \param tx The translation context.
+  \param snapshot True if reads of such grids are to be redirected.
+ */
+void AnalyzeInPlaceUpdate(StencilMap &sm, TranslationContext &tx,
+                          bool snapshot);
+//! Finds grids to be stored in the color-split layout.
+/*!
+  Grids bound to red-black stencils are color split, as are the
+  other grids that share a variable with them, so that every access
+  through a variable assumes a single layout. Grid variables
+  referring to such grids get the color_split flag.
+  \param tx The translation context.
+ */
+void AnalyzeColorSplitGrids(TranslationContext &tx);
+//! Finds temporary grids that can be allocated from a scratch pool.
+/*!
+  A grid is temporary if it is held by a local variable referring to
+  no other grid, and the variable is only passed to PSGridFree and to
+  stencil maps given directly to a single stencil run, where some map
+  writes it and some map reads it. Such grids get the scratch flag.
+  \param tx The translation context.
+ */
+void AnalyzeScratchGrids(TranslationContext &tx);
+//! Collects the boundary conditions emitted by a stencil kernel.
+/*!
+  Conditions must be unconditional statements of the kernel body,
+  and their values may only refer to the kernel parameters other
+  than grids and to global variables, so that they can be evaluated
+  outside of the kernel.
+  \param sm The stencil map to analyze.
+  \param tx The translation context.
+ */
+void AnalyzeBoundaryConditions(StencilMap &sm, TranslationContext &tx);
 
 //void AnalyzeEmit(SgFunctionDeclaration *func);
 
@@ -0,0 +1,106 @@
+#include "rose.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <boost/bind.hpp>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "translator/parallel_translation.h"
+
+using namespace ::testing;
+using namespace ::std;
+
+namespace physis {
+namespace translator {
+
+// Translations in worker processes leave files since the memory of
+// the workers is not shared
+static int Touch(const string &dir, int failure, int i) {
+  if (i == failure) return 1;
+  ostringstream path;
+  path << dir << "/" << i;
+  ofstream out(path.str().c_str());
+  out << getpid();
+  return 0;
+}
+
+static int Record(vector<int> *log, int failure, int i) {
+  log->push_back(i);
+  return i == failure ? 1 : 0;
+}
+
+static int Crash(int i) {
+  if (i == 1) abort();
+  return 0;
+}
+
+class TranslatePatternsTest: public Test {
+ public:
+  void SetUp() {
+    char dir[] = "/tmp/test_parallel_translation.XXXXXX";
+    ASSERT_THAT(mkdtemp(dir), NotNull());
+    dir_ = dir;
+  }
+  void TearDown() {
+    string cmd = "rm -rf " + dir_;
+    ASSERT_THAT(system(cmd.c_str()), Eq(0));
+  }
+ protected:
+  bool Done(int i) const {
+    ostringstream path;
+    path << dir_ << "/" << i;
+    return access(path.str().c_str(), F_OK) == 0;
+  }
+  string dir_;
+};
+
+TEST_F(TranslatePatternsTest, InProcess) {
+  vector<int> log;
+  ASSERT_THAT(TranslatePatterns(4, 1, boost::bind(Record, &log, -1, _1)),
+              Eq(0));
+  ASSERT_THAT(log, ElementsAre(0, 1, 2, 3));
+}
+
+TEST_F(TranslatePatternsTest, InProcessFailure) {
+  vector<int> log;
+  ASSERT_THAT(TranslatePatterns(4, 1, boost::bind(Record, &log, 1, _1)),
+              Ne(0));
+  ASSERT_THAT(log, ElementsAre(0, 1));
+}
+
+TEST_F(TranslatePatternsTest, Workers) {
+  ASSERT_THAT(TranslatePatterns(10, 3, boost::bind(Touch, dir_, -1, _1)),
+              Eq(0));
+  for (int i = 0; i < 10; ++i) {
+    ASSERT_TRUE(Done(i)) << i;
+  }
+}
+
+TEST_F(TranslatePatternsTest, MoreWorkersThanPatterns) {
+  ASSERT_THAT(TranslatePatterns(2, 8, boost::bind(Touch, dir_, -1, _1)),
+              Eq(0));
+  ASSERT_TRUE(Done(0));
+  ASSERT_TRUE(Done(1));
+}
+
+TEST_F(TranslatePatternsTest, WorkerFailure) {
+  ASSERT_THAT(TranslatePatterns(4, 2, boost::bind(Touch, dir_, 0, _1)),
+              Ne(0));
+  ASSERT_FALSE(Done(0));
+}
+
+TEST_F(TranslatePatternsTest, WorkerCrash) {
+  ASSERT_THAT(TranslatePatterns(3, 2, Crash), Ne(0));
+}
+
+} // namespace translator
+} // namespace physis
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleMock(&argc, argv);
+  return RUN_ALL_TESTS();
+}
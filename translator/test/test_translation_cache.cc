@@ -0,0 +1,113 @@
+#include "rose.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+#include "translator/translation_cache.h"
+
+using namespace ::testing;
+using namespace ::std;
+
+namespace physis {
+namespace translator {
+
+static void WriteFile(const string &path, const string &contents) {
+  ofstream out(path.c_str());
+  out << contents;
+}
+
+static string ReadFile(const string &path) {
+  ifstream in(path.c_str());
+  ostringstream ss;
+  ss << in.rdbuf();
+  return ss.str();
+}
+
+class TranslationCacheTest: public Test {
+ public:
+  void SetUp() {
+    char dir[] = "/tmp/test_translation_cache.XXXXXX";
+    ASSERT_THAT(mkdtemp(dir), NotNull());
+    dir_ = dir;
+    cache_dir_ = dir_ + "/cache";
+    output_ = dir_ + "/out.c";
+  }
+  void TearDown() {
+    string cmd = "rm -rf " + dir_;
+    ASSERT_THAT(system(cmd.c_str()), Eq(0));
+  }
+ protected:
+  string dir_;
+  string cache_dir_;
+  string output_;
+};
+
+TEST_F(TranslationCacheTest, Disabled) {
+  TranslationCache cache("");
+  ASSERT_FALSE(cache.enabled());
+  WriteFile(output_, "int x;\n");
+  cache.Store("a = 1\n", output_);
+  ASSERT_FALSE(cache.Fetch("a = 1\n", output_));
+}
+
+TEST_F(TranslationCacheTest, StoreFetch) {
+  TranslationCache cache(cache_dir_);
+  ASSERT_TRUE(cache.enabled());
+  cache.AddKey("base code");
+  ASSERT_FALSE(cache.Fetch("a = 1\n", output_));
+  WriteFile(output_, "int x;\n");
+  cache.Store("a = 1\n", output_);
+  WriteFile(output_, "int y;\n");
+  cache.Store("a = 2\n", output_);
+  unlink(output_.c_str());
+  ASSERT_TRUE(cache.Fetch("a = 1\n", output_));
+  ASSERT_THAT(ReadFile(output_), Eq("int x;\n"));
+  ASSERT_TRUE(cache.Fetch("a = 2\n", output_));
+  ASSERT_THAT(ReadFile(output_), Eq("int y;\n"));
+  ASSERT_FALSE(cache.Fetch("a = 3\n", output_));
+}
+
+TEST_F(TranslationCacheTest, KeyIncludesCommonCode) {
+  WriteFile(output_, "int x;\n");
+  TranslationCache cache(cache_dir_);
+  cache.AddKey("base code");
+  cache.Store("a = 1\n", output_);
+  // Shared by another physisc process with the same code
+  TranslationCache same(cache_dir_);
+  same.AddKey("base code");
+  ASSERT_TRUE(same.Fetch("a = 1\n", output_));
+  TranslationCache other(cache_dir_);
+  other.AddKey("other code");
+  ASSERT_FALSE(other.Fetch("a = 1\n", output_));
+  // Strings are separated in the key
+  TranslationCache split(cache_dir_);
+  split.AddKey("base");
+  split.AddKey(" code");
+  ASSERT_FALSE(split.Fetch("a = 1\n", output_));
+}
+
+TEST_F(TranslationCacheTest, FileKey) {
+  string kernel = dir_ + "/kernel.c";
+  WriteFile(kernel, "void kernel1() {}\n");
+  WriteFile(output_, "int x;\n");
+  TranslationCache cache(cache_dir_);
+  ASSERT_TRUE(cache.AddFileKey(kernel));
+  cache.Store("a = 1\n", output_);
+  WriteFile(kernel, "void kernel2() {}\n");
+  TranslationCache changed(cache_dir_);
+  ASSERT_TRUE(changed.AddFileKey(kernel));
+  ASSERT_FALSE(changed.Fetch("a = 1\n", output_));
+  ASSERT_FALSE(changed.AddFileKey(dir_ + "/missing.c"));
+}
+
+} // namespace translator
+} // namespace physis
+
+int main(int argc, char *argv[]) {
+  ::testing::InitGoogleMock(&argc, argv);
+  return RUN_ALL_TESTS();
+}
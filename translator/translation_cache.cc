@@ -0,0 +1,133 @@
+// Copyright 2011-2012, RIKEN AICS.
+// All rights reserved.
+//
+// This file is distributed under the BSD license. See LICENSE.txt for
+// details.
+
+#include "translator/translation_cache.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
+
+namespace physis {
+namespace translator {
+
+namespace {
+// 64-bit FNV-1a
+const uint64_t kFNVOffsetBasis = 14695981039346656037ULL;
+const uint64_t kFNVPrime = 1099511628211ULL;
+}
+
+static uint64_t Hash(uint64_t h, const char *p, size_t len) {
+  for (size_t i = 0; i < len; ++i) {
+    h ^= (unsigned char)p[i];
+    h *= kFNVPrime;
+  }
+  return h;
+}
+
+static uint64_t Hash(uint64_t h, const string &s) {
+  // The length separates consecutive strings
+  uint64_t len = s.size();
+  h = Hash(h, (const char*)&len, sizeof(len));
+  return Hash(h, s.data(), s.size());
+}
+
+static bool ReadFile(const string &path, string &contents) {
+  std::ifstream in(path.c_str(), std::ios_base::in | std::ios_base::binary);
+  if (!in) return false;
+  std::ostringstream ss;
+  ss << in.rdbuf();
+  contents = ss.str();
+  return true;
+}
+
+static bool CopyFile(const string &src, const string &dst) {
+  std::ifstream in(src.c_str(), std::ios_base::in | std::ios_base::binary);
+  if (!in) return false;
+  std::ofstream out(dst.c_str(), std::ios_base::out | std::ios_base::binary);
+  if (!out) return false;
+  out << in.rdbuf();
+  out.close();
+  return !out.fail();
+}
+
+TranslationCache::TranslationCache(const string &dir):
+    dir_(dir), key_(kFNVOffsetBasis) {
+  if (!enabled()) return;
+  if (mkdir(dir_.c_str(), 0755) && errno != EEXIST) {
+    LOG_WARNING() << "Failed to create cache directory " << dir_
+                  << "; caching disabled\n";
+    dir_.clear();
+    return;
+  }
+  // Rebuilding physisc invalidates the entries
+  struct stat st;
+  if (stat("/proc/self/exe", &st) == 0) {
+    std::ostringstream ss;
+    ss << st.st_size << " " << st.st_mtime;
+    AddKey(ss.str());
+  }
+  LOG_INFO() << "Translation cache: " << dir_ << "\n";
+}
+
+void TranslationCache::AddKey(const string &s) {
+  key_ = Hash(key_, s);
+}
+
+bool TranslationCache::AddFileKey(const string &path) {
+  string contents;
+  if (!ReadFile(path, contents)) return false;
+  AddKey(contents);
+  return true;
+}
+
+string TranslationCache::GetEntryPath(const string &pattern,
+                                      const string &path) const {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%016llx",
+           (unsigned long long)Hash(key_, pattern));
+  // Keeps the suffix of the output so that entries are recognizable
+  string suffix;
+  size_t dot = path.rfind(".");
+  if (dot != string::npos && path.find("/", dot) == string::npos) {
+    suffix = path.substr(dot);
+  }
+  return dir_ + "/" + buf + suffix;
+}
+
+bool TranslationCache::Fetch(const string &pattern,
+                             const string &path) const {
+  if (!enabled()) return false;
+  string entry = GetEntryPath(pattern, path);
+  if (access(entry.c_str(), R_OK)) return false;
+  if (!CopyFile(entry, path)) {
+    LOG_WARNING() << "Failed to copy cached translation " << entry << "\n";
+    return false;
+  }
+  LOG_DEBUG() << "Cache hit: " << entry << "\n";
+  return true;
+}
+
+void TranslationCache::Store(const string &pattern,
+                             const string &path) const {
+  if (!enabled()) return;
+  string entry = GetEntryPath(pattern, path);
+  std::ostringstream tmp;
+  tmp << entry << "." << getpid() << ".tmp";
+  if (!CopyFile(path, tmp.str()) ||
+      rename(tmp.str().c_str(), entry.c_str())) {
+    LOG_WARNING() << "Failed to store translation in " << entry << "\n";
+    unlink(tmp.str().c_str());
+    return;
+  }
+  LOG_DEBUG() << "Cached translation: " << entry << "\n";
+}
+
+} // namespace translator
+} // namespace physis
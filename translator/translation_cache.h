@@ -0,0 +1,65 @@
+// Copyright 2011-2012, RIKEN AICS.
+// All rights reserved.
+//
+// This file is distributed under the BSD license. See LICENSE.txt for
+// details.
+
+#ifndef PHYSIS_TRANSLATOR_TRANSLATION_CACHE_H_
+#define PHYSIS_TRANSLATOR_TRANSLATION_CACHE_H_
+
+#include <stdint.h>
+
+#include "translator/translator_common.h"
+
+namespace physis {
+namespace translator {
+
+//! On-disk cache of translated auto-tuning patterns.
+/*!
+  An entry is keyed by a hash of everything that determines the output
+  of a pattern: the physisc executable, the code common to all the
+  patterns, which is added by AddKey and AddFileKey, and the
+  configuration values of the pattern. Entries are never evicted; the
+  cache directory can be removed at any time.
+
+  Multiple physisc processes may share a directory since an entry is
+  written to a temporary file first and then renamed.
+ */
+class TranslationCache {
+ public:
+  /*!
+    \param dir Cache directory, which is created if not exist. Caching
+    is disabled if empty.
+   */
+  explicit TranslationCache(const string &dir);
+  bool enabled() const { return !dir_.empty(); }
+  //! Adds a string to the key common to all patterns.
+  void AddKey(const string &s);
+  //! Adds the contents of a file to the key common to all patterns.
+  /*!
+    \return True upon success.
+   */
+  bool AddFileKey(const string &path);
+  //! Copies the cached output of a pattern.
+  /*!
+    \param pattern Configuration values of the pattern.
+    \param path Output file path.
+    \return True if found.
+   */
+  bool Fetch(const string &pattern, const string &path) const;
+  //! Saves the output of a pattern.
+  /*!
+    \param pattern Configuration values of the pattern.
+    \param path Output file path.
+   */
+  void Store(const string &pattern, const string &path) const;
+ protected:
+  string GetEntryPath(const string &pattern, const string &path) const;
+  string dir_;
+  uint64_t key_;
+};
+
+} // namespace translator
+} // namespace physis
+
+#endif /* PHYSIS_TRANSLATOR_TRANSLATION_CACHE_H_ */
@@ -484,6 +484,7 @@ void TranslationContext::Build() {
   
   FOREACH (it, stencil_map_.begin(), stencil_map_.end()) {
     AnalyzeStencilRange(*(it->second), *this);
+    AnalyzeBoundaryConditions(*(it->second), *this);
   }
 
   LOG_INFO() << "Translation context built\n";
@@ -701,6 +702,16 @@ TranslationContext::getGridEmitCalls(SgScopeStatement *scope) {
   return getGridCalls(scope, "emit");
 }
 
+SgFunctionCallExpPtrList
+TranslationContext::getGridEmitDirichletCalls(SgScopeStatement *scope) {
+  return getGridCalls(scope, GridType::emit_dirichlet_name);
+}
+
+SgFunctionCallExpPtrList
+TranslationContext::getGridEmitNeumannCalls(SgScopeStatement *scope) {
+  return getGridCalls(scope, GridType::emit_neumann_name);
+}
+
 SgFunctionCallExpPtrList
 TranslationContext::getGridGetCalls(SgScopeStatement *scope) {
   return getGridCalls(scope, "get");
@@ -196,6 +196,8 @@ class TranslationContext {
   SgFunctionCallExpPtrList getGridEmitCalls(SgScopeStatement *scope);
   SgFunctionCallExpPtrList getGridGetCalls(SgScopeStatement *scope);
   SgFunctionCallExpPtrList getGridGetPeriodicCalls(SgScopeStatement *scope);  
+  SgFunctionCallExpPtrList getGridEmitDirichletCalls(SgScopeStatement *scope);
+  SgFunctionCallExpPtrList getGridEmitNeumannCalls(SgScopeStatement *scope);
 
   void print(std::ostream &os) const;
 
@@ -44,6 +44,23 @@ SgExpression *BuildIndexVal(PSIndex v) {
   return rose_util::BuildIntLikeVal(v);
 }
 
+SgType *BuildSizeType(SgScopeStatement *scope) {
+  SgType *t = si::lookupNamedTypeInParentScopes("size_t", scope);
+  PSAssert(t);
+  return t;
+}
+
+SgExpression *BuildPointMemberOffset(GridType *gt,
+                                     const std::string &member_name) {
+  PSAssert(gt->IsUserDefinedPointType());
+  SgExpression *base = sb::buildCastExp(
+      sb::buildIntVal(0), sb::buildPointerType(gt->point_type()));
+  SgExpression *member = sb::buildArrowExp(
+      base, sb::buildVarRefExp(member_name, gt->point_def()));
+  return sb::buildCastExp(sb::buildAddressOfOp(member),
+                          BuildSizeType(si::getGlobalScope(gt->point_def())));
+}
+
 
 SgType *BuildPSOffsetsType() {
   SgType *t =
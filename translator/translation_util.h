@@ -22,6 +22,22 @@ SgType *BuildIndexType2(SgScopeStatement *scope=NULL);
 
 SgExpression *BuildIndexVal(PSIndex v);
 
+//! Build the size_t type.
+/*!
+  \param scope Scope where size_t is looked up. The current scope is
+  used if NULL.
+ */
+SgType *BuildSizeType(SgScopeStatement *scope=NULL);
+
+//! Build the byte offset of a member in a user-defined point type.
+/*!
+  \param gt Grid type with a user-defined point type.
+  \param member_name Name of the member.
+  \return Expression like "(size_t)&((type *)0)->member".
+ */
+SgExpression *BuildPointMemberOffset(GridType *gt,
+                                     const std::string &member_name);
+
 SgType *BuildPSOffsetsType();
 SgVariableDeclaration *BuildPSOffsets(std::string name,
                                       SgScopeStatement *scope,
@@ -140,6 +140,13 @@ void Translator::buildGridDecl() {
   }
 }
 
+void Translator::TranslateBoundaryEmit(SgFunctionCallExp *node,
+                                       SgInitializedName *gv) {
+  LOG_ERROR() << "Boundary conditions not supported by this target: "
+              << node->unparseToString() << "\n";
+  PSAbort(1);
+}
+
 void Translator::Visit(SgFunctionDeclaration *node) {      
   if (tx_->isKernel(node)) {
     LOG_DEBUG() << "translate kernel declaration\n";
@@ -203,6 +210,10 @@ void Translator::Visit(SgFunctionCallExp *node) {
     } else if (methodName == GridType::emit_name) {
       LOG_ERROR() << "Emit should be handled above with EmitAttribute\n";
       PSAbort(1);
+    } else if (methodName == GridType::emit_dirichlet_name ||
+               methodName == GridType::emit_neumann_name) {
+      LOG_DEBUG() << "translating " << methodName << "\n";
+      TranslateBoundaryEmit(node, gv);
     } else if (methodName == GridType::set_name) {
       LOG_DEBUG() << "translating set\n";
       TranslateSet(node, gv);
@@ -104,6 +104,16 @@ class Translator: public rose_util::RoseASTTraversal {
                              GridEmitAttribute *attr) {}
   virtual void TranslateSet(SgFunctionCallExp *node,
                             SgInitializedName *gv) {}
+  //! Handler for a call to emitDirichlet or emitNeumann in a kernel.
+  /*!
+    Targets supporting boundary conditions emit the faces in the run
+    kernel, and remove the calls from the kernel. Aborts by default.
+    
+    \param node The call to the boundary condition.
+    \param gv The grid variable.
+   */
+  virtual void TranslateBoundaryEmit(SgFunctionCallExp *node,
+                                     SgInitializedName *gv);
   virtual void TranslateGridCall(SgFunctionCallExp *node,
                                  SgInitializedName *gv) {}
   virtual void TranslateMap(SgFunctionCallExp *node,